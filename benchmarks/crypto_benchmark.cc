@@ -0,0 +1,58 @@
+/*
+ * Cost of RSA-PSS signing and verification with the key parsed from its PEM
+ * on every call, against a key parsed once and cached, like PublicKey and
+ * KeyManager do.
+ *
+ * Needs to be run from the project root, like the tests, so that the test
+ * keys can be found.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "libaktualizr/crypto/crypto.h"
+#include "libaktualizr/utilities/utils.h"
+
+namespace {
+
+const std::string kText = "This is text for sign";
+
+void RsaSign(benchmark::State &state) {
+  const bool cached = state.range(0) != 0;
+  const std::string private_pem = Utils::readFile("tests/test_data/priv.key");
+  const std::shared_ptr<EVP_PKEY> private_key = Crypto::ParseRSAPrivateKey(private_pem);
+  for (auto _ : state) {
+    const std::string signature =
+        cached ? Crypto::RSAPSSSign(private_key.get(), kText) : Crypto::RSAPSSSign(nullptr, private_pem, kText);
+    if (signature.empty()) {
+      state.SkipWithError("Signing failed");
+      break;
+    }
+  }
+}
+
+void RsaVerify(benchmark::State &state) {
+  const bool cached = state.range(0) != 0;
+  const std::string public_pem = Utils::readFile("tests/test_data/public.key");
+  const std::shared_ptr<EVP_PKEY> public_key = Crypto::ParseRSAPublicKey(public_pem);
+  const std::string signature =
+      Crypto::RSAPSSSign(Crypto::ParseRSAPrivateKey(Utils::readFile("tests/test_data/priv.key")).get(), kText);
+  for (auto _ : state) {
+    const bool ok = cached ? Crypto::RSAPSSVerify(public_key.get(), signature, kText)
+                           : Crypto::RSAPSSVerify(public_pem, signature, kText);
+    if (!ok) {
+      state.SkipWithError("Verification failed");
+      break;
+    }
+  }
+}
+
+}  // namespace
+
+BENCHMARK(RsaSign)->ArgName("cached")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+BENCHMARK(RsaVerify)->ArgName("cached")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,90 @@
+/*
+ * Cost of logging on the download path.
+ *
+ * Emulates the download of a target in 16 KiB chunks: every chunk is hashed,
+ * like DownloadHandler does, and logged at debug level, and every percent of
+ * progress is logged at info level. Trace messages carrying a base64 dump of
+ * the chunk, like the ones of Asn1Rpc, are emitted as well. The benchmark is
+ * run with the log threshold at info and debug, with synchronous and
+ * asynchronous output. The "s/MB" counter is the time spent per downloaded MB
+ * on the downloading thread; hashing alone is the floor that logging adds to.
+ *
+ * The log goes to /dev/null, so that the numbers do not depend on the
+ * terminal; writing to a real console or the journal makes synchronous
+ * logging more expensive still.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "libaktualizr/crypto/crypto.h"
+#include "libaktualizr/logging/logging.h"
+#include "libaktualizr/utilities/utils.h"
+
+namespace {
+
+constexpr size_t kChunkSize = 16 << 10;
+constexpr size_t kDownloadSize = 8 << 20;
+constexpr double kMegabyte = 1 << 20;
+
+void DownloadLogging(benchmark::State &state) {
+  const auto level = static_cast<boost::log::trivial::severity_level>(state.range(0));
+  const bool async = state.range(1) != 0;
+  logger_set_async(async);
+  logger_set_threshold(level);
+
+  const std::string chunk(kChunkSize, 'x');
+  const std::string filename = "firmware.bin";
+  for (auto _ : state) {
+    MultiPartSHA256Hasher hasher;
+    unsigned int last_progress = 0;
+    for (size_t received = 0; received < kDownloadSize; received += kChunkSize) {
+      hasher.update(reinterpret_cast<const unsigned char *>(chunk.data()), chunk.size());
+      LOG_TRACE << "Asn1Rpc read " << Utils::toBase64(chunk.substr(0, 256));
+      LOG_DEBUG << "Received " << chunk.size() << " bytes of " << filename << ", " << received + kChunkSize
+                << " in total";
+      const auto progress = static_cast<unsigned int>((received + kChunkSize) * 100 / kDownloadSize);
+      if (progress != last_progress) {
+        LOG_INFO << "Download progress for file " << filename << ": " << progress << "%";
+        last_progress = progress;
+      }
+    }
+    benchmark::DoNotOptimize(hasher.getHexDigest());
+  }
+  // Leave an empty queue to the next run.
+  logger_flush();
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * kDownloadSize));
+  state.counters["s/MB"] = benchmark::Counter(static_cast<double>(state.iterations()) * kDownloadSize / kMegabyte,
+                                              benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+}  // namespace
+
+BENCHMARK(DownloadLogging)
+    ->ArgNames({"level", "async"})
+    ->Args({boost::log::trivial::info, 0})
+    ->Args({boost::log::trivial::info, 1})
+    ->Args({boost::log::trivial::debug, 0})
+    ->Args({boost::log::trivial::debug, 1})
+    ->Args({boost::log::trivial::trace, 0})
+    ->Args({boost::log::trivial::trace, 1})
+    ->Unit(benchmark::kMillisecond);
+
+int main(int argc, char **argv) {
+  setenv("LOG_STDERR", "1", 1);
+  std::ofstream devnull("/dev/null");
+  std::streambuf *cerr_buf = std::cerr.rdbuf(devnull.rdbuf());
+  logger_init();
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  logger_set_async(false);
+  std::cerr.rdbuf(cerr_buf);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,416 @@
+/*
+ * Fleet-scale benchmarks of the Uptane metadata paths.
+ *
+ * Each fleet is a synthetic repository generated with uptane-generator's batch
+ * mode and served from memory through HttpFake. The size of the fleet (number
+ * of Image repo targets, delegation depth and fan-out, number of ECUs) can be
+ * chosen on the command line with --fleet=<targets>:<depth>:<fanout>:<ecus>,
+ * which can be repeated. Appending ":overlapping" gives every delegation a
+ * pattern that matches all the targets, and installs the targets of the last
+ * delegations, so that resolving a target has to go through all the sibling
+ * delegations before it. Without any --fleet, a default matrix is run.
+ *
+ * Needs to be run from the project root, like the tests, so that the test
+ * credentials and configuration can be found.
+ */
+
+#include <gtest/gtest.h>
+
+#include <benchmark/benchmark.h>
+
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "httpfake.h"
+#include "libaktualizr/crypto/crypto.h"
+#include "libaktualizr/logging/logging.h"
+#include "libaktualizr/uptane/fetcher.h"
+#include "libaktualizr/uptane/imagerepository.h"
+#include "libaktualizr/uptane_repo.h"
+#include "primary/sotauptaneclient.h"
+#include "uptane/directorrepository.h"
+#include "uptane_test_common.h"
+
+namespace {
+
+const char *const kHardwareId = "bench_hw";
+const char *const kPrimarySerial = "bench_primary";
+
+struct FleetShape {
+  int targets;
+  int depth;
+  int fanout;
+  int ecus;
+  bool overlapping;
+
+  std::string Name() const {
+    return "targets:" + std::to_string(targets) + "/depth:" + std::to_string(depth) +
+           "/fanout:" + std::to_string(fanout) + "/ecus:" + std::to_string(ecus) + (overlapping ? "/overlapping" : "");
+  }
+};
+
+/* HttpFake that keeps the served metadata in memory and does not print every request. */
+class FleetHttp : public HttpFake {
+ public:
+  FleetHttp(const boost::filesystem::path &test_dir_in, const boost::filesystem::path &meta_dir_in)
+      : HttpFake(test_dir_in, "", meta_dir_in) {}
+
+  HttpResponse get(const std::string &url, int64_t maxsize) override {
+    (void)maxsize;
+    const boost::filesystem::path path = meta_dir / url.substr(tls_server.size());
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = cache_.find(path.string());
+    if (it == cache_.end()) {
+      if (!boost::filesystem::exists(path)) {
+        return HttpResponse({}, 404, CURLE_OK, "");
+      }
+      it = cache_.emplace(path.string(), Utils::readFile(path)).first;
+    }
+    return HttpResponse(it->second, 200, CURLE_OK, "");
+  }
+
+ private:
+  std::mutex mutex_;
+  std::map<std::string, std::string> cache_;
+};
+
+/* Reads a memory field of /proc/self/status, in kB. */
+int64_t ReadStatusKb(const std::string &field) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, field.size(), field) == 0 && line[field.size()] == ':') {
+      return std::stoll(line.substr(field.size() + 1));
+    }
+  }
+  return -1;
+}
+
+/*
+ * Tracks the peak memory usage of one benchmark. The kernel high-water mark is
+ * reset on construction so that benchmarks running in the same process do not
+ * see each other's peaks.
+ */
+class PeakMemory {
+ public:
+  PeakMemory() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    baseline_kb_ = ReadStatusKb("VmRSS");
+  }
+
+  void Report(benchmark::State &state) const {
+    const int64_t peak_kb = ReadStatusKb("VmHWM");
+    state.counters["peak_rss_kb"] = static_cast<double>(peak_kb);
+    state.counters["rss_growth_kb"] = static_cast<double>(peak_kb - baseline_kb_);
+  }
+
+ private:
+  int64_t baseline_kb_{0};
+};
+
+/* A generated Uptane repository and the fake server in front of it. */
+class Fleet {
+ public:
+  explicit Fleet(const FleetShape &shape) : shape_(shape) {
+    UptaneRepo repo(dir_.Path(), "", "");
+    repo.generateRepo(KeyType::kED25519);
+
+    const boost::filesystem::path manifest_path = dir_ / "batch.jsonl";
+    std::ofstream manifest(manifest_path.c_str());
+    std::vector<std::string> leaves;
+    addDelegations(manifest, "targets", "", 1, &leaves);
+    for (int i = 0; i < shape_.targets; ++i) {
+      Json::Value entry;
+      entry["command"] = "image";
+      entry["hwid"] = kHardwareId;
+      const std::string name = "target-" + std::to_string(i);
+      if (leaves.empty()) {
+        entry["targetname"] = name;
+      } else {
+        const std::string &leaf = leaves[static_cast<size_t>(i) % leaves.size()];
+        entry["targetname"] = leaf + "/" + name;
+        entry["dname"] = leaf;
+      }
+      entry["targetsha256"] = Crypto::sha256digestHex(name);
+      entry["targetlength"] = 1024;
+      manifest << Utils::jsonToCanonicalStr(entry) << "\n";
+      target_names_.push_back(entry["targetname"].asString());
+    }
+    for (int e = 0; e < shape_.ecus; ++e) {
+      Json::Value entry;
+      entry["command"] = "addtarget";
+      const size_t index = static_cast<size_t>(e) % target_names_.size();
+      entry["targetname"] = target_names_[shape_.overlapping ? target_names_.size() - 1 - index : index];
+      entry["hwid"] = kHardwareId;
+      entry["serial"] = EcuSerial(e);
+      manifest << Utils::jsonToCanonicalStr(entry) << "\n";
+    }
+    manifest << "{\"command\":\"signtargets\"}\n";
+    manifest.close();
+    repo.applyBatch(manifest_path);
+
+    http = std::make_shared<FleetHttp>(dir_.Path(), dir_ / "repo");
+  }
+
+  static std::string EcuSerial(int index) {
+    return index == 0 ? kPrimarySerial : "bench_secondary_" + std::to_string(index);
+  }
+
+  const FleetShape &shape() const { return shape_; }
+  std::string repoServer() const { return http->tls_server + "/repo"; }
+  std::string directorServer() const { return http->tls_server + "/director"; }
+
+  std::shared_ptr<FleetHttp> http;
+
+ private:
+  // Delegation roles are named after their path so that every leaf owns a
+  // distinct prefix of the target names.
+  void addDelegations(std::ostream &manifest, const std::string &parent, const std::string &prefix, int level,
+                      std::vector<std::string> *leaves) {
+    if (level > shape_.depth) {
+      return;
+    }
+    for (int i = 0; i < shape_.fanout; ++i) {
+      const std::string name = (prefix.empty() ? "" : prefix + "-") + "d" + std::to_string(i);
+      Json::Value entry;
+      entry["command"] = "adddelegation";
+      entry["dname"] = name;
+      entry["dpattern"] = shape_.overlapping ? "*" : name + (level == shape_.depth ? "/*" : "-*");
+      entry["dparent"] = parent;
+      entry["keytype"] = "ED25519";
+      manifest << Utils::jsonToCanonicalStr(entry) << "\n";
+      if (level == shape_.depth) {
+        leaves->push_back(name);
+      } else {
+        addDelegations(manifest, name, name, level + 1, leaves);
+      }
+    }
+  }
+
+  FleetShape shape_;
+  TemporaryDirectory dir_{"fleet"};
+  std::vector<std::string> target_names_;
+};
+
+/* Generating a fleet is expensive, so each shape is only built once per run. */
+Fleet &GetFleet(const FleetShape &shape) {
+  static std::map<std::string, std::unique_ptr<Fleet>> fleets;
+  auto &fleet = fleets[shape.Name()];
+  if (fleet == nullptr) {
+    fleet = std_::make_unique<Fleet>(shape);
+  }
+  return *fleet;
+}
+
+/* A provisioned Primary with one virtual Secondary per extra ECU of the fleet. */
+class FleetClient {
+ public:
+  explicit FleetClient(Fleet &fleet) {
+    config_ = Config("tests/config/basic.toml");
+    config_.uptane.director_server = fleet.directorServer();
+    config_.uptane.repo_server = fleet.repoServer();
+    config_.provision.server = fleet.http->tls_server;
+    config_.provision.primary_ecu_serial = kPrimarySerial;
+    config_.provision.primary_ecu_hardware_id = kHardwareId;
+    config_.storage.path = dir_.Path();
+    config_.import.base_path = dir_ / "import";
+    config_.pacman.images_path = dir_ / "images";
+    config_.tls.server = fleet.http->tls_server;
+    config_.bootloader.reboot_sentinel_dir = dir_.Path();
+    for (int e = 1; e < fleet.shape().ecus; ++e) {
+      UptaneTestCommon::addDefaultSecondary(config_, dir_, Fleet::EcuSerial(e), kHardwareId);
+    }
+
+    storage_ = INvStorage::newStorage(config_.storage);
+    client_ = std_::make_unique<UptaneTestCommon::TestUptaneClient>(config_, storage_, fleet.http);
+    client_->initialize();
+  }
+
+  SotaUptaneClient &client() { return *client_; }
+
+ private:
+  TemporaryDirectory dir_{"client"};
+  Config config_;
+  std::shared_ptr<INvStorage> storage_;
+  std::unique_ptr<SotaUptaneClient> client_;
+};
+
+void AddFleetCounters(benchmark::State &state, const FleetShape &shape) {
+  state.counters["targets"] = shape.targets;
+  state.counters["depth"] = shape.depth;
+  state.counters["fanout"] = shape.fanout;
+  state.counters["ecus"] = shape.ecus;
+}
+
+StorageConfig BenchmarkStorage(const TemporaryDirectory &dir) {
+  StorageConfig config;
+  config.path = dir.Path();
+  return config;
+}
+
+void UpdateImageMeta(INvStorage &storage, const Uptane::Fetcher &fetcher) {
+  Uptane::ImageRepository repo;
+  repo.updateMeta(storage, fetcher);
+  benchmark::DoNotOptimize(repo.getTargets());
+}
+
+void UpdateDirectorMeta(INvStorage &storage, const Uptane::Fetcher &fetcher) {
+  Uptane::DirectorRepository repo;
+  repo.updateMeta(storage, fetcher);
+  benchmark::DoNotOptimize(repo.getTargets());
+}
+
+/*
+ * Runs updateMeta() of a freshly constructed repository object. With `cold`,
+ * the storage is emptied before every iteration so that all the metadata has
+ * to be fetched and verified; otherwise the stored metadata is reused, as on a
+ * regular polling cycle.
+ */
+void BM_UpdateMeta(benchmark::State &state, void (*update)(INvStorage &, const Uptane::Fetcher &),
+                   const FleetShape &shape, bool cold) {
+  Fleet &fleet = GetFleet(shape);
+  Uptane::Fetcher fetcher(fleet.repoServer(), fleet.directorServer(), fleet.http);
+  auto dir = std_::make_unique<TemporaryDirectory>("storage");
+  auto storage = INvStorage::newStorage(BenchmarkStorage(*dir));
+  update(*storage, fetcher);
+
+  PeakMemory memory;
+  for (auto _ : state) {
+    if (cold) {
+      state.PauseTiming();
+      storage.reset();
+      dir = std_::make_unique<TemporaryDirectory>("storage");
+      storage = INvStorage::newStorage(BenchmarkStorage(*dir));
+      state.ResumeTiming();
+    }
+    update(*storage, fetcher);
+  }
+  memory.Report(state);
+  AddFleetCounters(state, shape);
+}
+
+}  // namespace
+
+class SotaUptaneClientBenchmark {
+ public:
+  /* Full metadata update and target resolution, including the delegation walk. */
+  static void CheckUpdates(benchmark::State &state, const FleetShape &shape) {
+    FleetClient fleet_client(GetFleet(shape));
+    SotaUptaneClient &client = fleet_client.client();
+    if (client.checkUpdates().status != result::UpdateStatus::kUpdatesAvailable) {
+      state.SkipWithError("no updates found in generated fleet");
+      return;
+    }
+
+    PeakMemory memory;
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(client.checkUpdates());
+    }
+    memory.Report(state);
+    AddFleetCounters(state, shape);
+  }
+
+  static void AssembleManifest(benchmark::State &state, const FleetShape &shape) {
+    FleetClient fleet_client(GetFleet(shape));
+    SotaUptaneClient &client = fleet_client.client();
+
+    PeakMemory memory;
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(client.AssembleManifest());
+    }
+    memory.Report(state);
+    AddFleetCounters(state, shape);
+  }
+};
+
+namespace {
+
+void RegisterFleet(const FleetShape &shape) {
+  const std::string suffix = "/" + shape.Name();
+  benchmark::RegisterBenchmark(("ImageRepository_updateMeta/cold" + suffix).c_str(), BM_UpdateMeta, UpdateImageMeta,
+                               shape, true)
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+  benchmark::RegisterBenchmark(("ImageRepository_updateMeta/warm" + suffix).c_str(), BM_UpdateMeta, UpdateImageMeta,
+                               shape, false)
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+  benchmark::RegisterBenchmark(("DirectorRepository_updateMeta/cold" + suffix).c_str(),
+                               BM_UpdateMeta, UpdateDirectorMeta, shape, true)
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+  benchmark::RegisterBenchmark(("DirectorRepository_updateMeta/warm" + suffix).c_str(),
+                               BM_UpdateMeta, UpdateDirectorMeta, shape, false)
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+  benchmark::RegisterBenchmark(("SotaUptaneClient_checkUpdates" + suffix).c_str(),
+                               SotaUptaneClientBenchmark::CheckUpdates, shape)
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+  benchmark::RegisterBenchmark(("SotaUptaneClient_AssembleManifest" + suffix).c_str(),
+                               SotaUptaneClientBenchmark::AssembleManifest, shape)
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+}
+
+bool ParseFleet(const std::string &arg, FleetShape *shape) {
+  const std::string prefix = "--fleet=";
+  if (arg.compare(0, prefix.size(), prefix) != 0) {
+    return false;
+  }
+  std::vector<int> values;
+  bool overlapping = false;
+  std::istringstream spec(arg.substr(prefix.size()));
+  std::string value;
+  while (std::getline(spec, value, ':')) {
+    if (values.size() == 4 && value == "overlapping") {
+      overlapping = true;
+    } else {
+      values.push_back(std::stoi(value));
+    }
+  }
+  if (values.size() != 4 || values[0] < 1 || values[1] < 0 || values[2] < 0 || values[3] < 1 ||
+      (values[1] > 0 && values[2] < 1) || values[1] > Uptane::kDelegationsMaxDepth) {
+    throw std::invalid_argument("Invalid fleet specification " + arg +
+                                ", expected --fleet=<targets>:<depth>:<fanout>:<ecus>[:overlapping]");
+  }
+  *shape = FleetShape{values[0], values[1], values[2], values[3], overlapping};
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  logger_init();
+  logger_set_threshold(boost::log::trivial::warning);
+
+  benchmark::Initialize(&argc, argv);
+  std::vector<FleetShape> shapes;
+  for (int i = 1; i < argc; ++i) {
+    FleetShape shape{};
+    if (!ParseFleet(argv[i], &shape)) {
+      std::cerr << "Unknown argument " << argv[i] << "\n";
+      return EXIT_FAILURE;
+    }
+    shapes.push_back(shape);
+  }
+  if (shapes.empty()) {
+    shapes = {{100, 0, 0, 1, false},   {1000, 0, 0, 8, false}, {10000, 0, 0, 8, false}, {1000, 2, 4, 8, false},
+              {1000, 3, 3, 8, false},  {1000, 0, 0, 64, false}, {1000, 1, 100, 8, false}, {100, 1, 100, 8, true}};
+  }
+  for (const auto &shape : shapes) {
+    RegisterFleet(shape);
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,193 @@
+/*
+ * Throughput of image uploads to an IP Secondary, with and without compression.
+ *
+ * A Secondary that decompresses and hashes what it receives, like
+ * aktualizr-secondary does before writing it, listens on the loopback
+ * interface. The Primary streams an image to it in 64 KiB pieces, the way
+ * images are forwarded while they are downloaded. Images are either zeros,
+ * like the empty space of a filesystem image, data with 4 bits of entropy per
+ * byte, like code, or random data, like an already compressed archive.
+ *
+ * The loopback interface is much faster than a real link to a Secondary, so
+ * this is the worst case for compression: the wall time shows its cost when
+ * the link is not the bottleneck, "cpu" the time spent by the Primary, and
+ * "ratio" what a slow link gains.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "asn1/asn1_message.h"
+#include "ipuptanesecondary.h"
+#include "libaktualizr/crypto/crypto.h"
+#include "libaktualizr/logging/logging.h"
+#include "msg_handler.h"
+#include "secondary_tcp_server.h"
+#include "utilities/compression.h"
+
+namespace {
+
+constexpr size_t kChunkSize = 64 << 10;
+constexpr size_t kImageSize = 16 << 20;
+
+enum ImageKind { kZeros, kCode, kRandom };
+
+class LoopbackSecondary : public MsgDispatcher {
+ public:
+  LoopbackSecondary() {
+    registerHandler(AKIpUptaneMes_PR_getInfoReq, [](Asn1Message &in_msg, Asn1Message &out_msg) -> ReturnCode {
+      (void)in_msg;
+      auto m = out_msg.present(AKIpUptaneMes_PR_getInfoResp).getInfoResp();
+      SetString(&m->ecuSerial, "loopback");
+      SetString(&m->hwId, "loopback");
+      m->keyType = AKIpUptaneKeyType_ed25519;
+      SetString(&m->key, "key");
+      return ReturnCode::kOk;
+    });
+    registerHandler(AKIpUptaneMes_PR_versionReq, [](Asn1Message &in_msg, Asn1Message &out_msg) -> ReturnCode {
+      (void)in_msg;
+      out_msg.present(AKIpUptaneMes_PR_versionResp).versionResp()->version = 2;
+      return ReturnCode::kOk;
+    });
+    registerHandler(AKIpUptaneMes_PR_manifestReq, [](Asn1Message &in_msg, Asn1Message &out_msg) -> ReturnCode {
+      (void)in_msg;
+      auto m = out_msg.present(AKIpUptaneMes_PR_manifestResp).manifestResp();
+      m->manifest.present = manifest_PR_json;
+      SetString(&m->manifest.choice.json, "{}");  // NOLINT(cppcoreguidelines-pro-type-union-access)
+      return ReturnCode::kOk;
+    });
+    registerHandler(AKIpUptaneMes_PR_uploadCompressionReq,
+                    [this](Asn1Message &in_msg, Asn1Message &out_msg) -> ReturnCode {
+                      (void)in_msg;
+                      decompressor_ =
+                          std_::make_unique<compression::Decompressor>(std::numeric_limits<uint64_t>::max());
+                      out_msg.present(AKIpUptaneMes_PR_uploadCompressionResp).uploadCompressionResp()->compression =
+                          AKCompression_deflate;
+                      return ReturnCode::kOk;
+                    });
+    registerHandler(AKIpUptaneMes_PR_uploadDataReq, [this](Asn1Message &in_msg, Asn1Message &out_msg) -> ReturnCode {
+      const auto &data = in_msg.uploadDataReq()->data;
+      received_ += static_cast<size_t>(data.size);
+      hasher_.update(data.buf, static_cast<uint64_t>(data.size));
+      return respond(out_msg);
+    });
+    registerHandler(AKIpUptaneMes_PR_uploadCompressedDataReq,
+                    [this](Asn1Message &in_msg, Asn1Message &out_msg) -> ReturnCode {
+                      const auto &data = in_msg.uploadCompressedDataReq()->data;
+                      received_ += static_cast<size_t>(data.size);
+                      decompressor_->decompress(data.buf, static_cast<size_t>(data.size),
+                                                [this](const uint8_t *buf, size_t size) -> bool {
+                                                  hasher_.update(buf, size);
+                                                  return true;
+                                                });
+                      return respond(out_msg);
+                    });
+  }
+
+  /** Bytes received over the network since the last call. */
+  size_t takeReceived() {
+    const size_t received = received_;
+    received_ = 0;
+    return received;
+  }
+
+ private:
+  static ReturnCode respond(Asn1Message &out_msg) {
+    auto m = out_msg.present(AKIpUptaneMes_PR_uploadDataResp).uploadDataResp();
+    m->result = AKInstallationResultCode_ok;
+    SetString(&m->description, "");
+    return ReturnCode::kOk;
+  }
+
+  std::unique_ptr<compression::Decompressor> decompressor_;
+  MultiPartSHA256Hasher hasher_;
+  size_t received_{0};
+};
+
+std::string makeImage(ImageKind kind) {
+  std::string image(kImageSize, '\0');
+  std::mt19937 rng(42);
+  if (kind == kCode) {
+    for (auto &c : image) {
+      c = static_cast<char>('A' + (rng() & 0x0F));
+    }
+  } else if (kind == kRandom) {
+    for (auto &c : image) {
+      c = static_cast<char>(rng() & 0xFF);
+    }
+  }
+  return image;
+}
+
+void SecondaryUpload(benchmark::State &state) {
+  const auto kind = static_cast<ImageKind>(state.range(0));
+  const auto level = static_cast<int>(state.range(1));
+  const std::string image = makeImage(kind);
+
+  LoopbackSecondary secondary;
+  SecondaryTcpServer server(secondary, "", 0);
+  std::thread server_thread([&server]() { server.run(); });
+  server.wait_until_running();
+
+  auto ip_secondary = std::dynamic_pointer_cast<Uptane::IpUptaneSecondary>(
+      Uptane::IpUptaneSecondary::connectAndCreate("localhost", server.port(), VerificationType::kFull));
+  // Negotiates the protocol version.
+  ip_secondary->getManifest();
+  ip_secondary->setCompressionLevel(level);
+
+  Json::Value target_json;
+  target_json["custom"]["targetFormat"] = "BINARY";
+  target_json["length"] = static_cast<Json::UInt64>(kImageSize);
+  const Uptane::Target target("image.bin", target_json);
+
+  size_t sent = 0;
+  for (auto _ : state) {
+    auto writer = ip_secondary->openFirmwareWriter(target);
+    for (size_t offset = 0; offset < image.size(); offset += kChunkSize) {
+      const auto result = writer->write(reinterpret_cast<const uint8_t *>(image.data()) + offset, kChunkSize);
+      if (!result.isSuccess()) {
+        state.SkipWithError(result.description.c_str());
+        break;
+      }
+    }
+    sent += secondary.takeReceived();
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * kImageSize));
+  state.counters["ratio"] = static_cast<double>(sent) / static_cast<double>(state.iterations() * kImageSize);
+
+  server.stop();
+  server_thread.join();
+}
+
+}  // namespace
+
+BENCHMARK(SecondaryUpload)
+    ->ArgNames({"image", "level"})
+    ->Args({kZeros, 0})
+    ->Args({kZeros, 1})
+    ->Args({kZeros, 6})
+    ->Args({kCode, 0})
+    ->Args({kCode, 1})
+    ->Args({kCode, 6})
+    ->Args({kRandom, 0})
+    ->Args({kRandom, 1})
+    ->Args({kRandom, 6})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+int main(int argc, char **argv) {
+  logger_init();
+  logger_set_threshold(boost::log::trivial::warning);
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return EXIT_SUCCESS;
+}
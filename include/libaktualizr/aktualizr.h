@@ -8,6 +8,7 @@
 
 #include "libaktualizr/config.h"
 #include "libaktualizr/events.h"
+#include "libaktualizr/metrics.h"
 #include "libaktualizr/secondaryinterface.h"
 
 class SotaUptaneClient;
@@ -17,6 +18,14 @@ namespace api {
 class CommandQueue;
 }
 
+namespace event {
+class AsyncDispatcher;
+}
+
+namespace metrics {
+class SocketServer;
+}
+
 /**
  * This class provides the main APIs necessary for launching and controlling
  * libaktualizr.
@@ -142,6 +151,8 @@ class Aktualizr {
 
   /**
    * Download targets.
+   * Stops the background download of the update started by CheckUpdates, if
+   * uptane.prefetch_targets is set, and completes what it stored.
    * @param updates Vector of targets to download as provided by CheckUpdates.
    * @return std::future object with information about download results.
    *
@@ -253,7 +264,8 @@ class Aktualizr {
 
   /**
    * Pause the library operations.
-   * In progress target downloads will be paused and API calls will be deferred.
+   * In progress target downloads, including the background download of an
+   * update, will be paused and API calls will be deferred.
    *
    * @return Information about pause results.
    *
@@ -276,7 +288,8 @@ class Aktualizr {
 
   /**
    * Aborts the currently running command, if it can be aborted, or waits for it
-   * to finish; then removes all other queued calls.
+   * to finish; then removes all other queued calls. The background download
+   * of an update is stopped too.
    * This doesn't reset the `Paused` state, i.e. if the queue was previously
    * paused, it will remain paused, but with an emptied queue.
    * The call is blocking.
@@ -349,6 +362,18 @@ class Aktualizr {
    */
   boost::signals2::connection SetSignalHandler(const SigHandler& handler);
 
+  /**
+   * Get the counters of the asynchronous event dispatcher. All counters are
+   * zero unless uptane.event_dispatch_async is enabled.
+   */
+  event::DispatchStats EventDispatchStats() const;
+
+  /**
+   * Get the current values of the performance counters of libaktualizr, such
+   * as download throughput, HTTP retries and storage latency.
+   */
+  metrics::Snapshot GetMetrics() const;
+
  private:
   // Make sure this is declared before SotaUptaneClient to prevent Valgrind
   // complaints with destructors.
@@ -369,6 +394,8 @@ class Aktualizr {
   std::shared_ptr<INvStorage> storage_;
   std::shared_ptr<event::Channel> sig_;
   std::unique_ptr<api::CommandQueue> api_queue_;
+  std::unique_ptr<event::AsyncDispatcher> event_dispatcher_;
+  std::unique_ptr<metrics::SocketServer> metrics_server_;
 };
 
 #endif  // AKTUALIZR_H_
@@ -17,6 +17,10 @@
 
 struct LoggerConfig {
   int loglevel{2};
+  // Write the log from a background thread.
+  bool async{false};
+  // What to do when the asynchronous log buffer is full: "block" or "drop".
+  std::string async_overflow{"block"};
   void updateFromPropertyTree(const boost::property_tree::ptree& pt);
   void writeToStream(std::ostream& out_stream) const;
 };
@@ -73,6 +77,30 @@ struct UptaneConfig {
   bool force_install_completion{false};
   boost::filesystem::path secondary_config_file;
   uint64_t secondary_preinstall_wait_sec{600U};
+  uint64_t secondary_metadata_threads{8U};
+  uint64_t secondary_install_threads{8U};
+  // Comma-separated "<Secondary type>:<limit>" pairs, e.g. "IP:2".
+  std::string secondary_bus_limits;
+  // Comma-separated ECU serials that are installed first, in this order.
+  std::string secondary_install_priority;
+  // Forward images to the Secondaries that support it while they are downloaded.
+  bool secondary_stream_firmware{false};
+  // Also store the streamed images on the Primary.
+  bool secondary_stream_keep_copy{true};
+  // Read an image assigned to several Secondaries once and send it to all of them together.
+  bool secondary_fan_out{false};
+  // Download the binary targets of an update in the background once it is found, before it is accepted.
+  bool prefetch_targets{false};
+  // Download rate of the prefetch in bytes per second; 0 is unlimited.
+  uint64_t prefetch_max_bytes_per_sec{0};
+  // Space in bytes that the stored, not yet installed target files of an update may take for a prefetch; 0 is
+  // unlimited.
+  uint64_t prefetch_quota{0};
+  // Deliver events to signal handlers from a separate thread.
+  bool event_dispatch_async{false};
+  uint64_t event_queue_size{1024U};
+  // "block" or "drop_progress".
+  std::string event_overflow_policy{"block"};
 
   void updateFromPropertyTree(const boost::property_tree::ptree& pt);
   void writeToStream(std::ostream& out_stream) const;
@@ -88,6 +116,10 @@ struct UptaneConfig {
 #define PACKAGE_MANAGER_DEFAULT PACKAGE_MANAGER_NONE
 #endif
 
+// Use of OSTree static deltas: when available, required, or never.
+enum class OstreeDeltaPolicy { kPrefer = 0, kOnly, kNever };
+std::ostream& operator<<(std::ostream& os, OstreeDeltaPolicy policy);
+
 struct PackageConfig {
   std::string type{PACKAGE_MANAGER_DEFAULT};
 
@@ -95,7 +127,19 @@ struct PackageConfig {
   std::string os;
   boost::filesystem::path sysroot;
   std::string ostree_server;
+  OstreeDeltaPolicy ostree_static_deltas{OstreeDeltaPolicy::kPrefer};
+  // Pull objects instead if a pull that may use static deltas fails.
+  bool ostree_delta_fallback{false};
+  int ostree_network_retries{5};
+  // Local mirror of the OSTree commits of Secondaries, served to them over
+  // HTTP on this address; disabled when empty.
+  std::string ostree_mirror_address;
+  int ostree_mirror_port{8099};
+  boost::filesystem::path ostree_mirror_repo{"/var/sota/ostree-mirror"};
   boost::filesystem::path images_path{"/var/sota/images"};
+  // Size in bytes that target files in `images_path` are trimmed to after an
+  // install; 0 keeps them all.
+  uint64_t images_quota{0};
   boost::filesystem::path packages_file{"/usr/package.manifest"};
 
   // Options for simulation
@@ -151,6 +195,28 @@ struct TelemetryConfig {
   void writeToStream(std::ostream& out_stream) const;
 };
 
+/**
+ * @brief The TracingConfig struct
+ * Performance tracing of the update cycle.
+ */
+struct TracingConfig {
+  // Chrome trace-event file to write spans to; tracing is off when empty.
+  boost::filesystem::path path;
+  void updateFromPropertyTree(const boost::property_tree::ptree& pt);
+  void writeToStream(std::ostream& out_stream) const;
+};
+
+/**
+ * @brief The MetricsConfig struct
+ * Local endpoint exposing performance counters.
+ */
+struct MetricsConfig {
+  // Unix socket to serve metrics on; the endpoint is off when empty.
+  boost::filesystem::path socket_path;
+  void updateFromPropertyTree(const boost::property_tree::ptree& pt);
+  void writeToStream(std::ostream& out_stream) const;
+};
+
 enum class RollbackMode { kBootloaderNone = 0, kUbootGeneric, kUbootMasked, kFioVB };
 std::ostream& operator<<(std::ostream& os, RollbackMode mode);
 
@@ -231,6 +297,8 @@ class Config : public BaseConfig {
   StorageConfig storage;
   ImportConfig import;
   TelemetryConfig telemetry;
+  TracingConfig tracing;
+  MetricsConfig metrics;
   BootloaderConfig bootloader;
 
  private:
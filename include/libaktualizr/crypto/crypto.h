@@ -86,6 +86,8 @@ class Crypto {
   /** A lower case, hexadecimal version of sha512digest */
   static std::string sha512digestHex(const std::string &text);
   static std::string RSAPSSSign(ENGINE *engine, const std::string &private_key, const std::string &message);
+  /** Sign with a key from ParseRSAPrivateKey(), skipping the PEM parsing. */
+  static std::string RSAPSSSign(EVP_PKEY *key, const std::string &message);
   static std::string Sign(KeyType key_type, ENGINE *engine, const std::string &private_key, const std::string &message);
   static std::string ED25519Sign(const std::string &private_key, const std::string &message);
   static bool parseP12(BIO *p12_bio, const std::string &p12_password, std::string *out_pkey, std::string *out_cert,
@@ -100,6 +102,14 @@ class Crypto {
   static bool generateKeyPair(KeyType key_type, std::string *public_key, std::string *private_key);
 
   static bool RSAPSSVerify(const std::string &public_key, const std::string &signature, const std::string &message);
+  /** Verify with a key from ParseRSAPublicKey(), skipping the PEM parsing. */
+  static bool RSAPSSVerify(EVP_PKEY *key, const std::string &signature, const std::string &message);
+  /**
+   * Parse a PEM encoded RSA key into a handle that can be used concurrently
+   * by several threads. Returns nullptr if the key is invalid.
+   */
+  static std::shared_ptr<EVP_PKEY> ParseRSAPublicKey(const std::string &public_key);
+  static std::shared_ptr<EVP_PKEY> ParseRSAPrivateKey(const std::string &private_key);
   static bool ED25519Verify(const std::string &public_key, const std::string &signature, const std::string &message);
 
   static bool IsRsaKeyType(KeyType type);
@@ -1,7 +1,10 @@
 #ifndef KEYMANAGER_H_
 #define KEYMANAGER_H_
 
+#include <openssl/ossl_typ.h>
+
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include "json/json.h"
@@ -46,6 +49,12 @@ class KeyManager {
   std::unique_ptr<TemporaryFile> tmp_pkey_file;
   std::unique_ptr<TemporaryFile> tmp_cert_file;
   std::unique_ptr<TemporaryFile> tmp_ca_file;
+
+  std::shared_ptr<EVP_PKEY> uptaneSigningKey(const std::string &private_key) const;
+  // The parsed Uptane private key, kept as long as the stored PEM is unchanged.
+  mutable std::mutex signing_key_mutex_;
+  mutable std::string signing_key_pem_;
+  mutable std::shared_ptr<EVP_PKEY> signing_key_;
 };
 
 #endif  // KEYMANAGER_H_
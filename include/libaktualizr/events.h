@@ -2,6 +2,7 @@
 #define EVENTS_H_
 /** \file */
 
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -77,14 +78,16 @@ class DownloadProgressReport : public BaseEvent {
     return (report.progress == DownloadProgressReport::ProgressCompletedValue);
   }
 
-  DownloadProgressReport(Uptane::Target target_in, std::string description_in, unsigned int progress_in)
-      : target{std::move(target_in)}, description{std::move(description_in)}, progress{progress_in} {
+  DownloadProgressReport(Uptane::Target target_in, std::string description_in, unsigned int progress_in,
+                         data::DownloadStats stats_in = data::DownloadStats())
+      : target{std::move(target_in)}, description{std::move(description_in)}, progress{progress_in}, stats{stats_in} {
     variant = TypeName;
   }
 
   Uptane::Target target;
   std::string description;
   unsigned int progress;
+  data::DownloadStats stats;
 
  private:
   static const unsigned int ProgressCompletedValue{100};
@@ -125,8 +128,13 @@ class InstallStarted : public BaseEvent {
  public:
   static constexpr const char* TypeName{"InstallStarted"};
 
-  explicit InstallStarted(Uptane::EcuSerial serial_in) : serial(std::move(serial_in)) { variant = TypeName; }
+  explicit InstallStarted(Uptane::EcuSerial serial_in, size_t queue_depth_in = 0)
+      : serial(std::move(serial_in)), queue_depth(queue_depth_in) {
+    variant = TypeName;
+  }
   Uptane::EcuSerial serial;
+  // Number of ECU installations still waiting for their turn.
+  size_t queue_depth;
 };
 
 /**
@@ -136,13 +144,15 @@ class InstallTargetComplete : public BaseEvent {
  public:
   static constexpr const char* TypeName{"InstallTargetComplete"};
 
-  InstallTargetComplete(Uptane::EcuSerial serial_in, bool success_in)
-      : serial(std::move(serial_in)), success(success_in) {
+  InstallTargetComplete(Uptane::EcuSerial serial_in, bool success_in, uint64_t transfer_rate_in = 0)
+      : serial(std::move(serial_in)), success(success_in), transfer_rate(transfer_rate_in) {
     variant = TypeName;
   }
 
   Uptane::EcuSerial serial;
   bool success;
+  // Bytes per second at which the firmware was sent to the ECU, 0 if unknown.
+  uint64_t transfer_rate;
 };
 
 /**
@@ -195,6 +205,16 @@ class CampaignPostponeComplete : public BaseEvent {
 
 using Channel = boost::signals2::signal<void(std::shared_ptr<event::BaseEvent>)>;
 
+/**
+ * Counters of the asynchronous event dispatcher.
+ */
+struct DispatchStats {
+  uint64_t dispatched{0};
+  uint64_t coalesced{0};
+  uint64_t dropped{0};
+  size_t queue_depth{0};
+};
+
 }  // namespace event
 
 #endif  // EVENTS_H_
@@ -0,0 +1,89 @@
+#ifndef ASYNCHTTPENGINE_H_
+#define ASYNCHTTPENGINE_H_
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <curl/curl.h>
+
+namespace api {
+class FlowControlToken;
+}
+
+/**
+ * Runs HTTP transfers on a single curl multi handle, driven by one I/O thread
+ * that is started on first use.
+ *
+ * The engine caps the number of open connections for all the transfers it
+ * runs, so HTTP clients use the one returned by shared(). A transfer whose
+ * write callback returns CURL_WRITEFUNC_PAUSE stays paused until unpause() is
+ * called for it.
+ */
+class AsyncHttpEngine {
+ public:
+  using DoneCallback = std::function<void(CURL *handle, CURLcode result)>;
+
+  static constexpr long kDefaultMaxConnections = 8;  // NOLINT(google-runtime-int)
+
+  explicit AsyncHttpEngine(long max_connections = kDefaultMaxConnections);  // NOLINT(google-runtime-int)
+  ~AsyncHttpEngine();
+  AsyncHttpEngine(const AsyncHttpEngine &) = delete;
+  AsyncHttpEngine(AsyncHttpEngine &&) = delete;
+  AsyncHttpEngine &operator=(const AsyncHttpEngine &) = delete;
+  AsyncHttpEngine &operator=(AsyncHttpEngine &&) = delete;
+
+  /** The engine of the process, created when first needed and kept while in use. */
+  static std::shared_ptr<AsyncHttpEngine> shared();
+
+  /**
+   * Start a fully configured easy handle. `done` is called on the I/O thread
+   * once the transfer is over. If `token` is given, the transfer ends with
+   * CURLE_ABORTED_BY_CALLBACK as soon as the token is paused or aborted.
+   * Transfers still running when the engine is destroyed end the same way, as
+   * well as those of `owner` when cancel() is called for it.
+   */
+  void start(std::shared_ptr<CURL> handle, DoneCallback done, const api::FlowControlToken *token = nullptr,
+             const void *owner = nullptr);
+
+  /** Same as start(), with the result delivered through a future. */
+  std::future<CURLcode> perform(std::shared_ptr<CURL> handle, const api::FlowControlToken *token = nullptr);
+
+  /** Resume a transfer paused by its write callback. */
+  void unpause(CURL *handle);
+
+  /** Abort the transfers started for `owner` and wait until they are done. */
+  void cancel(const void *owner);
+
+ private:
+  struct Transfer {
+    std::shared_ptr<CURL> handle;
+    DoneCallback done;
+    const api::FlowControlToken *token;
+    const void *owner;
+  };
+
+  void run();
+  void wakeup();
+  static void finish(Transfer &transfer, CURLcode result);
+
+  CURLM *multi_;
+  std::array<int, 2> wakeup_pipe_{{-1, -1}};
+  std::thread thread_;
+  std::mutex m_;
+  std::vector<Transfer> incoming_;
+  std::vector<CURL *> unpause_;
+  std::vector<const void *> cancel_;
+  uint64_t cancel_requested_{0};
+  uint64_t cancel_done_{0};
+  std::condition_variable cancel_cv_;
+  bool shutdown_{false};
+};
+
+#endif  // ASYNCHTTPENGINE_H_
@@ -1,14 +1,17 @@
 #ifndef HTTPCLIENT_H_
 #define HTTPCLIENT_H_
 
+#include <array>
 #include <future>
 #include <memory>
+#include <mutex>
 #include <set>
 
 #include <curl/curl.h>
 #include "gtest/gtest_prod.h"
 #include "json/json.h"
 
+#include "libaktualizr/http/asynchttpengine.h"
 #include "libaktualizr/http/httpinterface.h"
 
 /**
@@ -45,10 +48,16 @@ class HttpClient : public HttpInterface {
   std::future<HttpResponse> downloadAsync(const std::string &url, curl_write_callback write_cb,
                                           curl_xferinfo_callback progress_cb, void *userp, curl_off_t from,
                                           CurlHandler *easyp) override;
+  HttpResponse downloadRateLimited(const std::string &url, curl_write_callback write_cb,
+                                   curl_xferinfo_callback progress_cb, void *userp, curl_off_t from,
+                                   curl_off_t max_bytes_per_sec) override;
   void setCerts(const std::string &ca, CryptoSource ca_source, const std::string &cert, CryptoSource cert_source,
                 const std::string &pkey, CryptoSource pkey_source) override;
   bool updateHeader(const std::string &name, const std::string &value);
   void timeout(int64_t ms);
+  // Runs the transfers started by downloadAsync(); shared by all the clients
+  // of the process and by other asynchronous users.
+  AsyncHttpEngine &asyncEngine() { return *async_engine_; }
 
  private:
   FRIEND_TEST(GetTest, download_speed_limit);
@@ -57,11 +66,32 @@ class HttpClient : public HttpInterface {
   CURL *curl;
   curl_slist *headers;
   HttpResponse perform(CURL *curl_handler, int retry_times, int64_t size_limit);
+  std::future<HttpResponse> startDownload(const std::string &url, curl_write_callback write_cb,
+                                          curl_xferinfo_callback progress_cb, void *userp, curl_off_t from,
+                                          curl_off_t max_bytes_per_sec, CurlHandler *easyp);
   static curl_slist *curl_slist_dup(curl_slist *sl);
   virtual CURL *dupHandle(CURL *const curl_in, const bool using_pkcs11) {
-    return Utils::curlDupHandleWrapper(curl_in, using_pkcs11, nullptr);
+    return Utils::curlDupHandleWrapper(curl_in, using_pkcs11, curl_share_ ? curl_share_->handle : nullptr);
   }
 
+  // Connections (with keep-alive), TLS sessions and DNS lookups are shared by
+  // all the requests made through one client, so that a polling cycle does not
+  // pay for a new handshake on every request. Copies get their own.
+  struct CurlShare {
+    CurlShare();
+    ~CurlShare();
+    CurlShare(const CurlShare &) = delete;
+    CurlShare(CurlShare &&) = delete;
+    CurlShare &operator=(const CurlShare &) = delete;
+    CurlShare &operator=(CurlShare &&) = delete;
+
+    CURLSH *handle;
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> mutexes;
+  };
+  std::unique_ptr<CurlShare> curl_share_;
+  // The transfers of this client are cancelled before curl_share_ goes away.
+  std::shared_ptr<AsyncHttpEngine> async_engine_;
+
   std::unique_ptr<TemporaryFile> tls_ca_file;
   std::unique_ptr<TemporaryFile> tls_cert_file;
   std::unique_ptr<TemporaryFile> tls_pkey_file;
@@ -80,26 +110,19 @@ class HttpClient : public HttpInterface {
   std::set<std::string> response_header_names_;
 };
 
+// HttpClient shares connections, TLS sessions and DNS lookups on its own now;
+// this is kept for existing users.
 class HttpClientWithShare : public HttpClient {
  public:
   explicit HttpClientWithShare(const std::vector<std::string> *extra_headers = nullptr,
-                               const std::set<std::string> *response_header_names = nullptr);
-  explicit HttpClientWithShare(const std::string &socket);
-  HttpClientWithShare(const HttpClientWithShare &curl_in);  // non-default!
-  ~HttpClientWithShare() override;
+                               const std::set<std::string> *response_header_names = nullptr)
+      : HttpClient(extra_headers, response_header_names) {}
+  explicit HttpClientWithShare(const std::string &socket) : HttpClient(socket) {}
+  HttpClientWithShare(const HttpClientWithShare &curl_in) = default;
+  ~HttpClientWithShare() override = default;
   HttpClientWithShare(HttpClientWithShare &&) = delete;
   HttpClientWithShare &operator=(const HttpClientWithShare &) = delete;
   HttpClientWithShare &operator=(HttpClientWithShare &&) = delete;
-
- protected:
-  CURL *dupHandle(CURL *const curl_in, const bool using_pkcs11) override {
-    return Utils::curlDupHandleWrapper(curl_in, using_pkcs11, share_);
-  }
-  void initCurlShare();
-
- private:
-  CURLSH *share_{nullptr};
-  std::array<std::mutex, CURL_LOCK_DATA_LAST> curl_share_mutexes;
 };
 
 #endif
@@ -53,6 +53,16 @@ class HttpInterface {
   virtual std::future<HttpResponse> downloadAsync(const std::string &url, curl_write_callback write_cb,
                                                   curl_xferinfo_callback progress_cb, void *userp, curl_off_t from,
                                                   CurlHandler *easyp) = 0;
+  /**
+   * Like download(), receiving at most `max_bytes_per_sec` (0: no limit). The
+   * default implementation ignores the limit.
+   */
+  virtual HttpResponse downloadRateLimited(const std::string &url, curl_write_callback write_cb,
+                                           curl_xferinfo_callback progress_cb, void *userp, curl_off_t from,
+                                           curl_off_t max_bytes_per_sec) {
+    (void)max_bytes_per_sec;
+    return download(url, write_cb, progress_cb, userp, from);
+  }
   virtual void setCerts(const std::string &ca, CryptoSource ca_source, const std::string &cert,
                         CryptoSource cert_source, const std::string &pkey, CryptoSource pkey_source) = 0;
   static constexpr int64_t kNoLimit = 0;  // no limit the size of downloaded data
@@ -10,6 +10,15 @@ class ImageRepo : public Repo {
   void addBinaryImage(const boost::filesystem::path &image_path, const boost::filesystem::path &targetname,
                       const std::string &hardware_id, const std::string &url = "", int32_t custom_version = 0,
                       const Delegation &delegation = {}, const Json::Value &custom = {});
+  /**
+   * Copy an image into the repo and return its length and hashes as Targets
+   * metadata. Does not touch any metadata, so it is safe to call concurrently.
+   */
+  Json::Value importImage(const boost::filesystem::path &image_path, const boost::filesystem::path &targetname) const;
+  /** Add an image previously prepared with importImage() to the Image repo metadata. */
+  void addImportedImage(const boost::filesystem::path &targetname, Json::Value target, const std::string &hardware_id,
+                        const std::string &url = "", int32_t custom_version = 0, const Delegation &delegation = {},
+                        const Json::Value &custom = {});
   void addCustomImage(const std::string &name, const Hash &hash, uint64_t length, const std::string &hardware_id,
                       const std::string &url = "", int32_t custom_version = 0, const Delegation &delegation = {},
                       const Json::Value &custom = {});
@@ -2,28 +2,44 @@
 #define SOTA_CLIENT_TOOLS_LOGGING_H_
 
 #include <boost/log/trivial.hpp>
+#include <atomic>
 #include <cstdint>
 
 struct LoggerConfig;
 
+namespace logging_internal {
+extern std::atomic<int> threshold;
+}
+
+/** Checked before Boost.Log opens a record, so that a message below the
+ * threshold only costs an atomic load. */
+inline bool logger_enabled(boost::log::trivial::severity_level level) {
+  return static_cast<int>(level) >= logging_internal::threshold.load(std::memory_order_relaxed);
+}
+
+#define LOG_WITH_SEVERITY(lvl)                     \
+  if (!logger_enabled(boost::log::trivial::lvl)) { \
+  } else                                           \
+    BOOST_LOG_TRIVIAL(lvl)
+
 /** Log an unrecoverable error */
-#define LOG_FATAL BOOST_LOG_TRIVIAL(fatal)
+#define LOG_FATAL LOG_WITH_SEVERITY(fatal)
 
 /** Log that something has definitely gone wrong */
-#define LOG_ERROR BOOST_LOG_TRIVIAL(error)
+#define LOG_ERROR LOG_WITH_SEVERITY(error)
 
 /** Warn about behaviour that is probably bad, but hasn't yet caused the system
  * to operate out of spec. */
-#define LOG_WARNING BOOST_LOG_TRIVIAL(warning)
+#define LOG_WARNING LOG_WITH_SEVERITY(warning)
 
 /** Report a user-visible message about operation */
-#define LOG_INFO BOOST_LOG_TRIVIAL(info)
+#define LOG_INFO LOG_WITH_SEVERITY(info)
 
 /** Report a message for developer debugging */
-#define LOG_DEBUG BOOST_LOG_TRIVIAL(debug)
+#define LOG_DEBUG LOG_WITH_SEVERITY(debug)
 
 /** Report very-verbose debugging information */
-#define LOG_TRACE BOOST_LOG_TRIVIAL(trace)
+#define LOG_TRACE LOG_WITH_SEVERITY(trace)
 
 // Use like:
 // curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, get_curlopt_verbose());
@@ -33,8 +49,19 @@ void logger_init(bool use_colors = false);
 
 void logger_set_threshold(boost::log::trivial::severity_level threshold);
 
+// Also switches between synchronous and asynchronous output, see logger_set_async().
 void logger_set_threshold(const LoggerConfig& lconfig);
 
+/**
+ * Format and write log records on a background thread instead of the thread
+ * that logs them. Records are queued in a bounded buffer; when it is full,
+ * the logging thread either waits or the record is dropped.
+ */
+void logger_set_async(bool enabled, bool drop_on_overflow = false);
+
+/** Write out all queued records. Called at exit when logging asynchronously. */
+void logger_flush();
+
 void logger_set_enable(bool enabled);
 
 int loggerGetSeverity();
@@ -0,0 +1,153 @@
+#ifndef AKTUALIZR_METRICS_H_
+#define AKTUALIZR_METRICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Performance counters of libaktualizr.
+ *
+ * Metrics are registered once in a Registry, which hands out references that
+ * stay valid for the lifetime of the process. Updating a metric through such a
+ * reference only uses atomic operations and never allocates, so callers on a
+ * hot path should look their metrics up once and keep the reference.
+ */
+namespace metrics {
+
+using Labels = std::map<std::string, std::string>;
+
+enum class Type { kCounter, kGauge, kHistogram };
+
+/** Monotonically increasing count. */
+class Counter {
+ public:
+  void inc(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> value_{0};
+};
+
+/** Value that can go up and down. */
+class Gauge {
+ public:
+  void set(double value) { value_.store(value, std::memory_order_relaxed); }
+  void add(double delta);
+  double value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<double> value_{0};
+};
+
+/** Distribution of observed values over fixed buckets. */
+class Histogram {
+ public:
+  /** `bounds` are the inclusive upper bounds of the buckets, in increasing order. */
+  explicit Histogram(std::vector<double> bounds);
+
+  void observe(double value);
+  const std::vector<double> &bounds() const { return bounds_; }
+  /** Non-cumulative count of each bucket, the last one being the overflow bucket. */
+  std::vector<uint64_t> bucketCounts() const;
+  double sum() const { return sum_.load(std::memory_order_relaxed); }
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+ private:
+  const std::vector<double> bounds_;
+  std::unique_ptr<std::atomic<uint64_t>[]> buckets_;  // NOLINT(modernize-avoid-c-arrays)
+  std::atomic<double> sum_{0};
+  std::atomic<uint64_t> count_{0};
+};
+
+/** Latency buckets in seconds, from 100 µs to one minute. */
+const std::vector<double> &latencyBuckets();
+
+/** Observes the time between its construction and destruction, in seconds. */
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(Histogram &histogram) : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+  ~ScopedTimer() {
+    histogram_.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+  }
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer(ScopedTimer &&) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(ScopedTimer &&) = delete;
+
+ private:
+  Histogram &histogram_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+struct Sample {
+  Labels labels;
+  /** Value of a counter or gauge. */
+  double value{0};
+  /** Non-cumulative bucket counts of a histogram. */
+  std::vector<uint64_t> buckets;
+  double sum{0};
+  uint64_t count{0};
+};
+
+struct Family {
+  std::string name;
+  std::string help;
+  Type type{Type::kCounter};
+  /** Bucket bounds of a histogram. */
+  std::vector<double> bounds;
+  std::vector<Sample> samples;
+};
+
+using Snapshot = std::vector<Family>;
+
+/** Render a snapshot in the Prometheus text exposition format. */
+std::string toPrometheusText(const Snapshot &snapshot);
+
+class Registry {
+ public:
+  /** Registry used by libaktualizr itself. */
+  static Registry &global();
+
+  Registry() = default;
+  Registry(const Registry &) = delete;
+  Registry(Registry &&) = delete;
+  Registry &operator=(const Registry &) = delete;
+  Registry &operator=(Registry &&) = delete;
+  ~Registry() = default;
+
+  /**
+   * Get or create a metric. Using the same name for metrics of different
+   * types, or for histograms with different buckets, throws std::logic_error.
+   */
+  Counter &counter(const std::string &name, const std::string &help, const Labels &labels = Labels());
+  Gauge &gauge(const std::string &name, const std::string &help, const Labels &labels = Labels());
+  Histogram &histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds,
+                       const Labels &labels = Labels());
+
+  Snapshot snapshot() const;
+
+ private:
+  struct Entry {
+    std::string help;
+    Type type;
+    std::vector<double> bounds;
+    std::map<Labels, std::unique_ptr<Counter>> counters;
+    std::map<Labels, std::unique_ptr<Gauge>> gauges;
+    std::map<Labels, std::unique_ptr<Histogram>> histograms;
+  };
+
+  Entry &entry(const std::string &name, const std::string &help, Type type, const std::vector<double> &bounds);
+
+  mutable std::mutex m_;
+  std::map<std::string, Entry> entries_;
+};
+
+}  // namespace metrics
+
+#endif  // AKTUALIZR_METRICS_H_
@@ -40,6 +40,19 @@ struct PullMetaStruct {
   OstreeProgressCb progress_cb;
 };
 
+struct OstreePullOptions {
+  OstreePullOptions() = default;
+  explicit OstreePullOptions(const PackageConfig &pconfig)
+      : static_deltas{pconfig.ostree_static_deltas},
+        delta_fallback{pconfig.ostree_delta_fallback},
+        network_retries{pconfig.ostree_network_retries} {}
+  OstreeDeltaPolicy static_deltas{OstreeDeltaPolicy::kPrefer};
+  bool delta_fallback{false};
+  int network_retries{5};
+  // Commit to look up static deltas from. pull() uses the deployed one when empty.
+  std::string delta_from;
+};
+
 class OstreeManager : public PackageManagerInterface {
  public:
   OstreeManager(const PackageConfig &pconfig, const BootloaderConfig &bconfig,
@@ -72,7 +85,15 @@ class OstreeManager : public PackageManagerInterface {
       const boost::filesystem::path &sysroot_path, const std::string &ostree_server, const KeyManager &keys,
       const Uptane::Target &target, const api::FlowControlToken *token = nullptr,
       OstreeProgressCb progress_cb = nullptr, const char *alt_remote = nullptr,
-      boost::optional<std::unordered_map<std::string, std::string>> headers = boost::none);
+      boost::optional<std::unordered_map<std::string, std::string>> headers = boost::none,
+      OstreePullOptions options = OstreePullOptions());
+  // Same as pull(), into any repo rather than the one of a sysroot.
+  static data::InstallationResult pullToRepo(
+      OstreeRepo *repo, const std::string &ostree_server, const KeyManager &keys, const Uptane::Target &target,
+      const api::FlowControlToken *token = nullptr, OstreeProgressCb progress_cb = nullptr,
+      const char *alt_remote = nullptr,
+      boost::optional<std::unordered_map<std::string, std::string>> headers = boost::none,
+      const OstreePullOptions &options = OstreePullOptions());
 
  private:
   TargetStatus verifyTargetInternal(const Uptane::Target &target) const;
@@ -1,8 +1,10 @@
 #ifndef PACKAGEMANAGERINTERFACE_H_
 #define PACKAGEMANAGERINTERFACE_H_
 
+#include <ctime>
 #include <fstream>
 #include <mutex>
+#include <set>
 #include <string>
 
 #include "libaktualizr/config.h"
@@ -21,6 +23,35 @@ class Fetcher;
 }
 
 using FetcherProgressCb = std::function<void(const Uptane::Target&, const std::string&, unsigned int)>;
+// Progress callback that also receives the transfer counters, see WithDownloadStats.
+using FetcherStatsCb =
+    std::function<void(const Uptane::Target&, const std::string&, unsigned int, const data::DownloadStats&)>;
+
+/**
+ * FetcherProgressCb that hands the transfer counters of the download on to a
+ * FetcherStatsCb, so that the signatures taking a FetcherProgressCb stay the
+ * same. Called as a plain FetcherProgressCb, it passes empty counters.
+ */
+struct WithDownloadStats {
+  void operator()(const Uptane::Target& target, const std::string& description, unsigned int progress) const {
+    stats_cb(target, description, progress, data::DownloadStats());
+  }
+  FetcherStatsCb stats_cb;
+};
+
+/** Call `progress_cb`, with `stats` if it is a WithDownloadStats. */
+inline void reportDownloadProgress(const FetcherProgressCb& progress_cb, const Uptane::Target& target,
+                                   const std::string& description, unsigned int progress,
+                                   const data::DownloadStats& stats) {
+  const auto* with_stats = progress_cb.target<WithDownloadStats>();
+  if (with_stats != nullptr) {
+    with_stats->stats_cb(target, description, progress, stats);
+  } else {
+    progress_cb(target, description, progress);
+  }
+}
+// Receives the downloaded image piece by piece; returning false aborts the download.
+using TargetChunkCb = std::function<bool(const uint8_t*, size_t)>;
 
 /**
  * Status of downloaded target.
@@ -62,6 +93,24 @@ class PackageManagerInterface {
   virtual void installNotify(const Uptane::Target& target) { (void)target; }
   virtual bool fetchTarget(const Uptane::Target& target, Uptane::Fetcher& fetcher, const KeyManager& keys,
                            const FetcherProgressCb& progress_cb, const api::FlowControlToken* token);
+  /**
+   * Download a binary target like fetchTarget(), also passing the image to
+   * `chunk_cb` as it arrives. The download always starts from the beginning
+   * and the image is only stored if `keep_copy` is set. Returns true without
+   * calling `chunk_cb` if the image is already stored.
+   */
+  bool fetchTargetStreaming(const Uptane::Target& target, Uptane::Fetcher& fetcher,
+                            const FetcherProgressCb& progress_cb, const TargetChunkCb& chunk_cb, bool keep_copy,
+                            const api::FlowControlToken* token);
+  /**
+   * Download a binary target in the background like fetchTarget(), at most at
+   * `max_bytes_per_sec` (0: no limit). The target is skipped if the stored
+   * files of the update that no ECU has installed would then take more than
+   * `quota` bytes (0: no limit). An interrupted prefetch is resumed by the
+   * next fetchTarget().
+   */
+  bool prefetchTarget(const Uptane::Target& target, Uptane::Fetcher& fetcher, uint64_t max_bytes_per_sec,
+                      uint64_t quota, const api::FlowControlToken* token);
   virtual TargetStatus verifyTarget(const Uptane::Target& target) const;
   virtual bool checkAvailableDiskSpace(uint64_t required_bytes) const;
   virtual boost::optional<std::pair<uintmax_t, std::string>> checkTargetFile(const Uptane::Target& target) const;
@@ -70,10 +119,42 @@ class PackageManagerInterface {
   virtual std::ifstream openTargetFile(const Uptane::Target& target) const;
   virtual void removeTargetFile(const Uptane::Target& target);
   virtual std::vector<Uptane::Target> getTargetFiles();
+  /**
+   * Remove the target files that no ECU has installed or pending and that the
+   * update in the stored Director Targets does not contain, least recently
+   * used first, until the store fits in `images_quota` bytes. Returns the
+   * number of bytes freed.
+   */
+  virtual uint64_t collectTargetGarbage();
 
  protected:
+  // Space that removing unused target files would free.
+  uint64_t reclaimableTargetSpace() const;
+
   PackageConfig config;
   std::shared_ptr<INvStorage> storage_;
   std::shared_ptr<HttpInterface> http_;
+
+ private:
+  struct StoredFile {
+    std::string name;
+    uint64_t size;
+    std::time_t last_used;
+  };
+  bool fetchTargetImpl(const Uptane::Target& target, Uptane::Fetcher& fetcher, const FetcherProgressCb& progress_cb,
+                       const api::FlowControlToken* token, const TargetChunkCb* chunk_cb, bool keep_copy,
+                       uint64_t max_bytes_per_sec = 0);
+  // Files that an ECU has installed or pending, and those of the update in the stored Director Targets or fetched
+  // since the last collection.
+  void usedTargetFiles(std::set<std::string>* installed, std::set<std::string>* update) const;
+  std::vector<StoredFile> unusedTargetFiles(uint64_t *total_size) const;
+  // Space taken by the stored files of the update that no ECU has installed, other than those of `except`.
+  uint64_t updateTargetSpace(const Uptane::Target& except) const;
+  // Frees space until the unused files fit in `quota` (0: no limit) and `required_bytes` fit on the disk.
+  uint64_t removeUnusedTargetFiles(uint64_t quota, uint64_t required_bytes);
+
+  // Files fetched since the last collection, kept until they have been installed.
+  std::set<std::string> pinned_files_;
+  mutable std::mutex gc_mutex_;
 };
 #endif  // PACKAGEMANAGERINTERFACE_H_
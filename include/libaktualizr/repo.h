@@ -3,6 +3,7 @@
 
 #include <fnmatch.h>
 #include <boost/filesystem/path.hpp>
+#include <map>
 #include <string>
 #include <utility>
 
@@ -44,19 +45,43 @@ class Repo {
   void refresh(const Uptane::Role &role);
   void rotate(const Uptane::Role &role, KeyType key_type = KeyType::kRSA2048);
   KeyPair getKey(const Uptane::Role &role) const { return keys_.at(role); }
+  /**
+   * Keep all subsequent metadata changes in memory instead of re-reading,
+   * re-signing and re-writing the affected files on every change.
+   */
+  void beginBatch();
+  /**
+   * Sign and write every role modified since beginBatch() exactly once, then
+   * update the Snapshot and Timestamp metadata.
+   */
+  void commitBatch();
 
  protected:
+  struct StagedRole {
+    boost::filesystem::path path;
+    Json::Value meta;
+    bool sign{true};
+    bool modified{false};
+    // Removed once the role has been written, e.g. the staged Director Targets.
+    boost::filesystem::path replaces;
+  };
   void generateRepoKeys(KeyType key_type);
   void generateKeyPair(KeyType key_type, const Uptane::Role &key_name);
   static std::string getExpirationTime(const std::string &expires);
   void readKeys();
   void updateRepo();
+  StagedRole *findStaged(const Uptane::Role &role);
+  StagedRole &stage(const Uptane::Role &role, StagedRole staged);
+  const Json::Value &readStaged(const Uptane::Role &role, const boost::filesystem::path &path);
+  Json::Value &modifyStaged(const Uptane::Role &role, const boost::filesystem::path &path);
   Uptane::RepositoryType repo_type_;
   boost::filesystem::path path_;
   boost::filesystem::path repo_dir_;
   std::string correlation_id_;
   std::string expiration_time_;
   std::map<Uptane::Role, KeyPair> keys_;
+  bool batching_{false};
+  std::map<Uptane::Role, StagedRole> staged_;
 
  private:
   void addDelegationToSnapshot(Json::Value *snapshot, const Uptane::Role &role);
@@ -23,12 +23,18 @@ class SecondaryProvider {
 
  private:
   SecondaryProvider(Config& config_in, std::shared_ptr<const INvStorage> storage_in,
-                    std::shared_ptr<const PackageManagerInterface> package_manager_in)
-      : config_(config_in), storage_(std::move(storage_in)), package_manager_(std::move(package_manager_in)) {}
+                    std::shared_ptr<const PackageManagerInterface> package_manager_in,
+                    std::string ostree_mirror_url_in)
+      : config_(config_in),
+        storage_(std::move(storage_in)),
+        package_manager_(std::move(package_manager_in)),
+        ostree_mirror_url_(std::move(ostree_mirror_url_in)) {}
 
   Config& config_;
   const std::shared_ptr<const INvStorage> storage_;
   const std::shared_ptr<const PackageManagerInterface> package_manager_;
+  // Sent to Secondaries instead of pacman.ostree_server when not empty.
+  const std::string ostree_mirror_url_;
 };
 
 #endif  // UPTANE_SECONDARY_PROVIDER_H
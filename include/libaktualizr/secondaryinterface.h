@@ -1,10 +1,57 @@
 #ifndef UPTANE_SECONDARYINTERFACE_H
 #define UPTANE_SECONDARYINTERFACE_H
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include "libaktualizr/secondary_provider.h"
 #include "libaktualizr/types.h"
+#include "libaktualizr/uptane/tuf.h"
+
+/**
+ * Receives the image of a target in consecutive pieces, see
+ * SecondaryInterface::openFirmwareWriter().
+ */
+class FirmwareWriter {
+ public:
+  FirmwareWriter() = default;
+  virtual ~FirmwareWriter() = default;
+  FirmwareWriter(const FirmwareWriter&) = delete;
+  FirmwareWriter(FirmwareWriter&&) = delete;
+  FirmwareWriter& operator=(const FirmwareWriter&) = delete;
+  FirmwareWriter& operator=(FirmwareWriter&&) = delete;
+
+  virtual data::InstallationResult write(const uint8_t* data, size_t size) = 0;
+};
+
+/**
+ * Metadata sent to all the Secondaries of an update, loaded once by the
+ * Primary for all of them. Secondaries can also share encodings of it, which
+ * are dropped with the cache at the end of the update.
+ */
+class UpdateMetadataCache {
+ public:
+  explicit UpdateMetadataCache(Uptane::MetaBundle bundle) : bundle_(std::move(bundle)) {}
+
+  const Uptane::MetaBundle& bundle() const { return bundle_; }
+  // Returns the encoding stored under `key`, made with `encode` by the first caller.
+  std::shared_ptr<const std::string> encoded(const std::string& key, const std::function<std::string()>& encode) const {
+    std::lock_guard<std::mutex> guard(m_);
+    auto& value = encoded_[key];
+    if (value == nullptr) {
+      value = std::make_shared<const std::string>(encode());
+    }
+    return value;
+  }
+
+ private:
+  const Uptane::MetaBundle bundle_;
+  mutable std::mutex m_;
+  mutable std::map<std::string, std::shared_ptr<const std::string>> encoded_;
+};
 
 class SecondaryInterface {
  public:
@@ -21,6 +68,12 @@ class SecondaryInterface {
 
   virtual Uptane::Manifest getManifest() const = 0;
   virtual data::InstallationResult putMetadata(const Uptane::Target& target) = 0;
+  // Same as putMetadata(), with the metadata that the Primary loaded for the
+  // whole update.
+  virtual data::InstallationResult putMetadataFrom(const UpdateMetadataCache& metadata, const Uptane::Target& target) {
+    (void)metadata;
+    return putMetadata(target);
+  }
   virtual bool ping() const = 0;
 
   // return 0 during initialization and -1 for error.
@@ -28,6 +81,13 @@ class SecondaryInterface {
   virtual data::InstallationResult putRoot(const std::string& root, bool director) = 0;
 
   virtual data::InstallationResult sendFirmware(const Uptane::Target& target) = 0;
+  // Lets the Primary send the image while it is still downloading it, instead
+  // of calling sendFirmware(). Only called after a successful putMetadata().
+  // Returns nullptr if the Secondary does not support it for this target.
+  virtual std::unique_ptr<FirmwareWriter> openFirmwareWriter(const Uptane::Target& target) {
+    (void)target;
+    return nullptr;
+  }
   virtual data::InstallationResult install(const Uptane::Target& target) = 0;
 
  protected:
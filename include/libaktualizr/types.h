@@ -3,6 +3,8 @@
 /** \file */
 
 #include <algorithm>
+#include <cstdint>
+#include <memory>
 #include <stdexcept>
 #include <unordered_map>
 
@@ -156,8 +158,13 @@ class PublicKey {
   // std::string can be implicitly converted to a Json::Value. Make sure that
   // the Json::Value constructor is not called accidentally.
   PublicKey(std::string);  // NOLINT(google-explicit-constructor, hicpp-explicit-conversions)
+  // Parsed form of value_, created on first use and shared between copies.
+  struct ParsedKey;
+  const ParsedKey &parsed() const;
+
   std::string value_;
   KeyType type_{KeyType::kUnknown};
+  std::shared_ptr<ParsedKey> parsed_;
 };
 
 /**
@@ -307,6 +314,15 @@ struct InstallationResult {
   std::string description;
 };
 
+/** Transfer counters behind a download progress report, zero when unknown. */
+struct DownloadStats {
+  uint64_t bytes_fetched{0};
+  uint64_t objects_fetched{0};
+  uint64_t objects_requested{0};
+  uint64_t delta_parts_fetched{0};
+  uint64_t delta_parts_total{0};
+};
+
 }  // namespace data
 
 namespace Uptane {
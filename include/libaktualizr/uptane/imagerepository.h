@@ -1,8 +1,11 @@
 #ifndef IMAGE_REPOSITORY_H_
 #define IMAGE_REPOSITORY_H_
 
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "libaktualizr/uptane/uptanerepository.h"
 
@@ -12,6 +15,16 @@ constexpr int kDelegationsMaxDepth = 5;
 
 class ImageRepository : public RepositoryCommon {
  public:
+  /**
+   * Snapshot and Targets metadata verifications since the repository was created. Metadata that is byte for byte
+   * what was verified before against the same Root is reused instead of being parsed and verified again.
+   */
+  struct VerifyStats {
+    uint64_t verified{0};
+    uint64_t reused{0};
+    std::chrono::microseconds time{0};
+  };
+
   ImageRepository() : RepositoryCommon(RepositoryType::Image()) {}
 
   void resetMeta();
@@ -34,7 +47,20 @@ class ImageRepository : public RepositoryCommon {
   void updateRoot(INvStorage& storage, const IMetadataFetcher& fetcher);
   void updateMeta(INvStorage& storage, const IMetadataFetcher& fetcher) override;
 
+  const VerifyStats& verifyStats() const { return verify_stats_; }
+
  private:
+  template <typename T>
+  struct Verified {
+    std::string raw_digest;
+    Root root;
+    std::vector<Hash> canonical_hashes;
+    T meta;
+  };
+
+  void checkRoleHashes(const std::vector<Hash>& hashes, const Uptane::Role& role, bool prefetch) const;
+  template <typename T>
+  bool isVerified(const Verified<T>& verified, const std::string& raw_digest, const std::vector<Hash>& expected) const;
   void checkTimestampExpired();
   void checkSnapshotExpired();
   int64_t snapshotSize() const { return timestamp.snapshot_size(); }
@@ -45,6 +71,10 @@ class ImageRepository : public RepositoryCommon {
   std::shared_ptr<Uptane::Targets> targets;
   Uptane::TimestampMeta timestamp;
   Uptane::Snapshot snapshot;
+
+  Verified<Uptane::Snapshot> verified_snapshot_;
+  Verified<std::shared_ptr<Uptane::Targets>> verified_targets_;
+  VerifyStats verify_stats_;
 };
 
 }  // namespace Uptane
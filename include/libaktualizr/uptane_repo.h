@@ -16,6 +16,14 @@ class UptaneRepo {
   void addCustomImage(const std::string &name, const Hash &hash, uint64_t length, const std::string &hardware_id,
                       const std::string &url = "", int32_t custom_version = 0, const Delegation &delegation = {},
                       const Json::Value &custom = {});
+  /**
+   * Add a binary delta target that turns the image at `source_path` into the one at `image_path`. ECUs report the
+   * result as the target `image_targetname`.
+   */
+  void addDeltaImage(const boost::filesystem::path &source_path, const boost::filesystem::path &image_path,
+                     const boost::filesystem::path &targetname, const std::string &image_targetname,
+                     const std::string &hardware_id, const std::string &url = "", int32_t custom_version = 0,
+                     const Delegation &delegation = {});
   void addDelegation(const Uptane::Role &name, const Uptane::Role &parent_role, const std::string &path,
                      bool terminating, KeyType key_type);
   void revokeDelegation(const Uptane::Role &name);
@@ -25,8 +33,16 @@ class UptaneRepo {
   void generateCampaigns();
   void refresh(Uptane::RepositoryType repo_type, const Uptane::Role &role);
   void rotate(Uptane::RepositoryType repo_type, const Uptane::Role &role, KeyType key_type = KeyType::kRSA2048);
+  /**
+   * Apply a manifest of `image`, `adddelegation`, `addtarget` and `signtargets`
+   * commands (one JSON object per line, with the same fields as the command
+   * line options) in a single pass. Images are hashed in parallel and every
+   * modified role is signed only once.
+   */
+  void applyBatch(const boost::filesystem::path &manifest_path);
 
  private:
+  boost::filesystem::path path_;
   DirectorRepo director_repo_;
   ImageRepo image_repo_;
 };
@@ -1,8 +1,29 @@
 #include "get.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <future>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
+#include "libaktualizr/crypto/crypto.h"
 #include "libaktualizr/crypto/keymanager.h"
 #include "libaktualizr/http/httpclient.h"
+#include "libaktualizr/logging/logging.h"
 #include "libaktualizr/storage/invstorage.h"
 
+// Files are not split into segments smaller than this.
+static constexpr uint64_t kMinSegmentSize = 1024 * 1024;
+// How much of an error response is kept for the error message.
+static constexpr size_t kMaxErrorBody = 4096;
+
 std::string aktualizrGet(Config &config, const std::string &url, const std::vector<std::string> &headers,
                          StorageClient storage_client) {
   auto storage = INvStorage::newStorage(config.storage, false, storage_client);
@@ -18,3 +39,264 @@ std::string aktualizrGet(Config &config, const std::string &url, const std::vect
   }
   return resp.body;
 }
+
+namespace {
+
+class ScopedFd {
+ public:
+  explicit ScopedFd(int fd) : fd_(fd) {}
+  ~ScopedFd() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+  ScopedFd(const ScopedFd &) = delete;
+  ScopedFd(ScopedFd &&) = delete;
+  ScopedFd &operator=(const ScopedFd &) = delete;
+  ScopedFd &operator=(ScopedFd &&) = delete;
+  int get() const { return fd_; }
+
+ private:
+  int fd_;
+};
+
+// Destination of one transfer. Segments are written at their offset with
+// pwrite(), everything else with write() so that stdout works too.
+struct StreamSink {
+  int fd{-1};
+  bool positional{false};
+  uint64_t offset{0};
+  MultiPartHasher *hasher{nullptr};
+  CurlHandler handle;
+  long http_status{0};  // NOLINT(google-runtime-int)
+  uint64_t written{0};
+  std::string error_body;
+  std::string write_error;
+};
+
+size_t writeToSink(char *data, size_t size, size_t nmemb, void *userp) {
+  auto *sink = static_cast<StreamSink *>(userp);
+  const size_t len = size * nmemb;
+  if (sink->http_status == 0) {
+    curl_easy_getinfo(sink->handle.get(), CURLINFO_RESPONSE_CODE, &sink->http_status);
+  }
+  if (sink->http_status != 200 && sink->http_status != 206) {
+    // Keep error pages out of the output.
+    sink->error_body.append(data, std::min(len, kMaxErrorBody - std::min(kMaxErrorBody, sink->error_body.size())));
+    return len;
+  }
+
+  size_t done = 0;
+  while (done < len) {
+    const ssize_t res =
+        sink->positional
+            ? pwrite(sink->fd, data + done, len - done, static_cast<off_t>(sink->offset + sink->written + done))
+            : write(sink->fd, data + done, len - done);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      sink->write_error = std::strerror(errno);
+      return 0;  // aborts the transfer
+    }
+    done += static_cast<size_t>(res);
+  }
+  if (sink->hasher != nullptr) {
+    sink->hasher->update(reinterpret_cast<const unsigned char *>(data), len);
+  }
+  sink->written += len;
+  return len;
+}
+
+std::unique_ptr<HttpClient> makeClient(const KeyManager &keys, const std::vector<std::string> &headers,
+                                       const std::set<std::string> *response_headers = nullptr) {
+  auto client = std_::make_unique<HttpClient>(&headers, response_headers);
+  keys.copyCertsToCurl(*client);
+  return client;
+}
+
+void checkResponse(const std::string &url, const HttpResponse &resp, const StreamSink &sink) {
+  if (!sink.write_error.empty()) {
+    throw std::runtime_error("Unable to write " + url + ": " + sink.write_error);
+  }
+  if (resp.curl_code != CURLE_OK) {
+    throw std::runtime_error("Unable to get " + url + ": " + resp.getStatusStr());
+  }
+  if (resp.http_status_code != 200 && resp.http_status_code != 206) {
+    throw std::runtime_error("Unable to get " + url + ": HTTP_" + std::to_string(resp.http_status_code) + "\n" +
+                             sink.error_body);
+  }
+}
+
+void hashFile(const boost::filesystem::path &path, uint64_t length, MultiPartHasher &hasher) {
+  std::ifstream file(path.string(), std::ios::binary);
+  std::array<char, 64 * 1024> buf{};
+  while (length > 0 && file.read(buf.data(), static_cast<std::streamsize>(std::min<uint64_t>(buf.size(), length)))) {
+    hasher.update(reinterpret_cast<const unsigned char *>(buf.data()), static_cast<uint64_t>(file.gcount()));
+    length -= static_cast<uint64_t>(file.gcount());
+  }
+  if (length > 0) {
+    throw std::runtime_error("Unable to read " + path.string());
+  }
+}
+
+uint64_t getSequential(HttpClient &client, const std::string &url, const boost::filesystem::path &output, bool resume,
+                       MultiPartHasher *hasher) {
+  const bool to_stdout = output == "-";
+  const int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (resume ? 0 : O_TRUNC);
+  ScopedFd fd(to_stdout ? -1 : open(output.c_str(), flags, 0644));
+  if (!to_stdout && fd.get() < 0) {
+    throw std::runtime_error("Unable to open " + output.string() + ": " + std::strerror(errno));
+  }
+  const int out_fd = to_stdout ? STDOUT_FILENO : fd.get();
+
+  curl_off_t from = 0;
+  if (resume) {
+    from = lseek(out_fd, 0, SEEK_END);
+    if (from > 0) {
+      LOG_INFO << "Resuming the download of " << url << " from byte " << from;
+      if (hasher != nullptr) {
+        hashFile(output, static_cast<uint64_t>(from), *hasher);
+      }
+    }
+  }
+
+  StreamSink sink;
+  sink.fd = out_fd;
+  sink.hasher = hasher;
+  HttpResponse resp = client.downloadAsync(url, writeToSink, nullptr, &sink, from, &sink.handle).get();
+  if (resp.curl_code == CURLE_RANGE_ERROR) {
+    LOG_WARNING << "The server doesn't support byte range requests, downloading " << url << " from the beginning";
+    if (ftruncate(out_fd, 0) != 0 || lseek(out_fd, 0, SEEK_SET) != 0) {
+      throw std::runtime_error("Unable to truncate " + output.string() + ": " + std::strerror(errno));
+    }
+    if (hasher != nullptr) {
+      hasher->reset();
+    }
+    from = 0;
+    sink = StreamSink();
+    sink.fd = out_fd;
+    sink.hasher = hasher;
+    resp = client.downloadAsync(url, writeToSink, nullptr, &sink, from, &sink.handle).get();
+  }
+  // A range starting at the end of the file: there is nothing left to fetch.
+  if (from > 0 && resp.curl_code == CURLE_OK && resp.http_status_code == 416) {
+    LOG_INFO << output.string() << " is already complete";
+  } else {
+    checkResponse(url, resp, sink);
+  }
+  return static_cast<uint64_t>(from) + sink.written;
+}
+
+// Size of the file at `url` if the server supports range requests, zero otherwise.
+uint64_t rangeSize(const KeyManager &keys, const std::vector<std::string> &headers, const std::string &url) {
+  std::vector<std::string> probe_headers(headers);
+  probe_headers.emplace_back("Range: bytes=0-0");
+  const std::set<std::string> response_headers{"content-range"};
+  auto client = makeClient(keys, probe_headers, &response_headers);
+  // Servers ignoring the range would send the whole file, hence the limit.
+  const HttpResponse resp = client->get(url, 1024);
+  const auto it = resp.headers.find("content-range");
+  if (resp.http_status_code != 206 || it == resp.headers.end()) {
+    return 0;
+  }
+  // "bytes 0-0/<size>", the size being "*" when unknown.
+  const auto slash = it->second.find('/');
+  if (slash == std::string::npos) {
+    return 0;
+  }
+  try {
+    return std::stoull(it->second.substr(slash + 1));
+  } catch (const std::exception &) {
+    return 0;
+  }
+}
+
+void getSegments(const KeyManager &keys, const std::vector<std::string> &headers, const std::string &url,
+                 const boost::filesystem::path &output, uint64_t size, unsigned int segments) {
+  ScopedFd fd(open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+  if (fd.get() < 0 || ftruncate(fd.get(), static_cast<off_t>(size)) != 0) {
+    throw std::runtime_error("Unable to create " + output.string() + ": " + std::strerror(errno));
+  }
+  LOG_INFO << "Downloading " << url << " in " << segments << " segments";
+
+  const uint64_t part = (size + segments - 1) / segments;
+  std::vector<std::unique_ptr<HttpClient>> clients;
+  std::vector<StreamSink> sinks(segments);
+  std::vector<std::future<HttpResponse>> responses;
+  for (unsigned int i = 0; i < segments && i * part < size; ++i) {
+    const uint64_t begin = i * part;
+    const uint64_t end = std::min(size, begin + part) - 1;
+    std::vector<std::string> segment_headers(headers);
+    segment_headers.push_back("Range: bytes=" + std::to_string(begin) + "-" + std::to_string(end));
+    clients.push_back(makeClient(keys, segment_headers));
+
+    StreamSink &sink = sinks[i];
+    sink.fd = fd.get();
+    sink.positional = true;
+    sink.offset = begin;
+    responses.push_back(clients.back()->downloadAsync(url, writeToSink, nullptr, &sink, 0, &sink.handle));
+  }
+
+  // Wait for all transfers before checking any, they write into `sinks`.
+  std::vector<HttpResponse> results;
+  for (auto &response : responses) {
+    results.push_back(response.get());
+  }
+  for (size_t i = 0; i < results.size(); ++i) {
+    checkResponse(url, results[i], sinks[i]);
+    const uint64_t expected = std::min(part, size - sinks[i].offset);
+    if (results[i].http_status_code != 206 || sinks[i].written != expected) {
+      throw std::runtime_error("Unexpected response to a range request for " + url + ": got " +
+                               std::to_string(sinks[i].written) + " bytes instead of " + std::to_string(expected));
+    }
+  }
+}
+
+}  // namespace
+
+uint64_t aktualizrGetToFile(Config &config, const std::string &url, const std::vector<std::string> &headers,
+                            const boost::filesystem::path &output, const StreamOptions &options,
+                            StorageClient storage_client) {
+  const bool to_stdout = output == "-";
+  if (to_stdout && options.resume) {
+    throw std::runtime_error("Cannot resume a download to stdout");
+  }
+
+  auto storage = INvStorage::newStorage(config.storage, false, storage_client);
+  storage->importData(config.import);
+  KeyManager keys(storage, config.keymanagerConfig());
+
+  std::unique_ptr<MultiPartHasher> hasher;
+  if (!options.sha256.empty()) {
+    hasher = std_::make_unique<MultiPartSHA256Hasher>();
+  }
+
+  // Segments are only used for new files: a partial file is resumed in one go.
+  const bool partial = options.resume && boost::filesystem::exists(output) && boost::filesystem::file_size(output) > 0;
+  uint64_t size = 0;
+  if (!to_stdout && !partial && options.segments > 1) {
+    size = rangeSize(keys, headers, url);
+  }
+  const auto segments = static_cast<unsigned int>(std::min<uint64_t>(options.segments, size / kMinSegmentSize));
+  if (segments > 1) {
+    getSegments(keys, headers, url, output, size, segments);
+    if (hasher) {
+      hashFile(output, size, *hasher);
+    }
+  } else {
+    auto client = makeClient(keys, headers);
+    size = getSequential(*client, url, output, options.resume, hasher.get());
+  }
+
+  if (hasher) {
+    const std::string digest = hasher->getHexDigest();
+    if (!boost::iequals(digest, options.sha256)) {
+      if (!to_stdout) {
+        boost::filesystem::remove(output);
+      }
+      throw std::runtime_error("The sha256 of " + url + " is " + digest + ", expected " + options.sha256);
+    }
+  }
+  return size;
+}
@@ -1,10 +1,32 @@
 #ifndef AKTUALIZR_GET_HELPERS
 #define AKTUALIZR_GET_HELPERS
 
+#include <boost/filesystem/path.hpp>
+
 #include "libaktualizr/config.h"
 #include "libaktualizr/storage/invstorage.h"
 
 std::string aktualizrGet(Config &config, const std::string &url, const std::vector<std::string> &headers,
                          StorageClient storage_client = StorageClient::kUptane);
 
+struct StreamOptions {
+  // Continue from the end of an existing output file with a range request.
+  bool resume{false};
+  // Expected sha256 of the whole file, in hex; not checked when empty.
+  std::string sha256;
+  // Number of concurrent range requests. Only used for new files whose size
+  // the server reports, and never for stdout.
+  unsigned int segments{1};
+};
+
+/**
+ * Write the body of `url` to `output` ("-" for stdout) as it arrives, without
+ * holding it in memory. Returns the size of the output file. Throws
+ * std::runtime_error on failure, removing the output file if its sha256 does
+ * not match.
+ */
+uint64_t aktualizrGetToFile(Config &config, const std::string &url, const std::vector<std::string> &headers,
+                            const boost::filesystem::path &output, const StreamOptions &options,
+                            StorageClient storage_client = StorageClient::kUptane);
+
 #endif  // AKTUALIZR_GET_HELPERS
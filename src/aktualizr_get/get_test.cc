@@ -17,6 +17,77 @@ TEST(aktualizr_get, good) {
   EXPECT_EQ("{\"path\": \"/path/1/2/3\"}", body);
 }
 
+// sha256 of the 100 MiB served at /large_file.
+static const std::string large_file_sha256 = "dd7bd1c37a3226e520b8d6939c30991b1c08772d5dab62b381c3a63541dc629a";
+static const uint64_t large_file_size = 100 * 1024 * 1024;
+
+/* The body is streamed to a file and its hash checked on the fly. */
+TEST(aktualizr_get, stream_to_file) {
+  Config config;
+  TemporaryDirectory dir;
+  config.storage.path = dir.Path();
+  const boost::filesystem::path output = dir / "large_file";
+
+  StreamOptions options;
+  options.sha256 = large_file_sha256;
+  std::vector<std::string> headers;
+  EXPECT_EQ(aktualizrGetToFile(config, server + "/large_file", headers, output, options), large_file_size);
+  EXPECT_EQ(boost::filesystem::file_size(output), large_file_size);
+}
+
+/* A partial file is completed with a range request. */
+TEST(aktualizr_get, stream_resume) {
+  Config config;
+  TemporaryDirectory dir;
+  config.storage.path = dir.Path();
+  const boost::filesystem::path output = dir / "large_file";
+  Utils::writeFile(output, std::string(12345, '@'));
+
+  StreamOptions options;
+  options.resume = true;
+  options.sha256 = large_file_sha256;
+  std::vector<std::string> headers;
+  EXPECT_EQ(aktualizrGetToFile(config, server + "/large_file", headers, output, options), large_file_size);
+  EXPECT_EQ(boost::filesystem::file_size(output), large_file_size);
+
+  // Nothing left to fetch.
+  EXPECT_EQ(aktualizrGetToFile(config, server + "/large_file", headers, output, options), large_file_size);
+}
+
+/* Large files are fetched with parallel range requests. */
+TEST(aktualizr_get, stream_segments) {
+  Config config;
+  TemporaryDirectory dir;
+  config.storage.path = dir.Path();
+  const boost::filesystem::path output = dir / "large_file";
+
+  StreamOptions options;
+  options.segments = 3;
+  options.sha256 = large_file_sha256;
+  std::vector<std::string> headers;
+  EXPECT_EQ(aktualizrGetToFile(config, server + "/large_file", headers, output, options), large_file_size);
+  EXPECT_EQ(boost::filesystem::file_size(output), large_file_size);
+
+  // The server does not support ranges here: one request is made instead.
+  options.sha256.clear();
+  EXPECT_EQ(aktualizrGetToFile(config, server + "/path/1/2/3", headers, output, options), 23U);
+  EXPECT_EQ(Utils::readFile(output), "{\"path\": \"/path/1/2/3\"}");
+}
+
+/* A file with the wrong hash is removed. */
+TEST(aktualizr_get, stream_bad_hash) {
+  Config config;
+  TemporaryDirectory dir;
+  config.storage.path = dir.Path();
+  const boost::filesystem::path output = dir / "file";
+
+  StreamOptions options;
+  options.sha256 = large_file_sha256;
+  std::vector<std::string> headers;
+  EXPECT_THROW(aktualizrGetToFile(config, server + "/path/1/2/3", headers, output, options), std::runtime_error);
+  EXPECT_FALSE(boost::filesystem::exists(output));
+}
+
 #ifndef __NO_MAIN__
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -36,7 +36,11 @@ bpo::variables_map parse_options(int argc, char **argv) {
       ("header,H", bpo::value<std::vector<std::string> >()->composing(), "Additional headers to pass")
       ("storage,s", bpo::value<std::string>(), "options: TUF(default), Uptane")
       ("loglevel", bpo::value<int>(), "set log level 0-5 (trace, debug, info, warning, error, fatal)")
-      ("url,u", bpo::value<std::string>(), "url to get, mandatory");
+      ("url,u", bpo::value<std::string>(), "url to get, mandatory")
+      ("output,o", bpo::value<boost::filesystem::path>(), "write the body to this file (\"-\" for stdout) as it arrives instead of buffering it")
+      ("resume", "continue a partial download in the --output file")
+      ("sha256", bpo::value<std::string>(), "expected sha256 of the body, checked while writing it to --output")
+      ("segments", bpo::value<unsigned int>()->default_value(1), "number of parallel range requests for a new --output file");
 
   // clang-format on
 
@@ -61,11 +65,15 @@ bpo::variables_map parse_options(int argc, char **argv) {
 }
 
 int main(int argc, char *argv[]) {
+  bpo::variables_map commandline_map = parse_options(argc, argv);
+
+  // Keep the log out of a body streamed to stdout.
+  if (commandline_map.count("output") != 0 && commandline_map["output"].as<boost::filesystem::path>() == "-") {
+    setenv("LOG_STDERR", "1", 0);
+  }
   logger_init(isatty(1) == 1);
   logger_set_threshold(boost::log::trivial::info);
 
-  bpo::variables_map commandline_map = parse_options(argc, argv);
-
   int r = EXIT_FAILURE;
   try {
     Config config(commandline_map);
@@ -79,8 +87,23 @@ int main(int argc, char *argv[]) {
         client = StorageClient::kUptane;
       }
     }
-    std::string body = aktualizrGet(config, commandline_map["url"].as<std::string>(), headers, client);
-    std::cout << body;
+    const auto url = commandline_map["url"].as<std::string>();
+    if (commandline_map.count("output") != 0) {
+      StreamOptions options;
+      options.resume = commandline_map.count("resume") != 0;
+      if (commandline_map.count("sha256") != 0) {
+        options.sha256 = commandline_map["sha256"].as<std::string>();
+      }
+      options.segments = commandline_map["segments"].as<unsigned int>();
+      aktualizrGetToFile(config, url, headers, commandline_map["output"].as<boost::filesystem::path>(), options,
+                         client);
+    } else {
+      if (commandline_map.count("resume") != 0 || commandline_map.count("sha256") != 0) {
+        throw std::runtime_error("--resume and --sha256 require --output");
+      }
+      std::string body = aktualizrGet(config, url, headers, client);
+      std::cout << body;
+    }
 
     r = EXIT_SUCCESS;
   } catch (const std::exception &ex) {
@@ -56,6 +56,7 @@ void AktualizrInfoConfig::updateFromPropertyTree(const boost::property_tree::ptr
   CopySubtreeFromConfig(pacman, "pacman", pt);
   CopySubtreeFromConfig(storage, "storage", pt);
   CopySubtreeFromConfig(storage, "uptane", pt);
+  CopySubtreeFromConfig(metrics, "metrics", pt);
 }
 
 void AktualizrInfoConfig::writeToStream(std::ostream& sink) const {
@@ -66,6 +67,7 @@ void AktualizrInfoConfig::writeToStream(std::ostream& sink) const {
   WriteSectionToStream(pacman, "pacman", sink);
   WriteSectionToStream(storage, "storage", sink);
   WriteSectionToStream(storage, "uptane", sink);
+  WriteSectionToStream(metrics, "metrics", sink);
 }
 
 std::ostream& operator<<(std::ostream& os, const AktualizrInfoConfig& cfg) {
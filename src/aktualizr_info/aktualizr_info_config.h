@@ -28,6 +28,7 @@ class AktualizrInfoConfig : public BaseConfig {
   PackageConfig pacman;
   StorageConfig storage;
   UptaneConfig uptane;
+  MetricsConfig metrics;
 
  private:
   void updateFromCommandLine(const boost::program_options::variables_map& cmd);
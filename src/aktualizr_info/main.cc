@@ -12,6 +12,7 @@
 #include "libaktualizr/storage/invstorage.h"
 #include "libaktualizr/utilities/aktualizr_version.h"
 #include "storage/sql_utils.h"
+#include "utilities/metrics_server.h"
 
 namespace bpo = boost::program_options;
 
@@ -74,7 +75,8 @@ int main(int argc, char **argv) {
     ("director-targets",  "Outputs targets.json from Director repo")
     ("root-version",  bpo::value<int>(), "Use with --image-root or --director-root to specify the version to output")
     ("allow-migrate", "Opens database in read/write mode to make possible to migrate database if needed")
-    ("wait-until-provisioned", "Outputs metadata when device already provisioned");
+    ("wait-until-provisioned", "Outputs metadata when device already provisioned")
+    ("metrics", "Outputs the performance metrics of the running aktualizr daemon");
   // Support old names and variations due to common typos.
   hidden.add_options()
     ("images-root",  "Outputs root.json from Image repo")
@@ -107,6 +109,16 @@ int main(int argc, char **argv) {
 
     AktualizrInfoConfig config(vm);
 
+    // The metrics come from the running daemon, not from the storage.
+    if (vm.count("metrics") != 0U) {
+      if (config.metrics.socket_path.empty()) {
+        std::cerr << "The metrics endpoint is not configured, see socket_path in the [metrics] section" << std::endl;
+        return EXIT_FAILURE;
+      }
+      std::cout << metrics::readFromSocket(config.metrics.socket_path);
+      return EXIT_SUCCESS;
+    }
+
     bool secondary_db = false;
 
     bool readonly = true;
@@ -4,6 +4,7 @@
 #include "libaktualizr/aktualizr.h"
 #include "metafake.h"
 #include "secondary.h"
+#include "test_utils.h"
 #include "uptane_test_common.h"
 #include "libaktualizr/utilities/utils.h"
 
@@ -94,6 +95,60 @@ TEST(PrimarySecondaryReg, SecondariesMigration) {
   }
 }
 
+/* Stored IP Secondaries that cannot be reached are all contacted in parallel,
+ * each with its own timeout, and then kept with their stored information. */
+TEST(PrimarySecondaryReg, StoredSecondariesUnreachable) {
+  const Uptane::EcuSerial primary_serial{"p_serial"};
+  const Uptane::HardwareIdentifier primary_hwid{"p_hwid"};
+  const size_t num_secondaries = 4;
+
+  TemporaryDirectory temp_dir;
+  auto http = std::make_shared<HttpFake>(temp_dir.Path(), "noupdates", fake_meta_dir);
+  Config conf = UptaneTestCommon::makeTestConfig(temp_dir, http->tls_server);
+  conf.provision.primary_ecu_serial = primary_serial.ToString();
+  conf.provision.primary_ecu_hardware_id = primary_hwid.ToString();
+  const boost::filesystem::path sec_conf_path = temp_dir / "s_config.json";
+  conf.uptane.secondary_config_file = sec_conf_path;
+
+  auto storage = INvStorage::newStorage(conf.storage);
+  storage->storeDeviceId("device");
+  EcuSerials serials{{primary_serial, primary_hwid}};
+  Json::Value sec_conf;
+  sec_conf["IP"]["secondaries_wait_port"] = TestUtils::getFreePortAsInt();
+  sec_conf["IP"]["secondaries_wait_timeout"] = 1;
+  sec_conf["IP"]["secondaries_discovery_threads"] = 2;
+  sec_conf["IP"]["secondaries_discovery_timeout"] = 1;
+  sec_conf["IP"]["secondaries"] = Json::arrayValue;
+  std::vector<std::string> extras;
+  for (size_t i = 0; i < num_secondaries; ++i) {
+    const Uptane::EcuSerial serial{"s_serial" + std::to_string(i)};
+    serials.emplace_back(serial, Uptane::HardwareIdentifier("s_hwid"));
+    const std::string port = TestUtils::getFreePort();
+    Json::Value sec;
+    sec["addr"] = "127.0.0.1:" + port;
+    sec_conf["IP"]["secondaries"].append(sec);
+    extras.push_back(R"({"ip":"127.0.0.1","port":)" + port + R"(,"verification_type":"Full"})");
+  }
+  storage->storeEcuSerials(serials);
+  storage->storeEcuRegistered();
+  for (size_t i = 0; i < num_secondaries; ++i) {
+    storage->saveSecondaryInfo(serials[i + 1].first, "IP", PublicKey("", KeyType::kUnknown));
+    storage->saveSecondaryData(serials[i + 1].first, extras[i]);
+  }
+  Utils::writeFile(sec_conf_path, sec_conf);
+
+  UptaneTestCommon::TestAktualizr aktualizr(conf, storage, http);
+  Primary::initSecondaries(aktualizr, sec_conf_path);
+
+  std::vector<SecondaryInfo> secs_info;
+  storage->loadSecondariesInfo(&secs_info);
+  ASSERT_EQ(secs_info.size(), num_secondaries);
+  for (size_t i = 0; i < num_secondaries; ++i) {
+    EXPECT_EQ(secs_info[i].serial, serials[i + 1].first);
+    EXPECT_EQ(secs_info[i].extra, extras[i]);
+  }
+}
+
 /*
  * Register Virtual Secondaries via json configuration.
  * Reject multiple Secondaries with the same serial.
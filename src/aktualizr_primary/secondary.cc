@@ -6,6 +6,8 @@
 #include <boost/filesystem.hpp>
 
 #include <algorithm>
+#include <chrono>
+#include <future>
 #include <unordered_map>
 
 #include "ipuptanesecondary.h"
@@ -13,6 +15,7 @@
 #include "secondary.h"
 #include "secondary_config.h"
 #include "libaktualizr/utilities/utils.h"
+#include "utilities/thread_pool.h"
 
 namespace Primary {
 
@@ -68,6 +71,13 @@ void initSecondaries(Aktualizr& aktualizr, const boost::filesystem::path& config
   }
 }
 
+static void applyIPSecondaryConfig(const SecondaryInterface::Ptr& secondary, const IPSecondaryConfig& cfg) {
+  auto ip_secondary = std::dynamic_pointer_cast<Uptane::IpUptaneSecondary>(secondary);
+  if (ip_secondary != nullptr) {
+    ip_secondary->setCompressionLevel(cfg.compression_level);
+  }
+}
+
 class SecondaryWaiter {
  public:
   SecondaryWaiter(Aktualizr& aktualizr, uint16_t wait_port, int timeout_s, Secondaries& secondaries)
@@ -77,9 +87,7 @@ class SecondaryWaiter {
         timer_{io_context_},
         connected_secondaries_{secondaries} {}
 
-  void addSecondary(const std::string& ip, uint16_t port, VerificationType verification_type) {
-    secondaries_to_wait_for_.insert({key(ip, port), verification_type});
-  }
+  void addSecondary(const IPSecondaryConfig& cfg) { secondaries_to_wait_for_.insert({key(cfg.ip, cfg.port), cfg}); }
 
   void wait() {
     if (secondaries_to_wait_for_.empty()) {
@@ -120,14 +128,16 @@ class SecondaryWaiter {
 
       LOG_INFO << "Accepted connection from a Secondary: (" << sec_ip << ":" << sec_port << ")";
       try {
-        auto secondary = Uptane::IpUptaneSecondary::create(sec_ip, sec_port, it->second, con_socket_.native_handle());
+        auto secondary = Uptane::IpUptaneSecondary::create(sec_ip, sec_port, it->second.verification_type,
+                                                           con_socket_.native_handle());
         if (secondary) {
+          applyIPSecondaryConfig(secondary, it->second);
           connected_secondaries_.push_back(secondary);
           // set ip/port in the db so that we can match everything later
           Json::Value d;
           d["ip"] = sec_ip;
           d["port"] = sec_port;
-          d["verification_type"] = Uptane::VerificationTypeToString(it->second);
+          d["verification_type"] = Uptane::VerificationTypeToString(it->second.verification_type);
           aktualizr_.SetSecondaryData(secondary->getSerial(), Utils::jsonToCanonicalStr(d));
         }
       } catch (const std::exception& exc) {
@@ -159,7 +169,7 @@ class SecondaryWaiter {
   boost::asio::deadline_timer timer_;
 
   Secondaries& connected_secondaries_;
-  std::unordered_map<std::string, VerificationType> secondaries_to_wait_for_;
+  std::unordered_map<std::string, IPSecondaryConfig> secondaries_to_wait_for_;
 };
 
 // Four options for each Secondary:
@@ -168,13 +178,17 @@ class SecondaryWaiter {
 // cause re-registration.
 // 3. Same as 2 but cannot connect: abort.
 // 4. Secondary is stored but not configured: it must have been removed. Skip it. This will cause re-registration.
+//
+// The Secondaries are matched to the storage one after the other, then all of
+// them are contacted in parallel.
 static Secondaries createIPSecondaries(const IPSecondariesConfig& config, Aktualizr& aktualizr) {
   Secondaries result;
   SecondaryWaiter sec_waiter{aktualizr, config.secondaries_wait_port, config.secondaries_timeout_s, result};
   auto secondaries_info = aktualizr.GetSecondaries();
 
+  // The stored information of each configured Secondary, or nullptr if it is new.
+  std::vector<const SecondaryInfo*> stored_info;
   for (const auto& cfg : config.secondaries_cfg) {
-    SecondaryInterface::Ptr secondary;
     const SecondaryInfo* info = nullptr;
 
     // Try to match the configured Secondaries to stored Secondaries.
@@ -197,13 +211,56 @@ static Secondaries createIPSecondaries(const IPSecondariesConfig& config, Aktual
       d["verification_type"] = Uptane::VerificationTypeToString(cfg.verification_type);
       aktualizr.SetSecondaryData(info->serial, Utils::jsonToCanonicalStr(d));
       LOG_INFO << "Migrated a single IP Secondary to new storage format.";
-    } else if (f == secondaries_info.cend()) {
+    } else if (f != secondaries_info.cend()) {
+      // The configured Secondary was found in storage.
+      info = &(*f);
+    }
+    stored_info.push_back(info);
+  }
+
+  const std::chrono::milliseconds timeout{std::chrono::seconds(config.discovery_timeout_s)};
+  const auto discovery_start = std::chrono::steady_clock::now();
+  std::vector<std::future<SecondaryInterface::Ptr>> discovered;
+  {
+    ThreadPool pool(std::max<size_t>(1, std::min(config.discovery_threads, config.secondaries_cfg.size())));
+    for (size_t i = 0; i < config.secondaries_cfg.size(); ++i) {
+      const IPSecondaryConfig& cfg = config.secondaries_cfg[i];
+      const SecondaryInfo* info = stored_info[i];
+      discovered.push_back(pool.submit([&cfg, info, timeout]() -> SecondaryInterface::Ptr {
+        const auto start = std::chrono::steady_clock::now();
+        SecondaryInterface::Ptr secondary;
+        if (info == nullptr) {
+          secondary = Uptane::IpUptaneSecondary::connectAndCreate(cfg.ip, cfg.port, cfg.verification_type, timeout);
+        } else {
+          secondary = Uptane::IpUptaneSecondary::connectAndCheck(cfg.ip, cfg.port, cfg.verification_type,
+                                                                 info->serial, info->hw_id, info->pub_key, timeout);
+        }
+        if (secondary != nullptr) {
+          applyIPSecondaryConfig(secondary, cfg);
+        }
+        const auto elapsed =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        LOG_INFO << "Contacting IP Secondary at " << cfg.ip << ":" << cfg.port << " took " << elapsed.count()
+                 << " ms";
+        return secondary;
+      }));
+    }
+  }
+  LOG_INFO << "Contacted " << config.secondaries_cfg.size() << " IP Secondaries in "
+           << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - discovery_start)
+                  .count()
+           << " ms";
+
+  for (size_t i = 0; i < config.secondaries_cfg.size(); ++i) {
+    const IPSecondaryConfig& cfg = config.secondaries_cfg[i];
+    SecondaryInterface::Ptr secondary = discovered[i].get();
+
+    if (stored_info[i] == nullptr) {
       // Secondary was not found in storage; it must be new.
-      secondary = Uptane::IpUptaneSecondary::connectAndCreate(cfg.ip, cfg.port, cfg.verification_type);
       if (secondary == nullptr) {
         LOG_DEBUG << "Could not connect to IP Secondary at " << cfg.ip << ":" << cfg.port
                   << "; now trying to wait for it.";
-        sec_waiter.addSecondary(cfg.ip, cfg.port, cfg.verification_type);
+        sec_waiter.addSecondary(cfg);
       } else {
         result.push_back(secondary);
         // set ip/port in the db so that we can match everything later
@@ -214,18 +271,11 @@ static Secondaries createIPSecondaries(const IPSecondariesConfig& config, Aktual
         aktualizr.SetSecondaryData(secondary->getSerial(), Utils::jsonToCanonicalStr(d));
       }
       continue;
-    } else {
-      // The configured Secondary was found in storage.
-      info = &(*f);
     }
 
     if (secondary == nullptr) {
-      secondary = Uptane::IpUptaneSecondary::connectAndCheck(cfg.ip, cfg.port, cfg.verification_type, info->serial,
-                                                             info->hw_id, info->pub_key);
-      if (secondary == nullptr) {
-        throw std::runtime_error("Unable to connect to or verify IP Secondary at " + cfg.ip + ":" +
-                                 std::to_string(cfg.port));
-      }
+      throw std::runtime_error("Unable to connect to or verify IP Secondary at " + cfg.ip + ":" +
+                               std::to_string(cfg.port));
     }
 
     result.push_back(secondary);
@@ -1,4 +1,5 @@
 #include <boost/filesystem.hpp>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <unordered_map>
@@ -96,6 +97,14 @@ void JsonConfigParser::createIPSecondariesCfg(Configs& configs, const Json::Valu
   auto resultant_cfg = std::make_shared<IPSecondariesConfig>(
       static_cast<uint16_t>(json_ip_sec_cfg[IPSecondariesConfig::PortField].asUInt()),
       json_ip_sec_cfg[IPSecondariesConfig::TimeoutField].asInt());
+  if (json_ip_sec_cfg.isMember(IPSecondariesConfig::DiscoveryThreadsField)) {
+    resultant_cfg->discovery_threads =
+        std::max(1U, json_ip_sec_cfg[IPSecondariesConfig::DiscoveryThreadsField].asUInt());
+  }
+  if (json_ip_sec_cfg.isMember(IPSecondariesConfig::DiscoveryTimeoutField)) {
+    resultant_cfg->discovery_timeout_s =
+        std::max(0, json_ip_sec_cfg[IPSecondariesConfig::DiscoveryTimeoutField].asInt());
+  }
   auto secondaries = json_ip_sec_cfg[IPSecondariesConfig::SecondariesField];
 
   LOG_INFO << "Found IP secondaries config: " << *resultant_cfg;
@@ -107,7 +116,11 @@ void JsonConfigParser::createIPSecondariesCfg(Configs& configs, const Json::Valu
     if (secondary.isMember(IPSecondaryConfig::VerificationField)) {
       vtype = Uptane::VerificationTypeFromString(secondary[IPSecondaryConfig::VerificationField].asString());
     }
-    IPSecondaryConfig sec_cfg{addr.first, addr.second, vtype};
+    int compression_level = 0;
+    if (secondary.isMember(IPSecondaryConfig::CompressionLevelField)) {
+      compression_level = std::min(std::max(0, secondary[IPSecondaryConfig::CompressionLevelField].asInt()), 9);
+    }
+    IPSecondaryConfig sec_cfg{addr.first, addr.second, vtype, compression_level};
 
     LOG_INFO << "   found IP secondary config: " << sec_cfg;
     resultant_cfg->secondaries_cfg.push_back(sec_cfg);
@@ -17,18 +17,26 @@ class IPSecondaryConfig {
  public:
   static constexpr const char* const AddrField{"addr"};
   static constexpr const char* const VerificationField{"verification_type"};
+  static constexpr const char* const CompressionLevelField{"compression_level"};
 
-  IPSecondaryConfig(std::string addr_ip, uint16_t addr_port, VerificationType verification_type_in)
-      : ip(std::move(addr_ip)), port(addr_port), verification_type(verification_type_in) {}
+  IPSecondaryConfig(std::string addr_ip, uint16_t addr_port, VerificationType verification_type_in,
+                    int compression_level_in = 0)
+      : ip(std::move(addr_ip)),
+        port(addr_port),
+        verification_type(verification_type_in),
+        compression_level(compression_level_in) {}
 
   friend std::ostream& operator<<(std::ostream& os, const IPSecondaryConfig& cfg) {
-    os << "(addr: " << cfg.ip << ":" << cfg.port << " verification_type: " << cfg.verification_type << ")";
+    os << "(addr: " << cfg.ip << ":" << cfg.port << " verification_type: " << cfg.verification_type
+       << " compression_level: " << cfg.compression_level << ")";
     return os;
   }
 
   const std::string ip;
   const uint16_t port;
   const VerificationType verification_type;
+  // Deflate level (1-9) of the images sent to the Secondary; 0 disables compression.
+  const int compression_level;
 };
 
 class IPSecondariesConfig : public SecondaryConfig {
@@ -37,17 +45,24 @@ class IPSecondariesConfig : public SecondaryConfig {
   static constexpr const char* const PortField{"secondaries_wait_port"};
   static constexpr const char* const TimeoutField{"secondaries_wait_timeout"};
   static constexpr const char* const SecondariesField{"secondaries"};
+  static constexpr const char* const DiscoveryThreadsField{"secondaries_discovery_threads"};
+  static constexpr const char* const DiscoveryTimeoutField{"secondaries_discovery_timeout"};
 
   IPSecondariesConfig(const uint16_t wait_port, const int timeout_s)
       : SecondaryConfig(Type), secondaries_wait_port{wait_port}, secondaries_timeout_s{timeout_s} {}
 
   friend std::ostream& operator<<(std::ostream& os, const IPSecondariesConfig& cfg) {
-    os << "(wait_port: " << cfg.secondaries_wait_port << " timeout_s: " << cfg.secondaries_timeout_s << ")";
+    os << "(wait_port: " << cfg.secondaries_wait_port << " timeout_s: " << cfg.secondaries_timeout_s
+       << " discovery_threads: " << cfg.discovery_threads << " discovery_timeout_s: " << cfg.discovery_timeout_s << ")";
     return os;
   }
 
   const uint16_t secondaries_wait_port;
   const int secondaries_timeout_s;
+  // Secondaries are contacted in parallel at startup, each one with its own
+  // timeout; 0 means no timeout.
+  size_t discovery_threads{8};
+  int discovery_timeout_s{30};
   std::vector<IPSecondaryConfig> secondaries_cfg;
 };
 
@@ -1,6 +1,7 @@
 #include "aktualizr_secondary.h"
 
 #include <sys/types.h>
+#include <chrono>
 #include <memory>
 
 #include <boost/lexical_cast.hpp>
@@ -13,6 +14,7 @@
 #include "libaktualizr/utilities/utils.h"
 #include "update_agent.h"
 #include "uptane/manifest.h"
+#include "utilities/binary_delta.h"
 
 AktualizrSecondary::AktualizrSecondary(AktualizrSecondaryConfig config, std::shared_ptr<INvStorage> storage)
     : config_(std::move(config)),
@@ -52,13 +54,15 @@ data::InstallationResult AktualizrSecondary::install() {
 
   switch (result.result_code.num_code) {
     case data::ResultCode::Numeric::kOk: {
-      storage_->saveInstalledVersion(ecu_serial_.ToString(), pending_target_, InstalledVersionUpdateMode::kCurrent);
+      storage_->saveInstalledVersion(ecu_serial_.ToString(), binary_delta::installedTarget(pending_target_),
+                                    InstalledVersionUpdateMode::kCurrent);
       pending_target_ = Uptane::Target::Unknown();
       LOG_INFO << "The target has been successfully installed: " << target_name;
       break;
     }
     case data::ResultCode::Numeric::kNeedCompletion: {
-      storage_->saveInstalledVersion(ecu_serial_.ToString(), pending_target_, InstalledVersionUpdateMode::kPending);
+      storage_->saveInstalledVersion(ecu_serial_.ToString(), binary_delta::installedTarget(pending_target_),
+                                    InstalledVersionUpdateMode::kPending);
       LOG_INFO << "The target has been successfully installed, but a reboot is required to be applied: " << target_name;
       break;
     }
@@ -76,6 +80,8 @@ data::InstallationResult AktualizrSecondary::verifyMetadata(const Uptane::Second
   // 1. Load and verify the current time or the most recent securely attested time.
   //    We trust the time that the given system/ECU provides.
   TimeStamp now(TimeStamp::Now());
+  const auto start = std::chrono::steady_clock::now();
+  const auto image_stats = image_repo_.verifyStats();
 
   if (config_.uptane.verification_type == VerificationType::kFull) {
     // 2. Download and check the Root metadata file from the Director repository.
@@ -102,6 +108,11 @@ data::InstallationResult AktualizrSecondary::verifyMetadata(const Uptane::Second
     return data::InstallationResult(data::ResultCode::Numeric::kVerificationFailed,
                                     std::string("Failed to update Image repo metadata: ") + e.what());
   }
+  const auto& stats = image_repo_.verifyStats();
+  LOG_INFO << "Metadata checked in "
+           << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+           << " ms; Image repo Snapshot and Targets verified: " << stats.verified - image_stats.verified
+           << ", unchanged: " << stats.reused - image_stats.reused;
 
   data::InstallationResult result = findTargets();
   if (result.isSuccess()) {
@@ -22,6 +22,7 @@ class AktualizrSecondary : public MsgDispatcher {
   PublicKey publicKey() const;
   Uptane::Manifest getManifest() const;
   const Uptane::Target& getPendingTarget() const { return pending_target_; }
+  const Uptane::ImageRepository::VerifyStats& imageRepoVerifyStats() const { return image_repo_.verifyStats(); }
 
   virtual data::InstallationResult putMetadata(const Uptane::SecondaryMetadata& metadata);
   virtual data::InstallationResult putMetadata(const Uptane::MetaBundle& meta_bundle) {
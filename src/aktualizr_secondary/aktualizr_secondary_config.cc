@@ -32,6 +32,8 @@ void AktualizrSecondaryUptaneConfig::updateFromPropertyTree(const boost::propert
   CopyFromConfig(key_type, "key_type", pt);
   CopyFromConfig(force_install_completion, "force_install_completion", pt);
   CopyFromConfig(verification_type, "verification_type", pt);
+  CopyFromConfig(image_partitions, "image_partitions", pt);
+  CopyFromConfig(image_direct_io, "image_direct_io", pt);
 }
 
 void AktualizrSecondaryUptaneConfig::writeToStream(std::ostream& out_stream) const {
@@ -41,6 +43,8 @@ void AktualizrSecondaryUptaneConfig::writeToStream(std::ostream& out_stream) con
   writeOption(out_stream, key_type, "key_type");
   writeOption(out_stream, force_install_completion, "force_install_completion");
   writeOption(out_stream, verification_type, "verification_type");
+  writeOption(out_stream, image_partitions, "image_partitions");
+  writeOption(out_stream, image_direct_io, "image_direct_io");
 }
 
 AktualizrSecondaryConfig::AktualizrSecondaryConfig(const boost::program_options::variables_map& cmd) {
@@ -31,6 +31,9 @@ struct AktualizrSecondaryUptaneConfig {
   KeyType key_type{KeyType::kRSA2048};
   bool force_install_completion{false};
   VerificationType verification_type{VerificationType::kFull};
+  // Two comma-separated A/B partitions that file updates are written to directly.
+  std::string image_partitions;
+  bool image_direct_io{false};
 
   void updateFromPropertyTree(const boost::property_tree::ptree& pt);
   void writeToStream(std::ostream& out_stream) const;
@@ -1,9 +1,14 @@
 #include "aktualizr_secondary_file.h"
 
+#include <boost/algorithm/string.hpp>
+
+#include "image_sink_partition.h"
 #include "libaktualizr/storage/invstorage.h"
 #include "update_agent_file.h"
+#include "utilities/compression.h"
 
 const std::string AktualizrSecondaryFile::FileUpdateDefaultFile{"firmware.txt"};
+const std::string AktualizrSecondaryFile::PartitionStateFile{"image_partitions.json"};
 
 AktualizrSecondaryFile::AktualizrSecondaryFile(const AktualizrSecondaryConfig& config)
     : AktualizrSecondaryFile(config, INvStorage::newStorage(config.storage)) {}
@@ -12,8 +17,15 @@ AktualizrSecondaryFile::AktualizrSecondaryFile(const AktualizrSecondaryConfig& c
                                                std::shared_ptr<INvStorage> storage,
                                                std::shared_ptr<FileUpdateAgent> update_agent)
     : AktualizrSecondary(config, std::move(storage)), update_agent_{std::move(update_agent)} {
+  registerHandler(AKIpUptaneMes_PR_uploadStartReq, std::bind(&AktualizrSecondaryFile::uploadStartHdlr, this,
+                                                             std::placeholders::_1, std::placeholders::_2));
   registerHandler(AKIpUptaneMes_PR_uploadDataReq, std::bind(&AktualizrSecondaryFile::uploadDataHdlr, this,
                                                             std::placeholders::_1, std::placeholders::_2));
+  registerHandler(AKIpUptaneMes_PR_uploadCompressionReq, std::bind(&AktualizrSecondaryFile::uploadCompressionHdlr, this,
+                                                                   std::placeholders::_1, std::placeholders::_2));
+  registerHandler(AKIpUptaneMes_PR_uploadCompressedDataReq,
+                  std::bind(&AktualizrSecondaryFile::uploadCompressedDataHdlr, this, std::placeholders::_1,
+                            std::placeholders::_2));
   if (!update_agent_) {
     std::string current_target_name;
 
@@ -28,12 +40,37 @@ AktualizrSecondaryFile::AktualizrSecondaryFile(const AktualizrSecondaryConfig& c
       current_target_name = "unknown";
     }
 
-    update_agent_ = std::make_shared<FileUpdateAgent>(config.storage.path / FileUpdateDefaultFile, current_target_name);
+    if (config.uptane.image_partitions.empty()) {
+      update_agent_ =
+          std::make_shared<FileUpdateAgent>(config.storage.path / FileUpdateDefaultFile, current_target_name);
+    } else {
+      std::vector<std::string> partitions;
+      boost::split(partitions, config.uptane.image_partitions, boost::is_any_of(","));
+      std::vector<boost::filesystem::path> slots;
+      for (const auto& partition : partitions) {
+        slots.emplace_back(boost::algorithm::trim_copy(partition));
+      }
+      auto sink = std::make_shared<PartitionImageSink>(std::move(slots), config.storage.path / PartitionStateFile,
+                                                       config.uptane.image_direct_io);
+      update_agent_ = std::make_shared<FileUpdateAgent>(sink, current_target_name);
+    }
   }
 }
 
+AktualizrSecondaryFile::~AktualizrSecondaryFile() = default;
+
 void AktualizrSecondaryFile::initialize() { initPendingTargetIfAny(); }
 
+data::InstallationResult AktualizrSecondaryFile::putMetadata(const Uptane::SecondaryMetadata& metadata) {
+  const Uptane::Target previous_target = getPendingTarget();
+  auto result = AktualizrSecondary::putMetadata(metadata);
+  // Only the upload of the same target can be resumed.
+  if (!result.isSuccess() || !getPendingTarget().MatchTarget(previous_target)) {
+    update_agent_->discardReceivedData();
+  }
+  return result;
+}
+
 data::InstallationResult AktualizrSecondaryFile::receiveData(const uint8_t* data, size_t size) {
   if (!getPendingTarget().IsValid()) {
     LOG_ERROR << "Aborting image download; no valid target found.";
@@ -62,9 +99,34 @@ data::InstallationResult AktualizrSecondaryFile::installPendingTarget(const Upta
 
 void AktualizrSecondaryFile::completeInstall() { return update_agent_->completeInstall(); }
 
+MsgHandler::ReturnCode AktualizrSecondaryFile::uploadStartHdlr(Asn1Message& in_msg, Asn1Message& out_msg) {
+  (void)in_msg;
+  uint64_t offset = 0;
+  if (getPendingTarget().IsValid()) {
+    offset = update_agent_->resumeOffset(getPendingTarget());
+  } else {
+    update_agent_->discardReceivedData();
+  }
+  if (offset > 0) {
+    LOG_INFO << "Resuming the upload of " << getPendingTarget().filename() << " after " << offset << " bytes";
+  }
+  decompressor_.reset();
+  upload_started_ = true;
+
+  auto m = out_msg.present(AKIpUptaneMes_PR_uploadStartResp).uploadStartResp();
+  m->offset = static_cast<long>(offset);  // NOLINT(google-runtime-int)
+  return ReturnCode::kOk;
+}
+
 MsgHandler::ReturnCode AktualizrSecondaryFile::uploadDataHdlr(Asn1Message& in_msg, Asn1Message& out_msg) {
   if (last_msg_ != AKIpUptaneMes_PR_uploadDataReq) {
     LOG_INFO << "Received an initial data upload request message; attempting to receive data...";
+    // Primaries that don't ask where to resume send the image from its
+    // beginning, so whatever is left of an interrupted upload is stale.
+    if (!upload_started_) {
+      update_agent_->discardReceivedData();
+    }
+    upload_started_ = false;
   } else {
     LOG_DEBUG << "Received another data upload request message; attempting to receive data...";
   }
@@ -79,3 +141,52 @@ MsgHandler::ReturnCode AktualizrSecondaryFile::uploadDataHdlr(Asn1Message& in_ms
 
   return ReturnCode::kOk;
 }
+
+MsgHandler::ReturnCode AktualizrSecondaryFile::uploadCompressionHdlr(Asn1Message& in_msg, Asn1Message& out_msg) {
+  // The Primary negotiates the compression right before the upload, which
+  // starts from the beginning of the image unless it asked where to resume.
+  if (!upload_started_) {
+    update_agent_->discardReceivedData();
+  }
+  upload_started_ = false;
+  decompressor_.reset();
+  AKCompression_t accepted = AKCompression_none;
+  if (in_msg.uploadCompressionReq()->compression == AKCompression_deflate && getPendingTarget().IsValid()) {
+    LOG_INFO << "Receiving a compressed image";
+    decompressor_ = std_::make_unique<compression::Decompressor>(getPendingTarget().length());
+    accepted = AKCompression_deflate;
+  }
+
+  auto m = out_msg.present(AKIpUptaneMes_PR_uploadCompressionResp).uploadCompressionResp();
+  m->compression = accepted;
+  return ReturnCode::kOk;
+}
+
+MsgHandler::ReturnCode AktualizrSecondaryFile::uploadCompressedDataHdlr(Asn1Message& in_msg, Asn1Message& out_msg) {
+  data::InstallationResult result(data::ResultCode::Numeric::kOk, "");
+  if (decompressor_ == nullptr) {
+    result = data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                      "Received compressed image data without negotiating the compression");
+  } else {
+    const auto& data = in_msg.uploadCompressedDataReq()->data;
+    // The image is hashed and written while it is decompressed, one piece at a time.
+    auto write = [this, &result](const uint8_t* buf, size_t size) -> bool {
+      result = receiveData(buf, size);
+      return result.isSuccess();
+    };
+    try {
+      decompressor_->decompress(data.buf, static_cast<size_t>(data.size), write);
+    } catch (const std::exception& e) {
+      result = data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed, e.what());
+    }
+  }
+  if (!result.isSuccess()) {
+    LOG_ERROR << "Failed to receive compressed image data: " << result.description;
+    decompressor_.reset();
+  }
+
+  auto m = out_msg.present(AKIpUptaneMes_PR_uploadDataResp).uploadDataResp();
+  m->result = static_cast<AKInstallationResultCode_t>(result.result_code.num_code);
+  SetString(&m->description, result.description);
+  return ReturnCode::kOk;
+}
@@ -6,16 +6,27 @@
 #include "aktualizr_secondary.h"
 
 class FileUpdateAgent;
+namespace compression {
+class Decompressor;
+}
 
 class AktualizrSecondaryFile : public AktualizrSecondary {
  public:
   static const std::string FileUpdateDefaultFile;
+  static const std::string PartitionStateFile;
 
   explicit AktualizrSecondaryFile(const AktualizrSecondaryConfig& config);
   AktualizrSecondaryFile(const AktualizrSecondaryConfig& config, std::shared_ptr<INvStorage> storage,
                          std::shared_ptr<FileUpdateAgent> update_agent = nullptr);
+  ~AktualizrSecondaryFile() override;
+  AktualizrSecondaryFile(const AktualizrSecondaryFile&) = delete;
+  AktualizrSecondaryFile(AktualizrSecondaryFile&&) = delete;
+  AktualizrSecondaryFile& operator=(const AktualizrSecondaryFile&) = delete;
+  AktualizrSecondaryFile& operator=(AktualizrSecondaryFile&&) = delete;
 
   void initialize() override;
+  using AktualizrSecondary::putMetadata;
+  data::InstallationResult putMetadata(const Uptane::SecondaryMetadata& metadata) override;
   data::InstallationResult receiveData(const uint8_t* data, size_t size);
 
  protected:
@@ -25,10 +36,17 @@ class AktualizrSecondaryFile : public AktualizrSecondary {
   data::InstallationResult applyPendingInstall(const Uptane::Target& target) override;
   void completeInstall() override;
 
+  ReturnCode uploadStartHdlr(Asn1Message& in_msg, Asn1Message& out_msg);
   ReturnCode uploadDataHdlr(Asn1Message& in_msg, Asn1Message& out_msg);
+  ReturnCode uploadCompressionHdlr(Asn1Message& in_msg, Asn1Message& out_msg);
+  ReturnCode uploadCompressedDataHdlr(Asn1Message& in_msg, Asn1Message& out_msg);
 
  private:
   std::shared_ptr<FileUpdateAgent> update_agent_;
+  // Set while the Primary uploads a compressed image.
+  std::unique_ptr<compression::Decompressor> decompressor_;
+  // The Primary asked where to resume the upload that follows.
+  bool upload_started_{false};
 };
 
 #endif  // AKTUALIZR_SECONDARY_FILE_H
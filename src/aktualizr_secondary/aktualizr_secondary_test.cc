@@ -6,6 +6,7 @@
 
 #include "aktualizr_secondary_file.h"
 #include "libaktualizr/crypto/keymanager.h"
+#include "libaktualizr/metrics.h"
 #include "libaktualizr/storage/invstorage.h"
 #include "libaktualizr/types.h"
 #include "libaktualizr/uptane_repo.h"
@@ -56,6 +57,13 @@ class AktualizrSecondaryWrapper {
     return *pending_target;
   }
 
+  Uptane::Target getCurrentVersion() const {
+    boost::optional<Uptane::Target> current_target;
+
+    storage_->loadInstalledVersions(secondary_->serial().ToString(), &current_target, nullptr);
+    return *current_target;
+  }
+
   std::string hardwareID() const { return secondary_->hwID().ToString(); }
 
   std::string serial() const { return secondary_->serial().ToString(); }
@@ -115,6 +123,26 @@ class UptaneRepoWrapper {
     return Uptane::SecondaryMetadata(getCurrentMetadata());
   }
 
+  // Adds a delta from the image of `source_targetname` to a slightly modified copy of it, the target
+  // `targetname` + ".image" stored at getTargetImagePath(targetname + ".image").
+  Uptane::SecondaryMetadata addDeltaFile(const std::string& source_targetname, const std::string& targetname,
+                                         const std::string& hardware_id, const std::string& serial) {
+    const auto source_path = root_dir_ / source_targetname;
+    const auto image_path = root_dir_ / (targetname + ".image");
+    std::string image = Utils::readFile(source_path);
+    image.replace(100, 10, "modified!!");
+    image += "appended";
+    Utils::writeFile(image_path, image);
+
+    uptane_repo_.addDeltaImage(source_path, image_path, targetname, targetname + ".image", hardware_id);
+    uptane_repo_.emptyTargets();
+    uptane_repo_.addTarget(targetname, hardware_id, serial);
+    uptane_repo_.signTargets();
+    boost::filesystem::copy_file(imagerepo_dir_ / "targets" / targetname, root_dir_ / targetname);
+
+    return Uptane::SecondaryMetadata(getCurrentMetadata());
+  }
+
   void addCustomImageMetadata(const std::string& targetname, const std::string& hardware_id,
                               const std::string& custom_version) {
     auto custom = Json::Value();
@@ -260,6 +288,8 @@ class SecondaryTest : public ::testing::Test {
   static constexpr const char* const bigger_target_{"default-target.bigger"};
   static constexpr const char* const smaller_target_{"default-target.smaller"};
   static constexpr const char* const broken_target_{"default-target.broken"};
+  static constexpr const char* const delta_target_{"delta-target"};
+  static constexpr const char* const delta_image_target_{"delta-target.image"};
 
   static const size_t target_size{2049};
   static const size_t invalid_target_size_delta{2};
@@ -271,6 +301,10 @@ class SecondaryTest : public ::testing::Test {
   TemporaryDirectory image_dir_;
 };
 
+constexpr const char* const SecondaryTest::default_target_;
+constexpr const char* const SecondaryTest::delta_target_;
+constexpr const char* const SecondaryTest::delta_image_target_;
+
 class SecondaryTestNegative
     : public SecondaryTest,
       public ::testing::WithParamInterface<std::tuple<Uptane::RepositoryType, Uptane::Role, VerificationType, bool>> {
@@ -422,6 +456,42 @@ TEST_F(SecondaryTest, ImageRootVersionIncremented) {
   EXPECT_TRUE(secondary_->putMetadata(uptane_repo_.getCurrentMetadata()).isSuccess());
 }
 
+/* Image repo metadata that did not change since it was last verified is not verified again. */
+TEST_F(SecondaryTest, UnchangedImageMetadata) {
+  const std::string checks = "aktualizr_image_metadata_checks_total";
+  const std::string help = "Image repo Snapshot and Targets metadata verified or reused";
+  const metrics::Counter& verified = metrics::Registry::global().counter(checks, help, {{"result", "verified"}});
+  const metrics::Counter& reused = metrics::Registry::global().counter(checks, help, {{"result", "reused"}});
+  const metrics::Histogram& time = metrics::Registry::global().histogram(
+      "aktualizr_image_metadata_check_seconds", "Time taken to check Image repo Snapshot and Targets metadata",
+      metrics::latencyBuckets());
+  const uint64_t verified_before = verified.value();
+  const uint64_t reused_before = reused.value();
+  const uint64_t time_before = time.count();
+  const auto start = secondary_->imageRepoVerifyStats();
+
+  ASSERT_TRUE(secondary_->putMetadata(uptane_repo_.getCurrentMetadata()).isSuccess());
+  const auto first = secondary_->imageRepoVerifyStats();
+  EXPECT_EQ(first.verified, 2);
+
+  ASSERT_TRUE(secondary_->putMetadata(uptane_repo_.getCurrentMetadata()).isSuccess());
+  const auto second = secondary_->imageRepoVerifyStats();
+  EXPECT_EQ(second.verified, first.verified);
+  EXPECT_EQ(second.reused, first.reused + 2);
+
+  // A new image changes the Image repo Snapshot and Targets, but not the Director Targets.
+  auto metadata = uptane_repo_.addImageFile("another_target", "another_hwid", secondary_.serial(), 1024, false);
+  ASSERT_TRUE(secondary_->putMetadata(metadata).isSuccess());
+  const auto third = secondary_->imageRepoVerifyStats();
+  EXPECT_EQ(third.verified, second.verified + 2);
+  EXPECT_EQ(secondary_->getPendingTarget().filename(), default_target_);
+
+  // The metrics registry counts the same checks.
+  EXPECT_EQ(verified.value() - verified_before, third.verified - start.verified);
+  EXPECT_EQ(reused.value() - reused_before, third.reused - start.reused);
+  EXPECT_GE(time.count() - time_before, third.verified + third.reused - start.verified - start.reused);
+}
+
 TEST_F(SecondaryTest, SmallerImageFileSize) {
   EXPECT_CALL(update_agent_, receiveData)
       .Times((target_size - invalid_target_size_delta) / send_buffer_size +
@@ -456,6 +526,91 @@ TEST_F(SecondaryTest, InvalidImageData) {
   EXPECT_FALSE(secondary_->install().isSuccess());
 }
 
+/* The data of an interrupted upload is dropped before the image is sent again. */
+TEST_F(SecondaryTest, InterruptedUpload) {
+  EXPECT_TRUE(secondary_->putMetadata(uptane_repo_.getCurrentMetadata()).isSuccess());
+  const std::string image = Utils::readFile(uptane_repo_.getTargetImagePath(default_target_));
+  EXPECT_TRUE(secondary_->receiveData(reinterpret_cast<const uint8_t*>(image.data()), send_buffer_size).isSuccess());
+
+  update_agent_.discardReceivedData();
+  EXPECT_EQ(sendImageFile(), data::ResultCode::Numeric::kOk);
+  EXPECT_TRUE(secondary_->install().isSuccess());
+  verifyTargetAndManifest();
+}
+
+/* A delta is applied to the installed image while it is received. */
+TEST_F(SecondaryTest, DeltaUpdate) {
+  ASSERT_TRUE(secondary_->putMetadata(uptane_repo_.getCurrentMetadata()).isSuccess());
+  ASSERT_EQ(sendImageFile(), data::ResultCode::Numeric::kOk);
+  ASSERT_TRUE(secondary_->install().isSuccess());
+
+  auto metadata =
+      uptane_repo_.addDeltaFile(default_target_, delta_target_, secondary_.hardwareID(), secondary_.serial());
+  ASSERT_TRUE(secondary_->putMetadata(metadata).isSuccess());
+  ASSERT_EQ(sendImageFile(delta_target_), data::ResultCode::Numeric::kOk);
+  ASSERT_TRUE(secondary_->install().isSuccess());
+
+  // The Secondary reports the image the delta produced, also after a restart.
+  const std::string image = Utils::readFile(uptane_repo_.getTargetImagePath(delta_image_target_));
+  EXPECT_EQ(Utils::readFile(secondary_.targetFilepath()), image);
+  auto manifest = secondary_->getManifest();
+  EXPECT_EQ(manifest.installedImageHash(), Hash::generate(Hash::Type::kSha256, image));
+  EXPECT_EQ(manifest.filepath(), delta_image_target_);
+  EXPECT_EQ(manifest["signed"]["installed_image"]["fileinfo"]["length"].asUInt64(), image.size());
+  EXPECT_EQ(secondary_.getCurrentVersion().filename(), delta_image_target_);
+  EXPECT_TRUE(secondary_.getCurrentVersion().MatchHash(manifest.installedImageHash()));
+}
+
+/* The Primary's checks accept the manifest of a Secondary that installed a delta. */
+TEST_F(SecondaryTest, DeltaInstallationCheck) {
+  ASSERT_TRUE(secondary_->putMetadata(uptane_repo_.getCurrentMetadata()).isSuccess());
+  ASSERT_EQ(sendImageFile(), data::ResultCode::Numeric::kOk);
+  ASSERT_TRUE(secondary_->install().isSuccess());
+
+  auto metadata =
+      uptane_repo_.addDeltaFile(default_target_, delta_target_, secondary_.hardwareID(), secondary_.serial());
+  ASSERT_TRUE(secondary_->putMetadata(metadata).isSuccess());
+  const Uptane::Target delta_target = secondary_->getPendingTarget();
+  ASSERT_EQ(sendImageFile(delta_target_), data::ResultCode::Numeric::kOk);
+  ASSERT_TRUE(secondary_->install().isSuccess());
+  const auto manifest = secondary_->getManifest();
+
+  // The Primary records what SotaUptaneClient::sendImagesToEcus() does once the Secondary installed the delta.
+  TemporaryDirectory primary_dir;
+  StorageConfig primary_storage_config;
+  primary_storage_config.path = primary_dir.Path();
+  auto primary_storage = INvStorage::newStorage(primary_storage_config);
+  primary_storage->storeEcuSerials({{Uptane::EcuSerial("primary"), Uptane::HardwareIdentifier("primary-hw")},
+                                    {secondary_->serial(), secondary_->hwID()}});
+  primary_storage->saveInstalledVersion(secondary_.serial(), binary_delta::installedTarget(delta_target),
+                                        InstalledVersionUpdateMode::kPending);
+
+  // SotaUptaneClient::checkAndUpdatePendingSecondaries() completes the installation if the manifest matches.
+  std::vector<std::pair<Uptane::EcuSerial, Hash>> pending_ecus;
+  primary_storage->getPendingEcus(&pending_ecus);
+  ASSERT_EQ(pending_ecus.size(), 1);
+  EXPECT_EQ(pending_ecus[0].first, secondary_->serial());
+  EXPECT_EQ(pending_ecus[0].second, manifest.installedImageHash());
+
+  // SotaUptaneClient::getNewTargets() does not offer the delta again, nor the image it produced.
+  primary_storage->saveInstalledVersion(secondary_.serial(), binary_delta::installedTarget(delta_target),
+                                        InstalledVersionUpdateMode::kCurrent);
+  boost::optional<Uptane::Target> current_version;
+  ASSERT_TRUE(primary_storage->loadInstalledVersions(secondary_.serial(), &current_version, nullptr));
+  ASSERT_TRUE(!!current_version);
+  EXPECT_EQ(current_version->filename(), manifest.filepath());
+  EXPECT_EQ(current_version->length(), manifest["signed"]["installed_image"]["fileinfo"]["length"].asUInt64());
+  EXPECT_TRUE(current_version->MatchTarget(binary_delta::installedTarget(delta_target)));
+  EXPECT_FALSE(current_version->MatchTarget(delta_target));
+}
+
+/* A delta is refused if the image it was created from is not installed. */
+TEST_F(SecondaryTest, DeltaForAnotherImage) {
+  auto metadata =
+      uptane_repo_.addDeltaFile(default_target_, delta_target_, secondary_.hardwareID(), secondary_.serial());
+  EXPECT_FALSE(secondary_->putMetadata(metadata).isSuccess());
+}
+
 class SecondaryTestTuf
     : public SecondaryTest,
       public ::testing::WithParamInterface<std::pair<std::vector<std::string>, boost::optional<std::string>>> {
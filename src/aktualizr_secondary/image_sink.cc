@@ -0,0 +1,27 @@
+#include "image_sink.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+void ImageSink::readInstalled(const Reader& reader) const {
+  const auto length = installedLength();
+  if (!length) {
+    throw std::runtime_error("No image is installed");
+  }
+  readFile(installedPath(), *length, reader);
+}
+
+void ImageSink::readFile(const boost::filesystem::path& path, uint64_t length, const Reader& reader) {
+  std::ifstream file(path.c_str(), std::ios::binary);
+  std::vector<char> buf(64 * 1024);
+  while (length > 0) {
+    const auto size = static_cast<size_t>(std::min<uint64_t>(buf.size(), length));
+    if (!file.read(buf.data(), static_cast<std::streamsize>(size))) {
+      throw std::runtime_error("Failed to read the image from " + path.string());
+    }
+    reader(reinterpret_cast<const uint8_t*>(buf.data()), size);
+    length -= size;
+  }
+}
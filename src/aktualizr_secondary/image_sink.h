@@ -0,0 +1,50 @@
+#ifndef AKTUALIZR_SECONDARY_IMAGE_SINK_H
+#define AKTUALIZR_SECONDARY_IMAGE_SINK_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+/**
+ * Where a file Secondary stores the images it receives. A new image is
+ * written while it is received, and only replaces the installed one on
+ * commit(). Methods throw std::runtime_error on failure.
+ */
+class ImageSink {
+ public:
+  using Ptr = std::shared_ptr<ImageSink>;
+  using Reader = std::function<void(const uint8_t* data, size_t size)>;
+
+  virtual ~ImageSink() = default;
+  ImageSink(const ImageSink&) = delete;
+  ImageSink(ImageSink&&) = delete;
+  ImageSink& operator=(const ImageSink&) = delete;
+  ImageSink& operator=(ImageSink&&) = delete;
+
+  /** None if no image is installed. */
+  virtual boost::optional<uint64_t> installedLength() const = 0;
+  /** The installed image takes the first installedLength() bytes of this file or device. */
+  virtual boost::filesystem::path installedPath() const = 0;
+  /** Pass the installed image to `reader`, in pieces. */
+  void readInstalled(const Reader& reader) const;
+
+  /** Bytes of the new image received so far, which may have been kept from before a restart. */
+  virtual uint64_t received() const = 0;
+  /** Pass the part of the new image received so far to `reader`, in pieces. */
+  virtual void readReceived(const Reader& reader) const = 0;
+  /** Append to the new image. */
+  virtual void write(const uint8_t* data, size_t size) = 0;
+  /** Drop the new image. */
+  virtual void discard() = 0;
+  /** Make the new image the installed one. */
+  virtual void commit() = 0;
+
+ protected:
+  ImageSink() = default;
+  static void readFile(const boost::filesystem::path& path, uint64_t length, const Reader& reader);
+};
+
+#endif  // AKTUALIZR_SECONDARY_IMAGE_SINK_H
@@ -0,0 +1,43 @@
+#include "image_sink_file.h"
+
+#include <fstream>
+#include <stdexcept>
+
+boost::optional<uint64_t> FileImageSink::installedLength() const {
+  if (!boost::filesystem::exists(target_filepath_)) {
+    return boost::none;
+  }
+  return static_cast<uint64_t>(boost::filesystem::file_size(target_filepath_));
+}
+
+uint64_t FileImageSink::received() const {
+  boost::system::error_code ec;
+  const auto size = boost::filesystem::file_size(new_target_filepath_, ec);
+  return ec ? 0 : static_cast<uint64_t>(size);
+}
+
+void FileImageSink::readReceived(const Reader& reader) const { readFile(new_target_filepath_, received(), reader); }
+
+void FileImageSink::write(const uint8_t* data, size_t size) {
+  std::ofstream file(new_target_filepath_.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::app);
+  if (!file.good()) {
+    throw std::runtime_error("Failed to open a new target image file");
+  }
+  file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+  file.close();
+  if (!file.good()) {
+    throw std::runtime_error("Failed to write the new target image");
+  }
+}
+
+void FileImageSink::discard() {
+  boost::system::error_code ec;
+  boost::filesystem::remove(new_target_filepath_, ec);
+}
+
+void FileImageSink::commit() {
+  if (!boost::filesystem::exists(new_target_filepath_)) {
+    throw std::runtime_error("The target image has not been received");
+  }
+  boost::filesystem::rename(new_target_filepath_, target_filepath_);
+}
@@ -0,0 +1,26 @@
+#ifndef AKTUALIZR_SECONDARY_IMAGE_SINK_FILE_H
+#define AKTUALIZR_SECONDARY_IMAGE_SINK_FILE_H
+
+#include "image_sink.h"
+
+/** Receives the new image next to the installed one and renames it on commit(). */
+class FileImageSink : public ImageSink {
+ public:
+  explicit FileImageSink(boost::filesystem::path target_filepath)
+      : target_filepath_{std::move(target_filepath)}, new_target_filepath_{target_filepath_.string() + ".newtarget"} {}
+
+  boost::optional<uint64_t> installedLength() const override;
+  boost::filesystem::path installedPath() const override { return target_filepath_; }
+
+  uint64_t received() const override;
+  void readReceived(const Reader& reader) const override;
+  void write(const uint8_t* data, size_t size) override;
+  void discard() override;
+  void commit() override;
+
+ private:
+  const boost::filesystem::path target_filepath_;
+  const boost::filesystem::path new_target_filepath_;
+};
+
+#endif  // AKTUALIZR_SECONDARY_IMAGE_SINK_FILE_H
@@ -0,0 +1,154 @@
+#include "image_sink_partition.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "libaktualizr/logging/logging.h"
+#include "libaktualizr/utilities/utils.h"
+
+constexpr size_t PartitionImageSink::kBlockSize;
+constexpr size_t PartitionImageSink::kAlignment;
+
+void PartitionImageSink::AlignedFree::operator()(uint8_t* p) const { free(p); }
+
+PartitionImageSink::PartitionImageSink(std::vector<boost::filesystem::path> slots, boost::filesystem::path state_file,
+                                       bool direct_io)
+    : slots_(std::move(slots)), state_file_(std::move(state_file)), direct_io_(direct_io) {
+  if (slots_.size() != 2) {
+    throw std::runtime_error("Writing images to partitions needs exactly two of them, A and B");
+  }
+  void* buffer = nullptr;
+  if (posix_memalign(&buffer, kAlignment, kBlockSize) != 0) {
+    throw std::runtime_error("Failed to allocate the image write buffer");
+  }
+  buffer_.reset(static_cast<uint8_t*>(buffer));
+
+  if (boost::filesystem::exists(state_file_)) {
+    const Json::Value state = Utils::parseJSONFile(state_file_);
+    active_ = state["active"].asUInt() == 1 ? 1 : 0;
+    if (state.isMember("length")) {
+      installed_length_ = state["length"].asUInt64();
+    }
+    // Only whole blocks are known to have been written.
+    written_ = state["written"].asUInt64();
+    written_ -= written_ % kBlockSize;
+  }
+}
+
+PartitionImageSink::~PartitionImageSink() { close(); }
+
+void PartitionImageSink::readReceived(const Reader& reader) const {
+  readFile(slots_[inactive()], written_, reader);
+  if (buffered_ > 0) {
+    reader(buffer_.get(), buffered_);
+  }
+}
+
+void PartitionImageSink::write(const uint8_t* data, size_t size) {
+  while (size > 0) {
+    const size_t part = std::min(size, kBlockSize - buffered_);
+    memcpy(buffer_.get() + buffered_, data, part);
+    buffered_ += part;
+    data += part;
+    size -= part;
+    if (buffered_ == kBlockSize) {
+      flush(kBlockSize);
+    }
+  }
+}
+
+void PartitionImageSink::discard() {
+  close();
+  buffered_ = 0;
+  if (written_ > 0) {
+    written_ = 0;
+    saveState();
+  }
+}
+
+void PartitionImageSink::commit() {
+  if (buffered_ > 0) {
+    size_t size = buffered_;
+    if (direct_io_) {
+      // O_DIRECT only writes whole blocks, the padding is not part of the image.
+      size = (buffered_ + kAlignment - 1) / kAlignment * kAlignment;
+      memset(buffer_.get() + buffered_, 0, size - buffered_);
+    }
+    flush(size);
+  }
+  close();
+  installed_length_ = written_;
+  active_ = inactive();
+  written_ = 0;
+  saveState();
+  LOG_INFO << "Installed an image of " << *installed_length_ << " bytes on " << slots_[active_];
+}
+
+void PartitionImageSink::openInactive() {
+  if (fd_ >= 0) {
+    return;
+  }
+  const auto& path = slots_[inactive()];
+  const int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+  if (direct_io_) {
+    fd_ = ::open(path.c_str(), flags | O_DIRECT, S_IRUSR | S_IWUSR);
+    if (fd_ < 0 && errno == EINVAL) {
+      LOG_WARNING << path << " does not support O_DIRECT, writing through the page cache";
+    }
+  }
+  if (fd_ < 0) {
+    fd_ = ::open(path.c_str(), flags, S_IRUSR | S_IWUSR);
+  }
+  if (fd_ < 0) {
+    throw std::runtime_error("Failed to open " + path.string() + ": " + std::strerror(errno));
+  }
+}
+
+void PartitionImageSink::close() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+void PartitionImageSink::flush(size_t size) {
+  openInactive();
+  size_t done = 0;
+  while (done < size) {
+    const ssize_t res = ::pwrite(fd_, buffer_.get() + done, size - done, static_cast<off_t>(written_ + done));
+    if (res < 0 && errno == EINTR) {
+      continue;
+    }
+    if (res <= 0) {
+      const std::string error = res < 0 ? std::strerror(errno) : "nothing written";
+      close();
+      throw std::runtime_error("Failed to write the new image to " + slots_[inactive()].string() + ": " + error);
+    }
+    done += static_cast<size_t>(res);
+  }
+  // The state file must not claim more than what is on the partition.
+  if (::fdatasync(fd_) != 0) {
+    const std::string error = std::strerror(errno);
+    close();
+    throw std::runtime_error("Failed to write the new image to " + slots_[inactive()].string() + ": " + error);
+  }
+  written_ += buffered_;
+  buffered_ = 0;
+  saveState();
+}
+
+void PartitionImageSink::saveState() const {
+  Json::Value state;
+  state["active"] = static_cast<Json::UInt>(active_);
+  if (installed_length_) {
+    state["length"] = static_cast<Json::UInt64>(*installed_length_);
+  }
+  state["written"] = static_cast<Json::UInt64>(written_);
+  Utils::writeFile(state_file_, state);
+}
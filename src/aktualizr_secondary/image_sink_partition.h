@@ -0,0 +1,66 @@
+#ifndef AKTUALIZR_SECONDARY_IMAGE_SINK_PARTITION_H
+#define AKTUALIZR_SECONDARY_IMAGE_SINK_PARTITION_H
+
+#include <memory>
+#include <vector>
+
+#include "image_sink.h"
+
+/**
+ * Writes the new image straight to the inactive one of two A/B partitions, so
+ * that it does not have to be copied there after the installation. Data is
+ * written in large aligned blocks, optionally bypassing the page cache with
+ * O_DIRECT. Regular files can stand in for the partitions.
+ *
+ * The active slot, the length of the installed image and the part of the new
+ * image already written are kept in a state file, so that an interrupted
+ * transfer resumes after the last block written. Booting from the active slot
+ * is up to the platform.
+ */
+class PartitionImageSink : public ImageSink {
+ public:
+  static constexpr size_t kBlockSize = 1024 * 1024;
+  // Alignment of the last block of an image written with O_DIRECT.
+  static constexpr size_t kAlignment = 4096;
+
+  PartitionImageSink(std::vector<boost::filesystem::path> slots, boost::filesystem::path state_file,
+                     bool direct_io = false);
+  ~PartitionImageSink() override;
+  PartitionImageSink(const PartitionImageSink&) = delete;
+  PartitionImageSink(PartitionImageSink&&) = delete;
+  PartitionImageSink& operator=(const PartitionImageSink&) = delete;
+  PartitionImageSink& operator=(PartitionImageSink&&) = delete;
+
+  boost::optional<uint64_t> installedLength() const override { return installed_length_; }
+  boost::filesystem::path installedPath() const override { return slots_[active_]; }
+
+  uint64_t received() const override { return written_ + buffered_; }
+  void readReceived(const Reader& reader) const override;
+  void write(const uint8_t* data, size_t size) override;
+  void discard() override;
+  void commit() override;
+
+ private:
+  struct AlignedFree {
+    void operator()(uint8_t* p) const;
+  };
+
+  size_t inactive() const { return 1 - active_; }
+  void openInactive();
+  void close();
+  void flush(size_t size);
+  void saveState() const;
+
+  const std::vector<boost::filesystem::path> slots_;
+  const boost::filesystem::path state_file_;
+  const bool direct_io_;
+  size_t active_{0};
+  boost::optional<uint64_t> installed_length_;
+  // Bytes of the new image on the inactive slot, always a multiple of kBlockSize.
+  uint64_t written_{0};
+  std::unique_ptr<uint8_t, AlignedFree> buffer_;
+  size_t buffered_{0};
+  int fd_{-1};
+};
+
+#endif  // AKTUALIZR_SECONDARY_IMAGE_SINK_PARTITION_H
@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+
+#include <boost/algorithm/hex.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "image_sink_partition.h"
+#include "libaktualizr/crypto/crypto.h"
+#include "libaktualizr/utilities/utils.h"
+#include "update_agent_file.h"
+#include "utilities/binary_delta.h"
+
+static std::string randomData(std::mt19937 &rng, size_t size) {
+  std::string data(size, '\0');
+  for (auto &c : data) {
+    c = static_cast<char>(rng() & 0xFF);
+  }
+  return data;
+}
+
+static void writeImage(ImageSink &sink, const std::string &image, size_t offset, size_t piece) {
+  for (; offset < image.size(); offset += piece) {
+    const size_t size = std::min(piece, image.size() - offset);
+    sink.write(reinterpret_cast<const uint8_t *>(image.data()) + offset, size);
+  }
+}
+
+static std::string readInstalled(const ImageSink &sink) {
+  std::string out;
+  sink.readInstalled(
+      [&out](const uint8_t *data, size_t size) { out.append(reinterpret_cast<const char *>(data), size); });
+  return out;
+}
+
+static Uptane::Target makeTarget(const std::string &name, const std::string &image) {
+  Json::Value target_json;
+  target_json["hashes"]["sha256"] = boost::algorithm::hex(Crypto::sha256digest(image));
+  target_json["length"] = static_cast<Json::UInt64>(image.size());
+  return Uptane::Target(name, target_json);
+}
+
+class PartitionImageSinkTest : public ::testing::Test {
+ protected:
+  std::shared_ptr<PartitionImageSink> makeSink(bool direct_io = false) {
+    return std::make_shared<PartitionImageSink>(std::vector<boost::filesystem::path>{slot_a_, slot_b_},
+                                                temp_dir_ / "state.json", direct_io);
+  }
+
+  TemporaryDirectory temp_dir_;
+  const boost::filesystem::path slot_a_{temp_dir_ / "slot_a"};
+  const boost::filesystem::path slot_b_{temp_dir_ / "slot_b"};
+  std::mt19937 rng_{42};
+};
+
+/* Images alternate between the two slots, and the installed one survives a restart. */
+TEST_F(PartitionImageSinkTest, AlternateSlots) {
+  auto sink = makeSink();
+  EXPECT_FALSE(sink->installedLength());
+
+  const std::string image1 = randomData(rng_, 2 * PartitionImageSink::kBlockSize + 12345);
+  writeImage(*sink, image1, 0, 100000);
+  EXPECT_EQ(sink->received(), image1.size());
+  sink->commit();
+  EXPECT_EQ(sink->installedPath(), slot_b_);
+  EXPECT_EQ(*sink->installedLength(), image1.size());
+  EXPECT_EQ(readInstalled(*sink), image1);
+  EXPECT_EQ(sink->received(), 0);
+
+  // A shorter image leaves the rest of the slot alone, only its length counts.
+  const std::string image2 = randomData(rng_, 5000);
+  writeImage(*sink, image2, 0, 3000);
+  sink->commit();
+  EXPECT_EQ(sink->installedPath(), slot_a_);
+  EXPECT_EQ(readInstalled(*sink), image2);
+
+  sink = makeSink();
+  EXPECT_EQ(sink->installedPath(), slot_a_);
+  EXPECT_EQ(readInstalled(*sink), image2);
+  EXPECT_EQ(Utils::readFile(slot_b_), image1);
+}
+
+/* Whole blocks written before a restart are kept, the rest is received again. */
+TEST_F(PartitionImageSinkTest, Resume) {
+  const std::string image = randomData(rng_, 3 * PartitionImageSink::kBlockSize / 2);
+  auto sink = makeSink();
+  writeImage(*sink, image, 0, 65536);
+  EXPECT_EQ(sink->received(), image.size());
+
+  sink = makeSink();
+  ASSERT_EQ(sink->received(), PartitionImageSink::kBlockSize);
+  std::string received;
+  sink->readReceived(
+      [&received](const uint8_t *data, size_t size) { received.append(reinterpret_cast<const char *>(data), size); });
+  EXPECT_EQ(received, image.substr(0, PartitionImageSink::kBlockSize));
+  writeImage(*sink, image, PartitionImageSink::kBlockSize, 65536);
+  sink->commit();
+  EXPECT_EQ(readInstalled(*sink), image);
+
+  // Discarded data is not resumed.
+  writeImage(*sink, image, 0, 65536);
+  sink->discard();
+  EXPECT_EQ(sink->received(), 0);
+  EXPECT_EQ(makeSink()->received(), 0);
+}
+
+/* Padding of the last block written with O_DIRECT is not part of the image. */
+TEST_F(PartitionImageSinkTest, DirectIo) {
+  auto sink = makeSink(true);
+  const std::string image = randomData(rng_, PartitionImageSink::kBlockSize + 1000);
+  writeImage(*sink, image, 0, 4000);
+  sink->commit();
+  EXPECT_EQ(*sink->installedLength(), image.size());
+  EXPECT_EQ(readInstalled(*sink), image);
+}
+
+/* The file update agent installs images on partitions, and resumes an interrupted transfer after a restart. */
+TEST_F(PartitionImageSinkTest, UpdateAgent) {
+  const std::string image = randomData(rng_, 3 * PartitionImageSink::kBlockSize / 2);
+  const auto target = makeTarget("image.bin", image);
+  {
+    FileUpdateAgent agent(makeSink(), "unknown");
+    EXPECT_TRUE(
+        agent.receiveData(target, reinterpret_cast<const uint8_t *>(image.data()), PartitionImageSink::kBlockSize + 10)
+            .isSuccess());
+  }
+
+  auto sink = makeSink();
+  FileUpdateAgent agent(sink, "unknown");
+  const size_t offset = agent.resumeOffset(target);
+  ASSERT_EQ(offset, PartitionImageSink::kBlockSize);
+  EXPECT_TRUE(agent.receiveData(target, reinterpret_cast<const uint8_t *>(image.data()) + offset, image.size() - offset)
+                  .isSuccess());
+  EXPECT_TRUE(agent.install(target).isSuccess());
+
+  Uptane::InstalledImageInfo info;
+  EXPECT_TRUE(agent.getInstalledImageInfo(info));
+  EXPECT_EQ(info.name, "image.bin");
+  EXPECT_EQ(info.len, image.size());
+  EXPECT_EQ(info.hash, boost::algorithm::to_lower_copy(target.sha256Hash()));
+  EXPECT_EQ(readInstalled(*sink), image);
+
+  // A corrupted image is not installed.
+  std::string corrupted = image;
+  corrupted[100] = static_cast<char>(corrupted[100] ^ 1);
+  EXPECT_TRUE(agent.receiveData(target, reinterpret_cast<const uint8_t *>(corrupted.data()), corrupted.size())
+                  .isSuccess());
+  EXPECT_FALSE(agent.install(target).isSuccess());
+  EXPECT_EQ(sink->installedPath(), slot_b_);
+  // and not resumed.
+  EXPECT_EQ(agent.resumeOffset(target), 0);
+}
+
+/* Deltas are checked against the installed image on the partition, which is hashed in pieces. */
+TEST_F(PartitionImageSinkTest, DeltaUpdateAgent) {
+  const std::string image1 = randomData(rng_, 2 * PartitionImageSink::kBlockSize + 500);
+  const std::string image2 = image1.substr(0, 300000) + randomData(rng_, 7000) + image1.substr(400000);
+  const auto target1 = makeTarget("image1.bin", image1);
+
+  binary_delta::TargetInfo info;
+  info.source_sha256 = Hash::generate(Hash::Type::kSha256, image1).HashString();
+  info.source_length = image1.size();
+  info.target_name = "image2.bin";
+  info.sha256 = Hash::generate(Hash::Type::kSha256, image2).HashString();
+  info.length = image2.size();
+  const std::string delta = binary_delta::create(image1, image2);
+  auto delta_target = makeTarget("image2.delta", delta);
+  delta_target.updateCustom(info.toCustom());
+
+  auto sink = makeSink();
+  FileUpdateAgent agent(sink, "unknown");
+  EXPECT_FALSE(agent.isTargetSupported(delta_target));
+  ASSERT_TRUE(agent.receiveData(target1, reinterpret_cast<const uint8_t *>(image1.data()), image1.size()).isSuccess());
+  ASSERT_TRUE(agent.install(target1).isSuccess());
+
+  EXPECT_TRUE(agent.isTargetSupported(delta_target));
+  // Deltas are always received from their beginning.
+  ASSERT_TRUE(agent.receiveData(delta_target, reinterpret_cast<const uint8_t *>(delta.data()), 100).isSuccess());
+  EXPECT_EQ(agent.resumeOffset(delta_target), 0);
+  ASSERT_TRUE(
+      agent.receiveData(delta_target, reinterpret_cast<const uint8_t *>(delta.data()), delta.size()).isSuccess());
+  ASSERT_TRUE(agent.install(delta_target).isSuccess());
+  EXPECT_EQ(readInstalled(*sink), image2);
+
+  // The delta does not apply to the image it produced.
+  EXPECT_FALSE(agent.isTargetSupported(delta_target));
+  Uptane::InstalledImageInfo installed;
+  EXPECT_TRUE(agent.getInstalledImageInfo(installed));
+  EXPECT_EQ(installed.name, info.target_name);
+  EXPECT_EQ(installed.hash, boost::algorithm::to_lower_copy(info.sha256));
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
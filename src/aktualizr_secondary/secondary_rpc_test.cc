@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <limits>
 #include <thread>
 
 #include <gtest/gtest.h>
@@ -14,6 +16,7 @@
 #include "primary/secondary_provider_builder.h"
 #include "secondary_tcp_server.h"
 #include "test_utils.h"
+#include "utilities/compression.h"
 
 enum class HandlerVersion { kV1, kV2, kV2Failure };
 
@@ -69,6 +72,16 @@ class SecondaryMock : public MsgDispatcher {
 
   const std::string& getReceivedTlsCreds() const { return tls_creds_; }
 
+  void setCompressionSupported(bool supported) { compression_supported_ = supported; }
+  size_t getReceivedCompressedSize() const { return received_compressed_size_; }
+
+  void setResumeSupported(bool supported) { resume_supported_ = supported; }
+  // Part of an image received before, e.g. before a restart.
+  void receivePartialImage(const std::string& data) {
+    receiveImageData(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+  }
+  size_t getUploadedSize() const { return uploaded_size_; }
+
   // Used by both protocol versions:
   void registerBaseHandlers() {
     registerHandler(AKIpUptaneMes_PR_getInfoReq,
@@ -99,6 +112,8 @@ class SecondaryMock : public MsgDispatcher {
   void registerV2Handlers() {
     registerHandler(AKIpUptaneMes_PR_putMetaReq2,
                     std::bind(&SecondaryMock::putMeta2Hdlr, this, std::placeholders::_1, std::placeholders::_2));
+    registerHandler(AKIpUptaneMes_PR_uploadStartReq,
+                    std::bind(&SecondaryMock::uploadStartHdlr, this, std::placeholders::_1, std::placeholders::_2));
     registerHandler(AKIpUptaneMes_PR_uploadDataReq,
                     std::bind(&SecondaryMock::uploadDataHdlr, this, std::placeholders::_1, std::placeholders::_2));
     registerHandler(AKIpUptaneMes_PR_downloadOstreeRevReq,
@@ -109,6 +124,10 @@ class SecondaryMock : public MsgDispatcher {
                     std::bind(&SecondaryMock::rootVerHdlr, this, std::placeholders::_1, std::placeholders::_2));
     registerHandler(AKIpUptaneMes_PR_putRootReq,
                     std::bind(&SecondaryMock::putRootHdlr, this, std::placeholders::_1, std::placeholders::_2));
+    registerHandler(AKIpUptaneMes_PR_uploadCompressionReq, std::bind(&SecondaryMock::uploadCompressionHdlr, this,
+                                                                     std::placeholders::_1, std::placeholders::_2));
+    registerHandler(AKIpUptaneMes_PR_uploadCompressedDataReq, std::bind(&SecondaryMock::uploadCompressedDataHdlr, this,
+                                                                        std::placeholders::_1, std::placeholders::_2));
   }
 
   // Protocol v2 handlers that fail in predictable ways.
@@ -292,6 +311,20 @@ class SecondaryMock : public MsgDispatcher {
     return ReturnCode::kOk;
   }
 
+  MsgHandler::ReturnCode uploadStartHdlr(Asn1Message& in_msg, Asn1Message& out_msg) {
+    (void)in_msg;
+    if (!resume_supported_) {
+      // Secondaries that predate resumable uploads do not know the request.
+      return ReturnCode::kUnkownMsg;
+    }
+    boost::system::error_code ec;
+    const auto received = boost::filesystem::file_size(image_filepath_, ec);
+    auto m = out_msg.present(AKIpUptaneMes_PR_uploadStartResp).uploadStartResp();
+    m->offset = ec ? 0 : static_cast<long>(received);  // NOLINT(google-runtime-int)
+
+    return ReturnCode::kOk;
+  }
+
   MsgHandler::ReturnCode uploadDataHdlr(Asn1Message& in_msg, Asn1Message& out_msg) {
     if (in_msg.uploadDataReq()->data.size < 0) {
       out_msg.present(AKIpUptaneMes_PR_uploadDataResp).uploadDataResp()->result = AKInstallationResult_failure;
@@ -299,6 +332,7 @@ class SecondaryMock : public MsgDispatcher {
     }
 
     size_t data_size = static_cast<size_t>(in_msg.uploadDataReq()->data.size);
+    uploaded_size_ += data_size;
     auto result = receiveImageData(in_msg.uploadDataReq()->data.buf, data_size);
 
     auto m = out_msg.present(AKIpUptaneMes_PR_uploadDataResp).uploadDataResp();
@@ -318,6 +352,39 @@ class SecondaryMock : public MsgDispatcher {
     return ReturnCode::kOk;
   }
 
+  MsgHandler::ReturnCode uploadCompressionHdlr(Asn1Message& in_msg, Asn1Message& out_msg) {
+    if (!compression_supported_) {
+      // Secondaries that predate compression do not know the request.
+      return ReturnCode::kUnkownMsg;
+    }
+    EXPECT_EQ(in_msg.uploadCompressionReq()->compression, AKCompression_deflate);
+    decompressor_ = std_::make_unique<compression::Decompressor>(std::numeric_limits<uint64_t>::max());
+    out_msg.present(AKIpUptaneMes_PR_uploadCompressionResp).uploadCompressionResp()->compression =
+        AKCompression_deflate;
+
+    return ReturnCode::kOk;
+  }
+
+  MsgHandler::ReturnCode uploadCompressedDataHdlr(Asn1Message& in_msg, Asn1Message& out_msg) {
+    const auto& data = in_msg.uploadCompressedDataReq()->data;
+    received_compressed_size_ += static_cast<size_t>(data.size);
+    auto result = data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+    EXPECT_NE(decompressor_, nullptr);
+    if (decompressor_ != nullptr) {
+      decompressor_->decompress(data.buf, static_cast<size_t>(data.size),
+                                [this, &result](const uint8_t* buf, size_t size) -> bool {
+                                  result = receiveImageData(buf, size);
+                                  return result.isSuccess();
+                                });
+    }
+
+    auto m = out_msg.present(AKIpUptaneMes_PR_uploadDataResp).uploadDataResp();
+    m->result = static_cast<AKInstallationResultCode_t>(result.result_code.num_code);
+    SetString(&m->description, result.description);
+
+    return ReturnCode::kOk;
+  }
+
   MsgHandler::ReturnCode sendFirmwareHdlr(Asn1Message& in_msg, Asn1Message& out_msg) {
     received_firmware_data_ = ToString(in_msg.sendFirmwareReq()->firmware);
     out_msg.present(AKIpUptaneMes_PR_sendFirmwareResp).sendFirmwareResp()->result = AKInstallationResult_success;
@@ -436,6 +503,11 @@ class SecondaryMock : public MsgDispatcher {
   std::string received_firmware_data_;
   VerificationType vtype_;
   HandlerVersion handler_version_;
+  bool compression_supported_{true};
+  std::unique_ptr<compression::Decompressor> decompressor_;
+  size_t received_compressed_size_{0};
+  bool resume_supported_{false};
+  size_t uploaded_size_{0};
 };
 
 class TargetFile {
@@ -773,6 +845,179 @@ TEST_F(SecondaryRpcUpgrade, VersionUpgrade) {
   installOstreeRev();
 }
 
+class SecondaryRpcCompression : public SecondaryRpcCommon {
+ protected:
+  SecondaryRpcCompression() : SecondaryRpcCommon(1024 * 1024, HandlerVersion::kV2, VerificationType::kFull) {}
+
+  void enableCompression() {
+    ASSERT_TRUE(ip_secondary_ != nullptr) << "Failed to create IP Secondary";
+    std::dynamic_pointer_cast<Uptane::IpUptaneSecondary>(ip_secondary_)->setCompressionLevel(6);
+  }
+};
+
+/* Images are compressed when compression is enabled for a Secondary. */
+TEST_F(SecondaryRpcCompression, CompressedUpload) {
+  enableCompression();
+  sendAndInstallBinaryImage();
+  EXPECT_GT(secondary_.getReceivedCompressedSize(), 0);
+  EXPECT_LT(secondary_.getReceivedCompressedSize(), image_file_.size());
+}
+
+/* Images are sent as is to Secondaries that do not support compression. */
+TEST_F(SecondaryRpcCompression, Fallback) {
+  enableCompression();
+  secondary_.setCompressionSupported(false);
+  sendAndInstallBinaryImage();
+  EXPECT_EQ(secondary_.getReceivedCompressedSize(), 0);
+}
+
+class SecondaryRpcMetadataCache : public SecondaryRpcCommon {
+ protected:
+  SecondaryRpcMetadataCache() : SecondaryRpcCommon(1024, HandlerVersion::kV2, VerificationType::kFull) {}
+};
+
+/* The metadata loaded by the Primary for an update is sent as is to every
+ * Secondary of that update, without reading the storage again. */
+TEST_F(SecondaryRpcMetadataCache, PutMetadataFrom) {
+  ASSERT_TRUE(ip_secondary_ != nullptr) << "Failed to create IP Secondary";
+  Uptane::Target target = image_file_.createTarget(package_manager_);
+  Uptane::MetaBundle bundle;
+  ASSERT_TRUE(secondary_provider_->getMetadata(&bundle, target));
+  const UpdateMetadataCache cache(std::move(bundle));
+
+  EXPECT_TRUE(ip_secondary_->putMetadataFrom(cache, target).isSuccess());
+  verifyMetadata(secondary_.metadata());
+
+  storage_->storeNonRoot("image-timestamp-v2", Uptane::RepositoryType::Image(), Uptane::Role::Timestamp());
+  EXPECT_TRUE(ip_secondary_->putMetadataFrom(cache, target).isSuccess());
+  verifyMetadata(secondary_.metadata());
+
+  // The next update loads the metadata again.
+  EXPECT_TRUE(ip_secondary_->putMetadata(target).isSuccess());
+  EXPECT_EQ(
+      Uptane::getMetaFromBundle(secondary_.metadata(), Uptane::RepositoryType::Image(), Uptane::Role::Timestamp()),
+      "image-timestamp-v2");
+}
+
+class SecondaryRpcStreaming : public SecondaryRpcCommon {
+ protected:
+  SecondaryRpcStreaming() : SecondaryRpcCommon(64 * 1024, HandlerVersion::kV2, VerificationType::kFull) {}
+
+  // Passes the image to `writer` in pieces, as the Primary does while downloading it.
+  data::InstallationResult streamImage(FirmwareWriter& writer) {
+    const std::string content = Utils::readFile(image_file_.path());
+    const size_t piece_size = 1000;
+    data::InstallationResult result;
+    for (size_t offset = 0; offset < content.size() && result.isSuccess(); offset += piece_size) {
+      const size_t size = std::min(piece_size, content.size() - offset);
+      result = writer.write(reinterpret_cast<const uint8_t*>(content.data()) + offset, size);
+    }
+    return result;
+  }
+};
+
+/* An image streamed in pieces over the network is installed like an uploaded one. */
+TEST_F(SecondaryRpcStreaming, StreamAndInstall) {
+  ASSERT_TRUE(ip_secondary_ != nullptr) << "Failed to create IP Secondary";
+  Uptane::Target target = image_file_.createTarget(package_manager_);
+  ASSERT_TRUE(ip_secondary_->putMetadata(target).isSuccess());
+  verifyMetadata(secondary_.metadata());
+
+  {
+    std::unique_ptr<FirmwareWriter> writer = ip_secondary_->openFirmwareWriter(target);
+    ASSERT_TRUE(writer != nullptr);
+    EXPECT_TRUE(streamImage(*writer).isSuccess());
+  }
+  EXPECT_TRUE(ip_secondary_->install(target).isSuccess());
+  EXPECT_EQ(secondary_.getReceivedImageSize(), image_file_.size());
+  EXPECT_EQ(secondary_.getReceivedImageHash(), image_file_.hash());
+}
+
+/* A piece the Secondary fails to receive ends the stream with its error. */
+TEST_F(SecondaryRpcStreaming, UploadFailure) {
+  ASSERT_TRUE(ip_secondary_ != nullptr) << "Failed to create IP Secondary";
+  Uptane::Target target = image_file_.createTarget(package_manager_);
+  resetHandlers(HandlerVersion::kV2Failure);
+  // Sending the metadata negotiates the protocol version, as before every stream from the Primary.
+  EXPECT_FALSE(ip_secondary_->putMetadata(target).isSuccess());
+
+  std::unique_ptr<FirmwareWriter> writer = ip_secondary_->openFirmwareWriter(target);
+  ASSERT_TRUE(writer != nullptr);
+  const data::InstallationResult result = streamImage(*writer);
+  EXPECT_EQ(result.result_code, data::ResultCode::Numeric::kDownloadFailed);
+  EXPECT_EQ(result.description, secondary_.upload_data_failure);
+}
+
+/* OSTree targets are not streamed, the Secondary pulls them itself. */
+TEST_F(SecondaryRpcStreaming, NotForOstree) {
+  ASSERT_TRUE(ip_secondary_ != nullptr) << "Failed to create IP Secondary";
+  Json::Value target_json;
+  target_json["custom"]["targetFormat"] = "OSTREE";
+  EXPECT_TRUE(ip_secondary_->openFirmwareWriter(Uptane::Target("OSTREE", target_json)) == nullptr);
+}
+
+class SecondaryRpcResume : public SecondaryRpcStreaming {
+ protected:
+  // The Secondary already has the beginning of the image, e.g. from before a restart.
+  Uptane::Target startWithPartialImage() {
+    secondary_.setResumeSupported(true);
+    Uptane::Target target = image_file_.createTarget(package_manager_);
+    EXPECT_TRUE(ip_secondary_->putMetadata(target).isSuccess());
+    secondary_.receivePartialImage(Utils::readFile(image_file_.path()).substr(0, partial_size_));
+    return target;
+  }
+
+  void checkReceivedImage(const Uptane::Target& target) {
+    EXPECT_TRUE(ip_secondary_->install(target).isSuccess());
+    EXPECT_EQ(secondary_.getReceivedImageSize(), image_file_.size());
+    EXPECT_EQ(secondary_.getReceivedImageHash(), image_file_.hash());
+  }
+
+  const size_t partial_size_{10000};
+};
+
+/* An upload resumes after the part of the image the Secondary already has. */
+TEST_F(SecondaryRpcResume, Upload) {
+  ASSERT_TRUE(ip_secondary_ != nullptr) << "Failed to create IP Secondary";
+  const Uptane::Target target = startWithPartialImage();
+  EXPECT_TRUE(ip_secondary_->sendFirmware(target).isSuccess());
+  EXPECT_EQ(secondary_.getUploadedSize(), image_file_.size() - partial_size_);
+  checkReceivedImage(target);
+}
+
+/* A streamed image skips the part the Secondary already has. */
+TEST_F(SecondaryRpcResume, Stream) {
+  ASSERT_TRUE(ip_secondary_ != nullptr) << "Failed to create IP Secondary";
+  const Uptane::Target target = startWithPartialImage();
+  {
+    std::unique_ptr<FirmwareWriter> writer = ip_secondary_->openFirmwareWriter(target);
+    ASSERT_TRUE(writer != nullptr);
+    EXPECT_TRUE(streamImage(*writer).isSuccess());
+  }
+  EXPECT_EQ(secondary_.getUploadedSize(), image_file_.size() - partial_size_);
+  checkReceivedImage(target);
+}
+
+/* Only the rest of the image is compressed. */
+TEST_F(SecondaryRpcResume, Compressed) {
+  ASSERT_TRUE(ip_secondary_ != nullptr) << "Failed to create IP Secondary";
+  std::dynamic_pointer_cast<Uptane::IpUptaneSecondary>(ip_secondary_)->setCompressionLevel(6);
+  const Uptane::Target target = startWithPartialImage();
+  EXPECT_TRUE(ip_secondary_->sendFirmware(target).isSuccess());
+  EXPECT_GT(secondary_.getReceivedCompressedSize(), 0);
+  checkReceivedImage(target);
+}
+
+/* Secondaries that do not resume uploads get the whole image. */
+TEST_F(SecondaryRpcResume, NotSupported) {
+  ASSERT_TRUE(ip_secondary_ != nullptr) << "Failed to create IP Secondary";
+  Uptane::Target target = image_file_.createTarget(package_manager_);
+  ASSERT_TRUE(ip_secondary_->putMetadata(target).isSuccess());
+  EXPECT_TRUE(ip_secondary_->sendFirmware(target).isSuccess());
+  EXPECT_EQ(secondary_.getUploadedSize(), image_file_.size());
+  checkReceivedImage(target);
+}
+
 TEST(SecondaryTcpServer, TestIpSecondaryIfSecondaryIsNotRunning) {
   in_port_t secondary_port = TestUtils::getFreePortAsInt();
   SecondaryInterface::Ptr ip_secondary;
@@ -1,23 +1,52 @@
 #include "update_agent_file.h"
 
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 
-#include <fstream>
+#include "image_sink_file.h"
 #include "libaktualizr/crypto/crypto.h"
 #include "libaktualizr/logging/logging.h"
 #include "uptane/manifest.h"
 
+FileUpdateAgent::FileUpdateAgent(boost::filesystem::path target_filepath, std::string target_name)
+    : FileUpdateAgent(std::make_shared<FileImageSink>(std::move(target_filepath)), std::move(target_name)) {}
+
 // TODO(OTA-4939): Unify this with the check in
 // SotaUptaneClient::getNewTargets() and make it more generic.
-bool FileUpdateAgent::isTargetSupported(const Uptane::Target& target) const { return target.type() != "OSTREE"; }
+bool FileUpdateAgent::isTargetSupported(const Uptane::Target& target) const {
+  if (target.type() == "OSTREE") {
+    return false;
+  }
+  boost::optional<binary_delta::TargetInfo> delta;
+  try {
+    delta = binary_delta::TargetInfo::fromTarget(target);
+  } catch (const std::exception& e) {
+    LOG_ERROR << e.what();
+    return false;
+  }
+  if (!delta) {
+    return true;
+  }
+  // A delta can only be applied to the exact image it was created from.
+  const auto installed_length = sink_->installedLength();
+  if (!installed_length || *installed_length != delta->source_length) {
+    LOG_ERROR << "Delta " << target.filename() << " does not apply to the installed image";
+    return false;
+  }
+  if (hashInstalledImage() != Hash(Hash::Type::kSha256, delta->source_sha256)) {
+    LOG_ERROR << "Delta " << target.filename() << " does not apply to the installed image";
+    return false;
+  }
+  return true;
+}
 
 bool FileUpdateAgent::getInstalledImageInfo(Uptane::InstalledImageInfo& installed_image_info) const {
-  if (boost::filesystem::exists(target_filepath_)) {
-    auto file_content = Utils::readFile(target_filepath_);
-
+  const auto installed_length = sink_->installedLength();
+  if (installed_length) {
     installed_image_info.name = current_target_name_;
-    installed_image_info.len = file_content.size();
-    installed_image_info.hash = Uptane::ManifestIssuer::generateVersionHashStr(file_content);
+    installed_image_info.len = *installed_length;
+    // Same as Uptane::ManifestIssuer::generateVersionHashStr(), without reading a whole partition into memory.
+    installed_image_info.hash = boost::algorithm::to_lower_copy(hashInstalledImage().HashString());
   } else {
     // mimic the Primary's fake package manager behavior
     auto unknown_target = Uptane::Target::Unknown();
@@ -30,46 +59,63 @@ bool FileUpdateAgent::getInstalledImageInfo(Uptane::InstalledImageInfo& installe
 }
 
 data::InstallationResult FileUpdateAgent::install(const Uptane::Target& target) {
-  if (!boost::filesystem::exists(new_target_filepath_)) {
+  const auto delta = binary_delta::TargetInfo::fromTarget(target);
+  if (delta) {
+    auto result = checkDelta(target, *delta);
+    if (!result.isSuccess()) {
+      discardReceivedData();
+      return result;
+    }
+  } else if (sink_->received() == 0) {
     LOG_ERROR << "The target image has not been received";
     return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
                                     "The target image has not been received");
   }
 
-  auto received_target_image_size = boost::filesystem::file_size(new_target_filepath_);
-  if (received_target_image_size != target.length()) {
+  auto received_target_image_size = sink_->received();
+  if (!delta && received_target_image_size != target.length()) {
     LOG_ERROR << "Received image size does not match the size specified in Target metadata: "
               << received_target_image_size << " != " << target.length();
-    boost::filesystem::remove(new_target_filepath_);
+    discardReceivedData();
     return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
                                     "Received image size does not match the size specified in Target metadata: " +
                                         std::to_string(received_target_image_size) +
                                         " != " + std::to_string(target.length()));
   }
 
-  if (!target.MatchHash(new_target_hasher_->getHash())) {
+  if (!delta && new_target_hasher_ == nullptr) {
+    try {
+      resumeHashing(target);
+    } catch (const std::exception& e) {
+      LOG_ERROR << "Failed to read the received image: " << e.what();
+      return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                      std::string("Failed to read the received image: ") + e.what());
+    }
+  }
+  if (!delta && !target.MatchHash(new_target_hasher_->getHash())) {
     LOG_ERROR << "The received image's hash does not match the hash specified in Target metadata: "
               << new_target_hasher_->getHash() << " != " << getTargetHash(target).HashString();
+    const std::string received_hash = new_target_hasher_->getHash().HashString();
+    // Otherwise a resumed upload would keep the corrupted data.
+    discardReceivedData();
     return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
                                     "The received image's hash does not match the hash specified in Target metadata: " +
-                                        new_target_hasher_->getHash().HashString() +
-                                        " != " + getTargetHash(target).HashString());
+                                        received_hash + " != " + getTargetHash(target).HashString());
   }
 
-  boost::filesystem::rename(new_target_filepath_, target_filepath_);
-
-  if (boost::filesystem::exists(new_target_filepath_)) {
+  installed_hash_ = boost::none;
+  try {
+    sink_->commit();
+  } catch (const std::exception& e) {
+    LOG_ERROR << "Failed to install the target image: " << e.what();
     return data::InstallationResult(data::ResultCode::Numeric::kInstallFailed,
                                     "The target image has not been installed");
   }
 
-  if (!boost::filesystem::exists(target_filepath_)) {
-    return data::InstallationResult(data::ResultCode::Numeric::kInstallFailed,
-                                    "The target image has not been installed");
-  }
-
-  current_target_name_ = target.filename();
+  // After a delta, the ECU runs the image it produced.
+  current_target_name_ = delta ? delta->target_name : target.filename();
   new_target_hasher_.reset();
+  delta_image_hasher_.reset();
   return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
 }
 
@@ -82,64 +128,162 @@ data::InstallationResult FileUpdateAgent::applyPendingInstall(const Uptane::Targ
 }
 
 data::InstallationResult FileUpdateAgent::receiveData(const Uptane::Target& target, const uint8_t* data, size_t size) {
-  std::ofstream target_file(new_target_filepath_.c_str(),
-                            std::ofstream::out | std::ofstream::binary | std::ofstream::app);
-
-  if (!target_file.good()) {
-    LOG_ERROR << "Failed to open a new target image file";
-    return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
-                                    "Failed to open a new target image file");
+  const auto delta = binary_delta::TargetInfo::fromTarget(target);
+  if (delta) {
+    return receiveDelta(target, *delta, data, size);
   }
 
-  auto current_new_image_size = target_file.tellp();
-  if (-1 == current_new_image_size) {
-    LOG_ERROR << "Failed to obtain a size of the new target image that is being uploaded";
-    target_file.close();
-    return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
-                                    "Failed to obtain a size of the new target image that is being uploaded");
-  }
-
-  if (static_cast<uint64_t>(current_new_image_size) >= target.length()) {
+  const uint64_t current_new_image_size = sink_->received();
+  if (current_new_image_size >= target.length()) {
     LOG_ERROR << "The size of the received image data exceeds the expected Target image size: "
               << current_new_image_size << " != " << target.length();
-    target_file.close();
     return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
                                     "The size of the received image data exceeds the expected Target image size: " +
                                         std::to_string(current_new_image_size) +
                                         " != " + std::to_string(target.length()));
   }
 
-  if (current_new_image_size == 0) {
-    new_target_hasher_ = MultiPartHasher::create(getTargetHash(target).type());
-  }
-
-  target_file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
-  auto written_data_size = target_file.tellp() - current_new_image_size;
-
-  if (written_data_size < 0 || static_cast<size_t>(written_data_size) != size) {
-    LOG_ERROR << "The size of data written is not equal to the received data size: " << written_data_size
-              << " != " << size;
-    target_file.close();
+  try {
+    if (current_new_image_size == 0 || new_target_hasher_ == nullptr) {
+      resumeHashing(target);
+    }
+    sink_->write(data, size);
+  } catch (const std::exception& e) {
+    LOG_ERROR << "Failed to store the received image data: " << e.what();
+    // Whatever part of the data was stored is hashed again with the next piece.
+    new_target_hasher_.reset();
     return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
-                                    "The size of data written is not equal to the received data size: " +
-                                        std::to_string(written_data_size) + " != " + std::to_string(size));
+                                    std::string("Failed to store the received image data: ") + e.what());
   }
+  new_target_hasher_->update(data, size);
 
-  target_file.close();
-
-  auto total_size = current_new_image_size + written_data_size;
+  const uint64_t total_size = current_new_image_size + size;
   LOG_DEBUG << "Received and stored data of a new target image."
                " Received in this request (bytes): "
             << size << "; total received so far: " << total_size << "; expected total: " << target.length();
-  if (static_cast<uint64_t>(total_size) == target.length()) {
+  if (total_size == target.length()) {
     LOG_INFO << "Successfully received and stored new target image of " << total_size << " bytes.";
   }
 
+  return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+}
+
+data::InstallationResult FileUpdateAgent::receiveDelta(const Uptane::Target& target,
+                                                       const binary_delta::TargetInfo& delta, const uint8_t* data,
+                                                       size_t size) {
+  if (delta_received_ + size > target.length()) {
+    LOG_ERROR << "The size of the received delta exceeds the expected Target size: " << delta_received_ + size
+              << " != " << target.length();
+    discardReceivedData();
+    return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                    "The size of the received delta exceeds the expected Target size");
+  }
+
+  try {
+    if (!delta_applier_) {
+      discardReceivedData();
+      const auto installed_length = sink_->installedLength();
+      if (!installed_length) {
+        throw std::runtime_error("No image is installed");
+      }
+      new_target_hasher_ = MultiPartHasher::create(getTargetHash(target).type());
+      delta_image_hasher_ = MultiPartHasher::create(Hash::Type::kSha256);
+      const uint64_t image_length = delta.length;
+      delta_applier_ = std_::make_unique<binary_delta::Applier>(
+          sink_->installedPath(), *installed_length, [this, image_length](const char* out, size_t out_size) {
+            if (delta_applier_->written() + out_size > image_length) {
+              throw std::runtime_error("The delta produces a larger image than expected");
+            }
+            sink_->write(reinterpret_cast<const uint8_t*>(out), out_size);
+            delta_image_hasher_->update(reinterpret_cast<const unsigned char*>(out), out_size);
+          });
+    }
+    delta_applier_->feed(data, size);
+  } catch (const std::exception& e) {
+    LOG_ERROR << "Failed to apply delta " << target.filename() << ": " << e.what();
+    discardReceivedData();
+    return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                    std::string("Failed to apply the delta: ") + e.what());
+  }
+
   new_target_hasher_->update(data, size);
+  delta_received_ += size;
+  LOG_DEBUG << "Applied " << size << " bytes of delta; total received so far: " << delta_received_
+            << "; expected total: " << target.length();
+  return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+}
 
+data::InstallationResult FileUpdateAgent::checkDelta(const Uptane::Target& target,
+                                                     const binary_delta::TargetInfo& delta) {
+  if (!delta_applier_ || delta_received_ != target.length() || !delta_applier_->finished()) {
+    LOG_ERROR << "The delta has not been received completely";
+    return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                    "The delta has not been received completely");
+  }
+  if (!target.MatchHash(new_target_hasher_->getHash())) {
+    LOG_ERROR << "The received delta's hash does not match the hash specified in Target metadata";
+    return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed,
+                                    "The received delta's hash does not match the hash specified in Target metadata");
+  }
+  const Hash image_hash = delta_image_hasher_->getHash();
+  if (delta_applier_->written() != delta.length || image_hash != Hash(Hash::Type::kSha256, delta.sha256)) {
+    LOG_ERROR << "The image produced by the delta does not match Target metadata: " << image_hash
+              << " != " << delta.sha256;
+    return data::InstallationResult(data::ResultCode::Numeric::kInstallFailed,
+                                    "The image produced by the delta does not match Target metadata");
+  }
+  delta_applier_.reset();
+  delta_received_ = 0;
   return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
 }
 
+void FileUpdateAgent::discardReceivedData() {
+  delta_applier_.reset();
+  delta_image_hasher_.reset();
+  delta_received_ = 0;
+  try {
+    sink_->discard();
+  } catch (const std::exception& e) {
+    LOG_WARNING << "Failed to discard the received image data: " << e.what();
+  }
+  new_target_hasher_.reset();
+}
+
+uint64_t FileUpdateAgent::resumeOffset(const Uptane::Target& target) {
+  const uint64_t received = sink_->received();
+  // The state of a delta being applied is not kept.
+  if (received == 0 || binary_delta::TargetInfo::fromTarget(target) || received > target.length()) {
+    discardReceivedData();
+    return 0;
+  }
+  if (new_target_hasher_ == nullptr) {
+    try {
+      resumeHashing(target);
+    } catch (const std::exception& e) {
+      LOG_WARNING << "Failed to read the received image: " << e.what();
+      discardReceivedData();
+      return 0;
+    }
+  }
+  return received;
+}
+
+void FileUpdateAgent::resumeHashing(const Uptane::Target& target) {
+  new_target_hasher_ = MultiPartHasher::create(getTargetHash(target).type());
+  // Part of the image may have been stored before a restart.
+  auto hasher = new_target_hasher_;
+  sink_->readReceived([hasher](const uint8_t* buf, size_t buf_size) { hasher->update(buf, buf_size); });
+}
+
+Hash FileUpdateAgent::hashInstalledImage() const {
+  if (!installed_hash_) {
+    auto hasher = MultiPartHasher::create(Hash::Type::kSha256);
+    sink_->readInstalled([&hasher](const uint8_t* buf, size_t buf_size) { hasher->update(buf, buf_size); });
+    installed_hash_ = hasher->getHash();
+  }
+  return *installed_hash_;
+}
+
 Hash FileUpdateAgent::getTargetHash(const Uptane::Target& target) {
   // TODO(OTA-4831): check target.hashes() size.
   return target.hashes()[0];
@@ -1,19 +1,27 @@
 #ifndef AKTUALIZR_SECONDARY_UPDATE_AGENT_FILE_H
 #define AKTUALIZR_SECONDARY_UPDATE_AGENT_FILE_H
 
+#include <memory>
+
+#include "image_sink.h"
 #include "update_agent.h"
+#include "utilities/binary_delta.h"
 
 class FileUpdateAgent : public UpdateAgent {
  public:
-  FileUpdateAgent(boost::filesystem::path target_filepath, std::string target_name)
-      : target_filepath_{std::move(target_filepath)},
-        new_target_filepath_{target_filepath_.string() + ".newtarget"},
-        current_target_name_{std::move(target_name)} {}
+  FileUpdateAgent(boost::filesystem::path target_filepath, std::string target_name);
+  FileUpdateAgent(ImageSink::Ptr sink, std::string target_name)
+      : sink_{std::move(sink)}, current_target_name_{std::move(target_name)} {}
 
   bool isTargetSupported(const Uptane::Target& target) const override;
   bool getInstalledImageInfo(Uptane::InstalledImageInfo& installed_image_info) const override;
 
   virtual data::InstallationResult receiveData(const Uptane::Target& target, const uint8_t* data, size_t size);
+  // Drops the data received so far, e.g. of an interrupted upload.
+  void discardReceivedData();
+  // Bytes of `target` received so far, e.g. before a restart, that an upload
+  // can resume after. Drops them if it can't be resumed.
+  uint64_t resumeOffset(const Uptane::Target& target);
   data::InstallationResult install(const Uptane::Target& target) override;
 
   void completeInstall() override;
@@ -21,11 +29,23 @@ class FileUpdateAgent : public UpdateAgent {
 
  private:
   static Hash getTargetHash(const Uptane::Target& target);
+  data::InstallationResult receiveDelta(const Uptane::Target& target, const binary_delta::TargetInfo& delta,
+                                        const uint8_t* data, size_t size);
+  data::InstallationResult checkDelta(const Uptane::Target& target, const binary_delta::TargetInfo& delta);
+
+  void resumeHashing(const Uptane::Target& target);
+  Hash hashInstalledImage() const;
 
-  const boost::filesystem::path target_filepath_;
-  const boost::filesystem::path new_target_filepath_;
+  const ImageSink::Ptr sink_;
   std::string current_target_name_;
+  // The installed image only changes on install(), so it is hashed once rather than for every manifest.
+  mutable boost::optional<Hash> installed_hash_;
   std::shared_ptr<MultiPartHasher> new_target_hasher_;
+
+  // State of a delta being applied: the new image is written to the sink while the delta arrives.
+  std::unique_ptr<binary_delta::Applier> delta_applier_;
+  std::shared_ptr<MultiPartHasher> delta_image_hasher_;
+  uint64_t delta_received_{0};
 };
 
 #endif  // AKTUALIZR_SECONDARY_UPDATE_AGENT_FILE_H
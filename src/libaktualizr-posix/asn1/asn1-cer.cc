@@ -1,7 +1,7 @@
 #include "asn1-cer.h"
 #include <algorithm>
 
-static std::string cer_encode_length(size_t len) {
+std::string cer_encode_length(size_t len) {
   std::string res;
   // 1-byte length
   if (len <= 127) {
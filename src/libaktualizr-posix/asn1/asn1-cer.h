@@ -56,6 +56,8 @@ class deserialization_error : public std::exception {
 
 uint8_t cer_decode_token(const std::string& ber, int32_t* endpos, int32_t* int_param, std::string* string_param);
 
+// Definite-form length, which is also valid DER.
+std::string cer_encode_length(size_t len);
 std::string cer_encode_integer(int32_t number);
 std::string cer_encode_string(const std::string& contents, ASN1_UniversalTag tag);
 
@@ -99,6 +99,12 @@ class Asn1Message {
   ASN1_MESSAGE_DEFINE_ACCESSOR(AKPutRootReqMes_t, putRootReq);
   ASN1_MESSAGE_DEFINE_ACCESSOR(AKPutRootRespMes_t, putRootResp);
 
+  ASN1_MESSAGE_DEFINE_ACCESSOR(AKUploadCompressionReqMes_t, uploadCompressionReq);
+  ASN1_MESSAGE_DEFINE_ACCESSOR(AKUploadCompressionRespMes_t, uploadCompressionResp);
+  ASN1_MESSAGE_DEFINE_ACCESSOR(AKUploadCompressedDataReqMes_t, uploadCompressedDataReq);
+  ASN1_MESSAGE_DEFINE_ACCESSOR(AKUploadStartReqMes_t, uploadStartReq);
+  ASN1_MESSAGE_DEFINE_ACCESSOR(AKUploadStartRespMes_t, uploadStartResp);
+
 #define ASN1_MESSAGE_DEFINE_STR_NAME(MessageID) \
   case MessageID:                               \
     return #MessageID;
@@ -132,6 +138,12 @@ class Asn1Message {
         ASN1_MESSAGE_DEFINE_STR_NAME(AKIpUptaneMes_PR_rootVerResp);
         ASN1_MESSAGE_DEFINE_STR_NAME(AKIpUptaneMes_PR_putRootReq);
         ASN1_MESSAGE_DEFINE_STR_NAME(AKIpUptaneMes_PR_putRootResp);
+
+        ASN1_MESSAGE_DEFINE_STR_NAME(AKIpUptaneMes_PR_uploadCompressionReq);
+        ASN1_MESSAGE_DEFINE_STR_NAME(AKIpUptaneMes_PR_uploadCompressionResp);
+        ASN1_MESSAGE_DEFINE_STR_NAME(AKIpUptaneMes_PR_uploadCompressedDataReq);
+        ASN1_MESSAGE_DEFINE_STR_NAME(AKIpUptaneMes_PR_uploadStartReq);
+        ASN1_MESSAGE_DEFINE_STR_NAME(AKIpUptaneMes_PR_uploadStartResp);
     }
     return "Unknown";
   };
@@ -183,6 +195,24 @@ void SetString(OCTET_STRING_t* dest, const std::string& str);
 Asn1Message::Ptr Asn1Rpc(const Asn1Message::Ptr& tx, int con_fd);
 Asn1Message::Ptr Asn1Rpc(const Asn1Message::Ptr& tx, const std::pair<std::string, uint16_t>& addr);
 
+/**
+ * Same as above, but for a message that is already DER-encoded.
+ */
+Asn1Message::Ptr Asn1Rpc(const std::string& tx, int con_fd);
+Asn1Message::Ptr Asn1Rpc(const std::string& tx, const std::pair<std::string, uint16_t>& addr);
+
+/**
+ * DER-encode a metadata collection on its own, so that the result can be
+ * shared by several putMetaReq2 messages.
+ */
+std::string Asn1EncodeMetaCollection(const AKMetaCollection_t& collection);
+
+/**
+ * Assemble a DER-encoded putMetaReq2 message out of two collections encoded
+ * with Asn1EncodeMetaCollection().
+ */
+std::string Asn1EncodePutMetaReq2(const std::string& image_collection, const std::string& director_collection);
+
 /*
  * Helper function for creating pointers to ASN.1 types. Note that the encoder
  * will free these objects for you.
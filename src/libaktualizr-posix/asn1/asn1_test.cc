@@ -263,6 +263,52 @@ TEST(asn1_common, parse) {
   EXPECT_EQ(AKIpUptaneMes_PR_sendFirmwareReq, msg->present());
 }
 
+static void addMetaJson(AKMetaCollection_t& collection, const std::string& role, const std::string& json) {
+  auto* meta_json = Asn1Allocation<AKMetaJson_t>();
+  SetString(&meta_json->role, role);
+  SetString(&meta_json->json, json);
+  ASN_SEQUENCE_ADD(&collection, meta_json);
+}
+
+/* A putMetaReq2 assembled from separately encoded collections is identical to
+ * the one encoded in one go. */
+TEST(asn1_common, PutMetaReq2Splice) {
+  Asn1Message::Ptr original(Asn1Message::Empty());
+  original->present(AKIpUptaneMes_PR_putMetaReq2);
+  auto m = original->putMetaReq2();
+  m->imageRepo.present = imageRepo_PR_collection;
+  m->directorRepo.present = directorRepo_PR_collection;
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+  AKMetaCollection_t& image = m->imageRepo.choice.collection;
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+  AKMetaCollection_t& director = m->directorRepo.choice.collection;
+  addMetaJson(image, "root", std::string(300, 'r'));
+  addMetaJson(image, "timestamp", "{}");
+  addMetaJson(image, "snapshot", std::string(70000, 's'));
+  addMetaJson(image, "targets", std::string(1000, 't'));
+  addMetaJson(director, "root", std::string(10, 'R'));
+  addMetaJson(director, "targets", std::string(200, 'T'));
+
+  std::string expected;
+  der_encode(&asn_DEF_AKIpUptaneMes, &original->msg_, Asn1StringAppendCallback, &expected);
+  EXPECT_EQ(Asn1EncodePutMetaReq2(Asn1EncodeMetaCollection(image), Asn1EncodeMetaCollection(director)), expected);
+
+  // TUF-only Secondaries get an empty Director collection.
+  Asn1Message::Ptr tuf(Asn1Message::Empty());
+  tuf->present(AKIpUptaneMes_PR_putMetaReq2);
+  auto t = tuf->putMetaReq2();
+  t->imageRepo.present = imageRepo_PR_collection;
+  t->directorRepo.present = directorRepo_PR_collection;
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+  addMetaJson(t->imageRepo.choice.collection, "root", "{}");
+  expected.clear();
+  der_encode(&asn_DEF_AKIpUptaneMes, &tuf->msg_, Asn1StringAppendCallback, &expected);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+  EXPECT_EQ(Asn1EncodePutMetaReq2(Asn1EncodeMetaCollection(t->imageRepo.choice.collection),
+                                  Asn1EncodeMetaCollection(t->directorRepo.choice.collection)),
+            expected);
+}
+
 TEST(asn1_common, Asn1MessageFromRawNull) {
   Asn1Message::FromRaw(nullptr);
   AKIpUptaneMes_t* m = nullptr;
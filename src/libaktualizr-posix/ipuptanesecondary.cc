@@ -2,25 +2,76 @@
 
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 
-#include <array>
 #include <fstream>
+#include <functional>
 #include <memory>
+#include <vector>
 
 #include "asn1/asn1_message.h"
 #include "der_encoder.h"
 #include "libaktualizr/secondary_provider.h"
 #include "libaktualizr/logging/logging.h"
+#include "libaktualizr/metrics.h"
 #include "libaktualizr/uptane/tuf.h"
 #include "libaktualizr/utilities/utils.h"
+#include "utilities/compression.h"
 
 namespace Uptane {
 
+namespace {
+
+std::string encodeImageCollection(const MetaBundle& meta_bundle) {
+  Asn1Message::Ptr holder(Asn1Message::Empty());
+  holder->present(AKIpUptaneMes_PR_putMetaReq2);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+  AKMetaCollection_t& collection = holder->putMetaReq2()->imageRepo.choice.collection;
+  for (const auto& role : {Role::Root(), Role::Timestamp(), Role::Snapshot(), Role::Targets()}) {
+    IpUptaneSecondary::addMetadata(meta_bundle, RepositoryType::Image(), role, collection);
+  }
+  return Asn1EncodeMetaCollection(collection);
+}
+
+// Sends each piece of a streamed image as one upload request, except for the
+// first `skip` bytes that the Secondary already has.
+class UploadDataWriter : public FirmwareWriter {
+ public:
+  UploadDataWriter(uint64_t skip, std::function<data::InstallationResult(const uint8_t*, size_t)> upload)
+      : skip_(skip), upload_(std::move(upload)) {}
+  data::InstallationResult write(const uint8_t* data, size_t size) override {
+    if (skip_ >= size) {
+      skip_ -= size;
+      return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+    }
+    data += skip_;
+    size -= static_cast<size_t>(skip_);
+    skip_ = 0;
+    return upload_(data, size);
+  }
+
+ private:
+  uint64_t skip_;
+  std::function<data::InstallationResult(const uint8_t*, size_t)> upload_;
+};
+
+}  // namespace
+
 SecondaryInterface::Ptr IpUptaneSecondary::connectAndCreate(const std::string& address, unsigned short port,
-                                                            VerificationType verification_type) {
+                                                            VerificationType verification_type,
+                                                            std::chrono::milliseconds timeout) {
   LOG_INFO << "Connecting to and getting info about IP Secondary: " << address << ":" << port << "...";
 
   ConnectionSocket con_sock{address, port};
+  if (timeout > std::chrono::milliseconds::zero()) {
+    // On Linux, SO_SNDTIMEO also applies to connect().
+    struct timeval tv {};
+    tv.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+    tv.tv_usec = static_cast<suseconds_t>((timeout.count() % 1000) * 1000);
+    setsockopt(*con_sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(*con_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  }
 
   if (con_sock.connect() == 0) {
     LOG_INFO << "Connected to IP Secondary: "
@@ -62,12 +113,13 @@ SecondaryInterface::Ptr IpUptaneSecondary::create(const std::string& address, un
 
 SecondaryInterface::Ptr IpUptaneSecondary::connectAndCheck(const std::string& address, unsigned short port,
                                                            VerificationType verification_type, EcuSerial serial,
-                                                           HardwareIdentifier hw_id, PublicKey pub_key) {
+                                                           HardwareIdentifier hw_id, PublicKey pub_key,
+                                                           std::chrono::milliseconds timeout) {
   // try to connect:
   // - if it succeeds compare with what we expect
   // - otherwise, keep using what we know
   try {
-    auto sec = IpUptaneSecondary::connectAndCreate(address, port, verification_type);
+    auto sec = IpUptaneSecondary::connectAndCreate(address, port, verification_type, timeout);
     if (sec != nullptr) {
       auto s = sec->getSerial();
       if (s != serial && serial != EcuSerial::Unknown()) {
@@ -105,7 +157,20 @@ IpUptaneSecondary::IpUptaneSecondary(const std::string& address, unsigned short
       verification_type_{verification_type},
       serial_{std::move(serial)},
       hw_id_{std::move(hw_id)},
-      pub_key_{std::move(pub_key)} {}
+      pub_key_{std::move(pub_key)},
+      rpc_latency_{metrics::Registry::global().histogram("aktualizr_secondary_rpc_seconds",
+                                                         "Round-trip time of requests to IP Secondaries",
+                                                         metrics::latencyBuckets(), {{"ecu", serial_.ToString()}})} {}
+
+Asn1Message::Ptr IpUptaneSecondary::rpc(const Asn1Message::Ptr& req) const {
+  metrics::ScopedTimer timer(rpc_latency_);
+  return Asn1Rpc(req, getAddr());
+}
+
+Asn1Message::Ptr IpUptaneSecondary::rpc(const std::string& req) const {
+  metrics::ScopedTimer timer(rpc_latency_);
+  return Asn1Rpc(req, getAddr());
+}
 
 /* Determine the best protocol version to use for this Secondary. This did not
  * exist for v1 and thus only works for v2 and beyond. It would be great if we
@@ -119,7 +184,7 @@ void IpUptaneSecondary::getSecondaryVersion() const {
   req->present(AKIpUptaneMes_PR_versionReq);
   auto m = req->versionReq();
   m->version = latest_version;
-  auto resp = Asn1Rpc(req, getAddr());
+  auto resp = rpc(req);
 
   if (resp->present() != AKIpUptaneMes_PR_versionResp) {
     // Bad response probably means v1, but make sure the Secondary is actually
@@ -158,13 +223,22 @@ data::InstallationResult IpUptaneSecondary::putMetadata(const Target& target) {
     return data::InstallationResult(data::ResultCode::Numeric::kInternalError,
                                     "Unable to load stored metadata from Primary");
   }
+  return putMetadataBundle(meta_bundle, nullptr);
+}
+
+data::InstallationResult IpUptaneSecondary::putMetadataFrom(const UpdateMetadataCache& metadata, const Target& target) {
+  (void)target;
+  return putMetadataBundle(metadata.bundle(), &metadata);
+}
 
+data::InstallationResult IpUptaneSecondary::putMetadataBundle(const Uptane::MetaBundle& meta_bundle,
+                                                              const UpdateMetadataCache* cache) {
   getSecondaryVersion();
 
   LOG_INFO << "Sending Uptane metadata to the Secondary";
   data::InstallationResult put_result;
   if (protocol_version == 2) {
-    put_result = putMetadata_v2(meta_bundle);
+    put_result = putMetadata_v2(meta_bundle, cache);
   } else if (protocol_version == 1) {
     put_result = putMetadata_v1(meta_bundle);
   } else {
@@ -206,7 +280,7 @@ data::InstallationResult IpUptaneSecondary::putMetadata_v1(const Uptane::MetaBun
   SetString(&m->image.choice.json.targets,
             getMetaFromBundle(meta_bundle, Uptane::RepositoryType::Image(), Uptane::Role::Targets()));
 
-  auto resp = Asn1Rpc(req, getAddr());
+  auto resp = rpc(req);
 
   if (resp->present() != AKIpUptaneMes_PR_putMetaResp) {
     LOG_ERROR << "Secondary " << getSerial() << " failed to respond to a request to receive metadata.";
@@ -232,30 +306,29 @@ void IpUptaneSecondary::addMetadata(const Uptane::MetaBundle& meta_bundle, const
   ASN_SEQUENCE_ADD(&collection, meta_json);
 }
 
-data::InstallationResult IpUptaneSecondary::putMetadata_v2(const Uptane::MetaBundle& meta_bundle) {
-  Asn1Message::Ptr req(Asn1Message::Empty());
-  req->present(AKIpUptaneMes_PR_putMetaReq2);
-  auto m = req->putMetaReq2();
-
-  m->directorRepo.present = directorRepo_PR_collection;
+data::InstallationResult IpUptaneSecondary::putMetadata_v2(const Uptane::MetaBundle& meta_bundle,
+                                                           const UpdateMetadataCache* cache) {
+  // Only the Director part is specific to this Secondary.
+  Asn1Message::Ptr director(Asn1Message::Empty());
+  director->present(AKIpUptaneMes_PR_putMetaReq2);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+  AKMetaCollection_t& director_collection = director->putMetaReq2()->directorRepo.choice.collection;
   if (verification_type_ != VerificationType::kTuf) {
-    addMetadata(meta_bundle, Uptane::RepositoryType::Director(), Uptane::Role::Root(),
-                m->directorRepo.choice.collection);  // NOLINT(cppcoreguidelines-pro-type-union-access)
-    addMetadata(meta_bundle, Uptane::RepositoryType::Director(), Uptane::Role::Targets(),
-                m->directorRepo.choice.collection);  // NOLINT(cppcoreguidelines-pro-type-union-access)
+    addMetadata(meta_bundle, Uptane::RepositoryType::Director(), Uptane::Role::Root(), director_collection);
+    addMetadata(meta_bundle, Uptane::RepositoryType::Director(), Uptane::Role::Targets(), director_collection);
   }
 
-  m->imageRepo.present = imageRepo_PR_collection;
-  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
-  addMetadata(meta_bundle, Uptane::RepositoryType::Image(), Uptane::Role::Root(), m->imageRepo.choice.collection);
-  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
-  addMetadata(meta_bundle, Uptane::RepositoryType::Image(), Uptane::Role::Timestamp(), m->imageRepo.choice.collection);
-  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
-  addMetadata(meta_bundle, Uptane::RepositoryType::Image(), Uptane::Role::Snapshot(), m->imageRepo.choice.collection);
-  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
-  addMetadata(meta_bundle, Uptane::RepositoryType::Image(), Uptane::Role::Targets(), m->imageRepo.choice.collection);
+  // The Image repo part is the same for every Secondary of the update, so it
+  // is only encoded once.
+  std::shared_ptr<const std::string> image;
+  if (cache != nullptr) {
+    image = cache->encoded("ip-image-collection", [&meta_bundle]() { return encodeImageCollection(meta_bundle); });
+  } else {
+    image = std::make_shared<const std::string>(encodeImageCollection(meta_bundle));
+  }
+  const std::string req = Asn1EncodePutMetaReq2(*image, Asn1EncodeMetaCollection(director_collection));
 
-  auto resp = Asn1Rpc(req, getAddr());
+  auto resp = rpc(req);
 
   if (resp->present() != AKIpUptaneMes_PR_putMetaResp2) {
     LOG_ERROR << "Secondary " << getSerial() << " failed to respond to a request to receive metadata.";
@@ -282,7 +355,7 @@ int32_t IpUptaneSecondary::getRootVersion(bool director) const {
     m->repotype = AKRepoType_image;
   }
 
-  auto resp = Asn1Rpc(req, getAddr());
+  auto resp = rpc(req);
   if (resp->present() != AKIpUptaneMes_PR_rootVerResp) {
     // v1 (and v2 until this was added) Secondaries won't understand this.
     // Return 0 to indicate that this is unsupported. Sending intermediate Roots
@@ -312,7 +385,7 @@ data::InstallationResult IpUptaneSecondary::putRoot(const std::string& root, boo
   }
   SetString(&m->json, root);
 
-  auto resp = Asn1Rpc(req, getAddr());
+  auto resp = rpc(req);
   if (resp->present() != AKIpUptaneMes_PR_putRootResp) {
     LOG_ERROR << "Secondary " << getSerial() << " failed to respond to a request to receive Root metadata.";
     return data::InstallationResult(
@@ -331,7 +404,7 @@ Manifest IpUptaneSecondary::getManifest() const {
   Asn1Message::Ptr req(Asn1Message::Empty());
 
   req->present(AKIpUptaneMes_PR_manifestReq);
-  auto resp = Asn1Rpc(req, getAddr());
+  auto resp = rpc(req);
 
   if (resp->present() != AKIpUptaneMes_PR_manifestResp) {
     LOG_ERROR << "Secondary " << getSerial() << " failed to respond to a manifest request.";
@@ -353,7 +426,7 @@ bool IpUptaneSecondary::ping() const {
 
   auto m = req->getInfoReq();
 
-  auto resp = Asn1Rpc(req, getAddr());
+  auto resp = rpc(req);
 
   return resp->present() == AKIpUptaneMes_PR_getInfoResp;
 }
@@ -391,7 +464,7 @@ data::InstallationResult IpUptaneSecondary::sendFirmware_v1(const Uptane::Target
 
   auto m = req->sendFirmwareReq();
   SetString(&m->firmware, data_to_send);
-  auto resp = Asn1Rpc(req, getAddr());
+  auto resp = rpc(req);
 
   if (resp->present() != AKIpUptaneMes_PR_sendFirmwareResp) {
     LOG_ERROR << "Secondary " << getSerial() << " failed to respond to a request to receive firmware.";
@@ -416,6 +489,22 @@ data::InstallationResult IpUptaneSecondary::sendFirmware_v2(const Uptane::Target
   }
 }
 
+std::unique_ptr<FirmwareWriter> IpUptaneSecondary::openFirmwareWriter(const Uptane::Target& target) {
+  // Version 1 only accepts the whole image in one message.
+  if (target.IsOstree() || protocol_version != 2) {
+    return nullptr;
+  }
+  LOG_INFO << "Streaming the target image (" << target.filename() << ") to the Secondary (" << getSerial() << ")";
+  uint64_t offset = 0;
+  if (!startUpload(target, &offset).isSuccess()) {
+    return nullptr;
+  }
+  std::shared_ptr<compression::Compressor> compressor = startCompression();
+  return std_::make_unique<UploadDataWriter>(offset, [this, compressor](const uint8_t* data, size_t size) {
+    return uploadFirmwareData(compressor.get(), data, size);
+  });
+}
+
 data::InstallationResult IpUptaneSecondary::install(const Uptane::Target& target) {
   data::InstallationResult install_result;
   if (protocol_version == 2) {
@@ -441,7 +530,7 @@ data::InstallationResult IpUptaneSecondary::install_v1(const Uptane::Target& tar
   auto req_mes = req->installReq();
   SetString(&req_mes->hash, target.filename());
   // send request and receive response, a request-response type of RPC
-  auto resp = Asn1Rpc(req, getAddr());
+  auto resp = rpc(req);
 
   // invalid type of an response message
   if (resp->present() != AKIpUptaneMes_PR_installResp) {
@@ -470,7 +559,7 @@ data::InstallationResult IpUptaneSecondary::downloadOstreeRev(const Uptane::Targ
 
   auto m = req->downloadOstreeRevReq();
   SetString(&m->tlsCred, tls_creds);
-  auto resp = Asn1Rpc(req, getAddr());
+  auto resp = rpc(req);
 
   if (resp->present() != AKIpUptaneMes_PR_downloadOstreeRevResp) {
     LOG_ERROR << "Secondary " << getSerial() << " failed to respond to a request to download an OSTree commit.";
@@ -489,17 +578,30 @@ data::InstallationResult IpUptaneSecondary::uploadFirmware(const Uptane::Target&
 
   auto upload_result = data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed, "");
 
+  uint64_t offset = 0;
+  const auto start_result = startUpload(target, &offset);
+  if (!start_result.isSuccess()) {
+    return start_result;
+  }
   auto image_reader = secondary_provider_->getTargetFileHandle(target);
+  if (offset > 0) {
+    LOG_INFO << "Secondary " << getSerial() << " already has " << offset << " bytes of the image; uploading the rest";
+    image_reader.seekg(static_cast<std::streamoff>(offset));
+  }
+  const std::unique_ptr<compression::Compressor> compressor = startCompression();
 
   uint64_t image_size = target.length();
-  const size_t size = 1024;
-  size_t total_send_data = 0;
-  std::array<uint8_t, size> buf{};
+  // Every compressed piece ends with a flush, which costs a few bytes and
+  // resets the compression, so compressed data is sent in bigger pieces.
+  const size_t size = compressor != nullptr ? 64 * 1024 : 1024;
+  uint64_t total_send_data = offset;
+  std::vector<uint8_t> buf(size);
   auto upload_data_result = data::InstallationResult(data::ResultCode::Numeric::kOk, "");
 
   while (total_send_data < image_size && upload_data_result.isSuccess()) {
-    image_reader.read(reinterpret_cast<char*>(buf.data()), buf.size());
-    upload_data_result = uploadFirmwareData(buf.data(), static_cast<size_t>(image_reader.gcount()));
+    image_reader.read(reinterpret_cast<char*>(buf.data()), static_cast<std::streamsize>(buf.size()));
+    upload_data_result =
+        uploadFirmwareData(compressor.get(), buf.data(), static_cast<size_t>(image_reader.gcount()));
     total_send_data += static_cast<size_t>(image_reader.gcount());
   }
   if (upload_data_result.isSuccess() && total_send_data == image_size) {
@@ -510,16 +612,74 @@ data::InstallationResult IpUptaneSecondary::uploadFirmware(const Uptane::Target&
     upload_result = data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed, "Incomplete upload");
   }
   image_reader.close();
+  if (compressor != nullptr && upload_result.isSuccess()) {
+    LOG_INFO << "Compressed the image for Secondary " << getSerial() << " from " << compressor->bytesIn() << " to "
+             << compressor->bytesOut() << " bytes";
+  }
   return upload_result;
 }
 
-data::InstallationResult IpUptaneSecondary::uploadFirmwareData(const uint8_t* data, size_t size) {
+/* Ask the Secondary how much of the image it already has, so that an upload
+ * interrupted e.g. by a restart of the Secondary is resumed. Secondaries that
+ * predate resumable uploads close the connection on the unknown request, in
+ * which case the whole image is sent. */
+data::InstallationResult IpUptaneSecondary::startUpload(const Uptane::Target& target, uint64_t* offset) {
+  *offset = 0;
+  Asn1Message::Ptr req(Asn1Message::Empty());
+  req->present(AKIpUptaneMes_PR_uploadStartReq);
+  auto resp = rpc(req);
+
+  if (resp->present() != AKIpUptaneMes_PR_uploadStartResp) {
+    LOG_DEBUG << "Secondary " << getSerial() << " does not resume uploads; sending the whole image.";
+    return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+  }
+  const auto received = resp->uploadStartResp()->offset;
+  if (received < 0 || static_cast<uint64_t>(received) > target.length()) {
+    LOG_ERROR << "Secondary " << getSerial() << " returned an invalid upload offset: " << received;
+    return data::InstallationResult(
+        data::ResultCode::Numeric::kDownloadFailed,
+        "Secondary " + getSerial().ToString() + " returned an invalid upload offset: " + std::to_string(received));
+  }
+  *offset = static_cast<uint64_t>(received);
+  return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+}
+
+/* Ask the Secondary to accept compressed image data for the upload that
+ * follows. Secondaries that predate compression close the connection on the
+ * unknown request, in which case the image is sent as is. */
+std::unique_ptr<compression::Compressor> IpUptaneSecondary::startCompression() {
+  if (compression_level_ <= 0) {
+    return nullptr;
+  }
   Asn1Message::Ptr req(Asn1Message::Empty());
-  req->present(AKIpUptaneMes_PR_uploadDataReq);
+  req->present(AKIpUptaneMes_PR_uploadCompressionReq);
+  auto m = req->uploadCompressionReq();
+  m->compression = AKCompression_deflate;
+  auto resp = rpc(req);
+
+  if (resp->present() != AKIpUptaneMes_PR_uploadCompressionResp ||
+      resp->uploadCompressionResp()->compression != AKCompression_deflate) {
+    LOG_DEBUG << "Secondary " << getSerial() << " does not accept compressed images; sending the image as is.";
+    return nullptr;
+  }
+  return std_::make_unique<compression::Compressor>(compression_level_);
+}
 
-  auto m = req->uploadDataReq();
-  OCTET_STRING_fromBuf(&m->data, reinterpret_cast<const char*>(data), static_cast<int>(size));
-  auto resp = Asn1Rpc(req, getAddr());
+data::InstallationResult IpUptaneSecondary::uploadFirmwareData(compression::Compressor* compressor,
+                                                               const uint8_t* data, size_t size) {
+  Asn1Message::Ptr req(Asn1Message::Empty());
+  if (compressor != nullptr) {
+    std::string compressed;
+    compressor->compress(data, size, &compressed);
+    req->present(AKIpUptaneMes_PR_uploadCompressedDataReq);
+    auto m = req->uploadCompressedDataReq();
+    SetString(&m->data, compressed);
+  } else {
+    req->present(AKIpUptaneMes_PR_uploadDataReq);
+    auto m = req->uploadDataReq();
+    OCTET_STRING_fromBuf(&m->data, reinterpret_cast<const char*>(data), static_cast<int>(size));
+  }
+  auto resp = rpc(req);
 
   if (resp->present() == AKIpUptaneMes_PR_NOTHING) {
     LOG_ERROR << "Secondary " << getSerial() << " failed to respond to a request to receive firmware data.";
@@ -546,7 +706,7 @@ data::InstallationResult IpUptaneSecondary::invokeInstallOnSecondary(const Uptan
   auto req_mes = req->installReq();
   SetString(&req_mes->hash, target.filename());
   // send request and receive response, a request-response type of RPC
-  auto resp = Asn1Rpc(req, getAddr());
+  auto resp = rpc(req);
 
   // invalid type of an response message
   if (resp->present() != AKIpUptaneMes_PR_installResp2) {
@@ -1,24 +1,41 @@
 #ifndef UPTANE_IPUPTANESECONDARY_H_
 #define UPTANE_IPUPTANESECONDARY_H_
 
+#include <chrono>
+
+#include <boost/intrusive_ptr.hpp>
+
 #include "libaktualizr/secondaryinterface.h"
 #include "libaktualizr/types.h"
 
+class Asn1Message;
 struct AKMetaCollection;
 using AKMetaCollection_t = struct AKMetaCollection;
 
+namespace compression {
+class Compressor;
+}
+
+namespace metrics {
+class Histogram;
+}
+
 namespace Uptane {
 
 class IpUptaneSecondary : public SecondaryInterface {
  public:
-  static SecondaryInterface::Ptr connectAndCreate(const std::string& address, unsigned short port,
-                                                  VerificationType verification_type);
+  // A non-zero timeout bounds the connection attempt and each read or write of
+  // the information request; zero leaves the system defaults.
+  static SecondaryInterface::Ptr connectAndCreate(
+      const std::string& address, unsigned short port, VerificationType verification_type,
+      std::chrono::milliseconds timeout = std::chrono::milliseconds::zero());
   static SecondaryInterface::Ptr create(const std::string& address, unsigned short port,
                                         VerificationType verification_type, int con_fd);
 
   static SecondaryInterface::Ptr connectAndCheck(const std::string& address, unsigned short port,
                                                  VerificationType verification_type, EcuSerial serial,
-                                                 HardwareIdentifier hw_id, PublicKey pub_key);
+                                                 HardwareIdentifier hw_id, PublicKey pub_key,
+                                                 std::chrono::milliseconds timeout = std::chrono::milliseconds::zero());
 
   explicit IpUptaneSecondary(const std::string& address, unsigned short port, VerificationType verification_type,
                              EcuSerial serial, HardwareIdentifier hw_id, PublicKey pub_key);
@@ -32,28 +49,40 @@ class IpUptaneSecondary : public SecondaryInterface {
     secondary_provider_ = std::move(secondary_provider_in);
   }
   data::InstallationResult putMetadata(const Target& target) override;
+  data::InstallationResult putMetadataFrom(const UpdateMetadataCache& metadata, const Target& target) override;
   int32_t getRootVersion(bool director) const override;
   data::InstallationResult putRoot(const std::string& root, bool director) override;
   Manifest getManifest() const override;
   bool ping() const override;
   data::InstallationResult sendFirmware(const Uptane::Target& target) override;
+  std::unique_ptr<FirmwareWriter> openFirmwareWriter(const Uptane::Target& target) override;
   data::InstallationResult install(const Uptane::Target& target) override;
 
+  // Images are compressed with this deflate level (1-9) if the Secondary
+  // supports it; 0 sends them as is.
+  void setCompressionLevel(int level) { compression_level_ = level; }
+
+  static void addMetadata(const Uptane::MetaBundle& meta_bundle, Uptane::RepositoryType repo, const Uptane::Role& role,
+                          AKMetaCollection_t& collection);
+
  private:
   const std::pair<std::string, uint16_t>& getAddr() const { return addr_; }
+  boost::intrusive_ptr<Asn1Message> rpc(const boost::intrusive_ptr<Asn1Message>& req) const;
+  boost::intrusive_ptr<Asn1Message> rpc(const std::string& req) const;
   void getSecondaryVersion() const;
+  data::InstallationResult putMetadataBundle(const Uptane::MetaBundle& meta_bundle, const UpdateMetadataCache* cache);
   data::InstallationResult putMetadata_v1(const Uptane::MetaBundle& meta_bundle);
-  data::InstallationResult putMetadata_v2(const Uptane::MetaBundle& meta_bundle);
+  data::InstallationResult putMetadata_v2(const Uptane::MetaBundle& meta_bundle, const UpdateMetadataCache* cache);
   data::InstallationResult sendFirmware_v1(const Uptane::Target& target);
   data::InstallationResult sendFirmware_v2(const Uptane::Target& target);
   data::InstallationResult install_v1(const Uptane::Target& target);
   data::InstallationResult install_v2(const Uptane::Target& target);
-  static void addMetadata(const Uptane::MetaBundle& meta_bundle, Uptane::RepositoryType repo, const Uptane::Role& role,
-                          AKMetaCollection_t& collection);
   data::InstallationResult invokeInstallOnSecondary(const Uptane::Target& target);
   data::InstallationResult downloadOstreeRev(const Uptane::Target& target);
   data::InstallationResult uploadFirmware(const Uptane::Target& target);
-  data::InstallationResult uploadFirmwareData(const uint8_t* data, size_t size);
+  data::InstallationResult startUpload(const Uptane::Target& target, uint64_t* offset);
+  std::unique_ptr<compression::Compressor> startCompression();
+  data::InstallationResult uploadFirmwareData(compression::Compressor* compressor, const uint8_t* data, size_t size);
 
   std::shared_ptr<SecondaryProvider> secondary_provider_;
   const std::pair<std::string, uint16_t> addr_;
@@ -62,6 +91,8 @@ class IpUptaneSecondary : public SecondaryInterface {
   const HardwareIdentifier hw_id_;
   const PublicKey pub_key_;
   mutable uint32_t protocol_version{0};
+  int compression_level_{0};
+  metrics::Histogram& rpc_latency_;
 };
 
 }  // namespace Uptane
@@ -94,6 +94,19 @@ void UptaneConfig::updateFromPropertyTree(const boost::property_tree::ptree& pt)
   CopyFromConfig(force_install_completion, "force_install_completion", pt);
   CopyFromConfig(secondary_config_file, "secondary_config_file", pt);
   CopyFromConfig(secondary_preinstall_wait_sec, "secondary_preinstall_wait_sec", pt);
+  CopyFromConfig(secondary_metadata_threads, "secondary_metadata_threads", pt);
+  CopyFromConfig(secondary_install_threads, "secondary_install_threads", pt);
+  CopyFromConfig(secondary_bus_limits, "secondary_bus_limits", pt);
+  CopyFromConfig(secondary_install_priority, "secondary_install_priority", pt);
+  CopyFromConfig(secondary_stream_firmware, "secondary_stream_firmware", pt);
+  CopyFromConfig(secondary_stream_keep_copy, "secondary_stream_keep_copy", pt);
+  CopyFromConfig(secondary_fan_out, "secondary_fan_out", pt);
+  CopyFromConfig(prefetch_targets, "prefetch_targets", pt);
+  CopyFromConfig(prefetch_max_bytes_per_sec, "prefetch_max_bytes_per_sec", pt);
+  CopyFromConfig(prefetch_quota, "prefetch_quota", pt);
+  CopyFromConfig(event_dispatch_async, "event_dispatch_async", pt);
+  CopyFromConfig(event_queue_size, "event_queue_size", pt);
+  CopyFromConfig(event_overflow_policy, "event_overflow_policy", pt);
 }
 
 void UptaneConfig::writeToStream(std::ostream& out_stream) const {
@@ -105,6 +118,33 @@ void UptaneConfig::writeToStream(std::ostream& out_stream) const {
   writeOption(out_stream, force_install_completion, "force_install_completion");
   writeOption(out_stream, secondary_config_file, "secondary_config_file");
   writeOption(out_stream, secondary_preinstall_wait_sec, "secondary_preinstall_wait_sec");
+  writeOption(out_stream, secondary_metadata_threads, "secondary_metadata_threads");
+  writeOption(out_stream, secondary_install_threads, "secondary_install_threads");
+  writeOption(out_stream, secondary_bus_limits, "secondary_bus_limits");
+  writeOption(out_stream, secondary_install_priority, "secondary_install_priority");
+  writeOption(out_stream, secondary_stream_firmware, "secondary_stream_firmware");
+  writeOption(out_stream, secondary_stream_keep_copy, "secondary_stream_keep_copy");
+  writeOption(out_stream, secondary_fan_out, "secondary_fan_out");
+  writeOption(out_stream, prefetch_targets, "prefetch_targets");
+  writeOption(out_stream, prefetch_max_bytes_per_sec, "prefetch_max_bytes_per_sec");
+  writeOption(out_stream, prefetch_quota, "prefetch_quota");
+  writeOption(out_stream, event_dispatch_async, "event_dispatch_async");
+  writeOption(out_stream, event_queue_size, "event_queue_size");
+  writeOption(out_stream, event_overflow_policy, "event_overflow_policy");
+}
+
+void TracingConfig::updateFromPropertyTree(const boost::property_tree::ptree& pt) {
+  CopyFromConfig(path, "path", pt);
+}
+
+void TracingConfig::writeToStream(std::ostream& out_stream) const { writeOption(out_stream, path, "path"); }
+
+void MetricsConfig::updateFromPropertyTree(const boost::property_tree::ptree& pt) {
+  CopyFromConfig(socket_path, "socket_path", pt);
+}
+
+void MetricsConfig::writeToStream(std::ostream& out_stream) const {
+  writeOption(out_stream, socket_path, "socket_path");
 }
 
 /**
@@ -231,6 +271,8 @@ void Config::updateFromPropertyTree(const boost::property_tree::ptree& pt) {
   CopySubtreeFromConfig(storage, "storage", pt);
   CopySubtreeFromConfig(import, "import", pt);
   CopySubtreeFromConfig(telemetry, "telemetry", pt);
+  CopySubtreeFromConfig(tracing, "tracing", pt);
+  CopySubtreeFromConfig(metrics, "metrics", pt);
   CopySubtreeFromConfig(bootloader, "bootloader", pt);
 }
 
@@ -271,5 +313,7 @@ void Config::writeToStream(std::ostream& sink) const {
   WriteSectionToStream(storage, "storage", sink);
   WriteSectionToStream(import, "import", sink);
   WriteSectionToStream(telemetry, "telemetry", sink);
+  WriteSectionToStream(tracing, "tracing", sink);
+  WriteSectionToStream(metrics, "metrics", sink);
   WriteSectionToStream(bootloader, "bootloader", sink);
 }
@@ -153,6 +153,26 @@ TEST(config, TomlConsistentNonempty) {
   EXPECT_EQ(conf_str1, conf_str2);
 }
 
+/* OSTree pull options survive a round trip through the config file. */
+TEST(config, OstreePullOptions) {
+  TemporaryDirectory temp_dir;
+  Utils::writeFile(temp_dir / "pull.toml", std::string("[pacman]\nostree_static_deltas = \"only\"\n"
+                                                       "ostree_delta_fallback = true\nostree_network_retries = 2\n"));
+  Config config1((temp_dir / "pull.toml").string());
+  EXPECT_EQ(config1.pacman.ostree_static_deltas, OstreeDeltaPolicy::kOnly);
+  EXPECT_TRUE(config1.pacman.ostree_delta_fallback);
+  EXPECT_EQ(config1.pacman.ostree_network_retries, 2);
+
+  std::ofstream sink((temp_dir / "output.toml").c_str(), std::ofstream::out);
+  config1.writeToStream(sink);
+  sink.close();
+  Config config2((temp_dir / "output.toml").string());
+  EXPECT_EQ(config2.pacman.ostree_static_deltas, OstreeDeltaPolicy::kOnly);
+  EXPECT_TRUE(config2.pacman.ostree_delta_fallback);
+  EXPECT_EQ(config2.pacman.ostree_network_retries, 2);
+  EXPECT_EQ(Config().pacman.ostree_static_deltas, OstreeDeltaPolicy::kPrefer);
+}
+
 static std::vector<boost::filesystem::path> generate_multi_config(TemporaryDirectory &temp_dir) {
   std::string content;
   {
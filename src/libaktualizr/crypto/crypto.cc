@@ -2,6 +2,7 @@
 
 #include <array>
 #include <iostream>
+#include <mutex>
 #include <random>
 #include <string>
 
@@ -18,11 +19,18 @@
 #include "openssl_compat.h"
 #include "libaktualizr/utilities/utils.h"
 
-PublicKey::PublicKey(const boost::filesystem::path &path) : value_(Utils::readFile(path)) {
+struct PublicKey::ParsedKey {
+  std::once_flag once;
+  std::shared_ptr<EVP_PKEY> rsa;
+  std::string ed25519;
+};
+
+PublicKey::PublicKey(const boost::filesystem::path &path)
+    : value_(Utils::readFile(path)), parsed_(std::make_shared<ParsedKey>()) {
   type_ = Crypto::IdentifyRSAKeyType(value_);
 }
 
-PublicKey::PublicKey(const Json::Value &uptane_json) {
+PublicKey::PublicKey(const Json::Value &uptane_json) : parsed_(std::make_shared<ParsedKey>()) {
   std::string keytype;
   std::string keyvalue;
 
@@ -66,7 +74,8 @@ PublicKey::PublicKey(const Json::Value &uptane_json) {
   value_ = keyvalue;
 }
 
-PublicKey::PublicKey(const std::string &value, KeyType type) : value_(value), type_(type) {
+PublicKey::PublicKey(const std::string &value, KeyType type)
+    : value_(value), type_(type), parsed_(std::make_shared<ParsedKey>()) {
   if (Crypto::IsRsaKeyType(type)) {
     if (type != Crypto::IdentifyRSAKeyType(value)) {
       throw std::logic_error("RSA key length is incorrect");
@@ -74,14 +83,32 @@ PublicKey::PublicKey(const std::string &value, KeyType type) : value_(value), ty
   }
 }
 
+const PublicKey::ParsedKey &PublicKey::parsed() const {
+  // value_ and type_ never change after construction, so the parsed key can
+  // be shared by all copies of this PublicKey.
+  std::call_once(parsed_->once, [this]() {
+    if (type_ == KeyType::kED25519) {
+      parsed_->ed25519 = boost::algorithm::unhex(value_);
+    } else if (Crypto::IsRsaKeyType(type_)) {
+      parsed_->rsa = Crypto::ParseRSAPublicKey(value_);
+    }
+  });
+  return *parsed_;
+}
+
 bool PublicKey::VerifySignature(const std::string &signature, const std::string &message) const {
+  if (parsed_ == nullptr) {
+    return false;
+  }
   switch (type_) {
     case KeyType::kED25519:
-      return Crypto::ED25519Verify(boost::algorithm::unhex(value_), Utils::fromBase64(signature), message);
+      return Crypto::ED25519Verify(parsed().ed25519, Utils::fromBase64(signature), message);
     case KeyType::kRSA2048:
     case KeyType::kRSA3072:
-    case KeyType::kRSA4096:
-      return Crypto::RSAPSSVerify(value_, Utils::fromBase64(signature), message);
+    case KeyType::kRSA4096: {
+      EVP_PKEY *key = parsed().rsa.get();
+      return key != nullptr && Crypto::RSAPSSVerify(key, Utils::fromBase64(signature), message);
+    }
     default:
       return false;
   }
@@ -138,49 +165,55 @@ std::string Crypto::sha512digestHex(const std::string &text) {
   return boost::algorithm::to_lower_copy(boost::algorithm::hex(sha512digest(text)));
 }
 
-std::string Crypto::RSAPSSSign(ENGINE *engine, const std::string &private_key, const std::string &message) {
-  StructGuard<EVP_PKEY> key(nullptr, EVP_PKEY_free);
-  StructGuard<RSA> rsa(nullptr, RSA_free);
-  if (engine != nullptr) {
-    // TODO(OTA-2138): this call leaks memory somehow...
-    key.reset(ENGINE_load_private_key(engine, private_key.c_str(), nullptr, nullptr));
-
-    if (key == nullptr) {
-      LOG_ERROR << "ENGINE_load_private_key failed with error " << ERR_error_string(ERR_get_error(), nullptr);
-      return std::string();
-    }
-
-    rsa.reset(EVP_PKEY_get1_RSA(key.get()));
-    if (rsa == nullptr) {
-      LOG_ERROR << "EVP_PKEY_get1_RSA failed with error " << ERR_error_string(ERR_get_error(), nullptr);
-      return std::string();
-    }
-  } else {
-    StructGuard<BIO> bio(BIO_new_mem_buf(const_cast<char *>(private_key.c_str()), static_cast<int>(private_key.size())),
-                         BIO_vfree);
-    key.reset(PEM_read_bio_PrivateKey(bio.get(), nullptr, nullptr, nullptr));
-    if (key != nullptr) {
-      rsa.reset(EVP_PKEY_get1_RSA(key.get()));
-    }
-
-    if (rsa == nullptr) {
-      LOG_ERROR << "PEM_read_bio_PrivateKey failed with error " << ERR_error_string(ERR_get_error(), nullptr);
-      return std::string();
-    }
-
+// Switch to the default OpenSSL implementation, in case an engine has taken
+// over RSA, and wrap the key for caching.
+static std::shared_ptr<EVP_PKEY> wrapRSAKey(RSA *rsa) {
 #if AKTUALIZR_OPENSSL_PRE_11
-    RSA_set_method(rsa.get(), RSA_PKCS1_SSLeay());
+  RSA_set_method(rsa, RSA_PKCS1_SSLeay());
 #else
-    RSA_set_method(rsa.get(), RSA_PKCS1_OpenSSL());
+  RSA_set_method(rsa, RSA_PKCS1_OpenSSL());
 #endif
+  std::shared_ptr<EVP_PKEY> key(EVP_PKEY_new(), EVP_PKEY_free);
+  if (key == nullptr || EVP_PKEY_assign_RSA(key.get(), rsa) != 1) {
+    RSA_free(rsa);
+    return nullptr;
+  }
+  return key;
+}
+
+std::shared_ptr<EVP_PKEY> Crypto::ParseRSAPublicKey(const std::string &public_key) {
+  StructGuard<BIO> bio(BIO_new_mem_buf(const_cast<char *>(public_key.c_str()), static_cast<int>(public_key.size())),
+                       BIO_vfree);
+  RSA *rsa = nullptr;
+  if (PEM_read_bio_RSA_PUBKEY(bio.get(), &rsa, nullptr, nullptr) == nullptr) {
+    LOG_ERROR << "PEM_read_bio_RSA_PUBKEY failed with error " << ERR_error_string(ERR_get_error(), nullptr);
+    return nullptr;
   }
+  return wrapRSAKey(rsa);
+}
 
-  const auto sign_size = static_cast<unsigned int>(RSA_size(rsa.get()));
+std::shared_ptr<EVP_PKEY> Crypto::ParseRSAPrivateKey(const std::string &private_key) {
+  StructGuard<BIO> bio(BIO_new_mem_buf(const_cast<char *>(private_key.c_str()), static_cast<int>(private_key.size())),
+                       BIO_vfree);
+  StructGuard<EVP_PKEY> pem_key(PEM_read_bio_PrivateKey(bio.get(), nullptr, nullptr, nullptr), EVP_PKEY_free);
+  RSA *rsa = nullptr;
+  if (pem_key != nullptr) {
+    rsa = EVP_PKEY_get1_RSA(pem_key.get());
+  }
+  if (rsa == nullptr) {
+    LOG_ERROR << "PEM_read_bio_PrivateKey failed with error " << ERR_error_string(ERR_get_error(), nullptr);
+    return nullptr;
+  }
+  return wrapRSAKey(rsa);
+}
+
+static std::string RSAPSSSignWith(RSA *rsa, const std::string &message) {
+  const auto sign_size = static_cast<unsigned int>(RSA_size(rsa));
   boost::scoped_array<unsigned char> EM(new unsigned char[sign_size]);
   boost::scoped_array<unsigned char> pSignature(new unsigned char[sign_size]);
 
   std::string digest = Crypto::sha256digest(message);
-  int status = RSA_padding_add_PKCS1_PSS(rsa.get(), EM.get(), reinterpret_cast<const unsigned char *>(digest.c_str()),
+  int status = RSA_padding_add_PKCS1_PSS(rsa, EM.get(), reinterpret_cast<const unsigned char *>(digest.c_str()),
                                          EVP_sha256(), -1 /* maximum salt length*/);
   if (status == 0) {
     LOG_ERROR << "RSA_padding_add_PKCS1_PSS failed with error " << ERR_error_string(ERR_get_error(), nullptr);
@@ -188,7 +221,7 @@ std::string Crypto::RSAPSSSign(ENGINE *engine, const std::string &private_key, c
   }
 
   /* perform digital signature */
-  status = RSA_private_encrypt(RSA_size(rsa.get()), EM.get(), pSignature.get(), rsa.get(), RSA_NO_PADDING);
+  status = RSA_private_encrypt(RSA_size(rsa), EM.get(), pSignature.get(), rsa, RSA_NO_PADDING);
   if (status == -1) {
     LOG_ERROR << "RSA_private_encrypt failed with error " << ERR_error_string(ERR_get_error(), nullptr);
     return std::string();
@@ -197,6 +230,39 @@ std::string Crypto::RSAPSSSign(ENGINE *engine, const std::string &private_key, c
   return retval;
 }
 
+std::string Crypto::RSAPSSSign(ENGINE *engine, const std::string &private_key, const std::string &message) {
+  if (engine == nullptr) {
+    std::shared_ptr<EVP_PKEY> key = ParseRSAPrivateKey(private_key);
+    if (key == nullptr) {
+      return std::string();
+    }
+    return RSAPSSSign(key.get(), message);
+  }
+
+  // TODO(OTA-2138): this call leaks memory somehow...
+  StructGuard<EVP_PKEY> key(ENGINE_load_private_key(engine, private_key.c_str(), nullptr, nullptr), EVP_PKEY_free);
+  if (key == nullptr) {
+    LOG_ERROR << "ENGINE_load_private_key failed with error " << ERR_error_string(ERR_get_error(), nullptr);
+    return std::string();
+  }
+
+  StructGuard<RSA> rsa(EVP_PKEY_get1_RSA(key.get()), RSA_free);
+  if (rsa == nullptr) {
+    LOG_ERROR << "EVP_PKEY_get1_RSA failed with error " << ERR_error_string(ERR_get_error(), nullptr);
+    return std::string();
+  }
+  return RSAPSSSignWith(rsa.get(), message);
+}
+
+std::string Crypto::RSAPSSSign(EVP_PKEY *key, const std::string &message) {
+  StructGuard<RSA> rsa(EVP_PKEY_get1_RSA(key), RSA_free);
+  if (rsa == nullptr) {
+    LOG_ERROR << "EVP_PKEY_get1_RSA failed with error " << ERR_error_string(ERR_get_error(), nullptr);
+    return std::string();
+  }
+  return RSAPSSSignWith(rsa.get(), message);
+}
+
 std::string Crypto::Sign(KeyType key_type, ENGINE *engine, const std::string &private_key, const std::string &message) {
   if (key_type == KeyType::kED25519) {
     return Crypto::ED25519Sign(boost::algorithm::unhex(private_key), message);
@@ -212,23 +278,19 @@ std::string Crypto::ED25519Sign(const std::string &private_key, const std::strin
 }
 
 bool Crypto::RSAPSSVerify(const std::string &public_key, const std::string &signature, const std::string &message) {
-  StructGuard<RSA> rsa(nullptr, RSA_free);
-  StructGuard<BIO> bio(BIO_new_mem_buf(const_cast<char *>(public_key.c_str()), static_cast<int>(public_key.size())),
-                       BIO_vfree);
-  {
-    RSA *r = nullptr;
-    if (PEM_read_bio_RSA_PUBKEY(bio.get(), &r, nullptr, nullptr) == nullptr) {
-      LOG_ERROR << "PEM_read_bio_RSA_PUBKEY failed with error " << ERR_error_string(ERR_get_error(), nullptr);
-      return false;
-    }
-    rsa.reset(r);
+  std::shared_ptr<EVP_PKEY> key = ParseRSAPublicKey(public_key);
+  if (key == nullptr) {
+    return false;
   }
+  return RSAPSSVerify(key.get(), signature, message);
+}
 
-#if AKTUALIZR_OPENSSL_PRE_11
-  RSA_set_method(rsa.get(), RSA_PKCS1_SSLeay());
-#else
-  RSA_set_method(rsa.get(), RSA_PKCS1_OpenSSL());
-#endif
+bool Crypto::RSAPSSVerify(EVP_PKEY *key, const std::string &signature, const std::string &message) {
+  StructGuard<RSA> rsa(EVP_PKEY_get1_RSA(key), RSA_free);
+  if (rsa == nullptr) {
+    LOG_ERROR << "EVP_PKEY_get1_RSA failed with error " << ERR_error_string(ERR_get_error(), nullptr);
+    return false;
+  }
 
   const auto size = static_cast<unsigned int>(RSA_size(rsa.get()));
   boost::scoped_array<unsigned char> pDecrypted(new unsigned char[size]);
@@ -1,9 +1,11 @@
 #include <gtest/gtest.h>
 
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <json/json.h>
 #include <boost/algorithm/hex.hpp>
@@ -49,6 +51,27 @@ TEST(crypto, sign_verify_rsa_file) {
   EXPECT_TRUE(sign_is_ok);
 }
 
+/* Sign and verify with cached keys, shared between threads. */
+TEST(crypto, sign_verify_rsa_cached) {
+  std::string text = "This is text for sign";
+  std::shared_ptr<EVP_PKEY> private_key = Crypto::ParseRSAPrivateKey(Utils::readFile("tests/test_data/priv.key"));
+  ASSERT_NE(private_key, nullptr);
+  const PublicKey pkey(fs::path("tests/test_data/public.key"));
+
+  std::vector<std::future<bool>> results;
+  for (int i = 0; i < 4; ++i) {
+    results.push_back(std::async(std::launch::async, [&]() {
+      std::string signature = Utils::toBase64(Crypto::RSAPSSSign(private_key.get(), text));
+      return pkey.VerifySignature(signature, text) && !pkey.VerifySignature(signature, text + "!");
+    }));
+  }
+  for (auto &result : results) {
+    EXPECT_TRUE(result.get());
+  }
+  EXPECT_EQ(Crypto::ParseRSAPublicKey("this is bad key"), nullptr);
+  EXPECT_EQ(Crypto::ParseRSAPrivateKey("this is bad key"), nullptr);
+}
+
 #ifdef BUILD_P11
 
 class P11Crypto : public ::testing::Test {
@@ -296,8 +296,15 @@ Json::Value KeyManager::signTuf(const Json::Value &in_data) const {
   if (config_.uptane_key_source == CryptoSource::kFile) {
     backend_->loadPrimaryPrivate(&private_key);
   }
-  b64sig = Utils::toBase64(
-      Crypto::Sign(config_.uptane_key_type, crypto_engine, private_key, Utils::jsonToCanonicalStr(in_data)));
+  if (config_.uptane_key_source == CryptoSource::kFile && Crypto::IsRsaKeyType(config_.uptane_key_type)) {
+    std::shared_ptr<EVP_PKEY> key = uptaneSigningKey(private_key);
+    if (key != nullptr) {
+      b64sig = Utils::toBase64(Crypto::RSAPSSSign(key.get(), Utils::jsonToCanonicalStr(in_data)));
+    }
+  } else {
+    b64sig = Utils::toBase64(
+        Crypto::Sign(config_.uptane_key_type, crypto_engine, private_key, Utils::jsonToCanonicalStr(in_data)));
+  }
 
   Json::Value signature;
   switch (config_.uptane_key_type) {
@@ -322,6 +329,15 @@ Json::Value KeyManager::signTuf(const Json::Value &in_data) const {
   return out_data;
 }
 
+std::shared_ptr<EVP_PKEY> KeyManager::uptaneSigningKey(const std::string &private_key) const {
+  std::lock_guard<std::mutex> lock(signing_key_mutex_);
+  if (signing_key_ == nullptr || private_key != signing_key_pem_) {
+    signing_key_ = Crypto::ParseRSAPrivateKey(private_key);
+    signing_key_pem_ = private_key;
+  }
+  return signing_key_;
+}
+
 std::string KeyManager::generateUptaneKeyPair() {
   std::string primary_public;
 
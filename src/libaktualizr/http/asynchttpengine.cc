@@ -0,0 +1,209 @@
+#include "libaktualizr/http/asynchttpengine.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+#include "libaktualizr/logging/logging.h"
+#include "libaktualizr/utilities/apiqueue.h"
+
+constexpr long AsyncHttpEngine::kDefaultMaxConnections;  // NOLINT(google-runtime-int)
+
+// How often transfers with a flow control token are checked while nothing
+// else happens, in milliseconds.
+static constexpr int kTokenPollMs = 100;
+static constexpr int kIdleWaitMs = 1000;
+
+AsyncHttpEngine::AsyncHttpEngine(long max_connections) : multi_(curl_multi_init()) {  // NOLINT(google-runtime-int)
+  if (multi_ == nullptr) {
+    throw std::runtime_error("Could not initialize curl multi handle");
+  }
+  curl_multi_setopt(multi_, CURLMOPT_MAX_TOTAL_CONNECTIONS, max_connections);
+
+  // curl_multi_wait() also watches this pipe, so that new transfers do not
+  // have to wait for the timeout.
+  if (pipe(wakeup_pipe_.data()) != 0) {
+    curl_multi_cleanup(multi_);
+    throw std::runtime_error(std::string("Could not create a pipe: ") + std::strerror(errno));
+  }
+  for (const int fd : wakeup_pipe_) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+}
+
+AsyncHttpEngine::~AsyncHttpEngine() {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    shutdown_ = true;
+  }
+  cancel_cv_.notify_all();
+  wakeup();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  for (auto &transfer : incoming_) {
+    finish(transfer, CURLE_ABORTED_BY_CALLBACK);
+  }
+  close(wakeup_pipe_[0]);
+  close(wakeup_pipe_[1]);
+  curl_multi_cleanup(multi_);
+}
+
+std::shared_ptr<AsyncHttpEngine> AsyncHttpEngine::shared() {
+  static std::mutex m;
+  static std::weak_ptr<AsyncHttpEngine> engine;
+  std::lock_guard<std::mutex> lock(m);
+  auto res = engine.lock();
+  if (res == nullptr) {
+    res = std::make_shared<AsyncHttpEngine>();
+    engine = res;
+  }
+  return res;
+}
+
+void AsyncHttpEngine::start(std::shared_ptr<CURL> handle, DoneCallback done, const api::FlowControlToken *token,
+                            const void *owner) {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    incoming_.push_back(Transfer{std::move(handle), std::move(done), token, owner});
+    if (!thread_.joinable()) {
+      thread_ = std::thread(&AsyncHttpEngine::run, this);
+    }
+  }
+  wakeup();
+}
+
+std::future<CURLcode> AsyncHttpEngine::perform(std::shared_ptr<CURL> handle, const api::FlowControlToken *token) {
+  auto promise = std::make_shared<std::promise<CURLcode>>();
+  std::future<CURLcode> result = promise->get_future();
+  start(
+      std::move(handle), [promise](CURL *, CURLcode code) { promise->set_value(code); }, token);
+  return result;
+}
+
+void AsyncHttpEngine::unpause(CURL *handle) {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    unpause_.push_back(handle);
+  }
+  wakeup();
+}
+
+void AsyncHttpEngine::cancel(const void *owner) {
+  std::unique_lock<std::mutex> lock(m_);
+  if (!thread_.joinable() || std::this_thread::get_id() == thread_.get_id()) {
+    // Nothing was ever started, or called from a completion handler.
+    return;
+  }
+  cancel_.push_back(owner);
+  const uint64_t ticket = ++cancel_requested_;
+  lock.unlock();
+  wakeup();
+  lock.lock();
+  cancel_cv_.wait(lock, [this, ticket]() { return cancel_done_ >= ticket || shutdown_; });
+}
+
+void AsyncHttpEngine::wakeup() {
+  const char byte = 0;
+  // A full pipe already guarantees a wakeup, so errors can be ignored.
+  if (write(wakeup_pipe_[1], &byte, 1) < 0) {
+    return;
+  }
+}
+
+void AsyncHttpEngine::finish(Transfer &transfer, CURLcode result) {
+  try {
+    transfer.done(transfer.handle.get(), result);
+  } catch (const std::exception &ex) {
+    LOG_ERROR << "HTTP transfer completion handler failed: " << ex.what();
+  }
+}
+
+void AsyncHttpEngine::run() {
+  std::map<CURL *, Transfer> running;
+
+  auto end_transfer = [this, &running](std::map<CURL *, Transfer>::iterator it,
+                                       CURLcode result) -> std::map<CURL *, Transfer>::iterator {
+    curl_multi_remove_handle(multi_, it->first);
+    finish(it->second, result);
+    return running.erase(it);
+  };
+
+  for (;;) {
+    std::vector<Transfer> incoming;
+    std::vector<CURL *> unpause;
+    std::vector<const void *> cancel;
+    uint64_t cancel_ticket = 0;
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      if (shutdown_) {
+        break;
+      }
+      incoming.swap(incoming_);
+      unpause.swap(unpause_);
+      cancel.swap(cancel_);
+      cancel_ticket = cancel_requested_;
+    }
+
+    for (auto &transfer : incoming) {
+      CURL *handle = transfer.handle.get();
+      if (curl_multi_add_handle(multi_, handle) != CURLM_OK) {
+        finish(transfer, CURLE_FAILED_INIT);
+        continue;
+      }
+      running.emplace(handle, std::move(transfer));
+    }
+    for (CURL *handle : unpause) {
+      if (running.count(handle) != 0) {
+        curl_easy_pause(handle, CURLPAUSE_CONT);
+      }
+    }
+
+    bool has_tokens = false;
+    for (auto it = running.begin(); it != running.end();) {
+      const bool cancelled = it->second.owner != nullptr &&
+                             std::find(cancel.begin(), cancel.end(), it->second.owner) != cancel.end();
+      if (cancelled || (it->second.token != nullptr && !it->second.token->canContinue(false))) {
+        it = end_transfer(it, CURLE_ABORTED_BY_CALLBACK);
+        continue;
+      }
+      has_tokens = has_tokens || it->second.token != nullptr;
+      ++it;
+    }
+    if (!cancel.empty()) {
+      {
+        std::lock_guard<std::mutex> lock(m_);
+        cancel_done_ = cancel_ticket;
+      }
+      cancel_cv_.notify_all();
+    }
+
+    int still_running = 0;
+    curl_multi_perform(multi_, &still_running);
+    int msgs_left = 0;
+    while (CURLMsg *msg = curl_multi_info_read(multi_, &msgs_left)) {
+      if (msg->msg != CURLMSG_DONE) {
+        continue;
+      }
+      auto it = running.find(msg->easy_handle);
+      if (it != running.end()) {
+        end_transfer(it, msg->data.result);
+      }
+    }
+
+    curl_waitfd wakeup_fd{wakeup_pipe_[0], CURL_WAIT_POLLIN, 0};
+    curl_multi_wait(multi_, &wakeup_fd, 1, has_tokens ? kTokenPollMs : kIdleWaitMs, nullptr);
+    char buf[64];  // NOLINT(cppcoreguidelines-avoid-c-arrays, hicpp-avoid-c-arrays, modernize-avoid-c-arrays)
+    while (read(wakeup_pipe_[0], buf, sizeof(buf)) > 0) {
+    }
+  }
+
+  for (auto it = running.begin(); it != running.end();) {
+    it = end_transfer(it, CURLE_ABORTED_BY_CALLBACK);
+  }
+}
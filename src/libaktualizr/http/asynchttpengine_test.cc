@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <boost/process.hpp>
+
+#include "libaktualizr/http/asynchttpengine.h"
+#include "libaktualizr/http/httpclient.h"
+#include "libaktualizr/utilities/apiqueue.h"
+#include "test_utils.h"
+
+static std::string server = "http://127.0.0.1:";
+
+static size_t countBytes(char* contents, size_t size, size_t nmemb, void* userp) {
+  (void)contents;
+  *static_cast<size_t*>(userp) += size * nmemb;
+  return size * nmemb;
+}
+
+static size_t appendBody(char* contents, size_t size, size_t nmemb, void* userp) {
+  static_cast<std::string*>(userp)->append(contents, size * nmemb);
+  return size * nmemb;
+}
+
+static std::shared_ptr<CURL> makeHandle(const std::string& path, size_t* counter) {
+  std::shared_ptr<CURL> handle(curl_easy_init(), curl_easy_cleanup);
+  curl_easy_setopt(handle.get(), CURLOPT_URL, (server + path).c_str());
+  curl_easy_setopt(handle.get(), CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(handle.get(), CURLOPT_WRITEFUNCTION, countBytes);
+  curl_easy_setopt(handle.get(), CURLOPT_WRITEDATA, counter);
+  return handle;
+}
+
+/* Several transfers run at once on the single I/O thread. */
+TEST(AsyncHttpEngine, Parallel) {
+  AsyncHttpEngine engine(2);
+  std::vector<size_t> sizes(5, 0);
+  std::vector<std::future<CURLcode>> results;
+  for (auto& size : sizes) {
+    results.push_back(engine.perform(makeHandle("/large_file", &size)));
+  }
+  for (size_t i = 0; i < results.size(); ++i) {
+    EXPECT_EQ(results[i].get(), CURLE_OK);
+    EXPECT_EQ(sizes[i], 100 << 20);
+  }
+}
+
+/* Aborting the flow control token ends the transfer right away. */
+TEST(AsyncHttpEngine, Abort) {
+  AsyncHttpEngine engine;
+  api::FlowControlToken token;
+  size_t size = 0;
+  auto result = engine.perform(makeHandle("/slow_file", &size), &token);
+  EXPECT_EQ(result.wait_for(std::chrono::milliseconds(500)), std::future_status::timeout);
+  token.setAbort();
+  ASSERT_EQ(result.wait_for(std::chrono::seconds(2)), std::future_status::ready);
+  EXPECT_EQ(result.get(), CURLE_ABORTED_BY_CALLBACK);
+}
+
+/* Transfers that are still running when the engine goes away are aborted. */
+TEST(AsyncHttpEngine, Shutdown) {
+  size_t size = 0;
+  std::future<CURLcode> result;
+  {
+    AsyncHttpEngine engine;
+    result = engine.perform(makeHandle("/slow_file", &size));
+  }
+  ASSERT_EQ(result.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+  EXPECT_EQ(result.get(), CURLE_ABORTED_BY_CALLBACK);
+}
+
+/* HttpClient::downloadAsync() goes through the engine. */
+TEST(AsyncHttpEngine, HttpClientDownload) {
+  HttpClient http;
+  std::string body;
+  auto write = [](char* contents, size_t size, size_t nmemb, void* userp) -> size_t {
+    static_cast<std::string*>(userp)->append(contents, size * nmemb);
+    return size * nmemb;
+  };
+  std::vector<std::future<HttpResponse>> responses;
+  std::vector<std::string> bodies(3);
+  for (auto& b : bodies) {
+    responses.push_back(http.downloadAsync(server + "/download", write, nullptr, &b, 0, nullptr));
+  }
+  for (size_t i = 0; i < responses.size(); ++i) {
+    HttpResponse resp = responses[i].get();
+    EXPECT_TRUE(resp.isOk());
+    EXPECT_EQ(bodies[i], "content");
+  }
+}
+
+/* HTTP clients share one engine, and a client that goes away only aborts its
+ * own transfers. */
+TEST(AsyncHttpEngine, SharedByClients) {
+  HttpClient http;
+  std::future<HttpResponse> slow;
+  std::string slow_body;
+  {
+    HttpClient short_lived;
+    EXPECT_EQ(&short_lived.asyncEngine(), &http.asyncEngine());
+    slow = short_lived.downloadAsync(server + "/slow_file", appendBody, nullptr, &slow_body, 0, nullptr);
+    EXPECT_EQ(slow.wait_for(std::chrono::milliseconds(200)), std::future_status::timeout);
+  }
+  ASSERT_EQ(slow.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+  EXPECT_EQ(slow.get().curl_code, CURLE_ABORTED_BY_CALLBACK);
+
+  std::string body;
+  EXPECT_TRUE(http.downloadAsync(server + "/download", appendBody, nullptr, &body, 0, nullptr).get().isOk());
+  EXPECT_EQ(body, "content");
+}
+
+/* A rate-limited download is held back by curl, without holding up the other
+ * transfers of the engine. */
+TEST(AsyncHttpEngine, RateLimited) {
+  HttpClient http;
+  const curl_off_t length = 4 << 20;
+  size_t size = 0;
+  const auto start = std::chrono::steady_clock::now();
+  auto limited = std::async(std::launch::async, [&http, &size, length]() {
+    return http.downloadRateLimited(server + "/large_file", countBytes, nullptr, &size, (100 << 20) - length, 2 << 20);
+  });
+
+  std::string body;
+  EXPECT_TRUE(http.downloadAsync(server + "/download", appendBody, nullptr, &body, 0, nullptr).get().isOk());
+  EXPECT_EQ(body, "content");
+  EXPECT_EQ(limited.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+
+  EXPECT_TRUE(limited.get().isOk());
+  EXPECT_EQ(size, length);
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  std::string port = TestUtils::getFreePort();
+  server += port;
+  boost::process::child server_process("tests/fake_http_server/fake_test_server.py", port);
+  TestUtils::waitForServer(server + "/");
+
+  return RUN_ALL_TESTS();
+}
+#endif
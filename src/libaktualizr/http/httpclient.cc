@@ -1,11 +1,13 @@
 #include "libaktualizr/http/httpclient.h"
 
+#include <algorithm>
 #include <cassert>
 #include <sstream>
 
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string/trim.hpp>
 
+#include "libaktualizr/metrics.h"
 #include "libaktualizr/utilities/utils.h"
 
 struct WriteStringArg {
@@ -69,6 +71,59 @@ static size_t header_callback(char* buffer, size_t size, size_t nitems, void* us
   return nitems * size;
 }
 
+/* Locking for curl share instance */
+static void curl_share_lock_cb(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr) {
+  (void)handle;
+  (void)access;
+  auto* mutexes = static_cast<std::array<std::mutex, CURL_LOCK_DATA_LAST>*>(userptr);
+  mutexes->at(data).lock();
+}
+
+static void curl_share_unlock_cb(CURL* handle, curl_lock_data data, void* userptr) {
+  (void)handle;
+  auto* mutexes = static_cast<std::array<std::mutex, CURL_LOCK_DATA_LAST>*>(userptr);
+  mutexes->at(data).unlock();
+}
+
+HttpClient::CurlShare::CurlShare() : handle(curl_share_init()) {
+  if (handle == nullptr) {
+    throw std::runtime_error("Could not initialize share");
+  }
+
+  curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+  curl_share_setopt(handle, CURLSHOPT_LOCKFUNC, curl_share_lock_cb);
+  curl_share_setopt(handle, CURLSHOPT_UNLOCKFUNC, curl_share_unlock_cb);
+  curl_share_setopt(handle, CURLSHOPT_USERDATA, &mutexes);
+}
+
+HttpClient::CurlShare::~CurlShare() { curl_share_cleanup(handle); }
+
+/* Log where the time of a request went, to make connection reuse measurable. */
+static void logTimings(CURL* handle) {
+  char* url = nullptr;
+  double dns = 0;
+  double connect = 0;
+  double tls = 0;
+  double ttfb = 0;
+  double total = 0;
+  long new_connections = 0;  // NOLINT(google-runtime-int)
+  curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
+  curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME, &dns);
+  curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME, &connect);
+  curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME, &tls);
+  curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME, &ttfb);
+  curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &total);
+  curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &new_connections);
+  // The times are cumulative from the start of the request; report each phase
+  // on its own. APPCONNECT is 0 for plain HTTP and reused connections.
+  LOG_DEBUG << "Request to " << (url != nullptr ? url : "") << " took " << total * 1000 << " ms (DNS "
+            << dns * 1000 << " ms, connect " << (connect - dns) * 1000 << " ms, TLS "
+            << (tls > 0 ? (tls - connect) * 1000 : 0) << " ms, TTFB " << (ttfb - std::max(tls, connect)) * 1000
+            << " ms, " << (new_connections == 0 ? "reused connection" : "new connection") << ")";
+}
+
 HttpClient::HttpClient(const std::vector<std::string>* extra_headers,
                        const std::set<std::string>* response_header_names) {
   if (response_header_names != nullptr) {
@@ -97,6 +152,7 @@ HttpClient::HttpClient(const std::vector<std::string>* extra_headers,
   curlEasySetoptWrapper(curl, CURLOPT_WRITEDATA, NULL);
 
   curlEasySetoptWrapper(curl, CURLOPT_VERBOSE, get_curlopt_verbose());
+  curlEasySetoptWrapper(curl, CURLOPT_TCP_KEEPALIVE, 1L);
 
   headers = curl_slist_append(headers, "Accept: */*");
 
@@ -106,6 +162,8 @@ HttpClient::HttpClient(const std::vector<std::string>* extra_headers,
     }
   }
   curlEasySetoptWrapper(curl, CURLOPT_USERAGENT, Utils::getUserAgent());
+  curl_share_ = std_::make_unique<CurlShare>();
+  async_engine_ = AsyncHttpEngine::shared();
 }
 
 HttpClient::HttpClient(const std::string& socket) : HttpClient() {
@@ -116,11 +174,15 @@ HttpClient::HttpClient(const HttpClient& curl_in)
     : HttpInterface(curl_in), pkcs11_key(curl_in.pkcs11_key), pkcs11_cert(curl_in.pkcs11_key) {
   curl = curl_easy_duphandle(curl_in.curl);
   headers = curl_slist_dup(curl_in.headers);
+  curl_share_ = std_::make_unique<CurlShare>();
+  async_engine_ = curl_in.async_engine_;
 }
 
 const CurlGlobalInitWrapper HttpClient::manageCurlGlobalInit_{};
 
 HttpClient::~HttpClient() {
+  // The transfers still running use the headers and the shared connections.
+  async_engine_->cancel(this);
   curl_slist_free_all(headers);
   curl_easy_cleanup(curl);
 }
@@ -246,6 +308,7 @@ HttpResponse HttpClient::perform(CURL* curl_handler, int retry_times, int64_t si
     curlEasySetoptWrapper(curl_handler, CURLOPT_HEADERFUNCTION, header_callback);
   }
   CURLcode result = curl_easy_perform(curl_handler);
+  logTimings(curl_handler);
   long http_code;  // NOLINT(google-runtime-int)
   curl_easy_getinfo(curl_handler, CURLINFO_RESPONSE_CODE, &http_code);
   HttpResponse response(response_arg.out, http_code, result, (result != CURLE_OK) ? curl_easy_strerror(result) : "",
@@ -256,6 +319,9 @@ HttpResponse HttpClient::perform(CURL* curl_handler, int retry_times, int64_t si
                   << "): " << response.error_message;
     LOG_ERROR << error_message.str();
     if (retry_times != 0) {
+      static metrics::Counter& retries =
+          metrics::Registry::global().counter("aktualizr_http_retries_total", "HTTP requests retried after an error");
+      retries.inc();
       sleep(1);
       // NOLINTNEXTLINE(misc-no-recursion)
       response = perform(curl_handler, --retry_times, size_limit);
@@ -274,6 +340,18 @@ HttpResponse HttpClient::download(const std::string& url, curl_write_callback wr
 std::future<HttpResponse> HttpClient::downloadAsync(const std::string& url, curl_write_callback write_cb,
                                                     curl_xferinfo_callback progress_cb, void* userp, curl_off_t from,
                                                     CurlHandler* easyp) {
+  return startDownload(url, write_cb, progress_cb, userp, from, 0, easyp);
+}
+
+HttpResponse HttpClient::downloadRateLimited(const std::string& url, curl_write_callback write_cb,
+                                             curl_xferinfo_callback progress_cb, void* userp, curl_off_t from,
+                                             curl_off_t max_bytes_per_sec) {
+  return startDownload(url, write_cb, progress_cb, userp, from, max_bytes_per_sec, nullptr).get();
+}
+
+std::future<HttpResponse> HttpClient::startDownload(const std::string& url, curl_write_callback write_cb,
+                                                    curl_xferinfo_callback progress_cb, void* userp, curl_off_t from,
+                                                    curl_off_t max_bytes_per_sec, CurlHandler* easyp) {
   CURL* curl_download = dupHandle(curl, pkcs11_key);
 
   CurlHandler curlp = CurlHandler(curl_download, curl_easy_cleanup);
@@ -296,25 +374,28 @@ std::future<HttpResponse> HttpClient::downloadAsync(const std::string& url, curl
   curlEasySetoptWrapper(curl_download, CURLOPT_LOW_SPEED_TIME, speed_limit_time_interval_);
   curlEasySetoptWrapper(curl_download, CURLOPT_LOW_SPEED_LIMIT, speed_limit_bytes_per_sec_);
   curlEasySetoptWrapper(curl_download, CURLOPT_RESUME_FROM_LARGE, from);
+  // curl holds the transfer back itself, without blocking the engine that runs it.
+  curlEasySetoptWrapper(curl_download, CURLOPT_MAX_RECV_SPEED_LARGE, max_bytes_per_sec);
+
+  auto resp_headers = std::make_shared<ResponseHeaders>(response_header_names_);
+  if (!resp_headers->header_names.empty()) {
+    curlEasySetoptWrapper(curl_download, CURLOPT_HEADERDATA, resp_headers.get());
+    curlEasySetoptWrapper(curl_download, CURLOPT_HEADERFUNCTION, header_callback);
+  }
 
-  std::promise<HttpResponse> resp_promise;
-  auto resp_future = resp_promise.get_future();
-  std::thread(
-      [curlp, this](std::promise<HttpResponse> promise) {
-        ResponseHeaders resp_headers(response_header_names_);
-        if (!resp_headers.header_names.empty()) {
-          curlEasySetoptWrapper(curlp.get(), CURLOPT_HEADERDATA, &resp_headers);
-          curlEasySetoptWrapper(curlp.get(), CURLOPT_HEADERFUNCTION, header_callback);
-        }
-        CURLcode result = curl_easy_perform(curlp.get());
-        long http_code;  // NOLINT(google-runtime-int)
-        curl_easy_getinfo(curlp.get(), CURLINFO_RESPONSE_CODE, &http_code);
-        HttpResponse response("", http_code, result, (result != CURLE_OK) ? curl_easy_strerror(result) : "",
-                              std::move(resp_headers.headers));
-        promise.set_value(response);
+  auto resp_promise = std::make_shared<std::promise<HttpResponse>>();
+  auto resp_future = resp_promise->get_future();
+  async_engine_->start(
+      curlp,
+      [resp_promise, resp_headers](CURL* handle, CURLcode result) {
+        logTimings(handle);
+        long http_code = 0;  // NOLINT(google-runtime-int)
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &http_code);
+        resp_promise->set_value(HttpResponse("", http_code, result,
+                                             (result != CURLE_OK) ? curl_easy_strerror(result) : "",
+                                             std::move(resp_headers->headers)));
       },
-      std::move(resp_promise))
-      .detach();
+      nullptr, this);
   return resp_future;
 }
 
@@ -361,42 +442,4 @@ curl_slist* HttpClient::curl_slist_dup(curl_slist* sl) {
   return new_list;
 }
 
-/* Locking for curl share instance */
-static void curl_share_lock_cb(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr) {
-  (void)handle;
-  (void)access;
-  auto* mutexes = static_cast<std::array<std::mutex, CURL_LOCK_DATA_LAST>*>(userptr);
-  mutexes->at(data).lock();
-}
-
-static void curl_share_unlock_cb(CURL* handle, curl_lock_data data, void* userptr) {
-  (void)handle;
-  auto* mutexes = static_cast<std::array<std::mutex, CURL_LOCK_DATA_LAST>*>(userptr);
-  mutexes->at(data).unlock();
-}
-
-void HttpClientWithShare::initCurlShare() {
-  share_ = curl_share_init();
-  if (share_ == nullptr) {
-    throw std::runtime_error("Could not initialize share");
-  }
-
-  curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
-  curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
-  curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
-  curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, curl_share_lock_cb);
-  curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, curl_share_unlock_cb);
-  curl_share_setopt(share_, CURLSHOPT_USERDATA, &curl_share_mutexes);
-}
-
-HttpClientWithShare::HttpClientWithShare(const std::vector<std::string>* extra_headers,
-                                         const std::set<std::string>* response_header_names)
-    : HttpClient(extra_headers, response_header_names) {
-  initCurlShare();
-}
-HttpClientWithShare::HttpClientWithShare(const std::string& socket) : HttpClient(socket) { initCurlShare(); }
-
-HttpClientWithShare::HttpClientWithShare(const HttpClientWithShare& curl_in) : HttpClient(curl_in) { initCurlShare(); }
-
-HttpClientWithShare::~HttpClientWithShare() { curl_share_cleanup(share_); }
 // vim: set tabstop=2 shiftwidth=2 expandtab:
@@ -0,0 +1,164 @@
+#include "http/staticfileserver.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <boost/algorithm/string.hpp>
+
+#include "libaktualizr/logging/logging.h"
+
+// Idle connections are closed after this long.
+static constexpr int kIdleTimeoutMs = 5000;
+static constexpr size_t kMaxRequestSize = 16 * 1024;
+
+static bool sendAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    const ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    data += sent;
+    size -= static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+static bool sendStatus(int fd, const std::string &status, bool keep_alive) {
+  const std::string response = "HTTP/1.1 " + status + "\r\nContent-Length: " + std::to_string(status.size()) +
+                               "\r\nContent-Type: text/plain\r\nConnection: " + (keep_alive ? "keep-alive" : "close") +
+                               "\r\n\r\n" + status;
+  return sendAll(fd, response.data(), response.size()) && keep_alive;
+}
+
+StaticFileServer::StaticFileServer(boost::filesystem::path root, const std::string &ip, in_port_t port,
+                                   size_t threads)
+    : root_(std::move(root)), listen_socket_(port, ip), pool_(new ThreadPool(threads)) {
+  if (listen(*listen_socket_, SOMAXCONN) < 0) {
+    throw std::system_error(errno, std::system_category(), "listen");
+  }
+  if (pipe2(wakeup_pipe_.data(), O_CLOEXEC) != 0) {
+    throw std::system_error(errno, std::system_category(), "pipe");
+  }
+  thread_ = std::thread(&StaticFileServer::run, this);
+  LOG_INFO << "Serving " << root_ << " on " << listen_socket_.ToString();
+}
+
+StaticFileServer::~StaticFileServer() {
+  // The pipe stays readable, which also ends the connections being served.
+  const char byte = 0;
+  if (write(wakeup_pipe_[1], &byte, 1) < 0) {
+    LOG_ERROR << "Could not stop the file server: " << std::strerror(errno);
+  }
+  thread_.join();
+  pool_.reset();
+  close(wakeup_pipe_[0]);
+  close(wakeup_pipe_[1]);
+}
+
+bool StaticFileServer::waitReadable(int fd, int timeout_ms) const {
+  std::array<pollfd, 2> fds{{{fd, POLLIN, 0}, {wakeup_pipe_[0], POLLIN, 0}}};
+  int res;
+  do {
+    res = poll(fds.data(), fds.size(), timeout_ms);
+  } while (res < 0 && errno == EINTR);
+  return res > 0 && fds[1].revents == 0;
+}
+
+void StaticFileServer::run() {
+  while (waitReadable(*listen_socket_, -1)) {
+    const int fd = accept4(*listen_socket_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+    pool_->submit([this, fd]() {
+      serve(fd);
+      close(fd);
+    });
+  }
+}
+
+void StaticFileServer::serve(int fd) {
+  std::string buffer;
+  std::array<char, 4096> chunk{};
+  for (;;) {
+    size_t end;
+    while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+      if (buffer.size() > kMaxRequestSize || !waitReadable(fd, kIdleTimeoutMs)) {
+        return;
+      }
+      const ssize_t received = recv(fd, chunk.data(), chunk.size(), 0);
+      if (received <= 0) {
+        return;
+      }
+      buffer.append(chunk.data(), static_cast<size_t>(received));
+    }
+    const std::string request = buffer.substr(0, end);
+    buffer.erase(0, end + 4);
+    if (!handleRequest(fd, request)) {
+      return;
+    }
+  }
+}
+
+bool StaticFileServer::handleRequest(int fd, const std::string &request) {
+  std::istringstream lines(request);
+  std::string method;
+  std::string target;
+  std::string version;
+  lines >> method >> target >> version;
+  bool keep_alive = version == "HTTP/1.1";
+  std::string line;
+  std::getline(lines, line);
+  while (std::getline(lines, line)) {
+    boost::algorithm::to_lower(line);
+    if (boost::starts_with(line, "connection:")) {
+      keep_alive = line.find("close") == std::string::npos &&
+                   (keep_alive || line.find("keep-alive") != std::string::npos);
+    }
+  }
+
+  if (method != "GET" && method != "HEAD") {
+    return sendStatus(fd, "405 Method Not Allowed", false);
+  }
+  target = target.substr(0, target.find('?'));
+  std::vector<std::string> segments;
+  boost::split(segments, target, boost::is_any_of("/"));
+  if (target.empty() || target[0] != '/' ||
+      std::find(segments.begin(), segments.end(), "..") != segments.end()) {
+    return sendStatus(fd, "404 Not Found", keep_alive);
+  }
+
+  const boost::filesystem::path path = root_ / target.substr(1);
+  const int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st {};
+  if (file < 0 || fstat(file, &st) != 0 || !S_ISREG(st.st_mode)) {
+    if (file >= 0) {
+      close(file);
+    }
+    return sendStatus(fd, "404 Not Found", keep_alive);
+  }
+
+  const std::string header = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(st.st_size) +
+                             "\r\nContent-Type: application/octet-stream\r\nConnection: " +
+                             (keep_alive ? "keep-alive" : "close") + "\r\n\r\n";
+  bool ok = sendAll(fd, header.data(), header.size());
+  if (ok && method == "GET") {
+    std::array<char, 64 * 1024> buf{};
+    ssize_t n;
+    while (ok && (n = read(file, buf.data(), buf.size())) > 0) {
+      ok = sendAll(fd, buf.data(), static_cast<size_t>(n));
+    }
+  }
+  close(file);
+  return ok && keep_alive;
+}
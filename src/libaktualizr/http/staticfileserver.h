@@ -0,0 +1,46 @@
+#ifndef HTTP_STATICFILESERVER_H_
+#define HTTP_STATICFILESERVER_H_
+
+#include <netinet/in.h>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+#include "libaktualizr/utilities/utils.h"
+#include "utilities/thread_pool.h"
+
+/**
+ * Read-only HTTP/1.1 server for the files under a directory, such as the
+ * OSTree repo that the Primary mirrors for its Secondaries. Only GET and HEAD
+ * are supported, and connections are kept alive between requests.
+ */
+class StaticFileServer {
+ public:
+  /** Serve `root` on `ip`:`port`, all interfaces if `ip` is empty. Port 0 picks a free one. */
+  StaticFileServer(boost::filesystem::path root, const std::string &ip, in_port_t port, size_t threads = 4);
+  ~StaticFileServer();
+  StaticFileServer(const StaticFileServer &) = delete;
+  StaticFileServer(StaticFileServer &&) = delete;
+  StaticFileServer &operator=(const StaticFileServer &) = delete;
+  StaticFileServer &operator=(StaticFileServer &&) = delete;
+
+  in_port_t port() const { return listen_socket_.port(); }
+
+ private:
+  void run();
+  void serve(int fd);
+  bool handleRequest(int fd, const std::string &request);
+  bool waitReadable(int fd, int timeout_ms) const;
+
+  const boost::filesystem::path root_;
+  ListenSocket listen_socket_;
+  std::array<int, 2> wakeup_pipe_{{-1, -1}};
+  std::unique_ptr<ThreadPool> pool_;
+  std::thread thread_;
+};
+
+#endif  // HTTP_STATICFILESERVER_H_
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include <sys/socket.h>
+
+#include <array>
+#include <string>
+
+#include "http/staticfileserver.h"
+#include "libaktualizr/http/httpclient.h"
+#include "libaktualizr/utilities/utils.h"
+
+static std::string rawRequest(in_port_t port, const std::string &request) {
+  ConnectionSocket socket("127.0.0.1", port);
+  EXPECT_EQ(socket.connect(), 0);
+  EXPECT_EQ(send(*socket, request.data(), request.size(), 0), static_cast<ssize_t>(request.size()));
+  std::string response;
+  std::array<char, 1024> buf{};
+  ssize_t received;
+  while ((received = recv(*socket, buf.data(), buf.size(), 0)) > 0) {
+    response.append(buf.data(), static_cast<size_t>(received));
+  }
+  return response;
+}
+
+/* Files under the root are served, everything else is not found. */
+TEST(StaticFileServer, Serve) {
+  TemporaryDirectory temp_dir;
+  Utils::writeFile(temp_dir / "repo/config", std::string("[core]\nmode=archive-z2\n"));
+  Utils::writeFile(temp_dir / "repo/objects/ab/cdef.filez", std::string(100000, 'x'));
+  Utils::writeFile(temp_dir / "secret", std::string("secret"));
+
+  StaticFileServer server(temp_dir / "repo", "127.0.0.1", 0);
+  const std::string url = "http://127.0.0.1:" + std::to_string(server.port());
+
+  // One client, so that the connection is reused.
+  HttpClient http;
+  HttpResponse resp = http.get(url + "/config", HttpInterface::kNoLimit);
+  EXPECT_EQ(resp.http_status_code, 200);
+  EXPECT_EQ(resp.body, "[core]\nmode=archive-z2\n");
+  resp = http.get(url + "/objects/ab/cdef.filez", HttpInterface::kNoLimit);
+  EXPECT_EQ(resp.http_status_code, 200);
+  EXPECT_EQ(resp.body, std::string(100000, 'x'));
+  EXPECT_EQ(http.get(url + "/objects/ab/missing.filez", HttpInterface::kNoLimit).http_status_code, 404);
+  EXPECT_EQ(http.get(url + "/objects", HttpInterface::kNoLimit).http_status_code, 404);
+
+  // HTTP clients normalize paths, so try to escape the root with a raw request.
+  std::string raw = rawRequest(server.port(), "GET /../secret HTTP/1.0\r\n\r\n");
+  EXPECT_EQ(raw.compare(0, 22, "HTTP/1.1 404 Not Found"), 0) << raw;
+  raw = rawRequest(server.port(), "HEAD /config HTTP/1.0\r\n\r\n");
+  EXPECT_EQ(raw.compare(0, 15, "HTTP/1.1 200 OK"), 0) << raw;
+  EXPECT_NE(raw.find("Content-Length: 23\r\n"), std::string::npos) << raw;
+  EXPECT_EQ(raw.find("[core]"), std::string::npos) << raw;
+  raw = rawRequest(server.port(), "DELETE /config HTTP/1.0\r\n\r\n");
+  EXPECT_EQ(raw.compare(0, 31, "HTTP/1.1 405 Method Not Allowed"), 0) << raw;
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
@@ -1,8 +1,27 @@
+#include <cstdlib>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 
+#include <boost/core/null_deleter.hpp>
+#include <boost/log/core/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/bounded_fifo_queue.hpp>
+#include <boost/log/sinks/block_on_overflow.hpp>
+#include <boost/log/sinks/drop_on_overflow.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
 #include <boost/log/trivial.hpp>
-#include <boost/log/utility/setup/console.hpp>
+#include <boost/make_shared.hpp>
+
+#include "libaktualizr/logging/logging.h"
+
+namespace sinks = boost::log::sinks;
+
+// Records waiting to be written in asynchronous mode.
+static constexpr size_t kAsyncQueueSize = 4096;
 
 static void color_fmt(boost::log::record_view const& rec, boost::log::formatting_ostream& strm) {
   auto severity = rec[boost::log::trivial::severity];
@@ -29,14 +48,118 @@ static void color_fmt(boost::log::record_view const& rec, boost::log::formatting
   }
 }
 
-void logger_init_sink(bool use_colors = false) {
-  auto* stream = &std::cerr;
+static void plain_fmt(boost::log::record_view const& rec, boost::log::formatting_ostream& strm) {
+  strm << rec[boost::log::expressions::smessage];
+}
+
+namespace {
+
+struct SinkState {
+  std::mutex m;
+  bool initialized{false};
+  bool use_colors{false};
+  bool async{false};
+  bool drop_on_overflow{false};
+  boost::shared_ptr<sinks::sink> sink;
+  // Only set for asynchronous sinks.
+  std::function<void()> flush;
+  std::function<void()> stop;
+};
+
+SinkState& sinkState() {
+  static SinkState state;
+  return state;
+}
+
+boost::shared_ptr<sinks::text_ostream_backend> makeBackend() {
+  std::ostream* stream = &std::cerr;
   if (getenv("LOG_STDERR") == nullptr) {
     stream = &std::cout;
   }
-  auto sink = boost::log::add_console_log(*stream, boost::log::keywords::format = "%Message%",
-                                          boost::log::keywords::auto_flush = true);
-  if (use_colors) {
-    sink->set_formatter(&color_fmt);
+  auto backend = boost::make_shared<sinks::text_ostream_backend>();
+  backend->add_stream(boost::shared_ptr<std::ostream>(stream, boost::null_deleter()));
+  backend->auto_flush(true);
+  return backend;
+}
+
+template <typename Queue>
+void makeAsyncSink(SinkState& state) {
+  using Sink = sinks::asynchronous_sink<sinks::text_ostream_backend, Queue>;
+  auto sink = boost::make_shared<Sink>(makeBackend());
+  sink->set_formatter(state.use_colors ? &color_fmt : &plain_fmt);
+  state.sink = sink;
+  state.flush = [sink]() { sink->flush(); };
+  state.stop = [sink]() {
+    sink->stop();
+    sink->flush();
+  };
+}
+
+void replaceSink(SinkState& state) {
+  auto old_sink = state.sink;
+  auto old_stop = state.stop;
+  state.flush = nullptr;
+  state.stop = nullptr;
+  if (!state.async) {
+    auto sink = boost::make_shared<sinks::synchronous_sink<sinks::text_ostream_backend>>(makeBackend());
+    sink->set_formatter(state.use_colors ? &color_fmt : &plain_fmt);
+    state.sink = sink;
+  } else if (state.drop_on_overflow) {
+    makeAsyncSink<sinks::bounded_fifo_queue<kAsyncQueueSize, sinks::drop_on_overflow>>(state);
+  } else {
+    makeAsyncSink<sinks::bounded_fifo_queue<kAsyncQueueSize, sinks::block_on_overflow>>(state);
+  }
+
+  // Add the new sink first so that no record is lost during the switch.
+  auto core = boost::log::core::get();
+  core->add_sink(state.sink);
+  if (old_sink) {
+    core->remove_sink(old_sink);
+  }
+  if (old_stop) {
+    old_stop();
+  }
+}
+
+void stopAsyncAtExit() { logger_set_async(false); }
+
+}  // namespace
+
+void logger_init_sink(bool use_colors = false) {
+  SinkState& state = sinkState();
+  std::lock_guard<std::mutex> lock(state.m);
+  state.use_colors = use_colors;
+  state.initialized = true;
+  replaceSink(state);
+}
+
+void logger_set_async(bool enabled, bool drop_on_overflow) {
+  SinkState& state = sinkState();
+  std::lock_guard<std::mutex> lock(state.m);
+  if (state.async == enabled && (!enabled || state.drop_on_overflow == drop_on_overflow)) {
+    return;
+  }
+  state.async = enabled;
+  state.drop_on_overflow = drop_on_overflow;
+  if (enabled) {
+    // Queued records would be lost if the process exits without stopping the
+    // logging thread.
+    static bool at_exit_registered = false;
+    if (!at_exit_registered) {
+      std::atexit(stopAsyncAtExit);
+      at_exit_registered = true;
+    }
+  }
+  // Without logger_init(), Boost.Log's default sink is left alone.
+  if (state.initialized) {
+    replaceSink(state);
+  }
+}
+
+void logger_flush() {
+  SinkState& state = sinkState();
+  std::lock_guard<std::mutex> lock(state.m);
+  if (state.flush) {
+    state.flush();
   }
 }
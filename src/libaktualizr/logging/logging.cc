@@ -7,6 +7,9 @@
 
 using boost::log::trivial::severity_level;
 
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+std::atomic<int> logging_internal::threshold{boost::log::trivial::trace};
+
 static severity_level gLoggingThreshold;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
 
 extern void logger_init_sink(bool use_colors = false);
@@ -14,15 +17,13 @@ extern void logger_init_sink(bool use_colors = false);
 int64_t get_curlopt_verbose() { return gLoggingThreshold <= boost::log::trivial::trace ? 1L : 0L; }
 
 void logger_init(bool use_colors) {
-  gLoggingThreshold = boost::log::trivial::info;
-
   logger_init_sink(use_colors);
-
-  boost::log::core::get()->set_filter(boost::log::trivial::severity >= gLoggingThreshold);
+  logger_set_threshold(boost::log::trivial::info);
 }
 
 void logger_set_threshold(const severity_level threshold) {
   gLoggingThreshold = threshold;
+  logging_internal::threshold = threshold;
   boost::log::core::get()->set_filter(boost::log::trivial::severity >= gLoggingThreshold);
 }
 
@@ -37,6 +38,7 @@ void logger_set_threshold(const LoggerConfig& lconfig) {
     loglevel = boost::log::trivial::fatal;
   }
   logger_set_threshold(static_cast<boost::log::trivial::severity_level>(loglevel));
+  logger_set_async(lconfig.async, lconfig.async_overflow == "drop");
 }
 
 void logger_set_enable(bool enabled) { boost::log::core::get()->set_logging_enabled(enabled); }
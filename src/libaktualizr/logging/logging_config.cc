@@ -5,6 +5,12 @@
 
 void LoggerConfig::updateFromPropertyTree(const boost::property_tree::ptree& pt) {
   CopyFromConfig(loglevel, "loglevel", pt);
+  CopyFromConfig(async, "async", pt);
+  CopyFromConfig(async_overflow, "async_overflow", pt);
 }
 
-void LoggerConfig::writeToStream(std::ostream& out_stream) const { writeOption(out_stream, loglevel, "loglevel"); }
+void LoggerConfig::writeToStream(std::ostream& out_stream) const {
+  writeOption(out_stream, loglevel, "loglevel");
+  writeOption(out_stream, async, "async");
+  writeOption(out_stream, async_overflow, "async_overflow");
+}
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+
+#include "libaktualizr/logging/logging.h"
+
+/* Collects the log output. Writing waits while the buffer is held, like a slow
+ * console or disk would, to fill the queue of the asynchronous sink. */
+class CaptureBuf : public std::streambuf {
+ public:
+  CaptureBuf() : cout_buf_(std::cout.rdbuf(this)), cerr_buf_(std::cerr.rdbuf(this)) {}
+  ~CaptureBuf() override {
+    release();
+    std::cout.rdbuf(cout_buf_);
+    std::cerr.rdbuf(cerr_buf_);
+  }
+  CaptureBuf(const CaptureBuf&) = delete;
+  CaptureBuf& operator=(const CaptureBuf&) = delete;
+
+  void hold() {
+    std::lock_guard<std::mutex> lock(m_);
+    held_ = true;
+  }
+  void release() {
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      held_ = false;
+    }
+    cv_.notify_all();
+  }
+  // Number of records that start with `prefix`.
+  size_t count(const std::string& prefix) {
+    std::lock_guard<std::mutex> lock(m_);
+    size_t n = 0;
+    for (size_t pos = out_.find(prefix); pos != std::string::npos; pos = out_.find(prefix, pos + 1)) {
+      ++n;
+    }
+    return n;
+  }
+
+ protected:
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    std::unique_lock<std::mutex> lock(m_);
+    cv_.wait(lock, [this]() { return !held_; });
+    out_.append(s, static_cast<size_t>(n));
+    return n;
+  }
+  int_type overflow(int_type c) override {
+    if (c != traits_type::eof()) {
+      const char ch = traits_type::to_char_type(c);
+      xsputn(&ch, 1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+ private:
+  std::streambuf* cout_buf_;
+  std::streambuf* cerr_buf_;
+  std::mutex m_;
+  std::condition_variable cv_;
+  bool held_{false};
+  std::string out_;
+};
+
+// More than the 4096 records that the asynchronous sink queues.
+static const int kRecords = 10000;
+
+/* logger_flush() writes out every record queued by the asynchronous sink. */
+TEST(Logging, AsyncFlush) {
+  CaptureBuf capture;
+  logger_init();
+  logger_set_async(true);
+
+  for (int i = 0; i < kRecords; ++i) {
+    LOG_INFO << "flush-record " << i;
+  }
+  logger_flush();
+  EXPECT_EQ(capture.count("flush-record "), kRecords);
+
+  logger_set_async(false);
+}
+
+/* With drop_on_overflow, a full queue drops records instead of blocking the
+ * thread that logs them. */
+TEST(Logging, AsyncDropOnOverflow) {
+  CaptureBuf capture;
+  logger_init();
+  logger_set_async(true, true);
+
+  capture.hold();
+  auto logged = std::async(std::launch::async, []() {
+    for (int i = 0; i < kRecords; ++i) {
+      LOG_INFO << "drop-record " << i;
+    }
+  });
+  const bool blocked = logged.wait_for(std::chrono::seconds(20)) != std::future_status::ready;
+  capture.release();
+  logged.get();
+  EXPECT_FALSE(blocked);
+
+  logger_flush();
+  const size_t written = capture.count("drop-record ");
+  EXPECT_GT(written, 0);
+  EXPECT_LT(written, kRecords);
+
+  logger_set_async(false);
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
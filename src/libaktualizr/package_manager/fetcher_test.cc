@@ -132,6 +132,29 @@ TEST(Fetcher, PauseBinary) {
   test_pause(target);
 }
 
+/* Pass the transfer counters to callbacks wrapped in WithDownloadStats only. */
+TEST(Fetcher, ProgressWithStats) {
+  Json::Value target_json;
+  target_json["hashes"]["sha256"] = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+  target_json["length"] = 1;
+  Uptane::Target target("fake_file", target_json);
+  data::DownloadStats stats;
+  stats.bytes_fetched = 42;
+
+  uint64_t reported_bytes = 0;
+  const FetcherProgressCb with_stats =
+      WithDownloadStats{[&reported_bytes](const Uptane::Target&, const std::string&, unsigned int,
+                                          const data::DownloadStats& s) { reported_bytes = s.bytes_fetched; }};
+  reportDownloadProgress(with_stats, target, "Downloading", 50, stats);
+  EXPECT_EQ(reported_bytes, 42);
+
+  unsigned int reported_progress = 0;
+  const FetcherProgressCb plain = [&reported_progress](const Uptane::Target&, const std::string&,
+                                                       unsigned int progress) { reported_progress = progress; };
+  reportDownloadProgress(plain, target, "Downloading", 50, stats);
+  EXPECT_EQ(reported_progress, 50);
+}
+
 class HttpCustomUri : public HttpFake {
  public:
   HttpCustomUri(const boost::filesystem::path& test_dir_in) : HttpFake(test_dir_in) {}
@@ -1,6 +1,7 @@
 #include "libaktualizr/package_manager/ostreemanager.h"
 
 #include <unistd.h>
+#include <algorithm>
 #include <cstdio>
 #include <fstream>
 
@@ -17,12 +18,26 @@
 
 #include "libaktualizr/bootloader/bootloader.h"
 #include "libaktualizr/logging/logging.h"
+#include "libaktualizr/metrics.h"
 #include "libaktualizr/storage/invstorage.h"
 #include "libaktualizr/utilities/utils.h"
 
 // NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
 AUTO_REGISTER_PACKAGE_MANAGER(PACKAGE_MANAGER_OSTREE, OstreeManager);
 
+// Local ref pointed at the deployed commit during a pull, so that libostree looks up a static delta from it.
+constexpr const char *delta_base_ref = "aktualizr-delta-base";
+
+static data::DownloadStats pull_stats(OstreeAsyncProgress *progress) {
+  data::DownloadStats stats;
+  stats.bytes_fetched = ostree_async_progress_get_uint64(progress, "bytes-transferred");
+  stats.objects_fetched = ostree_async_progress_get_uint(progress, "fetched");
+  stats.objects_requested = ostree_async_progress_get_uint(progress, "requested");
+  stats.delta_parts_fetched = ostree_async_progress_get_uint(progress, "fetched-delta-parts");
+  stats.delta_parts_total = ostree_async_progress_get_uint(progress, "total-delta-parts");
+  return stats;
+}
+
 static void aktualizr_progress_cb(OstreeAsyncProgress *progress, gpointer data) {
   auto *mt = static_cast<PullMetaStruct *>(data);
   if (mt->token != nullptr && !mt->token->canContinue()) {
@@ -35,26 +50,37 @@ static void aktualizr_progress_cb(OstreeAsyncProgress *progress, gpointer data)
   guint outstanding_metadata_fetches = ostree_async_progress_get_uint(progress, "outstanding-metadata-fetches");
   guint outstanding_writes = ostree_async_progress_get_uint(progress, "outstanding-writes");
   guint n_scanned_metadata = ostree_async_progress_get_uint(progress, "scanned-metadata");
+  const data::DownloadStats stats = pull_stats(progress);
 
   if (status != nullptr && *status != '\0') {
     LOG_INFO << "ostree-pull: " << status;
   } else if (outstanding_fetches != 0) {
-    guint fetched = ostree_async_progress_get_uint(progress, "fetched");
-    guint metadata_fetched = ostree_async_progress_get_uint(progress, "metadata-fetched");
-    guint requested = ostree_async_progress_get_uint(progress, "requested");
-    if (scanning != 0 || outstanding_metadata_fetches != 0) {
-      LOG_INFO << "ostree-pull: Receiving metadata objects: " << metadata_fetched
+    if (stats.delta_parts_total != 0) {
+      guint64 total_size = ostree_async_progress_get_uint64(progress, "total-delta-part-size");
+      guint64 fetched_size = ostree_async_progress_get_uint64(progress, "fetched-delta-part-size");
+      auto calculated = static_cast<unsigned int>(total_size == 0 ? 0 : (fetched_size * 100) / total_size);
+      if (calculated != mt->percent_complete) {
+        mt->percent_complete = calculated;
+        LOG_INFO << "ostree-pull: Receiving delta parts: " << stats.delta_parts_fetched << "/"
+                 << stats.delta_parts_total << " " << calculated << "% ";
+        if (mt->progress_cb) {
+          reportDownloadProgress(mt->progress_cb, mt->target, "Receiving delta parts", calculated, stats);
+        }
+      }
+    } else if (scanning != 0 || outstanding_metadata_fetches != 0) {
+      LOG_INFO << "ostree-pull: Receiving metadata objects: "
+               << ostree_async_progress_get_uint(progress, "metadata-fetched")
                << " outstanding: " << outstanding_metadata_fetches;
       if (mt->progress_cb) {
-        mt->progress_cb(mt->target, "Receiving metadata objects", 0);
+        reportDownloadProgress(mt->progress_cb, mt->target, "Receiving metadata objects", 0, stats);
       }
-    } else {
-      guint calculated = (fetched * 100) / requested;
+    } else if (stats.objects_requested != 0) {
+      auto calculated = static_cast<unsigned int>((stats.objects_fetched * 100) / stats.objects_requested);
       if (calculated != mt->percent_complete) {
         mt->percent_complete = calculated;
         LOG_INFO << "ostree-pull: Receiving objects: " << calculated << "% ";
         if (mt->progress_cb) {
-          mt->progress_cb(mt->target, "Receiving objects", calculated);
+          reportDownloadProgress(mt->progress_cb, mt->target, "Receiving objects", calculated, stats);
         }
       }
     }
@@ -63,28 +89,83 @@ static void aktualizr_progress_cb(OstreeAsyncProgress *progress, gpointer data)
   } else {
     LOG_INFO << "ostree-pull: Scanning metadata: " << n_scanned_metadata;
     if (mt->progress_cb) {
-      mt->progress_cb(mt->target, "Scanning metadata", 0);
+      reportDownloadProgress(mt->progress_cb, mt->target, "Scanning metadata", 0, stats);
+    }
+  }
+}
+
+static std::string deployed_commit(OstreeSysroot *sysroot) {
+  OstreeDeployment *deployment = ostree_sysroot_get_booted_deployment(sysroot);
+  g_autoptr(GPtrArray) deployments = nullptr;
+  if (deployment == nullptr) {
+    deployments = ostree_sysroot_get_deployments(sysroot);
+    if (deployments != nullptr && deployments->len > 0) {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      deployment = static_cast<OstreeDeployment *>(deployments->pdata[0]);
+    }
+  }
+  return deployment == nullptr ? "" : ostree_deployment_get_csum(deployment);
+}
+
+static GVariant *pull_options(const std::string &refhash, bool from_base_ref, bool disable_deltas,
+                              const OstreePullOptions &options,
+                              const boost::optional<std::unordered_map<std::string, std::string>> &headers) {
+  // NOLINTNEXTLINE(modernize-avoid-c-arrays, cppcoreguidelines-avoid-c-arrays, hicpp-avoid-c-arrays)
+  const char *const commit_ids[] = {refhash.c_str()};
+  // NOLINTNEXTLINE(modernize-avoid-c-arrays, cppcoreguidelines-avoid-c-arrays, hicpp-avoid-c-arrays)
+  const char *const base_refs[] = {delta_base_ref};
+  GVariantBuilder builder;
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+  g_variant_builder_add(&builder, "{s@v}", "flags", g_variant_new_variant(g_variant_new_int32(0)));
+
+  if (from_base_ref) {
+    // The commit ID overrides the ref, which is then never fetched from the server. The ref is local, so the commit
+    // is not bound to it.
+    g_variant_builder_add(&builder, "{s@v}", "refs", g_variant_new_variant(g_variant_new_strv(base_refs, 1)));
+    g_variant_builder_add(&builder, "{s@v}", "override-commit-ids",
+                          g_variant_new_variant(g_variant_new_strv(commit_ids, 1)));
+    g_variant_builder_add(&builder, "{s@v}", "disable-verify-bindings",
+                          g_variant_new_variant(g_variant_new_boolean(TRUE)));
+  } else {
+    g_variant_builder_add(&builder, "{s@v}", "refs", g_variant_new_variant(g_variant_new_strv(commit_ids, 1)));
+  }
+
+  if (disable_deltas || options.static_deltas == OstreeDeltaPolicy::kNever) {
+    g_variant_builder_add(&builder, "{s@v}", "disable-static-deltas",
+                          g_variant_new_variant(g_variant_new_boolean(TRUE)));
+  } else if (options.static_deltas == OstreeDeltaPolicy::kOnly) {
+    g_variant_builder_add(&builder, "{s@v}", "require-static-deltas",
+                          g_variant_new_variant(g_variant_new_boolean(TRUE)));
+  }
+  const auto retries = static_cast<guint32>(std::max(0, options.network_retries));
+  g_variant_builder_add(&builder, "{s@v}", "n-network-retries", g_variant_new_variant(g_variant_new_uint32(retries)));
+
+  if (!!headers && !(*headers).empty()) {
+    GVariantBuilder hdr_builder;
+    g_variant_builder_init(&hdr_builder, G_VARIANT_TYPE("a(ss)"));
+
+    for (const auto &kv : *headers) {
+      g_variant_builder_add(&hdr_builder, "(ss)", kv.first.c_str(), kv.second.c_str());
     }
+    g_variant_builder_add(&builder, "{s@v}", "http-headers",
+                          g_variant_new_variant(g_variant_builder_end(&hdr_builder)));
   }
+
+  return g_variant_ref_sink(g_variant_builder_end(&builder));
 }
 
 data::InstallationResult OstreeManager::pull(const boost::filesystem::path &sysroot_path,
                                              const std::string &ostree_server, const KeyManager &keys,
                                              const Uptane::Target &target, const api::FlowControlToken *token,
                                              OstreeProgressCb progress_cb, const char *alt_remote,
-                                             boost::optional<std::unordered_map<std::string, std::string>> headers) {
+                                             boost::optional<std::unordered_map<std::string, std::string>> headers,
+                                             OstreePullOptions options) {
   if (!target.IsOstree()) {
     throw std::logic_error("Invalid type of Target, got " + target.type() + ", expected OSTREE");
   }
 
-  const std::string refhash = target.sha256Hash();
-  // NOLINTNEXTLINE(modernize-avoid-c-arrays, cppcoreguidelines-avoid-c-arrays, hicpp-avoid-c-arrays)
-  const char *const commit_ids[] = {refhash.c_str()};
   GError *error = nullptr;
-  GVariantBuilder builder;
-  GVariant *options;
-  GObjectUniquePtr<OstreeAsyncProgress> progress = nullptr;
-
   GObjectUniquePtr<OstreeSysroot> sysroot = OstreeManager::LoadSysroot(sysroot_path);
   GObjectUniquePtr<OstreeRepo> repo = LoadRepo(sysroot.get(), &error);
   if (error != nullptr) {
@@ -92,9 +173,28 @@ data::InstallationResult OstreeManager::pull(const boost::filesystem::path &sysr
     g_error_free(error);
     return data::InstallationResult(data::ResultCode::Numeric::kInstallFailed, "Could not get OSTree repo");
   }
+  if (options.delta_from.empty()) {
+    options.delta_from = deployed_commit(sysroot.get());
+  }
+  return pullToRepo(repo.get(), ostree_server, keys, target, token, std::move(progress_cb), alt_remote,
+                    std::move(headers), options);
+}
+
+data::InstallationResult OstreeManager::pullToRepo(
+    OstreeRepo *repo, const std::string &ostree_server, const KeyManager &keys, const Uptane::Target &target,
+    const api::FlowControlToken *token, OstreeProgressCb progress_cb, const char *alt_remote,
+    boost::optional<std::unordered_map<std::string, std::string>> headers, const OstreePullOptions &options) {
+  if (!target.IsOstree()) {
+    throw std::logic_error("Invalid type of Target, got " + target.type() + ", expected OSTREE");
+  }
+
+  const std::string refhash = target.sha256Hash();
+  const char *remote_name = alt_remote == nullptr ? remote : alt_remote;
+  GError *error = nullptr;
+  GObjectUniquePtr<OstreeAsyncProgress> progress = nullptr;
 
   GHashTable *ref_list = nullptr;
-  if (ostree_repo_list_commit_objects_starting_with(repo.get(), refhash.c_str(), &ref_list, nullptr, &error) != 0) {
+  if (ostree_repo_list_commit_objects_starting_with(repo, refhash.c_str(), &ref_list, nullptr, &error) != 0) {
     guint length = g_hash_table_size(ref_list);
     g_hash_table_destroy(ref_list);  // OSTree creates the table with destroy notifiers, so no memory leaks expected
     // should never be greater than 1, but use >= for robustness
@@ -118,42 +218,59 @@ data::InstallationResult OstreeManager::pull(const boost::filesystem::path &sysr
       ostree_remote_uri = uri_override;
     }
     // addRemote overwrites any previous ostree remote that was set
-    if (!OstreeManager::addRemote(repo.get(), ostree_remote_uri, keys)) {
+    if (!OstreeManager::addRemote(repo, ostree_remote_uri, keys)) {
       return data::InstallationResult(data::ResultCode::Numeric::kInstallFailed,
                                       std::string("Error adding a default OSTree remote: ") + remote);
     }
   }
 
-  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
-  g_variant_builder_add(&builder, "{s@v}", "flags", g_variant_new_variant(g_variant_new_int32(0)));
-
-  g_variant_builder_add(&builder, "{s@v}", "refs", g_variant_new_variant(g_variant_new_strv(commit_ids, 1)));
-
-  if (!!headers && !(*headers).empty()) {
-    GVariantBuilder hdr_builder;
-    g_variant_builder_init(&hdr_builder, G_VARIANT_TYPE("a(ss)"));
-
-    for (const auto &kv : *headers) {
-      g_variant_builder_add(&hdr_builder, "(ss)", kv.first.c_str(), kv.second.c_str());
+  bool from_base_ref = false;
+  if (options.static_deltas != OstreeDeltaPolicy::kNever && !options.delta_from.empty()) {
+    if (ostree_repo_set_ref_immediate(repo, remote_name, delta_base_ref, options.delta_from.c_str(), nullptr,
+                                      &error) != 0) {
+      from_base_ref = true;
+    } else {
+      LOG_WARNING << "Could not set the static delta base to " << options.delta_from << ": " << error->message;
+      g_error_free(error);
+      error = nullptr;
     }
-    g_variant_builder_add(&builder, "{s@v}", "http-headers",
-                          g_variant_new_variant(g_variant_builder_end(&hdr_builder)));
   }
 
-  options = g_variant_builder_end(&builder);
-
   PullMetaStruct mt(target, token, g_cancellable_new(), std::move(progress_cb));
+  GVariant *pull_opts = pull_options(refhash, from_base_ref, false, options, headers);
   progress.reset(ostree_async_progress_new_and_connect(aktualizr_progress_cb, &mt));
-  if (ostree_repo_pull_with_options(repo.get(), alt_remote == nullptr ? remote : alt_remote, options, progress.get(),
-                                    mt.cancellable.get(), &error) == 0) {
+  gboolean pulled = ostree_repo_pull_with_options(repo, remote_name, pull_opts, progress.get(), mt.cancellable.get(),
+                                                  &error);
+  g_variant_unref(pull_opts);
+  if (pulled == 0 && options.delta_fallback && options.static_deltas != OstreeDeltaPolicy::kNever &&
+      g_cancellable_is_cancelled(mt.cancellable.get()) == 0) {
+    LOG_WARNING << "Pulling with static deltas failed (" << error->message << "), fetching individual objects";
+    g_error_free(error);
+    error = nullptr;
+    ostree_async_progress_finish(progress.get());
+    mt.percent_complete = 0;
+    pull_opts = pull_options(refhash, false, true, options, headers);
+    progress.reset(ostree_async_progress_new_and_connect(aktualizr_progress_cb, &mt));
+    pulled = ostree_repo_pull_with_options(repo, remote_name, pull_opts, progress.get(), mt.cancellable.get(), &error);
+    g_variant_unref(pull_opts);
+  }
+  if (from_base_ref) {
+    // The pull moved the ref to the new commit; it is not needed past this point.
+    ostree_repo_set_ref_immediate(repo, remote_name, delta_base_ref, nullptr, nullptr, nullptr);
+  }
+  if (pulled == 0) {
     LOG_ERROR << "Error while pulling image: " << error->code << " " << error->message;
     data::InstallationResult install_res(data::ResultCode::Numeric::kInstallFailed, error->message);
     g_error_free(error);
-    g_variant_unref(options);
     return install_res;
   }
+  const data::DownloadStats stats = pull_stats(progress.get());
   ostree_async_progress_finish(progress.get());
-  g_variant_unref(options);
+  LOG_INFO << "ostree-pull: Fetched " << stats.objects_fetched << " objects and " << stats.delta_parts_fetched
+           << " delta parts, " << stats.bytes_fetched << " bytes";
+  metrics::Registry::global()
+      .counter("aktualizr_download_bytes_total", "Bytes of targets downloaded", {{"format", "ostree"}})
+      .inc(stats.bytes_fetched);
   return data::InstallationResult(data::ResultCode::Numeric::kOk, "Pulling OSTree image was successful");
 }
 
@@ -290,6 +407,21 @@ OstreeManager::OstreeManager(const PackageConfig &pconfig, const BootloaderConfi
     throw std::runtime_error("Could not find OSTree sysroot at: " + config.sysroot.string());
   }
 
+  // A pull interrupted by a crash or power loss leaves its static delta base behind.
+  GError *error = nullptr;
+  GObjectUniquePtr<OstreeRepo> repo = LoadRepo(sysroot_smart.get(), &error);
+  if (repo != nullptr) {
+    const std::string base_refspec = std::string(remote) + ":" + delta_base_ref;
+    g_autofree char *base_rev = nullptr;
+    if (ostree_repo_resolve_rev(repo.get(), base_refspec.c_str(), TRUE, &base_rev, nullptr) != 0 &&
+        base_rev != nullptr) {
+      LOG_DEBUG << "Removing the static delta base left by an interrupted pull";
+      ostree_repo_set_ref_immediate(repo.get(), remote, delta_base_ref, nullptr, nullptr, nullptr);
+    }
+  } else if (error != nullptr) {
+    g_error_free(error);
+  }
+
   // consider boot successful as soon as we started, missing internet connection or connection to Secondaries are not
   // proper reasons to roll back
   if (imageUpdated()) {
@@ -306,7 +438,9 @@ bool OstreeManager::fetchTarget(const Uptane::Target &target, Uptane::Fetcher &f
     // while the target is aimed for a Secondary ECU that is configured with another/non-OSTree package manager
     return PackageManagerInterface::fetchTarget(target, fetcher, keys, progress_cb, token);
   }
-  return OstreeManager::pull(config.sysroot, config.ostree_server, keys, target, token, progress_cb).success;
+  return OstreeManager::pull(config.sysroot, config.ostree_server, keys, target, token, progress_cb, nullptr,
+                             boost::none, OstreePullOptions(config))
+      .success;
 }
 
 TargetStatus OstreeManager::verifyTarget(const Uptane::Target &target) const {
@@ -6,10 +6,12 @@
 
 #include <boost/filesystem.hpp>
 
+#include "http/httpclient.h"
 #include "libaktualizr/config.h"
 #include "libaktualizr/storage/invstorage.h"
 #include "libaktualizr/utilities/utils.h"
 #include "libaktualizr/package_manager/ostreemanager.h"
+#include "package_manager/ostreemirror.h"
 
 boost::filesystem::path test_sysroot;
 
@@ -235,6 +237,103 @@ TEST(OstreeManager, AddRemoteWithCreds) {
   g_object_unref(repo);
 }
 
+static bool hasDeltaBaseRef(OstreeRepo *repo) {
+  g_autofree char *rev = nullptr;
+  EXPECT_TRUE(ostree_repo_resolve_rev(repo, "aktualizr-remote:aktualizr-delta-base", TRUE, &rev, nullptr));
+  return rev != nullptr;
+}
+
+/* Pull from a static delta base and remove the base ref afterwards. */
+TEST(OstreeManager, PullFromDeltaBase) {
+  TemporaryDirectory temp_dir;
+  Config config;
+  config.pacman.type = PACKAGE_MANAGER_OSTREE;
+  config.pacman.sysroot = test_sysroot;
+  config.pacman.booted = BootedType::kStaged;
+  config.storage.path = temp_dir.Path();
+
+  std::shared_ptr<INvStorage> storage = INvStorage::newStorage(config.storage);
+  KeyManager keys(storage, config.keymanagerConfig());
+  keys.loadKeys();
+  const std::string commit = OstreeManager(config.pacman, config.bootloader, storage, nullptr).getCurrentHash();
+  Json::Value target_json;
+  target_json["hashes"]["sha256"] = commit;
+  target_json["length"] = 0;
+  Uptane::Target target("pulled", target_json);
+
+  GObjectUniquePtr<GFile> path(g_file_new_for_path((temp_dir / "repo").c_str()));
+  GObjectUniquePtr<OstreeRepo> repo(ostree_repo_new(path.get()));
+  ASSERT_TRUE(ostree_repo_create(repo.get(), OSTREE_REPO_MODE_ARCHIVE, nullptr, nullptr));
+  OstreePullOptions options;
+  options.delta_from = commit;
+  // The test repo has no static deltas.
+  options.delta_fallback = true;
+  const std::string server = "file://" + (test_sysroot / "ostree/repo").string();
+  const data::InstallationResult result =
+      OstreeManager::pullToRepo(repo.get(), server, keys, target, nullptr, nullptr, nullptr, boost::none, options);
+  EXPECT_TRUE(result.isSuccess()) << result.description;
+  EXPECT_FALSE(hasDeltaBaseRef(repo.get()));
+}
+
+/* Remove the static delta base of an interrupted pull at startup. */
+TEST(OstreeManager, RemoveStaleDeltaBase) {
+  TemporaryDirectory temp_dir;
+  Config config;
+  config.pacman.type = PACKAGE_MANAGER_OSTREE;
+  config.pacman.sysroot = test_sysroot;
+  config.pacman.booted = BootedType::kStaged;
+  config.storage.path = temp_dir.Path();
+  std::shared_ptr<INvStorage> storage = INvStorage::newStorage(config.storage);
+
+  GObjectUniquePtr<OstreeSysroot> sysroot = OstreeManager::LoadSysroot(config.pacman.sysroot);
+  GObjectUniquePtr<OstreeRepo> repo = OstreeManager::LoadRepo(sysroot.get(), nullptr);
+  ASSERT_NE(repo, nullptr);
+  const std::string commit = OstreeManager(config.pacman, config.bootloader, storage, nullptr).getCurrentHash();
+  ASSERT_TRUE(ostree_repo_set_ref_immediate(repo.get(), "aktualizr-remote", "aktualizr-delta-base", commit.c_str(),
+                                            nullptr, nullptr));
+  EXPECT_TRUE(hasDeltaBaseRef(repo.get()));
+
+  OstreeManager ostree(config.pacman, config.bootloader, storage, nullptr);
+  EXPECT_FALSE(hasDeltaBaseRef(repo.get()));
+}
+
+/* Mirror a commit for the Secondaries, serve it and prune it once no update needs it. */
+TEST(OstreeMirror, PullServeAndPrune) {
+  TemporaryDirectory temp_dir;
+  Config config;
+  config.pacman.type = PACKAGE_MANAGER_OSTREE;
+  config.pacman.sysroot = test_sysroot;
+  config.pacman.booted = BootedType::kStaged;
+  config.pacman.ostree_server = "file://" + (test_sysroot / "ostree/repo").string();
+  config.pacman.ostree_static_deltas = OstreeDeltaPolicy::kNever;
+  config.pacman.ostree_mirror_address = "127.0.0.1";
+  config.pacman.ostree_mirror_port = 0;
+  config.pacman.ostree_mirror_repo = temp_dir / "mirror";
+  config.storage.path = temp_dir.Path();
+
+  std::shared_ptr<INvStorage> storage = INvStorage::newStorage(config.storage);
+  KeyManager keys(storage, config.keymanagerConfig());
+  keys.loadKeys();
+  const std::string commit = OstreeManager(config.pacman, config.bootloader, storage, nullptr).getCurrentHash();
+  Json::Value target_json;
+  target_json["hashes"]["sha256"] = commit;
+  target_json["length"] = 0;
+  Uptane::Target target("mirrored", target_json);
+
+  OstreeMirror mirror(config.pacman);
+  EXPECT_TRUE(mirror.pull(target, keys, nullptr, nullptr).isSuccess());
+  const std::string commit_object = "objects/" + commit.substr(0, 2) + "/" + commit.substr(2) + ".commit";
+  EXPECT_TRUE(boost::filesystem::exists(config.pacman.ostree_mirror_repo / commit_object));
+  HttpClient http;
+  EXPECT_EQ(http.get(mirror.url() + "/" + commit_object, HttpInterface::kNoLimit).http_status_code, 200);
+
+  // Kept as long as an update needs it.
+  mirror.prune({target});
+  EXPECT_TRUE(boost::filesystem::exists(config.pacman.ostree_mirror_repo / commit_object));
+  mirror.prune({});
+  EXPECT_FALSE(boost::filesystem::exists(config.pacman.ostree_mirror_repo / commit_object));
+}
+
 #ifndef __NO_MAIN__
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,110 @@
+#include "package_manager/ostreemirror.h"
+
+#include <set>
+
+#include <boost/filesystem.hpp>
+
+#include "libaktualizr/logging/logging.h"
+
+namespace {
+// Each mirrored commit has a ref below this one, so that pruning keeps it.
+const std::string mirror_ref_prefix = "aktualizr-mirror/";
+}  // namespace
+
+OstreeMirror::OstreeMirror(const PackageConfig &pconfig)
+    : ostree_server_(pconfig.ostree_server), address_(pconfig.ostree_mirror_address), pull_options_(pconfig) {
+  if (pconfig.ostree_mirror_port < 0 || pconfig.ostree_mirror_port > 65535) {
+    throw std::runtime_error("Invalid OSTree mirror port: " + std::to_string(pconfig.ostree_mirror_port));
+  }
+
+  boost::filesystem::create_directories(pconfig.ostree_mirror_repo);
+  GObjectUniquePtr<GFile> path(g_file_new_for_path(pconfig.ostree_mirror_repo.c_str()));
+  repo_.reset(ostree_repo_new(path.get()));
+  GError *error = nullptr;
+  // Also opens an existing repo.
+  if (ostree_repo_create(repo_.get(), OSTREE_REPO_MODE_ARCHIVE, nullptr, &error) == 0) {
+    const std::string message = error->message;
+    g_error_free(error);
+    throw std::runtime_error("Could not create the OSTree mirror in " + pconfig.ostree_mirror_repo.string() + ": " +
+                             message);
+  }
+
+  server_ = std_::make_unique<StaticFileServer>(pconfig.ostree_mirror_repo, address_,
+                                                static_cast<in_port_t>(pconfig.ostree_mirror_port));
+  LOG_INFO << "Secondaries pull OSTree commits from " << url();
+}
+
+std::string OstreeMirror::url() const { return "http://" + address_ + ":" + std::to_string(server_->port()); }
+
+data::InstallationResult OstreeMirror::pull(const Uptane::Target &target, const KeyManager &keys,
+                                            OstreeProgressCb progress_cb, const api::FlowControlToken *token) {
+  std::lock_guard<std::mutex> lock(pull_mutex_);
+  LOG_INFO << "Pulling OSTree commit " << target.sha256Hash() << " into the mirror for Secondaries";
+  data::InstallationResult result = OstreeManager::pullToRepo(repo_.get(), ostree_server_, keys, target, token,
+                                                              std::move(progress_cb), nullptr, boost::none,
+                                                              pull_options_);
+  if (result.isSuccess()) {
+    const std::string ref = mirror_ref_prefix + target.sha256Hash();
+    GError *error = nullptr;
+    if (ostree_repo_set_ref_immediate(repo_.get(), nullptr, ref.c_str(), target.sha256Hash().c_str(), nullptr,
+                                      &error) == 0) {
+      LOG_WARNING << "Could not set the mirror ref of " << target.sha256Hash() << ": " << error->message;
+      g_error_free(error);
+    }
+  }
+  return result;
+}
+
+void OstreeMirror::prune(const std::vector<Uptane::Target> &keep) {
+  std::lock_guard<std::mutex> lock(pull_mutex_);
+  std::set<std::string> kept_commits;
+  for (const auto &target : keep) {
+    if (target.IsOstree()) {
+      kept_commits.insert(target.sha256Hash());
+    }
+  }
+
+  GError *error = nullptr;
+  GHashTable *refs = nullptr;
+  if (ostree_repo_list_refs(repo_.get(), nullptr, &refs, nullptr, &error) == 0) {
+    LOG_WARNING << "Could not list the refs of the OSTree mirror: " << error->message;
+    g_error_free(error);
+    return;
+  }
+  std::vector<std::string> dropped_refs;
+  GHashTableIter it;
+  gpointer key = nullptr;
+  gpointer value = nullptr;
+  g_hash_table_iter_init(&it, refs);
+  while (g_hash_table_iter_next(&it, &key, &value) != 0) {
+    const std::string ref = static_cast<const char *>(key);
+    if (ref.compare(0, mirror_ref_prefix.size(), mirror_ref_prefix) == 0 &&
+        kept_commits.count(static_cast<const char *>(value)) == 0) {
+      dropped_refs.push_back(ref);
+    }
+  }
+  g_hash_table_destroy(refs);
+  if (dropped_refs.empty()) {
+    return;
+  }
+
+  for (const auto &ref : dropped_refs) {
+    if (ostree_repo_set_ref_immediate(repo_.get(), nullptr, ref.c_str(), nullptr, nullptr, &error) == 0) {
+      LOG_WARNING << "Could not delete the mirror ref " << ref << ": " << error->message;
+      g_error_free(error);
+      error = nullptr;
+    }
+  }
+
+  gint objects_total = 0;
+  gint objects_pruned = 0;
+  guint64 bytes_pruned = 0;
+  if (ostree_repo_prune(repo_.get(), OSTREE_REPO_PRUNE_FLAGS_REFS_ONLY, -1, &objects_total, &objects_pruned,
+                        &bytes_pruned, nullptr, &error) == 0) {
+    LOG_WARNING << "Could not prune the OSTree mirror: " << error->message;
+    g_error_free(error);
+    return;
+  }
+  LOG_INFO << "Pruned " << dropped_refs.size() << " commits from the OSTree mirror, " << objects_pruned
+           << " objects and " << bytes_pruned << " bytes";
+}
@@ -0,0 +1,40 @@
+#ifndef OSTREEMIRROR_H_
+#define OSTREEMIRROR_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "http/staticfileserver.h"
+#include "libaktualizr/config.h"
+#include "libaktualizr/package_manager/ostreemanager.h"
+
+/**
+ * Archive-mode OSTree repo on the Primary holding the commits of its
+ * Secondaries. Each commit is pulled once from the OSTree server, and the repo
+ * is served to the Secondaries over HTTP on the in-vehicle network.
+ */
+class OstreeMirror {
+ public:
+  explicit OstreeMirror(const PackageConfig &pconfig);
+
+  /** URL of the mirror for the Secondaries. */
+  std::string url() const;
+  data::InstallationResult pull(const Uptane::Target &target, const KeyManager &keys, OstreeProgressCb progress_cb,
+                                const api::FlowControlToken *token);
+  /** Drop the mirrored commits of all targets but `keep`, and the objects only they use. */
+  void prune(const std::vector<Uptane::Target> &keep);
+
+ private:
+  const std::string ostree_server_;
+  const std::string address_;
+  // Without a deployed commit, static deltas are only found through the summary of the server.
+  const OstreePullOptions pull_options_;
+  GObjectUniquePtr<OstreeRepo> repo_;
+  // Pulls into the same repo are not run concurrently.
+  std::mutex pull_mutex_;
+  std::unique_ptr<StaticFileServer> server_;
+};
+
+#endif  // OSTREEMIRROR_H_
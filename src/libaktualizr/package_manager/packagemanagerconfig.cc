@@ -1,6 +1,39 @@
 #include "libaktualizr/config.h"
 #include "utilities/config_utils.h"
 
+std::ostream& operator<<(std::ostream& os, OstreeDeltaPolicy policy) {
+  std::string policy_s;
+  switch (policy) {
+    case OstreeDeltaPolicy::kOnly:
+      policy_s = "only";
+      break;
+    case OstreeDeltaPolicy::kNever:
+      policy_s = "never";
+      break;
+    default:
+      policy_s = "prefer";
+      break;
+  }
+  os << '"' << policy_s << '"';
+  return os;
+}
+
+template <>
+inline void CopyFromConfig(OstreeDeltaPolicy& dest, const std::string& option_name,
+                           const boost::property_tree::ptree& pt) {
+  boost::optional<std::string> value = pt.get_optional<std::string>(option_name);
+  if (value.is_initialized()) {
+    std::string policy{StripQuotesFromStrings(value.get())};
+    if (policy == "only") {
+      dest = OstreeDeltaPolicy::kOnly;
+    } else if (policy == "never") {
+      dest = OstreeDeltaPolicy::kNever;
+    } else {
+      dest = OstreeDeltaPolicy::kPrefer;
+    }
+  }
+}
+
 void PackageConfig::updateFromPropertyTree(const boost::property_tree::ptree& pt) {
   for (const auto& cp : pt) {
     if (cp.first == "type") {
@@ -11,8 +44,22 @@ void PackageConfig::updateFromPropertyTree(const boost::property_tree::ptree& pt
       CopyFromConfig(sysroot, cp.first, pt);
     } else if (cp.first == "ostree_server") {
       CopyFromConfig(ostree_server, cp.first, pt);
+    } else if (cp.first == "ostree_static_deltas") {
+      CopyFromConfig(ostree_static_deltas, cp.first, pt);
+    } else if (cp.first == "ostree_delta_fallback") {
+      CopyFromConfig(ostree_delta_fallback, cp.first, pt);
+    } else if (cp.first == "ostree_network_retries") {
+      CopyFromConfig(ostree_network_retries, cp.first, pt);
+    } else if (cp.first == "ostree_mirror_address") {
+      CopyFromConfig(ostree_mirror_address, cp.first, pt);
+    } else if (cp.first == "ostree_mirror_port") {
+      CopyFromConfig(ostree_mirror_port, cp.first, pt);
+    } else if (cp.first == "ostree_mirror_repo") {
+      CopyFromConfig(ostree_mirror_repo, cp.first, pt);
     } else if (cp.first == "images_path") {
       CopyFromConfig(images_path, cp.first, pt);
+    } else if (cp.first == "images_quota") {
+      CopyFromConfig(images_quota, cp.first, pt);
     } else if (cp.first == "packages_file") {
       CopyFromConfig(packages_file, cp.first, pt);
     } else if (cp.first == "fake_need_reboot") {
@@ -30,7 +77,14 @@ void PackageConfig::writeToStream(std::ostream& out_stream) const {
   writeOption(out_stream, os, "os");
   writeOption(out_stream, sysroot, "sysroot");
   writeOption(out_stream, ostree_server, "ostree_server");
+  writeOption(out_stream, ostree_static_deltas, "ostree_static_deltas");
+  writeOption(out_stream, ostree_delta_fallback, "ostree_delta_fallback");
+  writeOption(out_stream, ostree_network_retries, "ostree_network_retries");
+  writeOption(out_stream, ostree_mirror_address, "ostree_mirror_address");
+  writeOption(out_stream, ostree_mirror_port, "ostree_mirror_port");
+  writeOption(out_stream, ostree_mirror_repo, "ostree_mirror_repo");
   writeOption(out_stream, images_path, "images_path");
+  writeOption(out_stream, images_quota, "images_quota");
   writeOption(out_stream, packages_file, "packages_file");
   writeOption(out_stream, fake_need_reboot, "fake_need_reboot");
   writeOption(out_stream, booted, "booted");
@@ -104,6 +104,210 @@ TEST(PackageManagerFake, ListRemove) {
                                         "A81C31AC62620B9215A14FF00544CB07A55B765594F3AB3BE77E70923AE27CF1"));
 }
 
+// Targets with the same content share a file, which is removed with the last of them.
+TEST(PackageManagerFake, SharedContent) {
+  TemporaryDirectory temp_dir;
+  Config config;
+  config.pacman.type = PACKAGE_MANAGER_NONE;
+  config.pacman.images_path = temp_dir.Path() / "images";
+  config.storage.path = temp_dir.Path();
+
+  auto storage = INvStorage::newStorage(config.storage);
+  PackageManagerFake pacman(config.pacman, config.bootloader, storage, nullptr);
+
+  Json::Value target_json;
+  target_json["hashes"]["sha256"] = "D9CD8155764C3543F10FAD8A480D743137466F8D55213C8EAEFCD12F06D43A80";
+  Uptane::Target t1("aa.bin", target_json);
+  Uptane::Target t2("aa-copy.bin", target_json);
+  const boost::filesystem::path file = temp_dir.Path() / "images" / t1.hashes()[0].HashString();
+
+  pacman.createTargetFile(t1) << "a";
+  pacman.createTargetFile(t2) << "a";
+  EXPECT_EQ(pacman.getTargetFiles().size(), 2);
+
+  pacman.removeTargetFile(t1);
+  EXPECT_TRUE(boost::filesystem::exists(file));
+  EXPECT_NO_THROW(pacman.openTargetFile(t2));
+  pacman.removeTargetFile(t2);
+  EXPECT_FALSE(boost::filesystem::exists(file));
+}
+
+/*
+ * Remove the least recently used target files that no ECU has installed until
+ * the store fits in the quota.
+ */
+TEST(PackageManagerFake, GarbageCollection) {
+  TemporaryDirectory temp_dir;
+  Config config;
+  config.pacman.type = PACKAGE_MANAGER_NONE;
+  config.pacman.images_path = temp_dir.Path() / "images";
+  config.pacman.images_quota = 13;
+  config.storage.path = temp_dir.Path();
+
+  auto storage = INvStorage::newStorage(config.storage);
+  const Uptane::EcuSerial primary_serial("primary");
+  storage->storeEcuSerials({{primary_serial, Uptane::HardwareIdentifier("primary_hw")}});
+  PackageManagerFake pacman(config.pacman, config.bootloader, storage, nullptr);
+
+  Uptane::EcuMap primary_ecu{{primary_serial, Uptane::HardwareIdentifier("primary_hw")}};
+  auto make_target = [&primary_ecu](const std::string &name, const std::string &content) {
+    return Uptane::Target(name, primary_ecu, {Hash(Hash::Type::kSha256, Crypto::sha256digestHex(content))},
+                          content.size(), "");
+  };
+  const std::vector<std::pair<std::string, std::string>> files{
+      {"installed.bin", "12345678"}, {"old.bin", "abcd"}, {"recent.bin", "efgh"}};
+  std::time_t mtime = std::time(nullptr) - 100;
+  for (const auto &file : files) {
+    const Uptane::Target target = make_target(file.first, file.second);
+    pacman.createTargetFile(target) << file.second;
+    boost::filesystem::last_write_time(temp_dir.Path() / "images" / target.hashes()[0].HashString(), mtime++);
+  }
+  storage->savePrimaryInstalledVersion(make_target("installed.bin", "12345678"), InstalledVersionUpdateMode::kCurrent);
+
+  // 16 bytes are stored, the oldest unused target is enough to fit in 13.
+  EXPECT_EQ(pacman.collectTargetGarbage(), 4);
+  auto targets = pacman.getTargetFiles();
+  ASSERT_EQ(targets.size(), 2);
+  EXPECT_EQ(targets.at(0).filename(), "installed.bin");
+  EXPECT_EQ(targets.at(1).filename(), "recent.bin");
+
+  // The installed target is kept even beyond the quota.
+  config.pacman.images_quota = 1;
+  PackageManagerFake strict_pacman(config.pacman, config.bootloader, storage, nullptr);
+  EXPECT_EQ(strict_pacman.collectTargetGarbage(), 4);
+  targets = strict_pacman.getTargetFiles();
+  ASSERT_EQ(targets.size(), 1);
+  EXPECT_EQ(targets.at(0).filename(), "installed.bin");
+  EXPECT_EQ(strict_pacman.collectTargetGarbage(), 0);
+}
+
+/*
+ * Keep the targets of the update offered by the Director, which are not
+ * installed yet, also after a restart and when the disk is short of space.
+ */
+TEST(PackageManagerFake, GarbageCollectionKeepsPendingUpdate) {
+  TemporaryDirectory temp_dir;
+  Config config;
+  config.pacman.type = PACKAGE_MANAGER_NONE;
+  config.pacman.images_path = temp_dir.Path() / "images";
+  config.pacman.images_quota = 1;
+  config.storage.path = temp_dir.Path();
+
+  auto storage = INvStorage::newStorage(config.storage);
+  const std::vector<std::pair<std::string, std::string>> files{{"old.bin", "abcd"}, {"pending.bin", "efgh"}};
+  for (const auto &file : files) {
+    const Uptane::Target target(file.first, Uptane::EcuMap{},
+                                {Hash(Hash::Type::kSha256, Crypto::sha256digestHex(file.second))},
+                                file.second.size(), "");
+    PackageManagerFake(config.pacman, config.bootloader, storage, nullptr).createTargetFile(target) << file.second;
+  }
+  Json::Value director_targets;
+  director_targets["signed"]["_type"] = "Targets";
+  director_targets["signed"]["version"] = 2;
+  director_targets["signed"]["expires"] = "2038-01-19T03:14:06Z";
+  director_targets["signed"]["targets"]["pending.bin"]["hashes"]["sha256"] = Crypto::sha256digestHex("efgh");
+  director_targets["signed"]["targets"]["pending.bin"]["length"] = 4;
+  storage->storeNonRoot(Utils::jsonToStr(director_targets), Uptane::RepositoryType::Director(),
+                        Uptane::Role::Targets());
+
+  PackageManagerFake pacman(config.pacman, config.bootloader, storage, nullptr);
+  EXPECT_EQ(pacman.collectTargetGarbage(), 4);
+  auto targets = pacman.getTargetFiles();
+  ASSERT_EQ(targets.size(), 1);
+  EXPECT_EQ(targets.at(0).filename(), "pending.bin");
+}
+
+/* A streamed download passes the whole image on, with or without keeping a copy. */
+TEST(PackageManagerFake, Streaming) {
+  TemporaryDirectory temp_dir;
+  Config config;
+  config.pacman.type = PACKAGE_MANAGER_NONE;
+  config.pacman.images_path = temp_dir.Path() / "images";
+  config.storage.path = temp_dir.Path();
+  auto storage = INvStorage::newStorage(config.storage);
+  auto http = std::make_shared<HttpFake>(temp_dir.Path(), "", temp_dir.Path() / "server");
+  Uptane::Fetcher uptane_fetcher(config, http);
+  PackageManagerFake pacman(config.pacman, config.bootloader, storage, http);
+
+  const std::string image(3000, 'x');
+  Utils::writeFile(temp_dir.Path() / "server/image.bin", image);
+  Json::Value target_json;
+  target_json["hashes"]["sha256"] = Crypto::sha256digestHex(image);
+  target_json["length"] = static_cast<Json::UInt64>(image.size());
+  target_json["custom"]["uri"] = "https://tlsserver.com/image.bin";
+  Uptane::Target target("image.bin", target_json);
+
+  std::string received;
+  const TargetChunkCb chunk_cb = [&received](const uint8_t *data, size_t size) {
+    received.append(reinterpret_cast<const char *>(data), size);
+    return true;
+  };
+  EXPECT_TRUE(pacman.fetchTargetStreaming(target, uptane_fetcher, nullptr, chunk_cb, false, nullptr));
+  EXPECT_EQ(received, image);
+  EXPECT_EQ(pacman.verifyTarget(target), TargetStatus::kNotFound);
+
+  received.clear();
+  EXPECT_TRUE(pacman.fetchTargetStreaming(target, uptane_fetcher, nullptr, chunk_cb, true, nullptr));
+  EXPECT_EQ(received, image);
+  EXPECT_EQ(pacman.verifyTarget(target), TargetStatus::kGood);
+
+  // Already stored: nothing to stream.
+  received.clear();
+  EXPECT_TRUE(pacman.fetchTargetStreaming(target, uptane_fetcher, nullptr, chunk_cb, true, nullptr));
+  EXPECT_TRUE(received.empty());
+
+  // The receiver can abort the download.
+  pacman.removeTargetFile(target);
+  const TargetChunkCb failing_cb = [](const uint8_t *data, size_t size) {
+    (void)data;
+    (void)size;
+    return false;
+  };
+  EXPECT_FALSE(pacman.fetchTargetStreaming(target, uptane_fetcher, nullptr, failing_cb, true, nullptr));
+}
+
+/*
+ * Prefetch a target with a bandwidth limit.
+ * Skip a target when the stored update would exceed the prefetch quota.
+ * Don't count the files that the garbage collection may remove.
+ */
+TEST(PackageManagerFake, Prefetch) {
+  TemporaryDirectory temp_dir;
+  Config config;
+  config.pacman.type = PACKAGE_MANAGER_NONE;
+  config.pacman.images_path = temp_dir.Path() / "images";
+  config.storage.path = temp_dir.Path();
+  auto storage = INvStorage::newStorage(config.storage);
+  auto http = std::make_shared<HttpFake>(temp_dir.Path(), "", temp_dir.Path() / "server");
+  Uptane::Fetcher uptane_fetcher(config, http);
+  PackageManagerFake pacman(config.pacman, config.bootloader, storage, http);
+
+  auto makeTarget = [&temp_dir](const std::string &name, const std::string &image) {
+    Utils::writeFile(temp_dir.Path() / "server" / name, image);
+    Json::Value target_json;
+    target_json["hashes"]["sha256"] = Crypto::sha256digestHex(image);
+    target_json["length"] = static_cast<Json::UInt64>(image.size());
+    target_json["custom"]["uri"] = "https://tlsserver.com/" + name;
+    return Uptane::Target(name, target_json);
+  };
+  const Uptane::Target target = makeTarget("image.bin", std::string(2000, 'x'));
+  const Uptane::Target other = makeTarget("other.bin", std::string(1500, 'y'));
+
+  EXPECT_TRUE(pacman.prefetchTarget(target, uptane_fetcher, 10000, 3000, nullptr));
+  EXPECT_EQ(http->last_rate_limit, 10000);
+  EXPECT_EQ(pacman.verifyTarget(target), TargetStatus::kGood);
+  // A target that is already stored is not skipped.
+  EXPECT_TRUE(pacman.prefetchTarget(target, uptane_fetcher, 0, 1000, nullptr));
+
+  EXPECT_FALSE(pacman.prefetchTarget(other, uptane_fetcher, 0, 3000, nullptr));
+  EXPECT_EQ(pacman.verifyTarget(other), TargetStatus::kNotFound);
+
+  // Once collected, the first target is no longer held for the update.
+  pacman.collectTargetGarbage();
+  EXPECT_TRUE(pacman.prefetchTarget(other, uptane_fetcher, 0, 3000, nullptr));
+  EXPECT_EQ(pacman.verifyTarget(other), TargetStatus::kGood);
+}
+
 /*
  * Verify a stored target.
  * Verify that a target is unavailable.
@@ -1,17 +1,21 @@
 #include "libaktualizr/packagemanagerinterface.h"
 
 #include <sys/statvfs.h>
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <chrono>
+#include <map>
 
 #include "libaktualizr/crypto/crypto.h"
 #include "libaktualizr/crypto/keymanager.h"
 #include "libaktualizr/http/httpinterface.h"
 #include "libaktualizr/logging/logging.h"
+#include "libaktualizr/metrics.h"
 #include "libaktualizr/storage/invstorage.h"
 #include "libaktualizr/uptane/exceptions.h"
 #include "libaktualizr/uptane/fetcher.h"
 #include "libaktualizr/utilities/apiqueue.h"
+#include "libaktualizr/utilities/utils.h"
 
 struct DownloadMetaStruct {
  public:
@@ -20,7 +24,9 @@ struct DownloadMetaStruct {
         target{std::move(target_in)},
         token{token_in},
         progress_cb{std::move(progress_cb_in)},
-        time_lastreport{std::chrono::steady_clock::now()} {}
+        time_lastreport{std::chrono::steady_clock::now()},
+        downloaded_bytes{metrics::Registry::global().counter("aktualizr_download_bytes_total",
+                                                             "Bytes of targets downloaded", {{"format", "binary"}})} {}
   uintmax_t downloaded_length{0};
   unsigned int last_progress{0};
   std::ofstream fhandle;
@@ -40,6 +46,9 @@ struct DownloadMetaStruct {
   FetcherProgressCb progress_cb;
   // each LogProgressInterval msec log download progress for big files
   std::chrono::time_point<std::chrono::steady_clock> time_lastreport;
+  metrics::Counter& downloaded_bytes;
+  const TargetChunkCb* chunk_cb{nullptr};
+  bool chunk_cb_failed{false};
 
  private:
   MultiPartSHA256Hasher sha256_hasher;
@@ -55,14 +64,45 @@ static size_t DownloadHandler(char* contents, size_t size, size_t nmemb, void* u
     return downloaded + 1;  // curl will abort if return unexpected size;
   }
 
-  ds->fhandle.write(contents, static_cast<std::streamsize>(downloaded));
+  if (ds->chunk_cb != nullptr && !(*ds->chunk_cb)(reinterpret_cast<const uint8_t*>(contents), downloaded)) {
+    ds->chunk_cb_failed = true;
+    return downloaded + 1;
+  }
+  if (ds->fhandle.is_open()) {
+    ds->fhandle.write(contents, static_cast<std::streamsize>(downloaded));
+  }
   ds->hasher().update(reinterpret_cast<const unsigned char*>(contents), downloaded);
   ds->downloaded_length += downloaded;
+  ds->downloaded_bytes.inc(downloaded);
   return downloaded;
 }
 
 static constexpr int64_t LogProgressInterval = 15000;
 
+// Space left free on the filesystem of the target files.
+static constexpr uint64_t ReservedBytes = 1 << 20;
+
+// Target files are named after their sha256, so that targets with the same content share a file.
+static std::string contentFilename(const Uptane::Target& target) {
+  for (const auto& hash : target.hashes()) {
+    if (hash.type() == Hash::Type::kSha256) {
+      return hash.HashString();
+    }
+  }
+  return target.hashes()[0].HashString();
+}
+
+static bool availableDiskSpace(const boost::filesystem::path& path, uint64_t* available_bytes) {
+  struct statvfs stvfsbuf {};
+  const int stat_res = statvfs(path.c_str(), &stvfsbuf);
+  if (stat_res < 0) {
+    LOG_WARNING << "Unable to read filesystem statistics: error code " << stat_res;
+    return false;
+  }
+  *available_bytes = static_cast<uint64_t>(stvfsbuf.f_bsize) * stvfsbuf.f_bavail;
+  return true;
+}
+
 static int ProgressHandler(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
   (void)dltotal;
   (void)dlnow;
@@ -74,7 +114,9 @@ static int ProgressHandler(void* clientp, curl_off_t dltotal, curl_off_t dlnow,
   auto progress = static_cast<unsigned int>((ds->downloaded_length * 100) / expected);
   if (ds->progress_cb && progress > ds->last_progress) {
     ds->last_progress = progress;
-    ds->progress_cb(ds->target, "Downloading", progress);
+    data::DownloadStats stats;
+    stats.bytes_fetched = ds->downloaded_length;
+    reportDownloadProgress(ds->progress_cb, ds->target, "Downloading", progress, stats);
     // OTA-4864:Improve binary file download progress logging. Report each XX sec report event that notify user
     auto now = std::chrono::steady_clock::now();
     auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(now - ds->time_lastreport);
@@ -102,23 +144,73 @@ bool PackageManagerInterface::fetchTarget(const Uptane::Target& target, Uptane::
                                           const KeyManager& keys, const FetcherProgressCb& progress_cb,
                                           const api::FlowControlToken* token) {
   (void)keys;
+  return fetchTargetImpl(target, fetcher, progress_cb, token, nullptr, true);
+}
+
+bool PackageManagerInterface::fetchTargetStreaming(const Uptane::Target& target, Uptane::Fetcher& fetcher,
+                                                   const FetcherProgressCb& progress_cb,
+                                                   const TargetChunkCb& chunk_cb, bool keep_copy,
+                                                   const api::FlowControlToken* token) {
+  return fetchTargetImpl(target, fetcher, progress_cb, token, &chunk_cb, keep_copy);
+}
+
+bool PackageManagerInterface::prefetchTarget(const Uptane::Target& target, Uptane::Fetcher& fetcher,
+                                             const uint64_t max_bytes_per_sec, const uint64_t quota,
+                                             const api::FlowControlToken* token) {
+  const auto stored = checkTargetFile(target);
+  const bool complete = !!stored && stored->first >= target.length();
+  if (quota != 0 && !complete) {
+    const uint64_t update_space = updateTargetSpace(target);
+    if (update_space + target.length() > quota) {
+      LOG_INFO << "Not prefetching " << target.filename() << ", its " << target.length() << " bytes and the "
+               << update_space << " bytes stored for the update would exceed the prefetch quota of " << quota
+               << " bytes";
+      return false;
+    }
+  }
+  return fetchTargetImpl(target, fetcher, nullptr, token, nullptr, true, max_bytes_per_sec);
+}
+
+bool PackageManagerInterface::fetchTargetImpl(const Uptane::Target& target, Uptane::Fetcher& fetcher,
+                                              const FetcherProgressCb& progress_cb,
+                                              const api::FlowControlToken* token, const TargetChunkCb* chunk_cb,
+                                              bool keep_copy, const uint64_t max_bytes_per_sec) {
   bool result = false;
   try {
     if (target.hashes().empty()) {
       throw Uptane::Exception("image", "No hash defined for the target");
     }
+    const std::string content_filename = contentFilename(target);
+    if (!checkTargetFile(target) && boost::filesystem::exists(config.images_path / content_filename)) {
+      LOG_INFO << "Image with the same content already stored; reusing it for " << target.filename();
+      storage_->storeTargetFilename(target.filename(), content_filename);
+    }
+    {
+      std::lock_guard<std::mutex> guard(gc_mutex_);
+      pinned_files_.insert(content_filename);
+      pinned_files_.insert(storage_->getTargetFilename(target.filename()));
+    }
     TargetStatus exists = PackageManagerInterface::verifyTarget(target);
     if (exists == TargetStatus::kGood) {
       LOG_INFO << "Image already downloaded; skipping download";
+      // Marks the file as recently used for the garbage collection.
+      boost::system::error_code ec;
+      boost::filesystem::last_write_time(config.images_path / storage_->getTargetFilename(target.filename()),
+                                         std::time(nullptr), ec);
       return true;
     }
     std::unique_ptr<DownloadMetaStruct> ds = std_::make_unique<DownloadMetaStruct>(target, progress_cb, token);
+    ds->chunk_cb = chunk_cb;
     if (target.length() == 0) {
       LOG_INFO << "Skipping download of target with length 0";
-      ds->fhandle = createTargetFile(target);
+      if (keep_copy) {
+        ds->fhandle = createTargetFile(target);
+      }
       return true;
     }
-    if (exists == TargetStatus::kIncomplete) {
+    if (!keep_copy) {
+      LOG_DEBUG << "Initiating download of file " << target.filename() << " without storing it";
+    } else if (exists == TargetStatus::kIncomplete && chunk_cb == nullptr) {
       LOG_INFO << "Continuing incomplete download of file " << target.filename();
       auto target_check = checkTargetFile(target);
       ds->downloaded_length = target_check->first;
@@ -131,9 +223,12 @@ bool PackageManagerInterface::fetchTarget(const Uptane::Target& target, Uptane::
       ds->fhandle = createTargetFile(target);
     }
 
-    const uint64_t required_bytes = target.length() - ds->downloaded_length;
-    if (!checkAvailableDiskSpace(required_bytes)) {
-      throw std::runtime_error("Insufficient disk space available to download target");
+    if (keep_copy) {
+      const uint64_t required_bytes = target.length() - ds->downloaded_length;
+      if (!checkAvailableDiskSpace(required_bytes)) {
+        throw std::runtime_error("Insufficient disk space available to download target");
+      }
+      removeUnusedTargetFiles(0, required_bytes);
     }
 
     std::string target_url = target.uri();
@@ -141,12 +236,24 @@ bool PackageManagerInterface::fetchTarget(const Uptane::Target& target, Uptane::
       target_url = fetcher.getRepoServer() + "/targets/" + Utils::urlEncode(target.filename());
     }
 
+    const uintmax_t resumed_from = ds->downloaded_length;
+    const auto download_start = std::chrono::steady_clock::now();
     HttpResponse response;
     for (;;) {
-      response = http_->download(target_url, DownloadHandler, ProgressHandler, ds.get(),
-                                 static_cast<curl_off_t>(ds->downloaded_length));
+      if (max_bytes_per_sec != 0) {
+        response = http_->downloadRateLimited(target_url, DownloadHandler, ProgressHandler, ds.get(),
+                                              static_cast<curl_off_t>(ds->downloaded_length),
+                                              static_cast<curl_off_t>(max_bytes_per_sec));
+      } else {
+        response = http_->download(target_url, DownloadHandler, ProgressHandler, ds.get(),
+                                   static_cast<curl_off_t>(ds->downloaded_length));
+      }
 
       if (response.curl_code == CURLE_RANGE_ERROR) {
+        if (chunk_cb != nullptr) {
+          // The part already streamed cannot be taken back.
+          throw Uptane::Exception("image", "The image server doesn't support byte range requests: " + target_url);
+        }
         LOG_WARNING << "The image server doesn't support byte range requests,"
                        " try to download the image from the beginning: "
                     << target_url;
@@ -163,10 +270,15 @@ bool PackageManagerInterface::fetchTarget(const Uptane::Target& target, Uptane::
       if (!token->canContinue()) {
         throw Uptane::Exception("image", "Download of a target was aborted");
       }
-      ds->fhandle = appendTargetFile(target);
+      if (keep_copy) {
+        ds->fhandle = appendTargetFile(target);
+      }
     }
     LOG_TRACE << "Download status: " << response.getStatusStr() << std::endl;
     if (!response.isOk()) {
+      if (ds->chunk_cb_failed) {
+        throw Uptane::Exception("image", "Could not forward " + target.filename());
+      }
       if (response.curl_code == CURLE_WRITE_ERROR) {
         throw Uptane::OversizedTarget(target.filename());
       }
@@ -174,10 +286,19 @@ bool PackageManagerInterface::fetchTarget(const Uptane::Target& target, Uptane::
     }
     if (!target.MatchHash(Hash(ds->hash_type, ds->hasher().getHexDigest()))) {
       ds->fhandle.close();
-      removeTargetFile(target);
+      if (keep_copy) {
+        removeTargetFile(target);
+      }
       throw Uptane::TargetHashMismatch(target.filename());
     }
     ds->fhandle.close();
+    const std::chrono::duration<double> download_time = std::chrono::steady_clock::now() - download_start;
+    if (download_time.count() > 0 && ds->downloaded_length > resumed_from) {
+      metrics::Registry::global()
+          .gauge("aktualizr_download_throughput_bytes_per_second",
+                 "Average throughput of the last download of a target")
+          .set(static_cast<double>(ds->downloaded_length - resumed_from) / download_time.count());
+    }
     result = true;
   } catch (const std::exception& e) {
     LOG_WARNING << "Error while downloading a target: " << e.what();
@@ -211,22 +332,24 @@ TargetStatus PackageManagerInterface::verifyTarget(const Uptane::Target& target)
 }
 
 bool PackageManagerInterface::checkAvailableDiskSpace(const uint64_t required_bytes) const {
-  struct statvfs stvfsbuf {};
-  const int stat_res = statvfs(config.images_path.c_str(), &stvfsbuf);
-  if (stat_res < 0) {
-    LOG_WARNING << "Unable to read filesystem statistics: error code " << stat_res;
+  uint64_t available_bytes = 0;
+  if (!availableDiskSpace(config.images_path, &available_bytes)) {
     return true;
   }
-  const uint64_t available_bytes = (static_cast<uint64_t>(stvfsbuf.f_bsize) * stvfsbuf.f_bavail);
-  const uint64_t reserved_bytes = 1 << 20;
 
-  if (required_bytes + reserved_bytes < available_bytes) {
+  if (required_bytes + ReservedBytes < available_bytes) {
     return true;
-  } else {
-    LOG_ERROR << "Insufficient disk space available to download target! Required: " << required_bytes
-              << ", available: " << available_bytes << ", reserved: " << reserved_bytes;
-    return false;
   }
+  const uint64_t reclaimable_bytes = reclaimableTargetSpace();
+  if (required_bytes + ReservedBytes < available_bytes + reclaimable_bytes) {
+    LOG_INFO << "Unused target files will be removed to make room for the download: " << reclaimable_bytes
+             << " bytes can be reclaimed";
+    return true;
+  }
+  LOG_ERROR << "Insufficient disk space available to download target! Required: " << required_bytes
+            << ", available: " << available_bytes << ", reserved: " << ReservedBytes
+            << ", reclaimable: " << reclaimable_bytes;
+  return false;
 }
 
 boost::optional<std::pair<uintmax_t, std::string>> PackageManagerInterface::checkTargetFile(
@@ -254,7 +377,7 @@ std::ifstream PackageManagerInterface::openTargetFile(const Uptane::Target& targ
 }
 
 std::ofstream PackageManagerInterface::createTargetFile(const Uptane::Target& target) {
-  std::string filename = target.hashes()[0].HashString();
+  std::string filename = contentFilename(target);
   std::string filepath = (config.images_path / filename).string();
   boost::filesystem::create_directories(config.images_path);
   std::ofstream stream(filepath, std::ios::binary | std::ios::ate);
@@ -282,8 +405,15 @@ void PackageManagerInterface::removeTargetFile(const Uptane::Target& target) {
   if (!file) {
     throw std::runtime_error("File doesn't exist for target " + target.filename());
   }
-  boost::filesystem::remove(file->second);
   storage_->deleteTargetInfo(target.filename());
+  // The file stays as long as another target has the same content.
+  const std::string filename = boost::filesystem::path(file->second).filename().string();
+  for (const auto& name : storage_->getAllTargetNames()) {
+    if (storage_->getTargetFilename(name) == filename) {
+      return;
+    }
+  }
+  boost::filesystem::remove(file->second);
 }
 
 std::vector<Uptane::Target> PackageManagerInterface::getTargetFiles() {
@@ -295,3 +425,138 @@ std::vector<Uptane::Target> PackageManagerInterface::getTargetFiles() {
   }
   return v;
 }
+
+uint64_t PackageManagerInterface::collectTargetGarbage() {
+  {
+    // Whatever has not been installed by now is only kept while it belongs to the update offered by the Director.
+    std::lock_guard<std::mutex> guard(gc_mutex_);
+    pinned_files_.clear();
+  }
+  return removeUnusedTargetFiles(config.images_quota, 0);
+}
+
+uint64_t PackageManagerInterface::reclaimableTargetSpace() const {
+  std::lock_guard<std::mutex> guard(gc_mutex_);
+  uint64_t total_size = 0;
+  uint64_t reclaimable = 0;
+  for (const auto& file : unusedTargetFiles(&total_size)) {
+    reclaimable += file.size;
+  }
+  return reclaimable;
+}
+
+uint64_t PackageManagerInterface::updateTargetSpace(const Uptane::Target& except) const {
+  std::lock_guard<std::mutex> guard(gc_mutex_);
+  uint64_t space = 0;
+  if (!boost::filesystem::is_directory(config.images_path)) {
+    return space;
+  }
+
+  std::set<std::string> installed;
+  std::set<std::string> update;
+  usedTargetFiles(&installed, &update);
+  if (!except.hashes().empty()) {
+    update.erase(contentFilename(except));
+  }
+  update.erase(storage_->getTargetFilename(except.filename()));
+  for (const auto& entry : boost::filesystem::directory_iterator(config.images_path)) {
+    const std::string name = entry.path().filename().string();
+    if (boost::filesystem::is_regular_file(entry.status()) && update.count(name) != 0 && installed.count(name) == 0) {
+      space += boost::filesystem::file_size(entry.path());
+    }
+  }
+  return space;
+}
+
+void PackageManagerInterface::usedTargetFiles(std::set<std::string>* installed, std::set<std::string>* update) const {
+  *update = pinned_files_;
+  EcuSerials serials;
+  storage_->loadEcuSerials(&serials);
+  for (const auto& ecu : serials) {
+    boost::optional<Uptane::Target> current_version;
+    boost::optional<Uptane::Target> pending_version;
+    storage_->loadInstalledVersions(ecu.first.ToString(), &current_version, &pending_version);
+    for (const boost::optional<Uptane::Target>* version : {&current_version, &pending_version}) {
+      if (!!*version && !(*version)->hashes().empty()) {
+        installed->insert(contentFilename(**version));
+        installed->insert(storage_->getTargetFilename((*version)->filename()));
+      }
+    }
+  }
+  // The targets of the update offered by the Director are kept until another update replaces it, also across
+  // restarts, whether they were prefetched or downloaded and not installed yet.
+  std::string director_targets;
+  if (storage_->loadNonRoot(&director_targets, Uptane::RepositoryType::Director(), Uptane::Role::Targets())) {
+    try {
+      for (const auto& target : Uptane::Targets(Utils::parseJSON(director_targets)).targets) {
+        if (!target.hashes().empty()) {
+          update->insert(contentFilename(target));
+          update->insert(storage_->getTargetFilename(target.filename()));
+        }
+      }
+    } catch (const std::exception& e) {
+      LOG_WARNING << "Could not read the targets of the pending update: " << e.what();
+    }
+  }
+}
+
+std::vector<PackageManagerInterface::StoredFile> PackageManagerInterface::unusedTargetFiles(
+    uint64_t* total_size) const {
+  std::vector<StoredFile> unused;
+  *total_size = 0;
+  if (!boost::filesystem::is_directory(config.images_path)) {
+    return unused;
+  }
+
+  std::set<std::string> used;
+  std::set<std::string> update;
+  usedTargetFiles(&used, &update);
+  used.insert(update.cbegin(), update.cend());
+  for (const auto& entry : boost::filesystem::directory_iterator(config.images_path)) {
+    if (!boost::filesystem::is_regular_file(entry.status())) {
+      continue;
+    }
+    const uint64_t size = boost::filesystem::file_size(entry.path());
+    *total_size += size;
+    const std::string name = entry.path().filename().string();
+    if (used.count(name) == 0) {
+      unused.push_back({name, size, boost::filesystem::last_write_time(entry.path())});
+    }
+  }
+  return unused;
+}
+
+uint64_t PackageManagerInterface::removeUnusedTargetFiles(const uint64_t quota, const uint64_t required_bytes) {
+  uint64_t available_bytes = 0;
+  const bool short_of_space = required_bytes != 0 && availableDiskSpace(config.images_path, &available_bytes) &&
+                              required_bytes + ReservedBytes >= available_bytes;
+  if (quota == 0 && !short_of_space) {
+    return 0;
+  }
+
+  std::lock_guard<std::mutex> guard(gc_mutex_);
+  uint64_t total_size = 0;
+  std::vector<StoredFile> unused = unusedTargetFiles(&total_size);
+  std::sort(unused.begin(), unused.end(),
+            [](const StoredFile& a, const StoredFile& b) { return a.last_used < b.last_used; });
+  std::map<std::string, std::vector<std::string>> targets_by_file;
+  for (const auto& name : storage_->getAllTargetNames()) {
+    targets_by_file[storage_->getTargetFilename(name)].push_back(name);
+  }
+
+  uint64_t freed = 0;
+  for (const auto& file : unused) {
+    const bool over_quota = quota != 0 && total_size - freed > quota;
+    const bool needs_space = short_of_space && required_bytes + ReservedBytes >= available_bytes + freed;
+    if (!over_quota && !needs_space) {
+      break;
+    }
+    boost::filesystem::remove(config.images_path / file.name);
+    for (const auto& name : targets_by_file[file.name]) {
+      storage_->deleteTargetInfo(name);
+    }
+    freed += file.size;
+    LOG_INFO << "Removed unused target file " << file.name << " (" << file.size << " bytes)";
+  }
+  return freed;
+}
@@ -5,9 +5,12 @@
 
 #include "libaktualizr/aktualizr.h"
 #include "libaktualizr/events.h"
+#include "primary/eventdispatcher.h"
 #include "primary/sotauptaneclient.h"
 #include "libaktualizr/utilities/apiqueue.h"
+#include "utilities/metrics_server.h"
 #include "utilities/timer.h"
+#include "utilities/tracer.h"
 
 using std::make_shared;
 using std::shared_ptr;
@@ -25,10 +28,39 @@ Aktualizr::Aktualizr(Config config, std::shared_ptr<INvStorage> storage_in,
   storage_ = std::move(storage_in);
   storage_->importData(config_.import);
 
-  uptane_client_ = std::make_shared<SotaUptaneClient>(config_, storage_, http_in, sig_);
+  if (!config_.tracing.path.empty()) {
+    tracing::Tracer::instance().start(config_.tracing.path);
+  }
+  if (!config_.metrics.socket_path.empty()) {
+    try {
+      metrics_server_ = std_::make_unique<metrics::SocketServer>(config_.metrics.socket_path, []() {
+        return metrics::toPrometheusText(metrics::Registry::global().snapshot());
+      });
+    } catch (const std::exception &e) {
+      LOG_ERROR << "Could not start the metrics endpoint: " << e.what();
+    }
+  }
+
+  std::shared_ptr<event::Channel> client_sig = sig_;
+  if (config_.uptane.event_dispatch_async) {
+    client_sig = std::make_shared<event::Channel>();
+    event_dispatcher_ = std_::make_unique<event::AsyncDispatcher>(
+        *client_sig, sig_, config_.uptane.event_queue_size,
+        event::AsyncDispatcher::parsePolicy(config_.uptane.event_overflow_policy));
+  }
+  uptane_client_ = std::make_shared<SotaUptaneClient>(config_, storage_, http_in, client_sig);
 }
 
-Aktualizr::~Aktualizr() { api_queue_.reset(nullptr); }
+Aktualizr::~Aktualizr() {
+  api_queue_.reset(nullptr);
+  // Deliver the remaining events while the handlers can still expect the
+  // client to be alive.
+  event_dispatcher_.reset(nullptr);
+  metrics_server_.reset(nullptr);
+  if (!config_.tracing.path.empty()) {
+    tracing::Tracer::instance().stop();
+  }
+}
 
 void Aktualizr::Initialize() {
   uptane_client_->initialize();
@@ -36,6 +68,7 @@ void Aktualizr::Initialize() {
 }
 
 bool Aktualizr::UptaneCycle() {
+  TRACE_FUNCTION("aktualizr");
   result::UpdateCheck update_result = CheckUpdates().get();
   if (update_result.updates.empty()) {
     if (update_result.status == result::UpdateStatus::kError) {
@@ -180,6 +213,7 @@ std::future<bool> Aktualizr::SendManifest(const Json::Value &custom) {
 }
 
 result::Pause Aktualizr::Pause() {
+  uptane_client_->pausePrefetch(true);
   if (api_queue_->pause(true)) {
     uptane_client_->reportPause();
     return result::PauseStatus::kSuccess;
@@ -189,6 +223,7 @@ result::Pause Aktualizr::Pause() {
 }
 
 result::Pause Aktualizr::Resume() {
+  uptane_client_->pausePrefetch(false);
   if (api_queue_->pause(false)) {
     uptane_client_->reportResume();
     return result::PauseStatus::kSuccess;
@@ -197,13 +232,25 @@ result::Pause Aktualizr::Resume() {
   }
 }
 
-void Aktualizr::Abort() { api_queue_->abort(); }
+void Aktualizr::Abort() {
+  uptane_client_->stopPrefetch();
+  api_queue_->abort();
+}
 
 boost::signals2::connection Aktualizr::SetSignalHandler(
     const std::function<void(shared_ptr<event::BaseEvent>)> &handler) {
   return sig_->connect(handler);
 }
 
+event::DispatchStats Aktualizr::EventDispatchStats() const {
+  if (!event_dispatcher_) {
+    return event::DispatchStats();
+  }
+  return event_dispatcher_->stats();
+}
+
+metrics::Snapshot Aktualizr::GetMetrics() const { return metrics::Registry::global().snapshot(); }
+
 Aktualizr::InstallationLog Aktualizr::GetInstallationLog() {
   std::vector<Aktualizr::InstallationLogEntry> ilog;
 
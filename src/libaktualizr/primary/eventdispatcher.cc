@@ -0,0 +1,153 @@
+#include "primary/eventdispatcher.h"
+
+#include <algorithm>
+#include <exception>
+#include <iterator>
+
+#include "libaktualizr/logging/logging.h"
+
+namespace event {
+
+static std::string coalescingKey(const BaseEvent &event) {
+  if (event.variant != DownloadProgressReport::TypeName) {
+    return std::string();
+  }
+  const auto &target = dynamic_cast<const DownloadProgressReport &>(event).target;
+  return target.filename() + "/" + target.sha256Hash();
+}
+
+AsyncDispatcher::OverflowPolicy AsyncDispatcher::parsePolicy(const std::string &name) {
+  if (name == "block") {
+    return OverflowPolicy::kBlock;
+  }
+  if (name == "drop_progress") {
+    return OverflowPolicy::kDropProgress;
+  }
+  LOG_WARNING << "Unknown event overflow policy \"" << name << "\", using \"block\"";
+  return OverflowPolicy::kBlock;
+}
+
+AsyncDispatcher::AsyncDispatcher(Channel &upstream, std::shared_ptr<Channel> downstream, size_t capacity,
+                                 OverflowPolicy policy)
+    : downstream_(std::move(downstream)), capacity_(std::max<size_t>(1, capacity)), policy_(policy) {
+  thread_ = std::thread(&AsyncDispatcher::run, this);
+  connection_ = upstream.connect([this](std::shared_ptr<BaseEvent> event) { post(std::move(event)); });
+}
+
+AsyncDispatcher::~AsyncDispatcher() {
+  connection_.disconnect();
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    shutdown_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+void AsyncDispatcher::post(std::shared_ptr<BaseEvent> event) {
+  if (!event) {
+    return;
+  }
+  const std::string key = coalescingKey(*event);
+
+  std::unique_lock<std::mutex> lock(m_);
+  if (key.empty()) {
+    pending_progress_.clear();
+  }
+  for (;;) {
+    if (shutdown_) {
+      return;
+    }
+    if (!key.empty()) {
+      auto it = pending_progress_.find(key);
+      if (it != pending_progress_.end()) {
+        it->second->event = std::move(event);
+        ++stats_.coalesced;
+        return;
+      }
+    }
+    if (queue_.size() < capacity_) {
+      break;
+    }
+    if (policy_ == OverflowPolicy::kDropProgress) {
+      if (dropOldestProgress()) {
+        ++stats_.dropped;
+        break;
+      }
+      if (!key.empty()) {
+        ++stats_.dropped;
+        return;
+      }
+    }
+    cv_.wait(lock);
+  }
+
+  queue_.push_back(Entry{std::move(event), key});
+  if (!key.empty()) {
+    pending_progress_[key] = std::prev(queue_.end());
+  }
+  stats_.queue_depth = queue_.size();
+  lock.unlock();
+  cv_.notify_all();
+}
+
+bool AsyncDispatcher::dropOldestProgress() {
+  for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+    if (it->key.empty()) {
+      continue;
+    }
+    auto pending = pending_progress_.find(it->key);
+    if (pending != pending_progress_.end() && pending->second == it) {
+      pending_progress_.erase(pending);
+    }
+    queue_.erase(it);
+    return true;
+  }
+  return false;
+}
+
+void AsyncDispatcher::flush() {
+  std::unique_lock<std::mutex> lock(m_);
+  cv_.wait(lock, [this] { return (queue_.empty() && !busy_) || thread_.get_id() == std::this_thread::get_id(); });
+}
+
+DispatchStats AsyncDispatcher::stats() const {
+  std::lock_guard<std::mutex> lock(m_);
+  return stats_;
+}
+
+void AsyncDispatcher::run() {
+  std::unique_lock<std::mutex> lock(m_);
+  for (;;) {
+    cv_.wait(lock, [this] { return !queue_.empty() || shutdown_; });
+    // Whatever is still queued at shutdown is delivered before exiting.
+    if (queue_.empty()) {
+      break;
+    }
+    Entry entry = std::move(queue_.front());
+    if (!entry.key.empty()) {
+      auto pending = pending_progress_.find(entry.key);
+      if (pending != pending_progress_.end() && pending->second == queue_.begin()) {
+        pending_progress_.erase(pending);
+      }
+    }
+    queue_.pop_front();
+    stats_.queue_depth = queue_.size();
+    busy_ = true;
+    lock.unlock();
+    cv_.notify_all();
+
+    try {
+      (*downstream_)(std::move(entry.event));
+    } catch (const std::exception &ex) {
+      LOG_ERROR << "Event handler failed: " << ex.what();
+    }
+
+    lock.lock();
+    busy_ = false;
+    ++stats_.dispatched;
+    cv_.notify_all();
+  }
+}
+
+}  // namespace event
@@ -0,0 +1,81 @@
+#ifndef EVENTDISPATCHER_H_
+#define EVENTDISPATCHER_H_
+
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "libaktualizr/events.h"
+
+namespace event {
+
+/**
+ * Forwards events from one channel to another on a dedicated thread, so that
+ * slow signal handlers do not hold up the thread emitting the events.
+ *
+ * Queued DownloadProgressReport events for the same target are coalesced into
+ * the latest one. Any other event acts as a barrier: progress events queued
+ * before it are never merged with ones queued after it, so all events reach
+ * the handlers in the order they were emitted.
+ */
+class AsyncDispatcher {
+ public:
+  /** What to do when an event is emitted while the queue is full. */
+  enum class OverflowPolicy {
+    /** Wait until the dispatcher thread has made room. */
+    kBlock,
+    /**
+     * Drop the oldest queued progress event, or the new event if it is a
+     * progress event and none is queued. Other events are never dropped; when
+     * no progress event can make room for one, the emitter waits.
+     */
+    kDropProgress,
+  };
+
+  static OverflowPolicy parsePolicy(const std::string &name);
+
+  AsyncDispatcher(Channel &upstream, std::shared_ptr<Channel> downstream, size_t capacity,
+                  OverflowPolicy policy = OverflowPolicy::kBlock);
+  ~AsyncDispatcher();
+  AsyncDispatcher(const AsyncDispatcher &) = delete;
+  AsyncDispatcher(AsyncDispatcher &&) = delete;
+  AsyncDispatcher &operator=(const AsyncDispatcher &) = delete;
+  AsyncDispatcher &operator=(AsyncDispatcher &&) = delete;
+
+  void post(std::shared_ptr<BaseEvent> event);
+  /** Wait until all events posted so far have been handled. */
+  void flush();
+  DispatchStats stats() const;
+
+ private:
+  struct Entry {
+    std::shared_ptr<BaseEvent> event;
+    std::string key;  // empty for events that are not coalesced
+  };
+
+  void run();
+  bool dropOldestProgress();
+
+  std::shared_ptr<Channel> downstream_;
+  const size_t capacity_;
+  const OverflowPolicy policy_;
+
+  mutable std::mutex m_;
+  std::condition_variable cv_;
+  std::list<Entry> queue_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> pending_progress_;
+  bool busy_{false};
+  bool shutdown_{false};
+  DispatchStats stats_;
+
+  boost::signals2::scoped_connection connection_;
+  std::thread thread_;
+};
+
+}  // namespace event
+
+#endif  // EVENTDISPATCHER_H_
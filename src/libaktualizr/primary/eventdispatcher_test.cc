@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "primary/eventdispatcher.h"
+
+using event::AsyncDispatcher;
+
+static Uptane::Target makeTarget(const std::string &name) {
+  Json::Value target_json;
+  target_json["hashes"]["sha256"] = std::string(64, 'a');
+  target_json["length"] = 1;
+  return Uptane::Target(name, target_json);
+}
+
+static std::shared_ptr<event::BaseEvent> progress(const std::string &name, unsigned int value) {
+  return std::make_shared<event::DownloadProgressReport>(makeTarget(name), "", value);
+}
+
+static std::shared_ptr<event::BaseEvent> complete(const std::string &name) {
+  return std::make_shared<event::DownloadTargetComplete>(makeTarget(name), true);
+}
+
+static std::string describe(const std::shared_ptr<event::BaseEvent> &event) {
+  if (event->isTypeOf<event::DownloadProgressReport>()) {
+    const auto report = std::dynamic_pointer_cast<event::DownloadProgressReport>(event);
+    return report->target.filename() + ":" + std::to_string(report->progress);
+  }
+  return std::dynamic_pointer_cast<event::DownloadTargetComplete>(event)->update.filename() + ":done";
+}
+
+/* Records delivered events. The handler can be held to let the queue fill up. */
+class Recorder {
+ public:
+  Recorder() : channel(std::make_shared<event::Channel>()) {
+    channel->connect([this](std::shared_ptr<event::BaseEvent> event) {
+      std::unique_lock<std::mutex> lock(m);
+      cv.wait(lock, [this] { return !held; });
+      events.push_back(describe(event));
+    });
+  }
+  void hold() {
+    std::lock_guard<std::mutex> lock(m);
+    held = true;
+  }
+  void release() {
+    {
+      std::lock_guard<std::mutex> lock(m);
+      held = false;
+    }
+    cv.notify_all();
+  }
+
+  std::shared_ptr<event::Channel> channel;
+  std::vector<std::string> events;
+
+ private:
+  std::mutex m;
+  std::condition_variable cv;
+  bool held{false};
+};
+
+/* Events are delivered in the order they were emitted. */
+TEST(EventDispatcher, Ordering) {
+  event::Channel upstream;
+  Recorder recorder;
+  AsyncDispatcher dispatcher(upstream, recorder.channel, 16);
+  for (int i = 0; i < 5; ++i) {
+    upstream(complete("t" + std::to_string(i)));
+  }
+  dispatcher.flush();
+  EXPECT_EQ(recorder.events, (std::vector<std::string>{"t0:done", "t1:done", "t2:done", "t3:done", "t4:done"}));
+  EXPECT_EQ(dispatcher.stats().dispatched, 5U);
+}
+
+/* Queued progress events for a target are merged into the latest one, but
+ * never across a completion event. */
+TEST(EventDispatcher, CoalesceProgress) {
+  event::Channel upstream;
+  Recorder recorder;
+  AsyncDispatcher dispatcher(upstream, recorder.channel, 16);
+  recorder.hold();
+  // The first event is taken off the queue straight away and waits in the handler.
+  upstream(complete("first"));
+  while (dispatcher.stats().queue_depth != 0) {
+    std::this_thread::yield();
+  }
+  upstream(progress("a", 10));
+  upstream(progress("b", 10));
+  upstream(progress("a", 20));
+  upstream(progress("a", 30));
+  upstream(complete("a"));
+  upstream(progress("b", 50));
+  upstream(progress("b", 100));
+  recorder.release();
+  dispatcher.flush();
+
+  EXPECT_EQ(recorder.events, (std::vector<std::string>{"first:done", "a:30", "b:10", "a:done", "b:100"}));
+  const event::DispatchStats stats = dispatcher.stats();
+  EXPECT_EQ(stats.coalesced, 3U);
+  EXPECT_EQ(stats.dropped, 0U);
+  EXPECT_EQ(stats.dispatched, 5U);
+}
+
+/* With drop_progress, a full queue sheds progress events but keeps completion events. */
+TEST(EventDispatcher, DropProgress) {
+  event::Channel upstream;
+  Recorder recorder;
+  AsyncDispatcher dispatcher(upstream, recorder.channel, 2, AsyncDispatcher::parsePolicy("drop_progress"));
+  recorder.hold();
+  upstream(complete("first"));
+  while (dispatcher.stats().queue_depth != 0) {
+    std::this_thread::yield();
+  }
+  upstream(progress("a", 10));
+  upstream(progress("b", 10));
+  // Full: the oldest progress event makes room.
+  upstream(progress("c", 10));
+  upstream(complete("a"));
+  upstream(progress("d", 10));
+  upstream(complete("b"));
+  // Only completion events are queued, so the new progress event is dropped.
+  upstream(progress("e", 10));
+  recorder.release();
+  dispatcher.flush();
+
+  EXPECT_EQ(recorder.events, (std::vector<std::string>{"first:done", "a:done", "b:done"}));
+  EXPECT_EQ(dispatcher.stats().dropped, 5U);
+}
+
+/* Events still queued when the dispatcher goes away are delivered. */
+TEST(EventDispatcher, DrainOnShutdown) {
+  event::Channel upstream;
+  Recorder recorder;
+  {
+    AsyncDispatcher dispatcher(upstream, recorder.channel, 16);
+    for (int i = 0; i < 3; ++i) {
+      upstream(complete("t" + std::to_string(i)));
+    }
+  }
+  EXPECT_EQ(recorder.events.size(), 3U);
+  // Disconnected: nothing is delivered anymore.
+  upstream(complete("late"));
+  EXPECT_EQ(recorder.events.size(), 3U);
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
@@ -0,0 +1,223 @@
+#include "primary/firmwareforwarder.h"
+
+#include <algorithm>
+
+#include "libaktualizr/logging/logging.h"
+#include "libaktualizr/utilities/utils.h"
+
+FirmwareForwarder::FirmwareForwarder(std::map<Uptane::EcuSerial, std::unique_ptr<FirmwareWriter>> writers,
+                                     size_t buffer_size, size_t chunk_size)
+    : FirmwareForwarder(std::move(writers), Source(), buffer_size, chunk_size) {}
+
+FirmwareForwarder::FirmwareForwarder(std::map<Uptane::EcuSerial, std::unique_ptr<FirmwareWriter>> writers,
+                                     Source source, size_t buffer_size, size_t chunk_size)
+    : buffer_size_(buffer_size), chunk_size_(std::max<size_t>(chunk_size, 1)), source_(std::move(source)) {
+  for (auto &writer : writers) {
+    destinations_.push_back(std_::make_unique<Destination>(writer.first, std::move(writer.second)));
+  }
+  for (auto &destination : destinations_) {
+    Destination &dest = *destination;
+    dest.thread = std::thread([this, &dest]() { run(dest); });
+  }
+}
+
+FirmwareForwarder::~FirmwareForwarder() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    // Whatever was not sent yet is dropped.
+    failed_ = true;
+  }
+  stop();
+}
+
+bool FirmwareForwarder::write(const uint8_t *data, size_t size) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (source_) {
+    return writeIndependent(lock, data, size);
+  }
+  for (auto &destination : destinations_) {
+    Destination &dest = *destination;
+    cv_.wait(lock, [this, &dest]() { return failed_ || dest.buffer.size() < buffer_size_; });
+    if (failed_) {
+      return false;
+    }
+    dest.buffer.append(reinterpret_cast<const char *>(data), size);
+    cv_.notify_all();
+  }
+  return true;
+}
+
+bool FirmwareForwarder::writeIndependent(std::unique_lock<std::mutex> &lock, const uint8_t *data, size_t size) {
+  // A full buffer is waited for, unless its Secondary is behind: another one
+  // has already sent a whole buffer more than it. That one is detached then.
+  auto behind = [this](const Destination &dest) -> bool {
+    for (const auto &other : destinations_) {
+      if (!other->failed && !other->detached && other->sent >= dest.sent + buffer_size_) {
+        return true;
+      }
+    }
+    return false;
+  };
+  cv_.wait(lock, [this, &behind]() -> bool {
+    for (const auto &destination : destinations_) {
+      const Destination &dest = *destination;
+      if (!dest.failed && !dest.detached && dest.buffer.size() >= buffer_size_ && !behind(dest)) {
+        return failed_;
+      }
+    }
+    return true;
+  });
+  if (failed_) {
+    return false;
+  }
+
+  bool taken = false;
+  for (auto &destination : destinations_) {
+    Destination &dest = *destination;
+    if (dest.failed || dest.detached) {
+      continue;
+    }
+    if (dest.buffer.size() >= buffer_size_) {
+      LOG_INFO << "Secondary " << dest.serial << " falls behind, it will read the image on its own from offset "
+               << dest.queued;
+      dest.detached = true;
+      continue;
+    }
+    dest.buffer.append(reinterpret_cast<const char *>(data), size);
+    dest.queued += size;
+    taken = true;
+  }
+  cv_.notify_all();
+  return taken;
+}
+
+std::map<Uptane::EcuSerial, data::InstallationResult> FirmwareForwarder::finish() {
+  stop();
+  std::map<Uptane::EcuSerial, data::InstallationResult> results;
+  for (const auto &destination : destinations_) {
+    results.emplace(destination->serial, destination->result);
+  }
+  return results;
+}
+
+void FirmwareForwarder::stop() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    closed_ = true;
+  }
+  cv_.notify_all();
+  for (auto &destination : destinations_) {
+    if (destination->thread.joinable()) {
+      destination->thread.join();
+    }
+  }
+}
+
+void FirmwareForwarder::run(Destination &destination) {
+  std::string pending;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this, &destination]() {
+        return failed_ || closed_ || destination.detached || !destination.buffer.empty();
+      });
+      if (failed_) {
+        return;
+      }
+      if (destination.buffer.empty()) {
+        break;
+      }
+      pending.clear();
+      pending.swap(destination.buffer);
+    }
+    // The writer is free to refill the buffer while this part is sent.
+    cv_.notify_all();
+
+    if (!send(destination, pending)) {
+      return;
+    }
+  }
+  if (destination.detached) {
+    readSource(destination);
+  }
+}
+
+bool FirmwareForwarder::send(Destination &destination, const std::string &data) {
+  for (size_t offset = 0; offset < data.size(); offset += chunk_size_) {
+    const size_t size = std::min(chunk_size_, data.size() - offset);
+    data::InstallationResult result;
+    try {
+      result = destination.writer->write(reinterpret_cast<const uint8_t *>(data.data()) + offset, size);
+    } catch (const std::exception &e) {
+      result = data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed, e.what());
+    }
+    if (!result.isSuccess()) {
+      LOG_ERROR << "Could not forward the image to Secondary " << destination.serial << ": " << result.description;
+      fail(destination, result);
+      return false;
+    }
+    if (source_) {
+      {
+        std::lock_guard<std::mutex> guard(mutex_);
+        destination.sent += size;
+      }
+      cv_.notify_all();
+    }
+  }
+  return true;
+}
+
+void FirmwareForwarder::fail(Destination &destination, const data::InstallationResult &result) {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    destination.result = result;
+    destination.failed = true;
+    // Without a source, the other Secondaries cannot go on without this one.
+    if (!source_) {
+      failed_ = true;
+    }
+  }
+  cv_.notify_all();
+}
+
+void FirmwareForwarder::fail(Destination &destination, const std::string &description) {
+  LOG_ERROR << description << " for Secondary " << destination.serial;
+  fail(destination, data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed, description));
+}
+
+void FirmwareForwarder::readSource(Destination &destination) {
+  std::unique_ptr<std::istream> stream;
+  try {
+    stream = source_();
+  } catch (const std::exception &e) {
+    LOG_ERROR << "Could not open the image for Secondary " << destination.serial << ": " << e.what();
+  }
+  if (stream) {
+    stream->seekg(static_cast<std::streamoff>(destination.queued));
+  }
+  if (!stream || !*stream) {
+    fail(destination, "Could not read the image");
+    return;
+  }
+
+  std::string chunk(chunk_size_, '\0');
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (failed_) {
+        return;
+      }
+    }
+    stream->read(&chunk[0], static_cast<std::streamsize>(chunk.size()));
+    const auto size = static_cast<size_t>(stream->gcount());
+    if (size == 0) {
+      if (stream->bad()) {
+        fail(destination, "Could not read the image");
+      }
+      return;
+    }
+    if (!send(destination, chunk.substr(0, size))) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef PRIMARY_FIRMWAREFORWARDER_H_
+#define PRIMARY_FIRMWAREFORWARDER_H_
+
+#include <condition_variable>
+#include <functional>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libaktualizr/secondaryinterface.h"
+#include "libaktualizr/types.h"
+
+/**
+ * Forwards an image to Secondaries while the Primary is still downloading it.
+ * Every Secondary is fed by its own thread from a bounded buffer, so that a
+ * slow Secondary throttles the download instead of the image piling up in
+ * memory.
+ *
+ * When the whole image is already available from a source, the Secondaries
+ * are independent instead: the image is fed at the pace of the fastest one, a
+ * Secondary that fails is dropped, and one whose buffer is full is left to
+ * read the rest of the image from the source on its own.
+ */
+class FirmwareForwarder {
+ public:
+  /** Opens the whole image. */
+  using Source = std::function<std::unique_ptr<std::istream>()>;
+
+  static constexpr size_t kDefaultBufferSize = 1024 * 1024;
+  static constexpr size_t kDefaultChunkSize = 64 * 1024;
+
+  explicit FirmwareForwarder(std::map<Uptane::EcuSerial, std::unique_ptr<FirmwareWriter>> writers,
+                             size_t buffer_size = kDefaultBufferSize, size_t chunk_size = kDefaultChunkSize);
+  FirmwareForwarder(std::map<Uptane::EcuSerial, std::unique_ptr<FirmwareWriter>> writers, Source source,
+                    size_t buffer_size = kDefaultBufferSize, size_t chunk_size = kDefaultChunkSize);
+  ~FirmwareForwarder();
+  FirmwareForwarder(const FirmwareForwarder &) = delete;
+  FirmwareForwarder(FirmwareForwarder &&) = delete;
+  FirmwareForwarder &operator=(const FirmwareForwarder &) = delete;
+  FirmwareForwarder &operator=(FirmwareForwarder &&) = delete;
+
+  /**
+   * Queue `data` for every Secondary, blocking while a buffer is full. Returns
+   * false once sending to any of them has failed, or with a source, once none
+   * of them takes data from this stream any more.
+   */
+  bool write(const uint8_t *data, size_t size);
+  /** Wait until everything queued has been sent and return the result for each Secondary. */
+  std::map<Uptane::EcuSerial, data::InstallationResult> finish();
+
+ private:
+  struct Destination {
+    Destination(Uptane::EcuSerial serial_in, std::unique_ptr<FirmwareWriter> writer_in)
+        : serial(std::move(serial_in)), writer(std::move(writer_in)) {}
+    Uptane::EcuSerial serial;
+    std::unique_ptr<FirmwareWriter> writer;
+    std::string buffer;
+    // Bytes queued so far, where a detached Secondary goes on reading the source.
+    uint64_t queued{0};
+    // Bytes sent so far, with a source.
+    uint64_t sent{0};
+    bool detached{false};
+    bool failed{false};
+    data::InstallationResult result{data::ResultCode::Numeric::kOk, ""};
+    std::thread thread;
+  };
+
+  bool writeIndependent(std::unique_lock<std::mutex> &lock, const uint8_t *data, size_t size);
+  void run(Destination &destination);
+  bool send(Destination &destination, const std::string &data);
+  void fail(Destination &destination, const data::InstallationResult &result);
+  void fail(Destination &destination, const std::string &description);
+  void readSource(Destination &destination);
+  void stop();
+
+  const size_t buffer_size_;
+  const size_t chunk_size_;
+  const Source source_;
+  std::vector<std::unique_ptr<Destination>> destinations_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool closed_{false};
+  bool failed_{false};
+};
+
+#endif  // PRIMARY_FIRMWAREFORWARDER_H_
@@ -0,0 +1,188 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <sstream>
+#include <string>
+
+#include "libaktualizr/utilities/utils.h"
+#include "primary/firmwareforwarder.h"
+
+/* Appends the received data to a string, and fails once it holds `fail_after` bytes. */
+class StringWriter : public FirmwareWriter {
+ public:
+  StringWriter(std::string *out, size_t *max_chunk, size_t fail_after = SIZE_MAX)
+      : out_(out), max_chunk_(max_chunk), fail_after_(fail_after) {}
+  data::InstallationResult write(const uint8_t *data, size_t size) override {
+    if (out_->size() >= fail_after_) {
+      return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed, "Disk full");
+    }
+    out_->append(reinterpret_cast<const char *>(data), size);
+    *max_chunk_ = std::max(*max_chunk_, size);
+    return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+  }
+
+ private:
+  std::string *out_;
+  size_t *max_chunk_;
+  size_t fail_after_;
+};
+
+/* Blocks until `release` is ready, then appends the received data to a string. */
+class BlockedWriter : public FirmwareWriter {
+ public:
+  BlockedWriter(std::string *out, std::shared_future<void> release) : out_(out), release_(std::move(release)) {}
+  data::InstallationResult write(const uint8_t *data, size_t size) override {
+    release_.wait();
+    out_->append(reinterpret_cast<const char *>(data), size);
+    return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+  }
+
+ private:
+  std::string *out_;
+  std::shared_future<void> release_;
+};
+
+static std::string makeImage(size_t size) {
+  std::string image(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    image[i] = static_cast<char>(i % 251);
+  }
+  return image;
+}
+
+/* Every Secondary receives the whole image, in chunks of bounded size. */
+TEST(FirmwareForwarder, Forward) {
+  const std::string image = makeImage(100000);
+  std::string out1;
+  std::string out2;
+  size_t max_chunk1 = 0;
+  size_t max_chunk2 = 0;
+  std::map<Uptane::EcuSerial, std::unique_ptr<FirmwareWriter>> writers;
+  writers.emplace(Uptane::EcuSerial("sec1"), std_::make_unique<StringWriter>(&out1, &max_chunk1));
+  writers.emplace(Uptane::EcuSerial("sec2"), std_::make_unique<StringWriter>(&out2, &max_chunk2));
+
+  FirmwareForwarder forwarder(std::move(writers), 4096, 1000);
+  for (size_t offset = 0; offset < image.size(); offset += 3000) {
+    const size_t size = std::min<size_t>(3000, image.size() - offset);
+    ASSERT_TRUE(forwarder.write(reinterpret_cast<const uint8_t *>(image.data()) + offset, size));
+  }
+  const auto results = forwarder.finish();
+
+  ASSERT_EQ(results.size(), 2);
+  for (const auto &result : results) {
+    EXPECT_TRUE(result.second.isSuccess()) << result.first;
+  }
+  EXPECT_EQ(out1, image);
+  EXPECT_EQ(out2, image);
+  EXPECT_LE(max_chunk1, 1000);
+  EXPECT_LE(max_chunk2, 1000);
+}
+
+/* A failing Secondary stops the transfer and is reported. */
+TEST(FirmwareForwarder, Failure) {
+  const std::string image = makeImage(100000);
+  std::string out1;
+  std::string out2;
+  size_t max_chunk = 0;
+  std::map<Uptane::EcuSerial, std::unique_ptr<FirmwareWriter>> writers;
+  writers.emplace(Uptane::EcuSerial("sec1"), std_::make_unique<StringWriter>(&out1, &max_chunk));
+  writers.emplace(Uptane::EcuSerial("sec2"), std_::make_unique<StringWriter>(&out2, &max_chunk, 10000));
+
+  FirmwareForwarder forwarder(std::move(writers), 4096, 1000);
+  bool written = true;
+  for (size_t offset = 0; offset < image.size() && written; offset += 1000) {
+    written = forwarder.write(reinterpret_cast<const uint8_t *>(image.data()) + offset, 1000);
+  }
+  EXPECT_FALSE(written);
+  const auto results = forwarder.finish();
+
+  EXPECT_EQ(results.at(Uptane::EcuSerial("sec2")).result_code.num_code, data::ResultCode::Numeric::kDownloadFailed);
+  EXPECT_EQ(results.at(Uptane::EcuSerial("sec2")).description, "Disk full");
+  EXPECT_EQ(out2, image.substr(0, 10000));
+}
+
+/* With a source, a failing Secondary does not stop the others. */
+TEST(FirmwareForwarder, IndependentFailure) {
+  const std::string image = makeImage(100000);
+  std::string out1;
+  std::string out2;
+  size_t max_chunk = 0;
+  std::map<Uptane::EcuSerial, std::unique_ptr<FirmwareWriter>> writers;
+  writers.emplace(Uptane::EcuSerial("sec1"), std_::make_unique<StringWriter>(&out1, &max_chunk));
+  writers.emplace(Uptane::EcuSerial("sec2"), std_::make_unique<StringWriter>(&out2, &max_chunk, 10000));
+  auto source = [&image]() -> std::unique_ptr<std::istream> { return std_::make_unique<std::istringstream>(image); };
+
+  FirmwareForwarder forwarder(std::move(writers), source, 4096, 1000);
+  // If sec2 was ahead when it failed, sec1 reads the rest from the source.
+  bool written = true;
+  for (size_t offset = 0; offset < image.size() && written; offset += 1000) {
+    written = forwarder.write(reinterpret_cast<const uint8_t *>(image.data()) + offset, 1000);
+  }
+  const auto results = forwarder.finish();
+
+  EXPECT_TRUE(results.at(Uptane::EcuSerial("sec1")).isSuccess());
+  EXPECT_EQ(out1, image);
+  EXPECT_EQ(results.at(Uptane::EcuSerial("sec2")).description, "Disk full");
+  EXPECT_EQ(out2, image.substr(0, 10000));
+}
+
+/* A Secondary that falls behind does not hold up the others, and reads the
+ * rest of the image from the source. */
+TEST(FirmwareForwarder, SlowSecondary) {
+  const std::string image = makeImage(100000);
+  std::string out1;
+  std::string out2;
+  size_t max_chunk = 0;
+  std::promise<void> release;
+  std::map<Uptane::EcuSerial, std::unique_ptr<FirmwareWriter>> writers;
+  writers.emplace(Uptane::EcuSerial("sec1"), std_::make_unique<StringWriter>(&out1, &max_chunk));
+  writers.emplace(Uptane::EcuSerial("sec2"), std_::make_unique<BlockedWriter>(&out2, release.get_future().share()));
+  int opened = 0;
+  auto source = [&image, &opened]() -> std::unique_ptr<std::istream> {
+    ++opened;
+    return std_::make_unique<std::istringstream>(image);
+  };
+
+  FirmwareForwarder forwarder(std::move(writers), source, 4096, 1000);
+  // sec2 is stuck, so this only completes if sec1 is fed on its own.
+  for (size_t offset = 0; offset < image.size(); offset += 1000) {
+    ASSERT_TRUE(forwarder.write(reinterpret_cast<const uint8_t *>(image.data()) + offset, 1000));
+  }
+  release.set_value();
+  const auto results = forwarder.finish();
+
+  ASSERT_EQ(results.size(), 2);
+  for (const auto &result : results) {
+    EXPECT_TRUE(result.second.isSuccess()) << result.first;
+  }
+  EXPECT_EQ(out1, image);
+  EXPECT_EQ(out2, image);
+  EXPECT_EQ(opened, 1);
+}
+
+/* With a source, writing stops being useful once every Secondary has failed. */
+TEST(FirmwareForwarder, AllFailed) {
+  const std::string image = makeImage(100000);
+  std::string out;
+  size_t max_chunk = 0;
+  std::map<Uptane::EcuSerial, std::unique_ptr<FirmwareWriter>> writers;
+  writers.emplace(Uptane::EcuSerial("sec1"), std_::make_unique<StringWriter>(&out, &max_chunk, 0));
+  auto source = [&image]() -> std::unique_ptr<std::istream> { return std_::make_unique<std::istringstream>(image); };
+
+  FirmwareForwarder forwarder(std::move(writers), source, 4096, 1000);
+  bool written = true;
+  for (size_t offset = 0; offset < image.size() && written; offset += 1000) {
+    written = forwarder.write(reinterpret_cast<const uint8_t *>(image.data()) + offset, 1000);
+  }
+  EXPECT_FALSE(written);
+  EXPECT_EQ(forwarder.finish().at(Uptane::EcuSerial("sec1")).description, "Disk full");
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
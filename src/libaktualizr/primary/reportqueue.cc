@@ -5,9 +5,16 @@
 #include "libaktualizr/config.h"
 #include "libaktualizr/http/httpclient.h"
 #include "libaktualizr/logging/logging.h"
+#include "libaktualizr/metrics.h"
 #include "libaktualizr/storage/invstorage.h"
 #include "storage/sql_utils.h"
 
+static metrics::Gauge& queueDepth() {
+  static metrics::Gauge& gauge =
+      metrics::Registry::global().gauge("aktualizr_report_queue_depth", "Report events waiting to be sent");
+  return gauge;
+}
+
 ReportQueue::ReportQueue(const Config& config_in, std::shared_ptr<HttpInterface> http_client,
                          std::shared_ptr<INvStorage> storage_in, int run_pause_s, int event_number_limit)
     : config(config_in),
@@ -64,6 +71,7 @@ void ReportQueue::enqueue(std::unique_ptr<ReportEvent> event) {
   {
     std::lock_guard<std::mutex> lock(m_);
     storage->saveReportEvent(event->toJson());
+    queueDepth().add(1);
   }
   cv_.notify_all();
 }
@@ -80,6 +88,11 @@ void ReportQueue::flushQueue() {
     LOG_ERROR << "Unknown failure while reading events from DB: " << exc.what();
     return;
   }
+  // Events left over from a previous run are only known once they are read.
+  const auto loaded = static_cast<double>(report_array.size());
+  if (report_array.size() < static_cast<size_t>(cur_event_number_limit_) || queueDepth().value() < loaded) {
+    queueDepth().set(loaded);
+  }
 
   if (config.tls.server.empty()) {
     // Prevent a lot of unnecessary garbage output in uptane vector tests.
@@ -109,6 +122,7 @@ void ReportQueue::flushQueue() {
       LOG_WARNING << "Failed to post update events: " << response.getStatusStr();
     }
     if (delete_events) {
+      queueDepth().add(-static_cast<double>(report_array.size()));
       report_array.clear();
       storage->deleteReportEvents(max_id);
       cur_event_number_limit_ = event_number_limit_;
@@ -84,7 +84,7 @@ std::string SecondaryProvider::getTreehubCredentials() const {
     return "";
   }
 
-  const std::string treehub_url = config_.pacman.ostree_server;
+  const std::string treehub_url = ostree_mirror_url_.empty() ? config_.pacman.ostree_server : ostree_mirror_url_;
   std::map<std::string, std::string> archive_map = {
       {"ca.pem", ca}, {"client.pem", cert}, {"pkey.pem", pkey}, {"server.url", treehub_url}};
 
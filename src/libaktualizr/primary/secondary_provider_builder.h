@@ -9,8 +9,9 @@ class SecondaryProviderBuilder {
  public:
   static std::shared_ptr<SecondaryProvider> Build(
       Config &config, const std::shared_ptr<const INvStorage> &storage,
-      const std::shared_ptr<const PackageManagerInterface> &package_manager) {
-    return std::make_shared<SecondaryProvider>(SecondaryProvider(config, storage, package_manager));
+      const std::shared_ptr<const PackageManagerInterface> &package_manager,
+      const std::string &ostree_mirror_url = "") {
+    return std::make_shared<SecondaryProvider>(SecondaryProvider(config, storage, package_manager, ostree_mirror_url));
   }
   ~SecondaryProviderBuilder() = default;
   SecondaryProviderBuilder(const SecondaryProviderBuilder &) = delete;
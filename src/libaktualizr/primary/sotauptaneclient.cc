@@ -1,24 +1,42 @@
 #include "primary/sotauptaneclient.h"
 
 #include <fnmatch.h>
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
 #include <memory>
+#include <tuple>
 #include <utility>
 
+#include <boost/algorithm/string.hpp>
+
 #include "libaktualizr/campaign.h"
 #include "libaktualizr/crypto/crypto.h"
 #include "libaktualizr/crypto/keymanager.h"
 #include "libaktualizr/logging/logging.h"
 #include "libaktualizr/uptane/exceptions.h"
 #include "libaktualizr/utilities/utils.h"
+#include "primary/firmwareforwarder.h"
 #include "provisioner.h"
+#include "utilities/binary_delta.h"
+#include "utilities/thread_pool.h"
+#include "utilities/tracer.h"
+#ifdef BUILD_OSTREE
+#include "package_manager/ostreemirror.h"
+#endif
+
+// Upper bound for the number of sibling delegations fetched at once.
+static constexpr size_t kDelegationPrefetchThreads = 4;
 
 static void report_progress_cb(event::Channel *channel, const Uptane::Target &target, const std::string &description,
-                               unsigned int progress) {
+                               unsigned int progress, const data::DownloadStats &stats) {
   if (channel == nullptr) {
     return;
   }
-  auto event = std::make_shared<event::DownloadProgressReport>(target, description, progress);
+  auto event = std::make_shared<event::DownloadProgressReport>(target, description, progress, stats);
   (*channel)(event);
 }
 
@@ -47,7 +65,28 @@ SotaUptaneClient::SotaUptaneClient(Config &config_in, std::shared_ptr<INvStorage
       events_channel(std::move(events_channel_in)),
       provisioner_(config.provision, storage, http, key_manager_, secondaries) {
   report_queue = std_::make_unique<ReportQueue>(config, http, storage);
-  secondary_provider_ = SecondaryProviderBuilder::Build(config, storage, package_manager_);
+
+  std::string ostree_mirror_url;
+#ifdef BUILD_OSTREE
+  if (!config.pacman.ostree_mirror_address.empty()) {
+    try {
+      ostree_mirror_ = std::make_shared<OstreeMirror>(config.pacman);
+      ostree_mirror_url = ostree_mirror_->url();
+    } catch (const std::exception &e) {
+      LOG_ERROR << "Could not set up the OSTree mirror, Secondaries will pull from " << config.pacman.ostree_server
+                << ": " << e.what();
+    }
+  }
+#endif
+  secondary_provider_ = SecondaryProviderBuilder::Build(config, storage, package_manager_, ostree_mirror_url);
+
+  if (config.uptane.prefetch_targets) {
+    prefetcher_ = std_::make_unique<TargetPrefetcher>(
+        [this](const Uptane::Target &target, const api::FlowControlToken *token) {
+          return package_manager_->prefetchTarget(target, *uptane_fetcher, config.uptane.prefetch_max_bytes_per_sec,
+                                                  config.uptane.prefetch_quota, token);
+        });
+  }
 }
 
 void SotaUptaneClient::addSecondary(const std::shared_ptr<SecondaryInterface> &sec) {
@@ -295,6 +334,7 @@ void SotaUptaneClient::reportAktualizrConfiguration() {
 }
 
 Json::Value SotaUptaneClient::AssembleManifest() {
+  TRACE_FUNCTION("uptane");
   Json::Value manifest;  // signed top-level
   Uptane::EcuSerial primary_ecu_serial = primaryEcuSerial();
   manifest["primary_ecu_serial"] = primary_ecu_serial.ToString();
@@ -421,6 +461,7 @@ void SotaUptaneClient::requiresAlreadyProvisioned() {
 }
 
 void SotaUptaneClient::updateDirectorMeta() {
+  TRACE_FUNCTION("uptane");
   requiresProvision();
   try {
     director_repo.updateMeta(*storage, *uptane_fetcher);
@@ -431,6 +472,7 @@ void SotaUptaneClient::updateDirectorMeta() {
 }
 
 void SotaUptaneClient::updateImageMeta() {
+  TRACE_FUNCTION("uptane");
   requiresProvision();
   try {
     image_repo.updateMeta(*storage, *uptane_fetcher);
@@ -570,8 +612,8 @@ void SotaUptaneClient::getNewTargets(std::vector<Uptane::Target> *new_targets, u
       if (!current_version) {
         LOG_WARNING << "Current version for ECU ID: " << ecu_serial << " is unknown";
         is_new = true;
-      } else if (current_version->MatchTarget(target)) {
-        // Do nothing; target is already installed.
+      } else if (current_version->MatchTarget(binary_delta::installedTarget(target))) {
+        // Do nothing; target is already installed, or for a delta, the image it produces.
       } else if (current_version->filename() == target.filename()) {
         LOG_ERROR << "Director Target filename matches currently installed version, but content differs!";
         throw Uptane::TargetContentMismatch(target.filename());
@@ -615,6 +657,7 @@ std::unique_ptr<Uptane::Target> SotaUptaneClient::findTargetHelper(const Uptane:
     return std::unique_ptr<Uptane::Target>(nullptr);
   }
 
+  std::vector<Uptane::Role> delegate_roles;
   for (const auto &delegate_name : cur_targets.delegated_role_names_) {
     Uptane::Role delegate_role = Uptane::Role::Delegation(delegate_name);
     auto patterns = cur_targets.paths_for_role_.find(delegate_role);
@@ -622,21 +665,53 @@ std::unique_ptr<Uptane::Target> SotaUptaneClient::findTargetHelper(const Uptane:
       continue;
     }
 
-    bool match = false;
     for (const auto &pattern : patterns->second) {
       if (fnmatch(pattern.c_str(), queried_target.filename().c_str(), 0) == 0) {
-        match = true;
+        // Target name matches one of the patterns
+        delegate_roles.push_back(delegate_role);
         break;
       }
     }
-    if (!match) {
-      continue;
-    }
+  }
 
-    // Target name matches one of the patterns
+  // The next few sibling delegations are fetched and verified in parallel
+  // while the current one is searched. They are still searched in order, so
+  // the first match wins as before, and at most a few of them are fetched in
+  // vain when the target is found early.
+  auto fetch_delegation = [this, &cur_targets, offline](const Uptane::Role &role) {
+    return Uptane::getTrustedDelegation(role, cur_targets, image_repo, *storage, *uptane_fetcher, offline);
+  };
+  ThreadPool *pool = delegate_roles.size() > 1 ? &delegationPool() : nullptr;
+  // Delegations fetched ahead use cur_targets, so they have to be done before
+  // it can go away.
+  struct Fetches {
+    std::vector<std::future<Uptane::Targets>> futures;
+    Fetches() = default;
+    ~Fetches() {
+      for (auto &f : futures) {
+        if (f.valid()) {
+          f.wait();
+        }
+      }
+    }
+    Fetches(const Fetches &) = delete;
+    Fetches(Fetches &&) = delete;
+    Fetches &operator=(const Fetches &) = delete;
+    Fetches &operator=(Fetches &&) = delete;
+  } fetches;
+  std::vector<std::future<Uptane::Targets>> &delegations = fetches.futures;
+  auto prefetch = [&](size_t current) {
+    while (delegations.size() < delegate_roles.size() && delegations.size() < current + kDelegationPrefetchThreads) {
+      auto fetch = std::bind(fetch_delegation, delegate_roles[delegations.size()]);
+      // Deeper levels go first: the search waits for them, not for the siblings.
+      delegations.push_back(pool != nullptr ? pool->submit(fetch, level) : std::async(std::launch::deferred, fetch));
+    }
+  };
 
-    auto delegation =
-        Uptane::getTrustedDelegation(delegate_role, cur_targets, image_repo, *storage, *uptane_fetcher, offline);
+  for (size_t i = 0; i < delegate_roles.size(); ++i) {
+    const Uptane::Role &delegate_role = delegate_roles[i];
+    prefetch(i);
+    auto delegation = delegations[i].get();
     if (delegation.isExpired(TimeStamp::Now())) {
       continue;
     }
@@ -656,6 +731,12 @@ std::unique_ptr<Uptane::Target> SotaUptaneClient::findTargetHelper(const Uptane:
   return std::unique_ptr<Uptane::Target>(nullptr);
 }
 
+ThreadPool &SotaUptaneClient::delegationPool() {
+  std::call_once(delegation_pool_once_,
+                 [this]() { delegation_pool_ = std::make_shared<ThreadPool>(kDelegationPrefetchThreads); });
+  return *delegation_pool_;
+}
+
 std::unique_ptr<Uptane::Target> SotaUptaneClient::findTargetInDelegationTree(const Uptane::Target &target,
                                                                              const bool offline) {
   auto toplevel_targets = image_repo.getTargets();
@@ -668,7 +749,10 @@ std::unique_ptr<Uptane::Target> SotaUptaneClient::findTargetInDelegationTree(con
 
 result::Download SotaUptaneClient::downloadImages(const std::vector<Uptane::Target> &targets,
                                                   const api::FlowControlToken *token) {
+  TRACE_FUNCTION("uptane");
   requiresAlreadyProvisioned();
+  // The download resumes whatever the prefetch has stored.
+  stopPrefetch();
   // Uptane step 4 - download all the images and verify them against the metadata (for OSTree - pull without
   // deploying)
   std::lock_guard<std::mutex> guard(download_mutex);
@@ -696,6 +780,13 @@ result::Download SotaUptaneClient::downloadImages(const std::vector<Uptane::Targ
     return result;
   }
 
+#ifdef BUILD_OSTREE
+  if (ostree_mirror_ != nullptr) {
+    // The Secondaries have pulled the commits of earlier updates by now.
+    ostree_mirror_->prune(targets);
+  }
+#endif
+
   for (const auto &target : targets) {
     auto res = downloadImage(target, token);
     if (res.first) {
@@ -721,6 +812,18 @@ result::Download SotaUptaneClient::downloadImages(const std::vector<Uptane::Targ
   return result;
 }
 
+void SotaUptaneClient::pausePrefetch(bool do_pause) {
+  if (prefetcher_ != nullptr) {
+    prefetcher_->pause(do_pause);
+  }
+}
+
+void SotaUptaneClient::stopPrefetch() {
+  if (prefetcher_ != nullptr) {
+    prefetcher_->stop();
+  }
+}
+
 void SotaUptaneClient::reportPause() {
   const std::string &correlation_id = director_repo.getCorrelationId();
   report_queue->enqueue(std_::make_unique<DevicePausedReport>(correlation_id));
@@ -733,6 +836,7 @@ void SotaUptaneClient::reportResume() {
 
 std::pair<bool, Uptane::Target> SotaUptaneClient::downloadImage(const Uptane::Target &target,
                                                                 const api::FlowControlToken *token) {
+  TRACE_FUNCTION("uptane");
   const std::string &correlation_id = director_repo.getCorrelationId();
   // send an event for all ECUs that are touched by this target
   for (const auto &ecu : target.ecus()) {
@@ -747,13 +851,26 @@ std::pair<bool, Uptane::Target> SotaUptaneClient::downloadImage(const Uptane::Ta
   try {
     KeyManager keys(storage, config.keymanagerConfig());
     keys.loadKeys();
-    auto prog_cb = [this](const Uptane::Target &t, const std::string &description, unsigned int progress) {
-      report_progress_cb(events_channel.get(), t, description, progress);
+    auto report_cb = [this](const Uptane::Target &t, const std::string &description, unsigned int progress,
+                            const data::DownloadStats &stats) {
+      report_progress_cb(events_channel.get(), t, description, progress, stats);
     };
+    const FetcherProgressCb prog_cb = WithDownloadStats{report_cb};
 
     const Uptane::EcuSerial &primary_ecu_serial = primaryEcuSerial();
 
-    if (target.IsForEcu(primary_ecu_serial) || !target.IsOstree()) {
+    boost::optional<bool> streamed;
+    if (config.uptane.secondary_stream_firmware && !target.IsForEcu(primary_ecu_serial) && !target.IsOstree()) {
+      streamed = streamImage(target, prog_cb, token);
+      if (!!streamed && !*streamed) {
+        // The Secondaries drop the partial image when it is sent again.
+        LOG_WARNING << "Could not stream " << target.filename() << " to its Secondaries, downloading it instead";
+      }
+    }
+
+    if (!!streamed && *streamed) {
+      success = true;
+    } else if (target.IsForEcu(primary_ecu_serial) || !target.IsOstree()) {
       const int max_tries = 3;
       int tries = 0;
       std::chrono::milliseconds wait(500);
@@ -780,6 +897,22 @@ std::pair<bool, Uptane::Target> SotaUptaneClient::downloadImage(const Uptane::Ta
       // we emulate successful download in case of the Secondary OSTree update
       success = true;
     }
+#ifdef BUILD_OSTREE
+    const bool for_secondaries = std::any_of(
+        target.ecus().cbegin(), target.ecus().cend(),
+        [&primary_ecu_serial](const std::pair<const Uptane::EcuSerial, Uptane::HardwareIdentifier> &ecu) {
+          return ecu.first != primary_ecu_serial;
+        });
+    if (success && ostree_mirror_ != nullptr && target.IsOstree() && for_secondaries) {
+      // Pulled once here for all the Secondaries installing this commit, also when the Primary installs it too:
+      // the Secondaries are told to fetch it from the mirror.
+      const data::InstallationResult pull_result = ostree_mirror_->pull(target, keys, prog_cb, token);
+      success = pull_result.isSuccess();
+      if (!success) {
+        LOG_ERROR << "Could not pull " << target.sha256Hash() << " into the OSTree mirror: " << pull_result.description;
+      }
+    }
+#endif
   } catch (const std::exception &e) {
     LOG_ERROR << "Error downloading image: " << e.what();
     last_exception = std::current_exception();
@@ -795,6 +928,128 @@ std::pair<bool, Uptane::Target> SotaUptaneClient::downloadImage(const Uptane::Ta
   return {success, target};
 }
 
+boost::optional<bool> SotaUptaneClient::streamImage(const Uptane::Target &target, const FetcherProgressCb &progress_cb,
+                                                    const api::FlowControlToken *token) {
+  {
+    std::lock_guard<std::mutex> guard(streamed_mutex_);
+    for (const auto &ecu : target.ecus()) {
+      streamed_images_.erase(ecu.first);
+    }
+  }
+
+  std::map<Uptane::EcuSerial, std::unique_ptr<FirmwareWriter>> writers;
+  try {
+    RootChain director_roots;
+    loadRootChain(Uptane::RepositoryType::Director(), director_roots);
+    RootChain image_roots;
+    loadRootChain(Uptane::RepositoryType::Image(), image_roots);
+    for (const auto &ecu : target.ecus()) {
+      const auto it = secondaries.find(ecu.first);
+      if (it == secondaries.end()) {
+        return boost::none;
+      }
+      // Secondaries only accept the image of a target they have verified the metadata of, which needs the
+      // intermediate Roots like in sendMetadataToEcus().
+      data::InstallationResult put_result =
+          rotateSecondaryRoot(Uptane::RepositoryType::Director(), director_roots, *it->second);
+      if (put_result.isSuccess()) {
+        put_result = rotateSecondaryRoot(Uptane::RepositoryType::Image(), image_roots, *it->second);
+      }
+      if (put_result.isSuccess()) {
+        put_result = it->second->putMetadata(target);
+      }
+      if (!put_result.isSuccess()) {
+        LOG_WARNING << "Secondary " << ecu.first << " rejected the metadata of " << target.filename()
+                    << ", the image will be sent after the download: " << put_result.description;
+        return boost::none;
+      }
+      auto writer = it->second->openFirmwareWriter(target);
+      if (writer == nullptr) {
+        return boost::none;
+      }
+      writers.emplace(ecu.first, std::move(writer));
+    }
+  } catch (const std::exception &e) {
+    LOG_WARNING << "Could not prepare the Secondaries to receive " << target.filename() << ": " << e.what();
+    return boost::none;
+  }
+
+  uint64_t forwarded_bytes = 0;
+  FirmwareForwarder forwarder(std::move(writers));
+  const TargetChunkCb chunk_cb = [&forwarder, &forwarded_bytes](const uint8_t *data, size_t size) {
+    forwarded_bytes += size;
+    return forwarder.write(data, size);
+  };
+  const bool downloaded = package_manager_->fetchTargetStreaming(
+      target, *uptane_fetcher, progress_cb, chunk_cb, config.uptane.secondary_stream_keep_copy, token);
+  const auto results = forwarder.finish();
+  bool forwarded = true;
+  for (const auto &result : results) {
+    forwarded = forwarded && result.second.isSuccess();
+  }
+  if (!downloaded || !forwarded) {
+    return false;
+  }
+
+  // Nothing is streamed for an image already stored on the Primary, it is sent
+  // during the installation as usual.
+  if (forwarded_bytes == target.length()) {
+    LOG_INFO << "Sent " << target.filename() << " to its Secondaries while downloading it";
+    std::lock_guard<std::mutex> guard(streamed_mutex_);
+    for (const auto &result : results) {
+      streamed_images_.emplace(result.first, target);
+    }
+  }
+  return true;
+}
+
+bool SotaUptaneClient::wasStreamed(const Uptane::Target &target, const Uptane::EcuSerial &serial) {
+  std::lock_guard<std::mutex> guard(streamed_mutex_);
+  const auto it = streamed_images_.find(serial);
+  return it != streamed_images_.end() && it->second.MatchTarget(target);
+}
+
+std::map<Uptane::EcuSerial, data::InstallationResult> SotaUptaneClient::fanOutImage(
+    const Uptane::Target &target, const std::vector<SecondaryInterface *> &recipients) {
+  std::map<Uptane::EcuSerial, std::unique_ptr<FirmwareWriter>> writers;
+  for (auto *secondary : recipients) {
+    try {
+      auto writer = secondary->openFirmwareWriter(target);
+      if (writer != nullptr) {
+        writers.emplace(secondary->getSerial(), std::move(writer));
+      }
+    } catch (const std::exception &e) {
+      LOG_WARNING << "Could not prepare Secondary " << secondary->getSerial() << " to receive " << target.filename()
+                  << ": " << e.what();
+    }
+  }
+  if (writers.size() < 2) {
+    return {};
+  }
+
+  LOG_INFO << "Sending " << target.filename() << " to " << writers.size() << " Secondaries at once";
+  const FirmwareForwarder::Source source = [this, &target]() -> std::unique_ptr<std::istream> {
+    return std_::make_unique<std::ifstream>(package_manager_->openTargetFile(target));
+  };
+  try {
+    auto file = source();
+    FirmwareForwarder forwarder(std::move(writers), source);
+    std::vector<char> buf(FirmwareForwarder::kDefaultChunkSize);
+    while (file->read(buf.data(), static_cast<std::streamsize>(buf.size())) || file->gcount() > 0) {
+      if (!forwarder.write(reinterpret_cast<const uint8_t *>(buf.data()), static_cast<size_t>(file->gcount()))) {
+        break;
+      }
+    }
+    if (file->bad()) {
+      throw std::runtime_error("Read error");
+    }
+    return forwarder.finish();
+  } catch (const std::exception &e) {
+    LOG_WARNING << "Could not read " << target.filename() << " to send it to its Secondaries: " << e.what();
+  }
+  return {};
+}
+
 void SotaUptaneClient::uptaneIteration(std::vector<Uptane::Target> *targets, unsigned int *ecus_count) {
   updateDirectorMeta();
 
@@ -856,6 +1111,7 @@ void SotaUptaneClient::sendDeviceData() {
 }
 
 result::UpdateCheck SotaUptaneClient::fetchMeta() {
+  TRACE_FUNCTION("uptane");
   requiresProvision();
 
   result::UpdateCheck result;
@@ -883,10 +1139,21 @@ result::UpdateCheck SotaUptaneClient::fetchMeta() {
   result = checkUpdates();
   sendEvent<event::UpdateCheckComplete>(result);
 
+  if (prefetcher_ != nullptr && result.status == result::UpdateStatus::kUpdatesAvailable) {
+    // OSTree commits are pulled by the package manager or the Secondaries themselves.
+    std::vector<Uptane::Target> binary_targets;
+    std::copy_if(result.updates.cbegin(), result.updates.cend(), std::back_inserter(binary_targets),
+                 [](const Uptane::Target &target) { return !target.IsOstree(); });
+    if (!binary_targets.empty()) {
+      prefetcher_->start(std::move(binary_targets));
+    }
+  }
+
   return result;
 }
 
 result::UpdateCheck SotaUptaneClient::checkUpdates() {
+  TRACE_FUNCTION("uptane");
   result::UpdateCheck result;
 
   std::vector<Uptane::Target> updates;
@@ -999,6 +1266,7 @@ result::UpdateStatus SotaUptaneClient::checkUpdatesOffline(const std::vector<Upt
 }
 
 result::Install SotaUptaneClient::uptaneInstall(const std::vector<Uptane::Target> &updates) {
+  TRACE_FUNCTION("uptane");
   requiresAlreadyProvisioned();
   const std::string &correlation_id = director_repo.getCorrelationId();
 
@@ -1032,6 +1300,14 @@ result::Install SotaUptaneClient::uptaneInstall(const std::vector<Uptane::Target
     Uptane::EcuSerial primary_ecu_serial = primaryEcuSerial();
     // Recheck the downloaded update hashes.
     for (const auto &update : updates) {
+      // Secondaries verify the images streamed to them, which the Primary might not have kept.
+      bool streamed = !update.IsForEcu(primary_ecu_serial) && !update.ecus().empty();
+      for (const auto &ecu : update.ecus()) {
+        streamed = streamed && wasStreamed(update, ecu.first);
+      }
+      if (streamed) {
+        continue;
+      }
       if (update.IsForEcu(primary_ecu_serial) || !update.IsOstree()) {
         // download binary images for any target, for both Primary and Secondary
         // download an OSTree revision just for Primary, Secondary will do it by itself
@@ -1039,6 +1315,13 @@ result::Install SotaUptaneClient::uptaneInstall(const std::vector<Uptane::Target
         // Downloading of Secondary's OSTree repo revision to the Primary's can fail
         // if they differ significantly as OSTree has a certain cap/limit of the diff it pulls
         if (package_manager_->verifyTarget(update) != TargetStatus::kGood) {
+          if (config.uptane.secondary_stream_firmware && !config.uptane.secondary_stream_keep_copy &&
+              !update.IsForEcu(primary_ecu_serial) && !update.IsOstree()) {
+            // The image was streamed without keeping a copy and its installation failed; only a new download
+            // streams it again.
+            result.dev_report = {false, data::ResultCode::Numeric::kDownloadFailed, ""};
+            return std::make_tuple(result, "Streamed target was not kept, it has to be downloaded again");
+          }
           result.dev_report = {false, data::ResultCode::Numeric::kInternalError, ""};
           return std::make_tuple(result, "Downloaded target is invalid");
         }
@@ -1109,6 +1392,13 @@ result::Install SotaUptaneClient::uptaneInstall(const std::vector<Uptane::Target
   }();
 
   storage->storeDeviceInstallationResult(r.dev_report, raw_report, correlation_id);
+  if (r.dev_report.isSuccess()) {
+    try {
+      package_manager_->collectTargetGarbage();
+    } catch (const std::exception &e) {
+      LOG_WARNING << "Could not remove unused target files: " << e.what();
+    }
+  }
 
   sendEvent<event::AllInstallsComplete>(r);
 
@@ -1203,6 +1493,7 @@ bool SotaUptaneClient::putManifestSimple(const Json::Value &custom) {
 }
 
 bool SotaUptaneClient::putManifest(const Json::Value &custom) {
+  TRACE_FUNCTION("uptane");
   requiresProvision();
 
   bool success = putManifestSimple(custom);
@@ -1272,18 +1563,45 @@ void SotaUptaneClient::storeInstallationFailure(const data::InstallationResult &
   director_repo.dropTargets(*storage);
 }
 
-/* If the Root has been rotated more than once, we need to provide the Secondary
- * with the incremental steps from what it has now. */
-data::InstallationResult SotaUptaneClient::rotateSecondaryRoot(Uptane::RepositoryType repo,
-                                                               SecondaryInterface &secondary) {
+void SotaUptaneClient::loadRootChain(Uptane::RepositoryType repo, RootChain &chain) {
   std::string latest_root;
   if (!storage->loadLatestRoot(&latest_root, repo)) {
     LOG_ERROR << "Error reading Root metadata";
+    return;
+  }
+  chain.loaded = true;
+  chain.latest_version = Uptane::extractVersionUntrusted(latest_root);
+}
+
+const std::string *SotaUptaneClient::intermediateRoot(Uptane::RepositoryType repo, RootChain &chain, int version) {
+  std::lock_guard<std::mutex> guard(chain.m);
+  auto it = chain.intermediate.find(version);
+  if (it == chain.intermediate.end()) {
+    std::string root;
+    if (!storage->loadRoot(&root, repo, Uptane::Version(version))) {
+      LOG_WARNING << "Couldn't find Root metadata in the storage, trying remote repo";
+      try {
+        uptane_fetcher->fetchRole(&root, Uptane::kMaxRootSize, repo, Uptane::Role::Root(), Uptane::Version(version));
+      } catch (const std::exception &e) {
+        LOG_ERROR << "Root metadata version " << version << " could not be fetched: " << e.what();
+        root.clear();
+      }
+    }
+    it = chain.intermediate.emplace(version, std::move(root)).first;
+  }
+  return it->second.empty() ? nullptr : &it->second;
+}
+
+/* If the Root has been rotated more than once, we need to provide the Secondary
+ * with the incremental steps from what it has now. */
+data::InstallationResult SotaUptaneClient::rotateSecondaryRoot(Uptane::RepositoryType repo, RootChain &chain,
+                                                               SecondaryInterface &secondary) {
+  if (!chain.loaded) {
     return data::InstallationResult(data::ResultCode::Numeric::kInternalError, "Error reading Root metadata");
   }
 
   data::InstallationResult result{data::ResultCode::Numeric::kOk, ""};
-  const int last_root_version = Uptane::extractVersionUntrusted(latest_root);
+  const int last_root_version = chain.latest_version;
   const int sec_root_version = secondary.getRootVersion((repo == Uptane::RepositoryType::Director()));
   // If sec_root_version is 0, assume either the Secondary doesn't have Root
   // metadata or doesn't support the Root version request. Continue on and hope
@@ -1299,22 +1617,17 @@ data::InstallationResult SotaUptaneClient::rotateSecondaryRoot(Uptane::Repositor
     // Only send intermediate Roots that would otherwise be skipped. The latest
     // will be sent with the complete set of the latest metadata.
     for (int v = sec_root_version + 1; v < last_root_version; v++) {
-      std::string root;
-      if (!storage->loadRoot(&root, repo, Uptane::Version(v))) {
-        LOG_WARNING << "Couldn't find Root metadata in the storage, trying remote repo";
-        try {
-          uptane_fetcher->fetchRole(&root, Uptane::kMaxRootSize, repo, Uptane::Role::Root(), Uptane::Version(v));
-        } catch (const std::exception &e) {
-          LOG_ERROR << "Root metadata could not be fetched for Secondary with serial " << secondary.getSerial()
-                    << ", skipping to the next Secondary";
-          result = data::InstallationResult(data::ResultCode::Numeric::kInternalError,
-                                            "Root metadata could not be fetched for Secondary with serial " +
-                                                secondary.getSerial().ToString() + ", skipping to the next Secondary");
-          break;
-        }
+      const std::string *root = intermediateRoot(repo, chain, v);
+      if (root == nullptr) {
+        LOG_ERROR << "Root metadata could not be fetched for Secondary with serial " << secondary.getSerial()
+                  << ", skipping to the next Secondary";
+        result = data::InstallationResult(data::ResultCode::Numeric::kInternalError,
+                                          "Root metadata could not be fetched for Secondary with serial " +
+                                              secondary.getSerial().ToString() + ", skipping to the next Secondary");
+        break;
       }
       try {
-        result = secondary.putRoot(root, repo == Uptane::RepositoryType::Director());
+        result = secondary.putRoot(*root, repo == Uptane::RepositoryType::Director());
       } catch (const std::exception &ex) {
         result = data::InstallationResult(data::ResultCode::Numeric::kInternalError, ex.what());
       }
@@ -1329,44 +1642,88 @@ data::InstallationResult SotaUptaneClient::rotateSecondaryRoot(Uptane::Repositor
 }
 
 // TODO: the function blocks until it updates all the Secondaries. Consider non-blocking operation.
+/* Secondaries are updated in parallel, but the metadata of all the targets of
+ * a given Secondary is sent in order by the same task. */
 void SotaUptaneClient::sendMetadataToEcus(const std::vector<Uptane::Target> &targets, data::InstallationResult *result,
                                           std::string *raw_installation_report) {
-  data::InstallationResult final_result{data::ResultCode::Numeric::kOk, ""};
-  std::string result_code_err_str;
+  TRACE_FUNCTION("uptane");
+  struct MetadataSend {
+    const Uptane::Target *target;
+    Uptane::HardwareIdentifier hw_id;
+    bool rotation_failed;
+    data::InstallationResult result;
+  };
+  std::vector<MetadataSend> sends;
+  std::map<Uptane::EcuSerial, std::vector<size_t>> sends_per_ecu;
   for (const auto &target : targets) {
     for (const auto &ecu : target.ecus()) {
-      const Uptane::EcuSerial ecu_serial = ecu.first;
-      const Uptane::HardwareIdentifier hw_id = ecu.second;
-      auto sec = secondaries.find(ecu_serial);
-      if (sec == secondaries.end()) {
+      if (secondaries.find(ecu.first) == secondaries.end()) {
         continue;
       }
+      sends_per_ecu[ecu.first].push_back(sends.size());
+      sends.push_back(MetadataSend{&target, ecu.second, false, data::InstallationResult()});
+    }
+  }
 
-      data::InstallationResult local_result{data::ResultCode::Numeric::kOk, ""};
-      do {
-        /* Root rotation if necessary */
-        local_result = rotateSecondaryRoot(Uptane::RepositoryType::Director(), *(sec->second));
-        if (!local_result.isSuccess()) {
-          final_result = local_result;
-          break;
-        }
-        local_result = rotateSecondaryRoot(Uptane::RepositoryType::Image(), *(sec->second));
-        if (!local_result.isSuccess()) {
-          final_result = local_result;
-          break;
-        }
-        try {
-          local_result = sec->second->putMetadata(target);
-        } catch (const std::exception &ex) {
-          local_result = data::InstallationResult(data::ResultCode::Numeric::kInternalError, ex.what());
+  if (!sends.empty()) {
+    RootChain director_roots;
+    loadRootChain(Uptane::RepositoryType::Director(), director_roots);
+    RootChain image_roots;
+    loadRootChain(Uptane::RepositoryType::Image(), image_roots);
+    // The metadata is the same for every Secondary, so it is loaded once for
+    // the whole update. If that fails, each Secondary loads and reports it.
+    std::unique_ptr<UpdateMetadataCache> metadata;
+    Uptane::MetaBundle bundle;
+    if (secondary_provider_->getMetadata(&bundle, targets.front())) {
+      metadata = std_::make_unique<UpdateMetadataCache>(std::move(bundle));
+    }
+
+    const size_t threads = std::min<size_t>(sends_per_ecu.size(), config.uptane.secondary_metadata_threads);
+    ThreadPool pool(threads);
+    std::vector<std::future<void>> done;
+    for (const auto &ecu_sends : sends_per_ecu) {
+      SecondaryInterface &secondary = *secondaries.at(ecu_sends.first);
+      const std::vector<size_t> &indices = ecu_sends.second;
+      done.push_back(pool.submit([this, &secondary, &indices, &sends, &director_roots, &image_roots, &metadata]() {
+        for (const size_t i : indices) {
+          MetadataSend &send = sends[i];
+          /* Root rotation if necessary */
+          send.result = rotateSecondaryRoot(Uptane::RepositoryType::Director(), director_roots, secondary);
+          if (send.result.isSuccess()) {
+            send.result = rotateSecondaryRoot(Uptane::RepositoryType::Image(), image_roots, secondary);
+          }
+          if (!send.result.isSuccess()) {
+            send.rotation_failed = true;
+          } else {
+            try {
+              send.result = metadata != nullptr ? secondary.putMetadataFrom(*metadata, *send.target)
+                                                : secondary.putMetadata(*send.target);
+            } catch (const std::exception &ex) {
+              send.result = data::InstallationResult(data::ResultCode::Numeric::kInternalError, ex.what());
+            }
+          }
+          if (!send.result.isSuccess()) {
+            LOG_ERROR << "Sending metadata to " << secondary.getSerial() << " failed: " << send.result.result_code
+                      << " " << send.result.description;
+          }
         }
-      } while (false);
-      if (!local_result.isSuccess()) {
-        LOG_ERROR << "Sending metadata to " << sec->first << " failed: " << local_result.result_code << " "
-                  << local_result.description;
-        const std::string ecu_code_str = hw_id.ToString() + ":" + local_result.result_code.ToString();
-        result_code_err_str += (!result_code_err_str.empty() ? "|" : "") + ecu_code_str;
-      }
+      }));
+    }
+    for (auto &d : done) {
+      d.get();
+    }
+  }
+
+  // Aggregate the results in the order of the targets, as they were sent.
+  data::InstallationResult final_result{data::ResultCode::Numeric::kOk, ""};
+  std::string result_code_err_str;
+  for (const auto &send : sends) {
+    if (send.rotation_failed) {
+      final_result = send.result;
+    }
+    if (!send.result.isSuccess()) {
+      const std::string ecu_code_str = send.hw_id.ToString() + ":" + send.result.result_code.ToString();
+      result_code_err_str += (!result_code_err_str.empty() ? "|" : "") + ecu_code_str;
     }
   }
 
@@ -1385,18 +1742,33 @@ void SotaUptaneClient::sendMetadataToEcus(const std::vector<Uptane::Target> &tar
   }
 }
 
-std::future<data::InstallationResult> SotaUptaneClient::sendFirmwareAsync(SecondaryInterface &secondary,
-                                                                          const Uptane::Target &target) {
-  auto f = [this, &secondary, target]() {
+std::future<data::InstallationResult> SotaUptaneClient::sendFirmwareAsync(ThreadPool &pool,
+                                                                          SecondaryInterface &secondary,
+                                                                          const Uptane::Target &target, int priority,
+                                                                          bool streamed) {
+  auto f = [this, &pool, &secondary, target, streamed]() {
     const std::string &correlation_id = director_repo.getCorrelationId();
 
-    sendEvent<event::InstallStarted>(secondary.getSerial());
+    sendEvent<event::InstallStarted>(secondary.getSerial(), pool.pending());
     report_queue->enqueue(std_::make_unique<EcuInstallationStartedReport>(secondary.getSerial(), correlation_id));
 
     data::InstallationResult result;
+    uint64_t transfer_rate = 0;
     try {
-      result = secondary.sendFirmware(target);
+      const auto transfer_start = std::chrono::steady_clock::now();
+      if (streamed) {
+        LOG_INFO << "Secondary " << secondary.getSerial() << " already received " << target.filename();
+        result = data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+      } else {
+        result = secondary.sendFirmware(target);
+      }
+      const auto transfer_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   std::chrono::steady_clock::now() - transfer_start)
+                                   .count();
       if (result.isSuccess()) {
+        if (!streamed) {
+          transfer_rate = target.length() * 1000 / static_cast<uint64_t>(std::max<int64_t>(transfer_ms, 1));
+        }
         result = secondary.install(target);
       }
     } catch (const std::exception &ex) {
@@ -1410,18 +1782,31 @@ std::future<data::InstallationResult> SotaUptaneClient::sendFirmwareAsync(Second
           std_::make_unique<EcuInstallationCompletedReport>(secondary.getSerial(), correlation_id, result.isSuccess()));
     }
 
-    sendEvent<event::InstallTargetComplete>(secondary.getSerial(), result.isSuccess());
+    sendEvent<event::InstallTargetComplete>(secondary.getSerial(), result.isSuccess(), transfer_rate);
     return result;
   };
 
-  return std::async(std::launch::async, f);
+  return pool.submit(f, priority, secondary.Type());
 }
 
 std::vector<result::Install::EcuReport> SotaUptaneClient::sendImagesToEcus(const std::vector<Uptane::Target> &targets) {
+  TRACE_FUNCTION("uptane");
   std::vector<result::Install::EcuReport> reports;
   std::vector<std::pair<result::Install::EcuReport, std::future<data::InstallationResult>>> firmwareFutures;
 
+  // Secondaries listed first in secondary_install_priority get the highest
+  // priority, all the others share the lowest one.
+  std::vector<std::string> priority_list;
+  if (!config.uptane.secondary_install_priority.empty()) {
+    boost::split(priority_list, config.uptane.secondary_install_priority, boost::is_any_of(","));
+  }
+  auto priority_of = [&priority_list](const Uptane::EcuSerial &serial) {
+    const auto it = std::find(priority_list.cbegin(), priority_list.cend(), serial.ToString());
+    return it == priority_list.cend() ? 0 : static_cast<int>(priority_list.cend() - it);
+  };
+
   const Uptane::EcuSerial &primary_ecu_serial = primaryEcuSerial();
+  std::vector<std::tuple<const Uptane::Target *, Uptane::EcuSerial, SecondaryInterface *>> jobs;
   // target images should already have been downloaded to metadata_path/targets/
   for (auto targets_it = targets.cbegin(); targets_it != targets.cend(); ++targets_it) {
     for (auto ecus_it = targets_it->ecus().cbegin(); ecus_it != targets_it->ecus().cend(); ++ecus_it) {
@@ -1437,10 +1822,118 @@ std::vector<result::Install::EcuReport> SotaUptaneClient::sendImagesToEcus(const
         continue;
       }
 
-      SecondaryInterface &sec = *f->second;
-      firmwareFutures.emplace_back(result::Install::EcuReport(*targets_it, ecu_serial, data::InstallationResult()),
-                                   sendFirmwareAsync(sec, *targets_it));
+      jobs.emplace_back(&*targets_it, ecu_serial, f->second.get());
+    }
+  }
+  if (jobs.empty()) {
+    return reports;
+  }
+
+  if (config.uptane.secondary_fan_out) {
+    // Jobs that send the same image, by image.
+    std::vector<std::vector<size_t>> groups;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      const Uptane::Target &target = *std::get<0>(jobs[i]);
+      if (target.IsOstree() || wasStreamed(target, std::get<1>(jobs[i]))) {
+        continue;
+      }
+      auto group = std::find_if(groups.begin(), groups.end(), [&jobs, &target](const std::vector<size_t> &g) {
+        const Uptane::Target &other = *std::get<0>(jobs[g.front()]);
+        return other.filename() == target.filename() && other.sha256Hash() == target.sha256Hash();
+      });
+      if (group == groups.end()) {
+        groups.emplace_back(1, i);
+      } else {
+        group->push_back(i);
+      }
     }
+
+    const bool fan_out = std::any_of(groups.cbegin(), groups.cend(),
+                                     [](const std::vector<size_t> &group) { return group.size() > 1; });
+    if (fan_out && (!config.uptane.secondary_bus_limits.empty() || !config.uptane.secondary_install_priority.empty())) {
+      LOG_WARNING << "Images sent to several Secondaries at once are not subject to secondary_bus_limits and "
+                     "secondary_install_priority";
+    }
+    for (const auto &group : groups) {
+      if (group.size() < 2) {
+        continue;
+      }
+      std::vector<SecondaryInterface *> recipients;
+      for (const size_t i : group) {
+        recipients.push_back(std::get<2>(jobs[i]));
+      }
+      const auto results = fanOutImage(*std::get<0>(jobs[group.front()]), recipients);
+      for (const size_t i : group) {
+        const auto result = results.find(std::get<1>(jobs[i]));
+        if (result == results.end()) {
+          continue;
+        }
+        if (result->second.isSuccess()) {
+          // Only installed by sendFirmwareAsync(), like a streamed image.
+          std::lock_guard<std::mutex> guard(streamed_mutex_);
+          streamed_images_.erase(std::get<1>(jobs[i]));
+          streamed_images_.emplace(std::get<1>(jobs[i]), *std::get<0>(jobs[i]));
+        } else {
+          // Prepares the Secondary for the image sent again below, which resumes the upload if it can.
+          try {
+            const auto put_result = std::get<2>(jobs[i])->putMetadata(*std::get<0>(jobs[i]));
+            if (!put_result.isSuccess()) {
+              LOG_WARNING << "Secondary " << std::get<1>(jobs[i])
+                          << " rejected the metadata again: " << put_result.description;
+            }
+          } catch (const std::exception &e) {
+            LOG_WARNING << "Could not send the metadata to Secondary " << std::get<1>(jobs[i])
+                        << " again: " << e.what();
+          }
+        }
+      }
+    }
+  }
+
+  ThreadPool pool(std::min<size_t>(jobs.size(), config.uptane.secondary_install_threads));
+  std::vector<std::string> bus_limits;
+  if (!config.uptane.secondary_bus_limits.empty()) {
+    boost::split(bus_limits, config.uptane.secondary_bus_limits, boost::is_any_of(","));
+  }
+  for (const auto &bus_limit : bus_limits) {
+    const auto sep = bus_limit.rfind(':');
+    try {
+      if (sep == std::string::npos) {
+        throw std::invalid_argument("missing ':'");
+      }
+      pool.setGroupLimit(bus_limit.substr(0, sep), std::stoul(bus_limit.substr(sep + 1)));
+    } catch (const std::exception &ex) {
+      LOG_WARNING << "Ignoring invalid Secondary bus limit \"" << bus_limit << "\": " << ex.what();
+    }
+  }
+
+  // Submit by priority so that the first workers already pick the most
+  // critical ECUs, but keep the reports in the original order.
+  std::vector<size_t> submit_order(jobs.size());
+  std::vector<int> priorities(jobs.size());
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    submit_order[i] = i;
+    priorities[i] = priority_of(std::get<1>(jobs[i]));
+  }
+  std::stable_sort(submit_order.begin(), submit_order.end(),
+                   [&priorities](size_t a, size_t b) { return priorities[a] > priorities[b]; });
+  std::vector<std::future<data::InstallationResult>> futures(jobs.size());
+  for (const size_t i : submit_order) {
+    const Uptane::EcuSerial &serial = std::get<1>(jobs[i]);
+    const bool streamed = wasStreamed(*std::get<0>(jobs[i]), serial);
+    futures[i] = sendFirmwareAsync(pool, *std::get<2>(jobs[i]), *std::get<0>(jobs[i]), priorities[i], streamed);
+  }
+  {
+    // Streamed images are installed at most once, they are sent again after a failure.
+    std::lock_guard<std::mutex> guard(streamed_mutex_);
+    for (const auto &job : jobs) {
+      streamed_images_.erase(std::get<1>(job));
+    }
+  }
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    firmwareFutures.emplace_back(
+        result::Install::EcuReport(*std::get<0>(jobs[i]), std::get<1>(jobs[i]), data::InstallationResult()),
+        std::move(futures[i]));
   }
 
   for (auto &f : firmwareFutures) {
@@ -1450,7 +1943,9 @@ std::vector<result::Install::EcuReport> SotaUptaneClient::sendImagesToEcus(const
       f.first.update.setCorrelationId(director_repo.getCorrelationId());
       auto update_mode =
           fut_result.isSuccess() ? InstalledVersionUpdateMode::kCurrent : InstalledVersionUpdateMode::kPending;
-      storage->saveInstalledVersion(f.first.serial.ToString(), f.first.update, update_mode);
+      // The Secondary reports what it runs, which for a delta is the image it produced.
+      storage->saveInstalledVersion(f.first.serial.ToString(), binary_delta::installedTarget(f.first.update),
+                                    update_mode);
     }
 
     f.first.install_res = fut_result;
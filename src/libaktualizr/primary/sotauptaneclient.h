@@ -29,10 +29,14 @@
 #include "libaktualizr/utilities/apiqueue.h"
 #include "primary/secondary_provider_builder.h"
 #include "provisioner.h"
+#include "targetprefetcher.h"
 #include "uptane/directorrepository.h"
 #include "uptane/iterator.h"
 #include "uptane/manifest.h"
 
+class OstreeMirror;
+class ThreadPool;
+
 class SotaUptaneClient {
  public:
   /**
@@ -90,6 +94,9 @@ class SotaUptaneClient {
   std::vector<Uptane::Target> getStoredTargets() const { return package_manager_->getTargetFiles(); }
   void deleteStoredTarget(const Uptane::Target &target) { package_manager_->removeTargetFile(target); }
   std::ifstream openStoredTarget(const Uptane::Target &target);
+  /** Pause or resume the background download of an update, see uptane.prefetch_targets. */
+  void pausePrefetch(bool do_pause);
+  void stopPrefetch();
 
  private:
   FRIEND_TEST(Aktualizr, FullNoUpdates);
@@ -124,6 +131,8 @@ class SotaUptaneClient {
   FRIEND_TEST(MetadataExpirationTest, MetadataExpirationAfterInstallationAndBeforeReboot);
   FRIEND_TEST(MetadataExpirationTest, MetadataExpirationBeforeInstallation);
   FRIEND_TEST(Delegation, IterateAll);
+  // Drives the individual update steps in benchmarks/metadata_benchmark.cc.
+  friend class SotaUptaneClientBenchmark;
 
   /**
    * This operation requires that the device is provisioned.
@@ -142,6 +151,15 @@ class SotaUptaneClient {
   data::InstallationResult PackageInstall(const Uptane::Target &target);
   std::pair<bool, Uptane::Target> downloadImage(const Uptane::Target &target,
                                                 const api::FlowControlToken *token = nullptr);
+  // Downloads a Secondary image while forwarding it to the Secondaries, see
+  // uptane.secondary_stream_firmware. Returns none if they can't receive it so.
+  boost::optional<bool> streamImage(const Uptane::Target &target, const FetcherProgressCb &progress_cb,
+                                    const api::FlowControlToken *token);
+  bool wasStreamed(const Uptane::Target &target, const Uptane::EcuSerial &serial);
+  // Sends an image to several Secondaries at once, see uptane.secondary_fan_out.
+  // Returns the result for each Secondary that took part.
+  std::map<Uptane::EcuSerial, data::InstallationResult> fanOutImage(
+      const Uptane::Target &target, const std::vector<SecondaryInterface *> &recipients);
   void uptaneIteration(std::vector<Uptane::Target> *targets, unsigned int *ecus_count);
   void uptaneOfflineIteration(std::vector<Uptane::Target> *targets, unsigned int *ecus_count);
   result::UpdateCheck checkUpdates();
@@ -164,10 +182,24 @@ class SotaUptaneClient {
   void reportAktualizrConfiguration();
   bool waitSecondariesReachable(const std::vector<Uptane::Target> &updates);
   void storeInstallationFailure(const data::InstallationResult &result);
-  data::InstallationResult rotateSecondaryRoot(Uptane::RepositoryType repo, SecondaryInterface &secondary);
+  // Root metadata of one repository, shared by all the Secondaries that need
+  // to be rotated to the latest version. Intermediate versions are only loaded
+  // when a Secondary is behind.
+  struct RootChain {
+    bool loaded{false};
+    int latest_version{-1};
+    std::map<int, std::string> intermediate;  // empty if the version could not be loaded
+    std::mutex m;
+  };
+  void loadRootChain(Uptane::RepositoryType repo, RootChain &chain);
+  const std::string *intermediateRoot(Uptane::RepositoryType repo, RootChain &chain, int version);
+  data::InstallationResult rotateSecondaryRoot(Uptane::RepositoryType repo, RootChain &chain,
+                                               SecondaryInterface &secondary);
   void sendMetadataToEcus(const std::vector<Uptane::Target> &targets, data::InstallationResult *result,
                           std::string *raw_installation_report);
-  std::future<data::InstallationResult> sendFirmwareAsync(SecondaryInterface &secondary, const Uptane::Target &target);
+  std::future<data::InstallationResult> sendFirmwareAsync(ThreadPool &pool, SecondaryInterface &secondary,
+                                                          const Uptane::Target &target, int priority,
+                                                          bool streamed = false);
   std::vector<result::Install::EcuReport> sendImagesToEcus(const std::vector<Uptane::Target> &targets);
 
   bool putManifestSimple(const Json::Value &custom = Json::nullValue);
@@ -182,6 +214,7 @@ class SotaUptaneClient {
   std::unique_ptr<Uptane::Target> findTargetHelper(const Uptane::Targets &cur_targets,
                                                    const Uptane::Target &queried_target, int level, bool terminating,
                                                    bool offline);
+  ThreadPool &delegationPool();
   Uptane::LazyTargetsList allTargets() const;
   void checkAndUpdatePendingSecondaries();
   Uptane::EcuSerial primaryEcuSerial() { return provisioner_.PrimaryEcuSerial(); }
@@ -210,13 +243,24 @@ class SotaUptaneClient {
   std::shared_ptr<Uptane::Fetcher> uptane_fetcher;
   std::unique_ptr<ReportQueue> report_queue;
   std::shared_ptr<SecondaryProvider> secondary_provider_;
+  // Only set up with OSTree support, see pacman.ostree_mirror_address.
+  std::shared_ptr<OstreeMirror> ostree_mirror_;
   std::shared_ptr<event::Channel> events_channel;
   std::exception_ptr last_exception;
   // ecu_serial => secondary*
   std::map<Uptane::EcuSerial, SecondaryInterface::Ptr> secondaries;
   std::mutex download_mutex;
+  // Images that Secondaries already received while they were downloaded.
+  std::map<Uptane::EcuSerial, Uptane::Target> streamed_images_;
+  std::mutex streamed_mutex_;
   Provisioner provisioner_;
   Json::Value custom_hardware_info_{Json::nullValue};
+  // Fetches sibling delegations ahead of the target search, at every level of
+  // the tree. Created on first use.
+  std::shared_ptr<ThreadPool> delegation_pool_;
+  std::once_flag delegation_pool_once_;
+  // Declared last so that it stops before what it uses is destroyed.
+  std::unique_ptr<TargetPrefetcher> prefetcher_;
 };
 
 #endif  // SOTA_UPTANE_CLIENT_H_
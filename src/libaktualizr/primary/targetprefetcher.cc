@@ -0,0 +1,79 @@
+#include "targetprefetcher.h"
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "libaktualizr/logging/logging.h"
+
+// Added to the nice value of the prefetch thread.
+static constexpr int kNiceIncrement = 10;
+
+// On Linux the nice value is per thread, this only slows down the prefetch.
+static void lowerThreadPriority() {
+  const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+  errno = 0;
+  const int nice_value = getpriority(PRIO_PROCESS, tid);
+  if (errno != 0 || setpriority(PRIO_PROCESS, tid, nice_value + kNiceIncrement) != 0) {
+    LOG_DEBUG << "Could not lower the priority of the prefetch: " << std::strerror(errno);
+  }
+}
+
+TargetPrefetcher::TargetPrefetcher(Fetch fetch) : fetch_(std::move(fetch)) {}
+
+TargetPrefetcher::~TargetPrefetcher() { stop(); }
+
+void TargetPrefetcher::start(std::vector<Uptane::Target> targets) {
+  std::lock_guard<std::mutex> guard(m_);
+  stopLocked();
+  running_ = true;
+  thread_ = std::thread([this, targets]() {
+    run(targets);
+    running_ = false;
+  });
+}
+
+void TargetPrefetcher::pause(bool do_pause) {
+  std::lock_guard<std::mutex> guard(m_);
+  paused_ = do_pause;
+  token_.setPause(do_pause);
+}
+
+void TargetPrefetcher::stop() {
+  std::lock_guard<std::mutex> guard(m_);
+  stopLocked();
+}
+
+bool TargetPrefetcher::running() const { return running_; }
+
+void TargetPrefetcher::stopLocked() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  token_.setAbort();
+  thread_.join();
+  token_.reset();
+  if (paused_) {
+    token_.setPause(true);
+  }
+}
+
+void TargetPrefetcher::run(const std::vector<Uptane::Target> &targets) {
+  lowerThreadPriority();
+  for (const auto &target : targets) {
+    // Waits while paused.
+    if (!token_.canContinue()) {
+      LOG_INFO << "Prefetch of the update stopped";
+      return;
+    }
+    LOG_INFO << "Prefetching " << target.filename();
+    if (fetch_(target, &token_)) {
+      LOG_INFO << "Prefetched " << target.filename();
+    } else if (token_.canContinue(false)) {
+      LOG_WARNING << "Could not prefetch " << target.filename() << ", it will be downloaded with the update";
+    }
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef PRIMARY_TARGETPREFETCHER_H_
+#define PRIMARY_TARGETPREFETCHER_H_
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "libaktualizr/types.h"
+#include "libaktualizr/utilities/apiqueue.h"
+
+/**
+ * Downloads the targets of an update in the background, before the user or a
+ * campaign has accepted it, so that the download started later only has to
+ * finish or verify them. Targets are fetched one after the other by a thread
+ * with a lower CPU priority. The prefetch stops as soon as a foreground
+ * download needs the link, and follows the pause state of the API.
+ */
+class TargetPrefetcher {
+ public:
+  /**
+   * Downloads a target, checking `token` regularly; returns true if it is
+   * stored. It can also skip the target, for instance when it doesn't fit in
+   * the storage quota of the prefetch.
+   */
+  using Fetch = std::function<bool(const Uptane::Target &, const api::FlowControlToken *)>;
+
+  explicit TargetPrefetcher(Fetch fetch);
+  ~TargetPrefetcher();
+  TargetPrefetcher(const TargetPrefetcher &) = delete;
+  TargetPrefetcher(TargetPrefetcher &&) = delete;
+  TargetPrefetcher &operator=(const TargetPrefetcher &) = delete;
+  TargetPrefetcher &operator=(TargetPrefetcher &&) = delete;
+
+  /** Prefetch `targets`, replacing the prefetch in progress, if any. */
+  void start(std::vector<Uptane::Target> targets);
+  void pause(bool do_pause);
+  /** Abort the prefetch in progress and wait for it to end. */
+  void stop();
+  /** Whether a prefetch is in progress, paused or not. */
+  bool running() const;
+
+ private:
+  void run(const std::vector<Uptane::Target> &targets);
+  void stopLocked();
+
+  const Fetch fetch_;
+  api::FlowControlToken token_;
+  bool paused_{false};
+  std::atomic_bool running_{false};
+  std::thread thread_;
+  // Serializes start(), pause() and stop().
+  std::mutex m_;
+};
+
+#endif  // PRIMARY_TARGETPREFETCHER_H_
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "primary/targetprefetcher.h"
+
+static Uptane::Target makeTarget(const std::string &name, uint64_t length) {
+  Json::Value target_json;
+  target_json["hashes"]["sha256"] = std::string(64, '0');
+  target_json["length"] = static_cast<Json::UInt64>(length);
+  return Uptane::Target(name, target_json);
+}
+
+static void waitUntilDone(const TargetPrefetcher &prefetcher) {
+  for (int i = 0; i < 500 && prefetcher.running(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_FALSE(prefetcher.running());
+}
+
+/* Targets are fetched in order, also after one that was skipped or could not be fetched. */
+TEST(TargetPrefetcher, Order) {
+  std::vector<std::string> fetched;
+  TargetPrefetcher prefetcher([&fetched](const Uptane::Target &target, const api::FlowControlToken *token) {
+    (void)token;
+    fetched.push_back(target.filename());
+    return target.filename() != "b";
+  });
+  prefetcher.start({makeTarget("a", 100), makeTarget("b", 300), makeTarget("c", 50)});
+  waitUntilDone(prefetcher);
+  EXPECT_EQ(fetched, (std::vector<std::string>{"a", "b", "c"}));
+}
+
+/* Nothing is fetched while paused, and stopping aborts the target being fetched. */
+TEST(TargetPrefetcher, PauseAndStop) {
+  std::mutex m;
+  std::vector<std::string> fetched;
+  std::promise<void> started;
+  TargetPrefetcher prefetcher([&](const Uptane::Target &target, const api::FlowControlToken *token) -> bool {
+    {
+      std::lock_guard<std::mutex> guard(m);
+      fetched.push_back(target.filename());
+    }
+    started.set_value();
+    // Downloads until aborted.
+    while (token->canContinue()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+  });
+
+  prefetcher.pause(true);
+  prefetcher.start({makeTarget("a", 100), makeTarget("b", 100)});
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_TRUE(prefetcher.running());
+  {
+    std::lock_guard<std::mutex> guard(m);
+    EXPECT_TRUE(fetched.empty());
+  }
+
+  prefetcher.pause(false);
+  EXPECT_EQ(started.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  prefetcher.stop();
+  EXPECT_FALSE(prefetcher.running());
+  EXPECT_EQ(fetched, std::vector<std::string>{"a"});
+}
+
+/* A new prefetch replaces the one in progress. */
+TEST(TargetPrefetcher, Restart) {
+  std::mutex m;
+  std::vector<std::string> fetched;
+  TargetPrefetcher prefetcher([&](const Uptane::Target &target, const api::FlowControlToken *token) -> bool {
+    {
+      std::lock_guard<std::mutex> guard(m);
+      fetched.push_back(target.filename());
+    }
+    // The first target takes until the prefetch is stopped.
+    while (target.filename() == "a" && token->canContinue()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return token->canContinue();
+  });
+
+  prefetcher.start({makeTarget("a", 100), makeTarget("b", 100)});
+  for (int i = 0; i < 500; ++i) {
+    {
+      std::lock_guard<std::mutex> guard(m);
+      if (!fetched.empty()) {
+        break;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  prefetcher.start({makeTarget("c", 100)});
+  waitUntilDone(prefetcher);
+  EXPECT_EQ(fetched, (std::vector<std::string>{"a", "c"}));
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
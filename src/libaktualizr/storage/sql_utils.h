@@ -13,6 +13,13 @@
 #include <sqlite3.h>
 
 #include "libaktualizr/logging/logging.h"
+#include "libaktualizr/metrics.h"
+
+inline metrics::Histogram& sqliteLatency() {
+  static metrics::Histogram& histogram = metrics::Registry::global().histogram(
+      "aktualizr_sqlite_operation_seconds", "Time taken by SQLite statements", metrics::latencyBuckets());
+  return histogram;
+}
 
 // Unique ownership SQLite3 statement creation
 
@@ -48,7 +55,10 @@ class SQLiteStatement {
   }
 
   inline sqlite3_stmt* get() const { return stmt_.get(); }
-  inline int step() const { return sqlite3_step(stmt_.get()); }
+  inline int step() const {
+    metrics::ScopedTimer timer(sqliteLatency());
+    return sqlite3_step(stmt_.get());
+  }
 
   // get results
   inline boost::optional<std::string> get_result_col_blob(int iCol) {
@@ -168,6 +178,7 @@ class SQLite3Guard {
   SQLite3Guard& operator=(SQLite3Guard&&) = delete;
 
   int exec(const char* sql, int (*callback)(void*, int, char**, char**), void* cb_arg) {
+    metrics::ScopedTimer timer(sqliteLatency());
     return sqlite3_exec(handle_.get(), sql, callback, cb_arg, nullptr);
   }
 
@@ -10,6 +10,7 @@
 
 #include "libaktualizr/logging/logging.h"
 #include "sql_utils.h"
+#include "utilities/tracer.h"
 #include "libaktualizr/utilities/utils.h"
 
 // Max events stored in the database, waiting to be sent
@@ -511,6 +512,7 @@ bool SQLStorage::loadTlsPkey(std::string* pkey) const {
 }
 
 void SQLStorage::storeRoot(const std::string& data, Uptane::RepositoryType repo, Uptane::Version version) {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
 
   db.beginTransaction();
@@ -537,6 +539,7 @@ void SQLStorage::storeRoot(const std::string& data, Uptane::RepositoryType repo,
 }
 
 void SQLStorage::storeNonRoot(const std::string& data, Uptane::RepositoryType repo, const Uptane::Role role) {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
 
   LOG_DEBUG << "Storing " << role << " for " << repo << " repo in SQL storage";
@@ -563,6 +566,7 @@ void SQLStorage::storeNonRoot(const std::string& data, Uptane::RepositoryType re
 }
 
 bool SQLStorage::loadRoot(std::string* data, Uptane::RepositoryType repo, Uptane::Version version) const {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
 
   // version < 0 => latest metadata requested
@@ -612,6 +616,7 @@ bool SQLStorage::loadRoot(std::string* data, Uptane::RepositoryType repo, Uptane
 }
 
 bool SQLStorage::loadNonRoot(std::string* data, Uptane::RepositoryType repo, const Uptane::Role role) const {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
 
   auto statement = db.prepareStatement<int, int>(
@@ -654,6 +659,7 @@ void SQLStorage::clearMetadata() {
 }
 
 void SQLStorage::storeDelegation(const std::string& data, const Uptane::Role role) {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
 
   auto statement = db.prepareStatement<SQLBlob, std::string>("INSERT OR REPLACE INTO delegations VALUES (?, ?);",
@@ -665,6 +671,7 @@ void SQLStorage::storeDelegation(const std::string& data, const Uptane::Role rol
 }
 
 bool SQLStorage::loadDelegation(std::string* data, const Uptane::Role role) const {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
 
   auto statement =
@@ -972,6 +979,7 @@ void SQLStorage::clearEcuSerials() {
 }
 
 void SQLStorage::storeCachedEcuManifest(const Uptane::EcuSerial& ecu_serial, const std::string& manifest) {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
 
   auto statement = db.prepareStatement<std::string, std::string>(
@@ -983,6 +991,7 @@ void SQLStorage::storeCachedEcuManifest(const Uptane::EcuSerial& ecu_serial, con
 }
 
 bool SQLStorage::loadCachedEcuManifest(const Uptane::EcuSerial& ecu_serial, std::string* manifest) const {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
 
   std::string stmanifest;
@@ -1061,6 +1070,7 @@ void SQLStorage::clearMisconfiguredEcus() {
 
 void SQLStorage::saveInstalledVersion(const std::string& ecu_serial, const Uptane::Target& target,
                                       InstalledVersionUpdateMode update_mode) {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
 
   db.beginTransaction();
@@ -1181,6 +1191,7 @@ static void loadEcuMap(SQLite3Guard& db, std::string& ecu_serial, Uptane::EcuMap
 
 bool SQLStorage::loadInstallationLog(const std::string& ecu_serial, std::vector<Uptane::Target>* log,
                                      bool only_installed) const {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
 
   std::string ecu_serial_real = ecu_serial;
@@ -1260,6 +1271,7 @@ bool SQLStorage::loadInstallationLog(const std::string& ecu_serial, std::vector<
 
 bool SQLStorage::loadInstalledVersions(const std::string& ecu_serial, boost::optional<Uptane::Target>* current_version,
                                        boost::optional<Uptane::Target>* pending_version) const {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
 
   std::string ecu_serial_real = ecu_serial;
@@ -1390,6 +1402,7 @@ void SQLStorage::clearInstalledVersions() {
 
 void SQLStorage::saveEcuInstallationResult(const Uptane::EcuSerial& ecu_serial,
                                            const data::InstallationResult& result) {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
 
   auto statement = db.prepareStatement<std::string, int, std::string, std::string>(
@@ -1445,6 +1458,7 @@ bool SQLStorage::loadEcuInstallationResults(
 
 void SQLStorage::storeDeviceInstallationResult(const data::InstallationResult& result, const std::string& raw_report,
                                                const std::string& correlation_id) {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
 
   auto statement = db.prepareStatement<int, std::string, std::string, std::string, std::string>(
@@ -1566,6 +1580,7 @@ bool SQLStorage::loadEcuReportCounter(std::vector<std::pair<Uptane::EcuSerial, i
 }
 
 void SQLStorage::saveReportEvent(const Json::Value& json_value) {
+  TRACE_FUNCTION("storage");
   std::string json_string = Utils::jsonToCanonicalStr(json_value);
   SQLite3Guard db = dbConnection();
   auto statement = db.prepareStatement<std::string>(
@@ -1595,6 +1610,7 @@ void SQLStorage::saveReportEvent(const Json::Value& json_value) {
 }
 
 bool SQLStorage::loadReportEvents(Json::Value* report_array, int64_t* id_max, int limit) const {
+  TRACE_FUNCTION("storage");
   SQLite3Guard db = dbConnection();
   auto statement = db.prepareStatement<int>("SELECT id, json_string FROM report_events LIMIT ?;", limit);
   int statement_result = statement.step();
@@ -1,13 +1,104 @@
 #include "libaktualizr/uptane/imagerepository.h"
 
+#include <algorithm>
+
 #include "libaktualizr/crypto/crypto.h"
 #include "libaktualizr/logging/logging.h"
+#include "libaktualizr/metrics.h"
 #include "libaktualizr/storage/invstorage.h"
 #include "libaktualizr/uptane/exceptions.h"
 #include "libaktualizr/uptane/fetcher.h"
 
 namespace Uptane {
 
+namespace {
+
+bool isSupported(const Hash& hash) { return hash.type() == Hash::Type::kSha256 || hash.type() == Hash::Type::kSha512; }
+
+const Hash* findHash(const std::vector<Hash>& hashes, Hash::Type type) {
+  for (const auto& it : hashes) {
+    if (it.type() == type) {
+      return &it;
+    }
+  }
+  return nullptr;
+}
+
+// Hashes of the canonical form of some metadata, of the types listed for it in Timestamp or Snapshot metadata.
+std::vector<Hash> canonicalHashes(const std::string& canonical, const std::vector<Hash>& expected) {
+  std::vector<Hash> hashes;
+  for (const auto& it : expected) {
+    if (isSupported(it) && findHash(hashes, it.type()) == nullptr) {
+      hashes.push_back(Hash::generate(it.type(), canonical));
+    }
+  }
+  return hashes;
+}
+
+bool hashesMatch(const std::vector<Hash>& hashes, const std::vector<Hash>& expected) {
+  for (const auto& it : expected) {
+    if (isSupported(it)) {
+      const Hash* hash = findHash(hashes, it.type());
+      if (hash == nullptr || *hash != it) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Process-wide counterparts of ImageRepository::VerifyStats.
+struct VerifyMetrics {
+  metrics::Counter& verified;
+  metrics::Counter& reused;
+  metrics::Histogram& time;
+};
+
+const VerifyMetrics& verifyMetrics() {
+  static const std::string name = "aktualizr_image_metadata_checks_total";
+  static const std::string help = "Image repo Snapshot and Targets metadata verified or reused";
+  static const VerifyMetrics verify_metrics{
+      metrics::Registry::global().counter(name, help, {{"result", "verified"}}),
+      metrics::Registry::global().counter(name, help, {{"result", "reused"}}),
+      metrics::Registry::global().histogram("aktualizr_image_metadata_check_seconds",
+                                            "Time taken to check Image repo Snapshot and Targets metadata",
+                                            metrics::latencyBuckets())};
+  return verify_metrics;
+}
+
+// Adds the time spent verifying a role to the total and to the metrics.
+class VerifyTimer {
+ public:
+  explicit VerifyTimer(std::chrono::microseconds& total) : total_(total), start_(std::chrono::steady_clock::now()) {}
+  ~VerifyTimer() {
+    const auto elapsed = std::chrono::steady_clock::now() - start_;
+    total_ += std::chrono::duration_cast<std::chrono::microseconds>(elapsed);
+    verifyMetrics().time.observe(std::chrono::duration<double>(elapsed).count());
+  }
+  VerifyTimer(const VerifyTimer&) = delete;
+  VerifyTimer(VerifyTimer&&) = delete;
+  VerifyTimer& operator=(const VerifyTimer&) = delete;
+  VerifyTimer& operator=(VerifyTimer&&) = delete;
+
+ private:
+  std::chrono::microseconds& total_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace
+
+template <typename T>
+bool ImageRepository::isVerified(const Verified<T>& verified, const std::string& raw_digest,
+                                 const std::vector<Hash>& expected) const {
+  // The signatures only need checking again if the Root changed, and the hashes if other types are expected.
+  if (verified.raw_digest != raw_digest || !(verified.root == root)) {
+    return false;
+  }
+  return std::all_of(expected.cbegin(), expected.cend(), [&verified](const Hash& hash) {
+    return !isSupported(hash) || findHash(verified.canonical_hashes, hash.type()) != nullptr;
+  });
+}
+
 void ImageRepository::resetMeta() {
   resetRoot();
   targets.reset();
@@ -54,44 +145,41 @@ void ImageRepository::fetchSnapshot(INvStorage& storage, const IMetadataFetcher&
 }
 
 void ImageRepository::verifySnapshot(const std::string& snapshot_raw, bool prefetch) {
-  const std::string canonical = Utils::jsonToCanonicalStr(Utils::parseJSON(snapshot_raw));
-  bool hash_exists = false;
-  for (const auto& it : timestamp.snapshot_hashes()) {
-    switch (it.type()) {
-      case Hash::Type::kSha256:
-        if (Hash(Hash::Type::kSha256, Crypto::sha256digestHex(canonical)) != it) {
-          if (!prefetch) {
-            LOG_ERROR << "Hash verification for Snapshot metadata failed";
-          }
-          throw Uptane::SecurityException(RepositoryType::IMAGE, "Snapshot metadata hash verification failed");
-        }
-        hash_exists = true;
-        break;
-      case Hash::Type::kSha512:
-        if (Hash(Hash::Type::kSha512, Crypto::sha512digestHex(canonical)) != it) {
-          if (!prefetch) {
-            LOG_ERROR << "Hash verification for Snapshot metadata failed";
-          }
-          throw Uptane::SecurityException(RepositoryType::IMAGE, "Snapshot metadata hash verification failed");
-        }
-        hash_exists = true;
-        break;
-      default:
-        break;
-    }
+  const VerifyTimer timer(verify_stats_.time);
+  const std::vector<Hash>& expected = timestamp.snapshot_hashes();
+  if (std::none_of(expected.cbegin(), expected.cend(), isSupported)) {
+    LOG_ERROR << "No hash found for snapshot.json";
+    throw Uptane::SecurityException(RepositoryType::IMAGE, "Snapshot metadata hash verification failed");
   }
 
-  if (!hash_exists) {
-    LOG_ERROR << "No hash found for snapshot.json";
+  const std::string raw_digest = Crypto::sha256digest(snapshot_raw);
+  const bool reuse = isVerified(verified_snapshot_, raw_digest, expected);
+  const std::vector<Hash> hashes =
+      reuse ? verified_snapshot_.canonical_hashes
+            : canonicalHashes(Utils::jsonToCanonicalStr(Utils::parseJSON(snapshot_raw)), expected);
+  if (!hashesMatch(hashes, expected)) {
+    if (!prefetch) {
+      LOG_ERROR << "Hash verification for Snapshot metadata failed";
+    }
     throw Uptane::SecurityException(RepositoryType::IMAGE, "Snapshot metadata hash verification failed");
   }
 
-  try {
-    // Verify the signature:
-    snapshot = Snapshot(RepositoryType::Image(), Utils::parseJSON(snapshot_raw), std::make_shared<MetaWithKeys>(root));
-  } catch (const Exception& e) {
-    LOG_ERROR << "Signature verification for Snapshot metadata failed";
-    throw;
+  if (reuse) {
+    snapshot = verified_snapshot_.meta;
+    ++verify_stats_.reused;
+    verifyMetrics().reused.inc();
+  } else {
+    try {
+      // Verify the signature:
+      snapshot =
+          Snapshot(RepositoryType::Image(), Utils::parseJSON(snapshot_raw), std::make_shared<MetaWithKeys>(root));
+    } catch (const Exception& e) {
+      LOG_ERROR << "Signature verification for Snapshot metadata failed";
+      throw;
+    }
+    verified_snapshot_ = Verified<Snapshot>{raw_digest, root, hashes, snapshot};
+    ++verify_stats_.verified;
+    verifyMetrics().verified.inc();
   }
 
   if (snapshot.version() != timestamp.snapshot_version()) {
@@ -128,35 +216,22 @@ void ImageRepository::fetchTargets(INvStorage& storage, const IMetadataFetcher&
 }
 
 void ImageRepository::verifyRoleHashes(const std::string& role_data, const Uptane::Role& role, bool prefetch) const {
-  const std::string canonical = Utils::jsonToCanonicalStr(Utils::parseJSON(role_data));
   // Hashes are not required in snapshot metadata. If present, however, we may as well check them.
   // This provides no security benefit, but may help with fault detection.
-  for (const auto& it : snapshot.role_hashes(role)) {
-    switch (it.type()) {
-      case Hash::Type::kSha256:
-        if (Hash(Hash::Type::kSha256, Crypto::sha256digestHex(canonical)) != it) {
-          // If prefetch is true, it means we're checking a local copy of the metadata.
-          // Failures in that case just indicate we need to refresh it from the server, so
-          // we only actually log the error if the metadata comes directly from the server.
-          if (!prefetch) {
-            LOG_ERROR << "Hash verification for " << role << " metadata failed";
-          }
-          throw Uptane::SecurityException(RepositoryType::IMAGE,
-                                          "Snapshot hash mismatch for " + role.ToString() + " metadata");
-        }
-        break;
-      case Hash::Type::kSha512:
-        if (Hash(Hash::Type::kSha512, Crypto::sha512digestHex(canonical)) != it) {
-          if (!prefetch) {
-            LOG_ERROR << "Hash verification for " << role << " metadata failed";
-          }
-          throw Uptane::SecurityException(RepositoryType::IMAGE,
-                                          "Snapshot hash mismatch for " + role.ToString() + " metadata");
-        }
-        break;
-      default:
-        break;
+  const std::vector<Hash> expected = snapshot.role_hashes(role);
+  checkRoleHashes(canonicalHashes(Utils::jsonToCanonicalStr(Utils::parseJSON(role_data)), expected), role, prefetch);
+}
+
+void ImageRepository::checkRoleHashes(const std::vector<Hash>& hashes, const Uptane::Role& role, bool prefetch) const {
+  if (!hashesMatch(hashes, snapshot.role_hashes(role))) {
+    // If prefetch is true, it means we're checking a local copy of the metadata.
+    // Failures in that case just indicate we need to refresh it from the server, so
+    // we only actually log the error if the metadata comes directly from the server.
+    if (!prefetch) {
+      LOG_ERROR << "Hash verification for " << role << " metadata failed";
     }
+    throw Uptane::SecurityException(RepositoryType::IMAGE,
+                                    "Snapshot hash mismatch for " + role.ToString() + " metadata");
   }
 }
 
@@ -165,15 +240,28 @@ int ImageRepository::getRoleVersion(const Uptane::Role& role) const { return sna
 int64_t ImageRepository::getRoleSize(const Uptane::Role& role) const { return snapshot.role_size(role); }
 
 void ImageRepository::verifyTargets(const std::string& targets_raw, bool prefetch, bool hash_change_expected) {
+  const VerifyTimer timer(verify_stats_.time);
   try {
-    verifyRoleHashes(targets_raw, Uptane::Role::Targets(), prefetch);
-
-    auto targets_json = Utils::parseJSON(targets_raw);
-
-    // Verify the signature:
-    auto signer = std::make_shared<MetaWithKeys>(root);
-    targets = std::make_shared<Uptane::Targets>(
-        Targets(RepositoryType::Image(), Uptane::Role::Targets(), targets_json, signer));
+    const std::vector<Hash> expected = snapshot.role_hashes(Uptane::Role::Targets());
+    const std::string raw_digest = Crypto::sha256digest(targets_raw);
+    if (isVerified(verified_targets_, raw_digest, expected)) {
+      checkRoleHashes(verified_targets_.canonical_hashes, Uptane::Role::Targets(), prefetch);
+      targets = verified_targets_.meta;
+      ++verify_stats_.reused;
+      verifyMetrics().reused.inc();
+    } else {
+      auto targets_json = Utils::parseJSON(targets_raw);
+      const std::vector<Hash> hashes = canonicalHashes(Utils::jsonToCanonicalStr(targets_json), expected);
+      checkRoleHashes(hashes, Uptane::Role::Targets(), prefetch);
+
+      // Verify the signature:
+      auto signer = std::make_shared<MetaWithKeys>(root);
+      targets = std::make_shared<Uptane::Targets>(
+          Targets(RepositoryType::Image(), Uptane::Role::Targets(), targets_json, signer));
+      verified_targets_ = Verified<std::shared_ptr<Uptane::Targets>>{raw_digest, root, hashes, targets};
+      ++verify_stats_.verified;
+      verifyMetrics().verified.inc();
+    }
 
     if (targets->version() != snapshot.role_version(Uptane::Role::Targets())) {
       throw Uptane::VersionMismatch(RepositoryType::IMAGE, Uptane::Role::TARGETS);
@@ -1,13 +1,28 @@
 #include "libaktualizr/uptane/tuf.h"
 
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <thread>
+#include <vector>
+
 #include <boost/algorithm/string/case_conv.hpp>
 
 #include "libaktualizr/logging/logging.h"
+#include "libaktualizr/metrics.h"
 #include "libaktualizr/uptane/exceptions.h"
 #include "libaktualizr/utilities/utils.h"
+#include "utilities/thread_pool.h"
 
 using Uptane::MetaWithKeys;
 
+// Shared by all metadata verification. Its tasks never wait for other tasks,
+// so it can be used from any thread, including from other pools.
+static ThreadPool &signaturePool() {
+  static ThreadPool pool(std::max(2U, std::min(4U, std::thread::hardware_concurrency())));
+  return pool;
+}
+
 MetaWithKeys::MetaWithKeys(const Json::Value &json) : BaseMeta(json) {}
 MetaWithKeys::MetaWithKeys(RepositoryType repo, const Role &role, const Json::Value &json,
                            const std::shared_ptr<MetaWithKeys> &signer)
@@ -61,6 +76,11 @@ void Uptane::MetaWithKeys::ParseRole(const RepositoryType repo, const Json::Valu
 
 void Uptane::MetaWithKeys::UnpackSignedObject(const RepositoryType repo, const Role &role,
                                               const Json::Value &signed_object) {
+  static metrics::Histogram &verification_time =
+      metrics::Registry::global().histogram("aktualizr_metadata_verification_seconds",
+                                            "Time taken to verify the signatures of a metadata object",
+                                            metrics::latencyBuckets());
+  metrics::ScopedTimer timer(verification_time);
   const std::string repository = repo;
 
   const Uptane::Role type(signed_object["signed"]["_type"].asString());
@@ -77,9 +97,16 @@ void Uptane::MetaWithKeys::UnpackSignedObject(const RepositoryType repo, const R
 
   const std::string canonical = Utils::jsonToCanonicalStr(signed_object["signed"]);
   const Json::Value signatures = signed_object["signatures"];
-  int valid_signatures = 0;
 
+  // Check all the signatures before verifying any of them, so that the
+  // verification of independent signatures can run in parallel.
   std::set<std::string> used_keyids;
+  struct Candidate {
+    std::string keyid;
+    std::string signature;
+    const PublicKey *key;
+  };
+  std::vector<Candidate> candidates;
   for (auto sig = signatures.begin(); sig != signatures.end(); ++sig) {
     const std::string keyid = (*sig)["keyid"].asString();
     if (used_keyids.count(keyid) != 0) {
@@ -94,7 +121,8 @@ void Uptane::MetaWithKeys::UnpackSignedObject(const RepositoryType repo, const R
       throw SecurityException(repository, std::string("Unsupported sign method: ") + (*sig)["method"].asString());
     }
 
-    if (keys_.count(keyid) == 0U) {
+    const auto key = keys_.find(keyid);
+    if (key == keys_.end()) {
       LOG_DEBUG << "Signed by unknown KeyId: " << keyid << ". Skipping.";
       continue;
     }
@@ -103,11 +131,35 @@ void Uptane::MetaWithKeys::UnpackSignedObject(const RepositoryType repo, const R
       LOG_WARNING << "KeyId " << keyid << " is not valid to sign for this role (" << role << ").";
       continue;
     }
-    const std::string signature = (*sig)["sig"].asString();
-    if (keys_[keyid].VerifySignature(signature, canonical)) {
+    candidates.push_back(Candidate{keyid, (*sig)["sig"].asString(), &key->second});
+  }
+
+  // The pool verifies all the signatures but the first one, which is verified
+  // on this thread in the meantime.
+  auto verify = [&canonical](const Candidate &candidate) {
+    return candidate.key->VerifySignature(candidate.signature, canonical);
+  };
+  std::vector<std::future<bool>> results;
+  if (!candidates.empty()) {
+    std::packaged_task<bool()> first(std::bind(verify, std::cref(candidates.front())));
+    results.push_back(first.get_future());
+    for (size_t i = 1; i < candidates.size(); ++i) {
+      results.push_back(signaturePool().submit(std::bind(verify, std::cref(candidates[i]))));
+    }
+    first();
+  }
+  // The tasks refer to local data, so let all of them finish before anything
+  // can throw.
+  for (auto &result : results) {
+    result.wait();
+  }
+  int valid_signatures = 0;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    if (results[i].get()) {
       valid_signatures++;
     } else {
-      LOG_WARNING << "Signature was present but invalid: " << signature << " with KeyId: " << keyid;
+      LOG_WARNING << "Signature was present but invalid: " << candidates[i].signature
+                  << " with KeyId: " << candidates[i].keyid;
     }
   }
   const int64_t threshold = thresholds_for_role_[role];
@@ -4,7 +4,9 @@
 #include <vector>
 
 #include <json/json.h>
+#include <boost/algorithm/hex.hpp>
 
+#include "libaktualizr/crypto/crypto.h"
 #include "libaktualizr/logging/logging.h"
 #include "libaktualizr/uptane/exceptions.h"
 #include "libaktualizr/utilities/utils.h"
@@ -60,6 +62,59 @@ TEST(Root, RootJsonRsassaPssSha256) {
   EXPECT_NO_THROW(Uptane::Root(Uptane::RepositoryType::Director(), initial_root, root));
 }
 
+/* Root metadata signed by `signers` of `num_keys` root keys, with the given threshold. */
+static Json::Value thresholdRoot(int num_keys, int threshold, int signers) {
+  Json::Value root;
+  root["signed"]["_type"] = "Root";
+  root["signed"]["expires"] = "2038-01-19T03:14:06Z";
+  root["signed"]["version"] = 1;
+  root["signed"]["roles"]["root"]["threshold"] = threshold;
+  std::vector<std::string> private_keys;
+  for (int i = 0; i < num_keys; ++i) {
+    std::string public_key;
+    std::string private_key;
+    Crypto::generateEDKeyPair(&public_key, &private_key);
+    const PublicKey key(public_key, KeyType::kED25519);
+    root["signed"]["keys"][key.KeyId()] = key.ToUptane();
+    root["signed"]["roles"]["root"]["keyids"].append(key.KeyId());
+    private_keys.push_back(private_key);
+  }
+  const std::string canonical = Utils::jsonToCanonicalStr(root["signed"]);
+  root["signatures"] = Json::arrayValue;
+  for (int i = 0; i < signers; ++i) {
+    Json::Value signature;
+    signature["keyid"] = root["signed"]["roles"]["root"]["keyids"][i];
+    signature["method"] = "ed25519";
+    signature["sig"] =
+        Utils::toBase64(Crypto::ED25519Sign(boost::algorithm::unhex(private_keys[static_cast<size_t>(i)]), canonical));
+    root["signatures"].append(signature);
+  }
+  return root;
+}
+
+/* Count the valid signatures of metadata against the threshold, whatever the
+ * order in which they are verified. */
+TEST(Root, SignatureThreshold) {
+  Uptane::Root accept_all(Uptane::Root::Policy::kAcceptAll);
+  const Json::Value valid = thresholdRoot(5, 3, 5);
+  EXPECT_NO_THROW(Uptane::Root(Uptane::RepositoryType::Image(), valid, accept_all));
+
+  EXPECT_NO_THROW(Uptane::Root(Uptane::RepositoryType::Image(), thresholdRoot(5, 3, 3), accept_all));
+  EXPECT_THROW(Uptane::Root(Uptane::RepositoryType::Image(), thresholdRoot(5, 3, 2), accept_all),
+               Uptane::UnmetThreshold);
+
+  Json::Value tampered = valid;
+  tampered["signatures"][0]["sig"] = tampered["signatures"][1]["sig"];
+  EXPECT_NO_THROW(Uptane::Root(Uptane::RepositoryType::Image(), tampered, accept_all));
+  tampered["signatures"][4]["sig"] = tampered["signatures"][1]["sig"];
+  tampered["signatures"][2]["sig"] = tampered["signatures"][1]["sig"];
+  EXPECT_THROW(Uptane::Root(Uptane::RepositoryType::Image(), tampered, accept_all), Uptane::UnmetThreshold);
+
+  Json::Value duplicated = valid;
+  duplicated["signatures"][3] = duplicated["signatures"][2];
+  EXPECT_THROW(Uptane::Root(Uptane::RepositoryType::Image(), duplicated, accept_all), Uptane::NonUniqueSignatures);
+}
+
 /* Validate TUF roles. */
 TEST(Role, ValidateRoles) {
   Uptane::Role root = Uptane::Role::Root();
@@ -1,8 +1,15 @@
 #include "libaktualizr/utilities/apiqueue.h"
 #include "libaktualizr/logging/logging.h"
+#include "libaktualizr/metrics.h"
 
 namespace api {
 
+static metrics::Gauge &queueDepth() {
+  static metrics::Gauge &gauge =
+      metrics::Registry::global().gauge("aktualizr_command_queue_depth", "API commands waiting to be run");
+  return gauge;
+}
+
 bool FlowControlToken::setPause(bool set_paused) {
   {
     std::lock_guard<std::mutex> lock(m_);
@@ -66,6 +73,7 @@ void CommandQueue::run() {
         }
         auto task = std::move(queue_.front());
         queue_.pop();
+        queueDepth().set(static_cast<double>(queue_.size()));
         lock.unlock();
         task->PerformTask(&ctx);
         lock.lock();
@@ -103,6 +111,7 @@ void CommandQueue::abort(bool restart_thread) {
       // Flush the queue and reset to initial state
       std::lock_guard<std::mutex> g(m_);
       std::queue<ICommand::Ptr>().swap(queue_);
+      queueDepth().set(0);
       token_.reset();
       shutdown_ = false;
     }
@@ -116,6 +125,7 @@ void CommandQueue::enqueue(ICommand::Ptr&& task) {
   {
     std::lock_guard<std::mutex> lock(m_);
     queue_.push(std::move(task));
+    queueDepth().set(static_cast<double>(queue_.size()));
   }
   cv_.notify_all();
 }
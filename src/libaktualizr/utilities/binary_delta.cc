@@ -0,0 +1,280 @@
+#include "utilities/binary_delta.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace binary_delta {
+
+namespace {
+
+constexpr char kMagic[] = "AKDELTA1";
+constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+constexpr uint8_t kEnd = 0x00;
+constexpr uint8_t kCopy = 0x01;
+constexpr uint8_t kInsert = 0x02;
+// Matches are looked up for blocks of this size, aligned in the source.
+constexpr size_t kBlockSize = 32;
+constexpr uint64_t kHashBase = 1099511628211ULL;
+
+void putVarint(std::string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+// Parses a varint at `pos`, advancing it. Returns false if more data is needed.
+bool getVarint(const std::string &in, size_t *pos, uint64_t *value) {
+  uint64_t result = 0;
+  for (unsigned int shift = 0; *pos + shift / 7 < in.size(); shift += 7) {
+    if (shift > 63) {
+      throw std::runtime_error("Invalid number in the delta");
+    }
+    const auto byte = static_cast<uint8_t>(in[*pos + shift / 7]);
+    result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      *pos += shift / 7 + 1;
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t blockHash(const char *data) {
+  uint64_t hash = 0;
+  for (size_t i = 0; i < kBlockSize; ++i) {
+    hash = hash * kHashBase + static_cast<uint8_t>(data[i]);
+  }
+  return hash;
+}
+
+}  // namespace
+
+std::string create(const std::string &source, const std::string &image) {
+  std::string delta(kMagic, kMagicSize);
+  putVarint(delta, source.size());
+  putVarint(delta, image.size());
+
+  std::unordered_map<uint64_t, size_t> blocks;
+  for (size_t offset = 0; offset + kBlockSize <= source.size(); offset += kBlockSize) {
+    blocks.emplace(blockHash(&source[offset]), offset);
+  }
+  // Weight of the byte leaving the window when the hash is rolled.
+  uint64_t top_weight = 1;
+  for (size_t i = 1; i < kBlockSize; ++i) {
+    top_weight *= kHashBase;
+  }
+
+  auto insert = [&delta, &image](size_t begin, size_t end) {
+    if (end > begin) {
+      delta.push_back(static_cast<char>(kInsert));
+      putVarint(delta, end - begin);
+      delta.append(image, begin, end - begin);
+    }
+  };
+
+  size_t literal_start = 0;
+  size_t pos = 0;
+  uint64_t hash = 0;
+  bool hash_valid = false;
+  while (pos + kBlockSize <= image.size()) {
+    if (!hash_valid) {
+      hash = blockHash(&image[pos]);
+      hash_valid = true;
+    }
+    const auto it = blocks.find(hash);
+    if (it != blocks.end() && std::memcmp(&source[it->second], &image[pos], kBlockSize) == 0) {
+      size_t src_begin = it->second;
+      size_t img_begin = pos;
+      while (img_begin > literal_start && src_begin > 0 && source[src_begin - 1] == image[img_begin - 1]) {
+        --src_begin;
+        --img_begin;
+      }
+      size_t img_end = pos + kBlockSize;
+      size_t src_end = it->second + kBlockSize;
+      while (img_end < image.size() && src_end < source.size() && source[src_end] == image[img_end]) {
+        ++src_end;
+        ++img_end;
+      }
+      insert(literal_start, img_begin);
+      delta.push_back(static_cast<char>(kCopy));
+      putVarint(delta, src_begin);
+      putVarint(delta, img_end - img_begin);
+      pos = img_end;
+      literal_start = img_end;
+      hash_valid = false;
+      continue;
+    }
+    if (pos + kBlockSize < image.size()) {
+      hash = (hash - top_weight * static_cast<uint8_t>(image[pos])) * kHashBase +
+             static_cast<uint8_t>(image[pos + kBlockSize]);
+    }
+    ++pos;
+  }
+  insert(literal_start, image.size());
+  delta.push_back(static_cast<char>(kEnd));
+  return delta;
+}
+
+boost::optional<TargetInfo> TargetInfo::fromTarget(const Uptane::Target &target) {
+  if (target.type() != kTargetFormat) {
+    return boost::none;
+  }
+  const Json::Value delta = target.custom_data()["delta"];
+  if (!delta.isObject() || !delta["source_sha256"].isString() || !delta["source_length"].isUInt64() ||
+      !delta["target"].isString() || delta["target"].asString().empty() || !delta["sha256"].isString() ||
+      !delta["length"].isUInt64()) {
+    throw std::runtime_error("Invalid delta description in target " + target.filename());
+  }
+  TargetInfo info;
+  info.source_sha256 = delta["source_sha256"].asString();
+  info.source_length = delta["source_length"].asUInt64();
+  info.target_name = delta["target"].asString();
+  info.sha256 = delta["sha256"].asString();
+  info.length = delta["length"].asUInt64();
+  return info;
+}
+
+Json::Value TargetInfo::toCustom() const {
+  Json::Value custom;
+  custom["targetFormat"] = kTargetFormat;
+  custom["delta"]["source_sha256"] = source_sha256;
+  custom["delta"]["source_length"] = static_cast<Json::UInt64>(source_length);
+  custom["delta"]["target"] = target_name;
+  custom["delta"]["sha256"] = sha256;
+  custom["delta"]["length"] = static_cast<Json::UInt64>(length);
+  return custom;
+}
+
+Uptane::Target installedTarget(const Uptane::Target &target) {
+  boost::optional<TargetInfo> delta;
+  try {
+    delta = TargetInfo::fromTarget(target);
+  } catch (const std::exception &) {
+    // ECUs refuse such a delta, so it never gets installed.
+    return target;
+  }
+  if (!delta) {
+    return target;
+  }
+  return Uptane::Target(delta->target_name, target.ecus(), {Hash(Hash::Type::kSha256, delta->sha256)}, delta->length,
+                        target.correlation_id());
+}
+
+Applier::Applier(const boost::filesystem::path &source, Output output) : Applier(source, 0, std::move(output)) {
+  source_length_ = boost::filesystem::file_size(source);
+}
+
+Applier::Applier(const boost::filesystem::path &source, uint64_t source_length, Output output)
+    : source_(source.string(), std::ios::binary), source_length_(source_length), output_(std::move(output)) {
+  if (!source_.good()) {
+    throw std::runtime_error("Unable to read the image to apply the delta to: " + source.string());
+  }
+}
+
+void Applier::feed(const uint8_t *data, size_t size) {
+  while (size > 0) {
+    if (state_ == State::kInsert) {
+      const auto part = static_cast<size_t>(std::min<uint64_t>(size, insert_remaining_));
+      emit(reinterpret_cast<const char *>(data), part);
+      data += part;
+      size -= part;
+      insert_remaining_ -= part;
+      if (insert_remaining_ == 0) {
+        state_ = State::kOperation;
+      }
+      continue;
+    }
+    if (state_ == State::kDone) {
+      throw std::runtime_error("Unexpected data after the end of the delta");
+    }
+    // Headers and operations are a few bytes long, so they are parsed whenever one more byte arrives.
+    pending_.push_back(static_cast<char>(*data));
+    ++data;
+    --size;
+    parsePending();
+  }
+}
+
+void Applier::parsePending() {
+  size_t pos = 0;
+  if (state_ == State::kHeader) {
+    if (pending_.size() <= kMagicSize) {
+      if (pending_.compare(0, pending_.size(), kMagic, pending_.size()) != 0) {
+        throw std::runtime_error("Not a binary delta");
+      }
+      return;
+    }
+    pos = kMagicSize;
+    uint64_t source_length;
+    if (!getVarint(pending_, &pos, &source_length) || !getVarint(pending_, &pos, &image_length_)) {
+      return;
+    }
+    if (source_length != source_length_) {
+      throw std::runtime_error("The delta applies to an image of " + std::to_string(source_length) +
+                               " bytes, but the installed one has " + std::to_string(source_length_));
+    }
+    state_ = State::kOperation;
+    pending_.clear();
+    return;
+  }
+
+  const auto operation = static_cast<uint8_t>(pending_[0]);
+  pos = 1;
+  if (operation == kEnd) {
+    if (written_ != image_length_) {
+      throw std::runtime_error("The delta produced " + std::to_string(written_) + " bytes instead of " +
+                               std::to_string(image_length_));
+    }
+    state_ = State::kDone;
+  } else if (operation == kCopy) {
+    uint64_t offset;
+    uint64_t length;
+    if (!getVarint(pending_, &pos, &offset) || !getVarint(pending_, &pos, &length)) {
+      return;
+    }
+    copy(offset, length);
+  } else if (operation == kInsert) {
+    if (!getVarint(pending_, &pos, &insert_remaining_)) {
+      return;
+    }
+    if (insert_remaining_ > 0) {
+      state_ = State::kInsert;
+    }
+  } else {
+    throw std::runtime_error("Unknown operation " + std::to_string(operation) + " in the delta");
+  }
+  pending_.clear();
+}
+
+void Applier::copy(uint64_t offset, uint64_t length) {
+  if (offset > source_length_ || length > source_length_ - offset) {
+    throw std::runtime_error("The delta refers to data beyond the end of the installed image");
+  }
+  source_.clear();
+  source_.seekg(static_cast<std::streamoff>(offset));
+  std::array<char, 64 * 1024> buf{};
+  while (length > 0) {
+    const auto part = static_cast<size_t>(std::min<uint64_t>(buf.size(), length));
+    if (!source_.read(buf.data(), static_cast<std::streamsize>(part))) {
+      throw std::runtime_error("Unable to read the installed image");
+    }
+    emit(buf.data(), part);
+    length -= part;
+  }
+}
+
+void Applier::emit(const char *data, size_t size) {
+  if (size > image_length_ - written_) {
+    throw std::runtime_error("The delta produces more data than announced");
+  }
+  output_(data, size);
+  written_ += size;
+}
+
+}  // namespace binary_delta
@@ -0,0 +1,91 @@
+#ifndef UTILITIES_BINARY_DELTA_H_
+#define UTILITIES_BINARY_DELTA_H_
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "libaktualizr/types.h"
+
+/**
+ * Binary deltas turn one image into another with a stream of operations that
+ * either copy a range of the old image or insert new data:
+ *
+ *   "AKDELTA1" <source length> <image length>
+ *   { 0x01 <offset> <length> | 0x02 <length> <data> }* 0x00
+ *
+ * All numbers are unsigned LEB128. A delta can be applied while it is being
+ * received, with random access to the old image only.
+ */
+namespace binary_delta {
+
+/** Create the delta from `source` to `image`. */
+std::string create(const std::string &source, const std::string &image);
+
+/**
+ * Delta targets have "targetFormat": "BINARY_DELTA". Their hashes and length
+ * are the ones of the delta file, and "custom"."delta" describes the image it
+ * applies to and the one it produces, including the name of the target for
+ * the latter.
+ */
+struct TargetInfo {
+  static constexpr const char *kTargetFormat = "BINARY_DELTA";
+
+  std::string source_sha256;
+  uint64_t source_length{0};
+  std::string target_name;
+  std::string sha256;
+  uint64_t length{0};
+
+  /** None if `target` is not a delta; throws if its delta description is invalid. */
+  static boost::optional<TargetInfo> fromTarget(const Uptane::Target &target);
+  /** Custom metadata for a delta target. */
+  Json::Value toCustom() const;
+};
+
+/**
+ * The target an ECU runs, and reports in its manifest, once `target` is
+ * installed: `target` itself, or the image a delta produces.
+ */
+Uptane::Target installedTarget(const Uptane::Target &target);
+
+/** Applies a delta received in pieces of any size. */
+class Applier {
+ public:
+  using Output = std::function<void(const char *data, size_t size)>;
+
+  /** Throws std::runtime_error if `source` can't be read. */
+  Applier(const boost::filesystem::path &source, Output output);
+  /** Only the first `source_length` bytes of `source` are the old image, e.g. on a partition. */
+  Applier(const boost::filesystem::path &source, uint64_t source_length, Output output);
+
+  /** Throws std::runtime_error if the delta is invalid or does not match the source. */
+  void feed(const uint8_t *data, size_t size);
+  /** The whole delta has been applied. */
+  bool finished() const { return state_ == State::kDone; }
+  uint64_t written() const { return written_; }
+
+ private:
+  enum class State { kHeader, kOperation, kInsert, kDone };
+
+  void parsePending();
+  void copy(uint64_t offset, uint64_t length);
+  void emit(const char *data, size_t size);
+
+  std::ifstream source_;
+  uint64_t source_length_;
+  Output output_;
+  State state_{State::kHeader};
+  std::string pending_;
+  uint64_t image_length_{0};
+  uint64_t insert_remaining_{0};
+  uint64_t written_{0};
+};
+
+}  // namespace binary_delta
+
+#endif  // UTILITIES_BINARY_DELTA_H_
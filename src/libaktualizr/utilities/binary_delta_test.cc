@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+
+#include "libaktualizr/utilities/utils.h"
+#include "utilities/binary_delta.h"
+
+static std::string randomData(std::mt19937 &rng, size_t size) {
+  std::string data(size, '\0');
+  for (auto &c : data) {
+    c = static_cast<char>(rng() & 0xFF);
+  }
+  return data;
+}
+
+/* Apply `delta` to the contents of `source`, feeding it `piece` bytes at a time. */
+static std::string apply(const boost::filesystem::path &source, const std::string &delta, size_t piece) {
+  std::string out;
+  binary_delta::Applier applier(source, [&out](const char *data, size_t size) { out.append(data, size); });
+  for (size_t offset = 0; offset < delta.size(); offset += piece) {
+    const size_t size = std::min(piece, delta.size() - offset);
+    applier.feed(reinterpret_cast<const uint8_t *>(delta.data()) + offset, size);
+  }
+  EXPECT_TRUE(applier.finished());
+  EXPECT_EQ(applier.written(), out.size());
+  return out;
+}
+
+/* A delta between similar images reproduces the new one and is much smaller. */
+TEST(BinaryDelta, RoundTrip) {
+  std::mt19937 rng(42);
+  const std::string source = randomData(rng, 200000);
+  std::string image = source.substr(1000, 50000) + randomData(rng, 3000) + source.substr(60000);
+  image[100000] = static_cast<char>(image[100000] ^ 0x55);
+  image += source.substr(0, 7000);
+
+  TemporaryDirectory temp_dir;
+  const auto source_path = temp_dir / "source";
+  Utils::writeFile(source_path, source);
+  const std::string delta = binary_delta::create(source, image);
+
+  EXPECT_LT(delta.size(), 5000);
+  EXPECT_EQ(apply(source_path, delta, 65536), image);
+  EXPECT_EQ(apply(source_path, delta, 1), image);
+}
+
+/* Empty and completely different images are handled too. */
+TEST(BinaryDelta, EdgeCases) {
+  std::mt19937 rng(7);
+  TemporaryDirectory temp_dir;
+  const auto source_path = temp_dir / "source";
+  Utils::writeFile(source_path, std::string());
+  const std::string image = randomData(rng, 1000);
+  EXPECT_EQ(apply(source_path, binary_delta::create("", image), 100), image);
+
+  const std::string source = randomData(rng, 1000);
+  Utils::writeFile(source_path, source);
+  EXPECT_EQ(apply(source_path, binary_delta::create(source, ""), 100), "");
+  EXPECT_EQ(apply(source_path, binary_delta::create(source, image), 100), image);
+}
+
+/* A delta for another image or a corrupted delta is rejected. */
+TEST(BinaryDelta, Invalid) {
+  std::mt19937 rng(1);
+  const std::string source = randomData(rng, 10000);
+  const std::string image = source.substr(0, 5000) + "new data" + source.substr(5000);
+  const std::string delta = binary_delta::create(source, image);
+  TemporaryDirectory temp_dir;
+  const auto source_path = temp_dir / "source";
+  auto ignore = [](const char *data, size_t size) {
+    (void)data;
+    (void)size;
+  };
+
+  Utils::writeFile(source_path, source.substr(1));
+  EXPECT_THROW(apply(source_path, delta, 100), std::runtime_error);
+
+  Utils::writeFile(source_path, source);
+  EXPECT_THROW(apply(source_path, "AKDELTA2", 100), std::runtime_error);
+  EXPECT_THROW(apply(source_path, delta + "x", 100), std::runtime_error);
+
+  // Header for 10000 -> 10 bytes, then a copy of 10 bytes at offset 9995.
+  const std::string bad_copy("AKDELTA1\x90\x4E\x0A\x01\x8B\x4E\x0A\x00", 16);
+  EXPECT_THROW(apply(source_path, bad_copy, 100), std::runtime_error);
+
+  binary_delta::Applier truncated(source_path, ignore);
+  truncated.feed(reinterpret_cast<const uint8_t *>(delta.data()), delta.size() - 1);
+  EXPECT_FALSE(truncated.finished());
+
+  EXPECT_THROW(binary_delta::Applier(temp_dir / "missing", ignore), std::runtime_error);
+}
+
+/* ECUs that installed a delta run, and report, the image target it names. */
+TEST(BinaryDelta, InstalledTarget) {
+  binary_delta::TargetInfo info;
+  info.source_sha256 = std::string(64, 'a');
+  info.source_length = 10;
+  info.target_name = "image-v2";
+  info.sha256 = std::string(64, 'b');
+  info.length = 20;
+  Json::Value delta_json;
+  delta_json["hashes"]["sha256"] = std::string(64, 'c');
+  delta_json["length"] = 5;
+  delta_json["custom"] = info.toCustom();
+  delta_json["custom"]["ecuIdentifiers"]["serial"]["hardwareId"] = "hwid";
+  Uptane::Target delta("image-v2.delta", delta_json);
+  delta.setCorrelationId("id");
+
+  const Uptane::Target installed = binary_delta::installedTarget(delta);
+  EXPECT_EQ(installed.filename(), "image-v2");
+  EXPECT_EQ(installed.length(), 20);
+  EXPECT_TRUE(installed.MatchHash(Hash(Hash::Type::kSha256, info.sha256)));
+  EXPECT_EQ(installed.ecus(), delta.ecus());
+  EXPECT_EQ(installed.correlation_id(), "id");
+  EXPECT_FALSE(binary_delta::TargetInfo::fromTarget(installed));
+
+  Json::Value image_json = delta_json;
+  image_json["custom"] = Json::Value();
+  const Uptane::Target image("image-v2", image_json);
+  EXPECT_TRUE(binary_delta::installedTarget(image).MatchTarget(image));
+
+  delta_json["custom"]["delta"].removeMember("target");
+  EXPECT_THROW(binary_delta::TargetInfo::fromTarget(Uptane::Target("broken", delta_json)), std::runtime_error);
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
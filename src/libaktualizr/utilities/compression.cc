@@ -0,0 +1,157 @@
+#include "utilities/compression.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace compression {
+
+namespace {
+
+// Compression ratio is checked every time this much input has been consumed.
+constexpr uint64_t kWindowSize = 1024 * 1024;
+// A window that compresses to more than 90% of its size is not worth the CPU time.
+constexpr uint64_t kPoorRatioPercent = 90;
+// Data is stored as is for 2, 4, ... up to this many windows before compression is tried again.
+constexpr unsigned int kMaxStoredWindows = 64;
+constexpr size_t kOutputPiece = 64 * 1024;
+
+std::string zlibError(const std::string &what, const z_stream &stream) {
+  return what + (stream.msg != nullptr ? std::string(": ") + stream.msg : std::string());
+}
+
+}  // namespace
+
+constexpr int Compressor::kMinLevel;
+constexpr int Compressor::kMaxLevel;
+
+struct Compressor::Stream {
+  z_stream z{};
+};
+
+struct Decompressor::Stream {
+  z_stream z{};
+};
+
+Compressor::Compressor(int level)
+    : stream_(new Stream()),
+      level_(std::min(std::max(level, kMinLevel), kMaxLevel)),
+      current_level_(level_) {
+  if (deflateInit(&stream_->z, level_) != Z_OK) {
+    throw std::runtime_error(zlibError("Unable to initialize compression", stream_->z));
+  }
+}
+
+Compressor::~Compressor() { deflateEnd(&stream_->z); }
+
+void Compressor::compress(const uint8_t *data, size_t size, std::string *out) {
+  const size_t out_start = out->size();
+  z_stream &z = stream_->z;
+  z.next_in = const_cast<Bytef *>(data);  // NOLINT(cppcoreguidelines-pro-type-const-cast)
+  z.avail_in = static_cast<uInt>(size);
+  // Every call ends with a sync flush, so the Secondary can decompress and
+  // write the data before the next piece arrives.
+  do {
+    const size_t offset = out->size();
+    out->resize(offset + std::max<size_t>(deflateBound(&z, z.avail_in), kOutputPiece));
+    z.next_out = reinterpret_cast<Bytef *>(&(*out)[offset]);
+    z.avail_out = static_cast<uInt>(out->size() - offset);
+    const int ret = deflate(&z, Z_SYNC_FLUSH);
+    out->resize(out->size() - z.avail_out);
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      throw std::runtime_error(zlibError("Compression failed", z));
+    }
+  } while (z.avail_in > 0 || z.avail_out == 0);
+
+  bytes_in_ += size;
+  bytes_out_ += out->size() - out_start;
+  window_in_ += size;
+  window_out_ += out->size() - out_start;
+  if (window_in_ >= kWindowSize) {
+    adapt(out);
+  }
+}
+
+void Compressor::adapt(std::string *out) {
+  if (current_level_ != Z_NO_COMPRESSION) {
+    if (window_out_ * 100 > window_in_ * kPoorRatioPercent) {
+      ++poor_windows_;
+      stored_windows_left_ = std::min(1U << std::min(poor_windows_, 31U), kMaxStoredWindows);
+      setLevel(Z_NO_COMPRESSION, out);
+    } else {
+      poor_windows_ = 0;
+    }
+  } else if (--stored_windows_left_ == 0) {
+    setLevel(level_, out);
+  }
+  window_in_ = 0;
+  window_out_ = 0;
+}
+
+void Compressor::setLevel(int level, std::string *out) {
+  z_stream &z = stream_->z;
+  const size_t out_start = out->size();
+  int ret;
+  // Changing the level may flush a block, for which deflateParams() needs room.
+  do {
+    const size_t offset = out->size();
+    out->resize(offset + kOutputPiece);
+    z.next_in = nullptr;
+    z.avail_in = 0;
+    z.next_out = reinterpret_cast<Bytef *>(&(*out)[offset]);
+    z.avail_out = static_cast<uInt>(kOutputPiece);
+    ret = deflateParams(&z, level, Z_DEFAULT_STRATEGY);
+    out->resize(out->size() - z.avail_out);
+  } while (ret == Z_BUF_ERROR && z.avail_out == 0);
+  if (ret != Z_OK && ret != Z_BUF_ERROR) {
+    throw std::runtime_error(zlibError("Unable to change the compression level", z));
+  }
+  bytes_out_ += out->size() - out_start;
+  current_level_ = level;
+}
+
+Decompressor::Decompressor(uint64_t max_output) : stream_(new Stream()), max_output_(max_output) {
+  if (inflateInit(&stream_->z) != Z_OK) {
+    throw std::runtime_error(zlibError("Unable to initialize decompression", stream_->z));
+  }
+}
+
+Decompressor::~Decompressor() { inflateEnd(&stream_->z); }
+
+bool Decompressor::decompress(const uint8_t *data, size_t size, const Output &output) {
+  z_stream &z = stream_->z;
+  z.next_in = const_cast<Bytef *>(data);  // NOLINT(cppcoreguidelines-pro-type-const-cast)
+  z.avail_in = static_cast<uInt>(size);
+  std::array<uint8_t, kOutputPiece> buf{};
+  for (;;) {
+    z.next_out = buf.data();
+    z.avail_out = static_cast<uInt>(buf.size());
+    const int ret = inflate(&z, Z_NO_FLUSH);
+    const size_t produced = buf.size() - z.avail_out;
+    if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+      throw std::runtime_error(zlibError("Invalid compressed data", z));
+    }
+    if (produced > max_output_ - bytes_out_) {
+      throw std::runtime_error("Compressed data expands beyond the expected " + std::to_string(max_output_) +
+                               " bytes");
+    }
+    bytes_out_ += produced;
+    if (produced > 0 && !output(buf.data(), produced)) {
+      return false;
+    }
+    if (ret == Z_STREAM_END) {
+      if (z.avail_in > 0) {
+        throw std::runtime_error("Unexpected data after the end of the compressed stream");
+      }
+      return true;
+    }
+    // Everything was consumed and inflate() had room left, or no progress is possible without more input.
+    if ((z.avail_in == 0 && z.avail_out > 0) || (ret == Z_BUF_ERROR && produced == 0)) {
+      return true;
+    }
+  }
+}
+
+}  // namespace compression
@@ -0,0 +1,87 @@
+#ifndef UTILITIES_COMPRESSION_H_
+#define UTILITIES_COMPRESSION_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+/**
+ * Streaming deflate compression of firmware images. Every piece of compressed
+ * data can be decompressed as soon as it is received, so that an image can be
+ * written while it is being transferred.
+ */
+namespace compression {
+
+class Compressor {
+ public:
+  static constexpr int kMinLevel = 1;
+  static constexpr int kMaxLevel = 9;
+
+  /** `level` is clamped to [kMinLevel, kMaxLevel]. */
+  explicit Compressor(int level);
+  ~Compressor();
+  Compressor(const Compressor &) = delete;
+  Compressor(Compressor &&) = delete;
+  Compressor &operator=(const Compressor &) = delete;
+  Compressor &operator=(Compressor &&) = delete;
+
+  /**
+   * Compress `size` bytes and append the result to `out`. Data that does not
+   * compress well is stored as is for a while, so that incompressible images
+   * cost little CPU time.
+   */
+  void compress(const uint8_t *data, size_t size, std::string *out);
+  int level() const { return level_; }
+  uint64_t bytesIn() const { return bytes_in_; }
+  uint64_t bytesOut() const { return bytes_out_; }
+
+ private:
+  struct Stream;
+
+  void setLevel(int level, std::string *out);
+  void adapt(std::string *out);
+
+  std::unique_ptr<Stream> stream_;
+  const int level_;
+  int current_level_;
+  uint64_t bytes_in_{0};
+  uint64_t bytes_out_{0};
+  // Compression ratio is checked over windows of this many input bytes.
+  uint64_t window_in_{0};
+  uint64_t window_out_{0};
+  unsigned int poor_windows_{0};
+  unsigned int stored_windows_left_{0};
+};
+
+class Decompressor {
+ public:
+  using Output = std::function<bool(const uint8_t *data, size_t size)>;
+
+  /** Decompressing more than `max_output` bytes is an error. */
+  explicit Decompressor(uint64_t max_output);
+  ~Decompressor();
+  Decompressor(const Decompressor &) = delete;
+  Decompressor(Decompressor &&) = delete;
+  Decompressor &operator=(const Decompressor &) = delete;
+  Decompressor &operator=(Decompressor &&) = delete;
+
+  /**
+   * Decompress `size` bytes and pass the result to `output` in pieces of at
+   * most 64 KiB. Returns false as soon as `output` does; throws
+   * std::runtime_error if the data is invalid.
+   */
+  bool decompress(const uint8_t *data, size_t size, const Output &output);
+  uint64_t bytesOut() const { return bytes_out_; }
+
+ private:
+  struct Stream;
+
+  std::unique_ptr<Stream> stream_;
+  const uint64_t max_output_;
+  uint64_t bytes_out_{0};
+};
+
+}  // namespace compression
+
+#endif  // UTILITIES_COMPRESSION_H_
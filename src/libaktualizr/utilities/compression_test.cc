@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+
+#include "utilities/compression.h"
+
+static std::string randomData(std::mt19937 &rng, size_t size) {
+  std::string data(size, '\0');
+  for (auto &c : data) {
+    c = static_cast<char>(rng() & 0xFF);
+  }
+  return data;
+}
+
+/* Compress `data` in pieces of `piece` bytes, and check that every compressed
+ * piece decompresses to its input on its own. */
+static void roundTrip(int level, const std::string &data, size_t piece, std::string *compressed) {
+  compression::Compressor compressor(level);
+  compression::Decompressor decompressor(data.size());
+  std::string out;
+  auto append = [&out](const uint8_t *d, size_t size) -> bool {
+    out.append(reinterpret_cast<const char *>(d), size);
+    return true;
+  };
+  for (size_t offset = 0; offset < data.size(); offset += piece) {
+    const size_t size = std::min(piece, data.size() - offset);
+    std::string chunk;
+    compressor.compress(reinterpret_cast<const uint8_t *>(data.data()) + offset, size, &chunk);
+    EXPECT_TRUE(decompressor.decompress(reinterpret_cast<const uint8_t *>(chunk.data()), chunk.size(), append));
+    EXPECT_EQ(out.size(), offset + size);
+    compressed->append(chunk);
+  }
+  EXPECT_EQ(out, data);
+  EXPECT_EQ(compressor.bytesIn(), data.size());
+  EXPECT_EQ(compressor.bytesOut(), compressed->size());
+  EXPECT_EQ(decompressor.bytesOut(), data.size());
+}
+
+/* Compressible data shrinks at any level, and levels are clamped. */
+TEST(Compression, RoundTrip) {
+  std::mt19937 rng(42);
+  std::string data;
+  for (int i = 0; i < 2000; ++i) {
+    data += "line " + std::to_string(i % 37) + " of a very repetitive firmware image\n";
+  }
+  data += std::string(300000, '\0') + randomData(rng, 1000);
+
+  for (int level : {0, 1, 6, 9, 42}) {
+    std::string compressed;
+    roundTrip(level, data, 65536, &compressed);
+    EXPECT_LT(compressed.size(), data.size() / 10);
+  }
+  EXPECT_EQ(compression::Compressor(0).level(), compression::Compressor::kMinLevel);
+  EXPECT_EQ(compression::Compressor(42).level(), compression::Compressor::kMaxLevel);
+
+  std::string compressed;
+  roundTrip(6, data, 1, &compressed);
+}
+
+/* Incompressible data is stored once compression proves useless, and data that
+ * follows it is compressed again. */
+TEST(Compression, Incompressible) {
+  std::mt19937 rng(7);
+  const std::string random = randomData(rng, 8 * 1024 * 1024);
+  std::string compressed;
+  roundTrip(9, random, 65536, &compressed);
+  // Stored blocks only add a few bytes per flush.
+  EXPECT_LT(compressed.size(), random.size() + random.size() / 100);
+
+  const std::string data = random + std::string(16 * 1024 * 1024, 'a');
+  compressed.clear();
+  roundTrip(9, data, 65536, &compressed);
+  EXPECT_LT(compressed.size(), random.size() + 2 * 1024 * 1024);
+}
+
+/* Corrupted data and data that expands beyond the limit are rejected, and the
+ * output callback can stop decompression. */
+TEST(Compression, Invalid) {
+  const std::string data(100000, 'x');
+  std::string compressed;
+  compression::Compressor(6).compress(reinterpret_cast<const uint8_t *>(data.data()), data.size(), &compressed);
+  auto ignore = [](const uint8_t *d, size_t size) -> bool {
+    (void)d;
+    (void)size;
+    return true;
+  };
+
+  compression::Decompressor small(data.size() - 1);
+  EXPECT_THROW(small.decompress(reinterpret_cast<const uint8_t *>(compressed.data()), compressed.size(), ignore),
+               std::runtime_error);
+
+  const std::string garbage = "not compressed at all";
+  compression::Decompressor invalid(data.size());
+  EXPECT_THROW(invalid.decompress(reinterpret_cast<const uint8_t *>(garbage.data()), garbage.size(), ignore),
+               std::runtime_error);
+
+  compression::Decompressor stopped(data.size());
+  auto stop = [](const uint8_t *d, size_t size) -> bool {
+    (void)d;
+    (void)size;
+    return false;
+  };
+  EXPECT_FALSE(stopped.decompress(reinterpret_cast<const uint8_t *>(compressed.data()), compressed.size(), stop));
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
@@ -0,0 +1,208 @@
+#include "libaktualizr/metrics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace metrics {
+
+static void atomicAdd(std::atomic<double> &target, double delta) {
+  double current = target.load(std::memory_order_relaxed);
+  while (!target.compare_exchange_weak(current, current + delta, std::memory_order_relaxed)) {
+  }
+}
+
+void Gauge::add(double delta) { atomicAdd(value_, delta); }
+
+Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds)),
+      buckets_(new std::atomic<uint64_t>[bounds_.size() + 1]) {  // NOLINT(modernize-avoid-c-arrays)
+  if (!std::is_sorted(bounds_.begin(), bounds_.end())) {
+    throw std::logic_error("Histogram bucket bounds must be sorted");
+  }
+  for (size_t i = 0; i <= bounds_.size(); ++i) {
+    buckets_[i] = 0;
+  }
+}
+
+void Histogram::observe(double value) {
+  const auto bucket = static_cast<size_t>(std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin());
+  buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  atomicAdd(sum_, value);
+  count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<uint64_t> Histogram::bucketCounts() const {
+  std::vector<uint64_t> counts(bounds_.size() + 1);
+  for (size_t i = 0; i < counts.size(); ++i) {
+    counts[i] = buckets_[i].load(std::memory_order_relaxed);
+  }
+  return counts;
+}
+
+const std::vector<double> &latencyBuckets() {
+  static const std::vector<double> buckets{0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 60};
+  return buckets;
+}
+
+Registry &Registry::global() {
+  static Registry registry;
+  return registry;
+}
+
+Registry::Entry &Registry::entry(const std::string &name, const std::string &help, Type type,
+                                 const std::vector<double> &bounds) {
+  auto it = entries_.find(name);
+  if (it == entries_.end()) {
+    Entry entry;
+    entry.help = help;
+    entry.type = type;
+    entry.bounds = bounds;
+    it = entries_.emplace(name, std::move(entry)).first;
+  } else if (it->second.type != type || it->second.bounds != bounds) {
+    throw std::logic_error("Metric " + name + " is already registered with a different type");
+  }
+  return it->second;
+}
+
+Counter &Registry::counter(const std::string &name, const std::string &help, const Labels &labels) {
+  std::lock_guard<std::mutex> lock(m_);
+  auto &metric = entry(name, help, Type::kCounter, {}).counters[labels];
+  if (!metric) {
+    metric.reset(new Counter());
+  }
+  return *metric;
+}
+
+Gauge &Registry::gauge(const std::string &name, const std::string &help, const Labels &labels) {
+  std::lock_guard<std::mutex> lock(m_);
+  auto &metric = entry(name, help, Type::kGauge, {}).gauges[labels];
+  if (!metric) {
+    metric.reset(new Gauge());
+  }
+  return *metric;
+}
+
+Histogram &Registry::histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds,
+                               const Labels &labels) {
+  std::lock_guard<std::mutex> lock(m_);
+  auto &metric = entry(name, help, Type::kHistogram, bounds).histograms[labels];
+  if (!metric) {
+    metric.reset(new Histogram(bounds));
+  }
+  return *metric;
+}
+
+Snapshot Registry::snapshot() const {
+  std::lock_guard<std::mutex> lock(m_);
+  Snapshot snapshot;
+  for (const auto &it : entries_) {
+    const Entry &entry = it.second;
+    Family family;
+    family.name = it.first;
+    family.help = entry.help;
+    family.type = entry.type;
+    family.bounds = entry.bounds;
+    for (const auto &counter : entry.counters) {
+      Sample sample;
+      sample.labels = counter.first;
+      sample.value = static_cast<double>(counter.second->value());
+      family.samples.push_back(sample);
+    }
+    for (const auto &gauge : entry.gauges) {
+      Sample sample;
+      sample.labels = gauge.first;
+      sample.value = gauge.second->value();
+      family.samples.push_back(sample);
+    }
+    for (const auto &histogram : entry.histograms) {
+      Sample sample;
+      sample.labels = histogram.first;
+      sample.count = histogram.second->count();
+      sample.buckets = histogram.second->bucketCounts();
+      sample.sum = histogram.second->sum();
+      family.samples.push_back(sample);
+    }
+    snapshot.push_back(family);
+  }
+  return snapshot;
+}
+
+static std::string escapeLabelValue(const std::string &value) {
+  std::string escaped;
+  for (const char c : value) {
+    if (c == '\\' || c == '"') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+static std::string formatLabels(const Labels &labels, const std::string &le = std::string()) {
+  if (labels.empty() && le.empty()) {
+    return std::string();
+  }
+  std::string out = "{";
+  for (const auto &label : labels) {
+    if (out.size() > 1) {
+      out += ",";
+    }
+    out += label.first + "=\"" + escapeLabelValue(label.second) + "\"";
+  }
+  if (!le.empty()) {
+    if (out.size() > 1) {
+      out += ",";
+    }
+    out += "le=\"" + le + "\"";
+  }
+  return out + "}";
+}
+
+static std::string formatValue(double value) {
+  std::ostringstream out;
+  out << std::setprecision(15) << value;
+  return out.str();
+}
+
+std::string toPrometheusText(const Snapshot &snapshot) {
+  std::ostringstream out;
+  for (const auto &family : snapshot) {
+    out << "# HELP " << family.name << " " << family.help << "\n";
+    switch (family.type) {
+      case Type::kCounter:
+        out << "# TYPE " << family.name << " counter\n";
+        break;
+      case Type::kGauge:
+        out << "# TYPE " << family.name << " gauge\n";
+        break;
+      case Type::kHistogram:
+        out << "# TYPE " << family.name << " histogram\n";
+        break;
+      default:
+        break;
+    }
+    for (const auto &sample : family.samples) {
+      if (family.type != Type::kHistogram) {
+        out << family.name << formatLabels(sample.labels) << " " << formatValue(sample.value) << "\n";
+        continue;
+      }
+      uint64_t cumulative = 0;
+      for (size_t i = 0; i < sample.buckets.size(); ++i) {
+        cumulative += sample.buckets[i];
+        const std::string le = i < family.bounds.size() ? formatValue(family.bounds[i]) : "+Inf";
+        out << family.name << "_bucket" << formatLabels(sample.labels, le) << " " << cumulative << "\n";
+      }
+      out << family.name << "_sum" << formatLabels(sample.labels) << " " << formatValue(sample.sum) << "\n";
+      out << family.name << "_count" << formatLabels(sample.labels) << " " << cumulative << "\n";
+    }
+  }
+  return out.str();
+}
+
+}  // namespace metrics
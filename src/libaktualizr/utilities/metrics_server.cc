@@ -0,0 +1,153 @@
+#include "utilities/metrics_server.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "libaktualizr/logging/logging.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace metrics {
+
+// How long a client has to send its request before it gets the bare text.
+static constexpr int kRequestTimeoutMs = 100;
+
+static sockaddr_un makeAddress(const boost::filesystem::path &path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.string().size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("Unix socket path is too long: " + path.string());
+  }
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  return addr;
+}
+
+SocketServer::SocketServer(boost::filesystem::path path, std::function<std::string()> render)
+    : path_(std::move(path)), render_(std::move(render)) {
+  const sockaddr_un addr = makeAddress(path_);
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    throw std::runtime_error(std::string("Could not create a unix socket: ") + std::strerror(errno));
+  }
+  // A socket file left over by a previous run would make bind() fail.
+  boost::system::error_code ec;
+  boost::filesystem::remove(path_, ec);
+  if (bind(listen_fd_, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(listen_fd_, SOMAXCONN) != 0) {
+    const std::string error = std::strerror(errno);
+    close(listen_fd_);
+    throw std::runtime_error("Could not listen on " + path_.string() + ": " + error);
+  }
+  if (pipe(wakeup_pipe_.data()) != 0) {
+    const std::string error = std::strerror(errno);
+    close(listen_fd_);
+    throw std::runtime_error("Could not create a pipe: " + error);
+  }
+  thread_ = std::thread(&SocketServer::run, this);
+}
+
+SocketServer::~SocketServer() {
+  const char byte = 0;
+  if (write(wakeup_pipe_[1], &byte, 1) < 0) {
+    LOG_ERROR << "Could not stop the metrics server: " << std::strerror(errno);
+  }
+  thread_.join();
+  close(wakeup_pipe_[0]);
+  close(wakeup_pipe_[1]);
+  close(listen_fd_);
+  boost::system::error_code ec;
+  boost::filesystem::remove(path_, ec);
+}
+
+void SocketServer::run() {
+  for (;;) {
+    std::array<pollfd, 2> fds{{{listen_fd_, POLLIN, 0}, {wakeup_pipe_[0], POLLIN, 0}}};
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG_ERROR << "Metrics server failed: " << std::strerror(errno);
+      return;
+    }
+    if (fds[1].revents != 0) {
+      return;
+    }
+    const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+    try {
+      serve(fd);
+    } catch (const std::exception &ex) {
+      LOG_WARNING << "Could not serve metrics: " << ex.what();
+    }
+    close(fd);
+  }
+}
+
+void SocketServer::serve(int fd) {
+  std::string request;
+  std::array<char, 1024> buf{};
+  while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8 * buf.size()) {
+    pollfd pfd{fd, POLLIN, 0};
+    if (poll(&pfd, 1, kRequestTimeoutMs) <= 0) {
+      break;
+    }
+    const ssize_t received = recv(fd, buf.data(), buf.size(), 0);
+    if (received <= 0) {
+      break;
+    }
+    request.append(buf.data(), static_cast<size_t>(received));
+  }
+
+  std::string response = render_();
+  if (request.compare(0, 4, "GET ") == 0) {
+    response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+               std::to_string(response.size()) + "\r\n\r\n" + response;
+  }
+  size_t sent = 0;
+  while (sent < response.size()) {
+    const ssize_t written = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+    if (written <= 0) {
+      throw std::runtime_error(std::strerror(errno));
+    }
+    sent += static_cast<size_t>(written);
+  }
+}
+
+std::string readFromSocket(const boost::filesystem::path &path) {
+  const sockaddr_un addr = makeAddress(path);
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::runtime_error(std::string("Could not create a unix socket: ") + std::strerror(errno));
+  }
+  if (connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0) {
+    const std::string error = std::strerror(errno);
+    close(fd);
+    throw std::runtime_error("Could not connect to " + path.string() + ": " + error);
+  }
+  // No request: tell the server right away.
+  shutdown(fd, SHUT_WR);
+  std::string text;
+  std::array<char, 4096> buf{};
+  ssize_t received;
+  while ((received = recv(fd, buf.data(), buf.size(), 0)) > 0) {
+    text.append(buf.data(), static_cast<size_t>(received));
+  }
+  const int read_errno = errno;
+  close(fd);
+  if (received < 0) {
+    throw std::runtime_error("Could not read from " + path.string() + ": " + std::strerror(read_errno));
+  }
+  return text;
+}
+
+}  // namespace metrics
@@ -0,0 +1,43 @@
+#ifndef METRICS_SERVER_H_
+#define METRICS_SERVER_H_
+
+#include <array>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+namespace metrics {
+
+/**
+ * Serves text on a unix socket, one client at a time. Clients that send an
+ * HTTP GET request get an HTTP response, so that Prometheus can scrape the
+ * socket through a proxy; other clients get the bare text.
+ */
+class SocketServer {
+ public:
+  SocketServer(boost::filesystem::path path, std::function<std::string()> render);
+  ~SocketServer();
+  SocketServer(const SocketServer &) = delete;
+  SocketServer(SocketServer &&) = delete;
+  SocketServer &operator=(const SocketServer &) = delete;
+  SocketServer &operator=(SocketServer &&) = delete;
+
+ private:
+  void run();
+  void serve(int fd);
+
+  const boost::filesystem::path path_;
+  const std::function<std::string()> render_;
+  int listen_fd_{-1};
+  std::array<int, 2> wakeup_pipe_{{-1, -1}};
+  std::thread thread_;
+};
+
+/** Read everything a SocketServer at `path` sends. Throws std::runtime_error on failure. */
+std::string readFromSocket(const boost::filesystem::path &path);
+
+}  // namespace metrics
+
+#endif  // METRICS_SERVER_H_
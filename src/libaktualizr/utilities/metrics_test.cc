@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libaktualizr/metrics.h"
+#include "libaktualizr/utilities/utils.h"
+#include "utilities/metrics_server.h"
+
+/* Counters and gauges can be updated from several threads. */
+TEST(Metrics, CounterAndGauge) {
+  metrics::Registry registry;
+  metrics::Counter &counter = registry.counter("test_total", "Test counter");
+  metrics::Gauge &gauge = registry.gauge("test_gauge", "Test gauge", {{"queue", "a"}});
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&counter, &gauge]() {
+      for (int j = 0; j < 1000; ++j) {
+        counter.inc();
+        gauge.add(0.5);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(counter.value(), 4000U);
+  EXPECT_DOUBLE_EQ(gauge.value(), 2000);
+
+  // Looking a metric up again returns the same one.
+  EXPECT_EQ(&registry.counter("test_total", "Test counter"), &counter);
+  EXPECT_NE(&registry.gauge("test_gauge", "Test gauge", {{"queue", "b"}}), &gauge);
+}
+
+/* Observations land in the first bucket whose bound is not lower. */
+TEST(Metrics, Histogram) {
+  metrics::Histogram histogram({1, 2, 5});
+  histogram.observe(0.5);
+  histogram.observe(1);
+  histogram.observe(3);
+  histogram.observe(100);
+  EXPECT_EQ(histogram.bucketCounts(), std::vector<uint64_t>({2, 0, 1, 1}));
+  EXPECT_EQ(histogram.count(), 4U);
+  EXPECT_DOUBLE_EQ(histogram.sum(), 104.5);
+
+  EXPECT_THROW(metrics::Histogram({2, 1}), std::logic_error);
+}
+
+/* A name can only be used for one type of metric. */
+TEST(Metrics, TypeMismatch) {
+  metrics::Registry registry;
+  registry.counter("test", "Test");
+  EXPECT_THROW(registry.gauge("test", "Test"), std::logic_error);
+  registry.histogram("test_seconds", "Test", {1, 2});
+  EXPECT_THROW(registry.histogram("test_seconds", "Test", {1, 3}), std::logic_error);
+}
+
+/* Snapshots render in the Prometheus text format. */
+TEST(Metrics, PrometheusText) {
+  metrics::Registry registry;
+  registry.counter("requests_total", "Requests", {{"target", "a\"b"}}).inc(3);
+  metrics::Histogram &histogram = registry.histogram("latency_seconds", "Latency", {0.5, 1});
+  histogram.observe(0.25);
+  histogram.observe(2);
+
+  const std::string expected =
+      "# HELP latency_seconds Latency\n"
+      "# TYPE latency_seconds histogram\n"
+      "latency_seconds_bucket{le=\"0.5\"} 1\n"
+      "latency_seconds_bucket{le=\"1\"} 1\n"
+      "latency_seconds_bucket{le=\"+Inf\"} 2\n"
+      "latency_seconds_sum 2.25\n"
+      "latency_seconds_count 2\n"
+      "# HELP requests_total Requests\n"
+      "# TYPE requests_total counter\n"
+      "requests_total{target=\"a\\\"b\"} 3\n";
+  EXPECT_EQ(metrics::toPrometheusText(registry.snapshot()), expected);
+}
+
+/* The socket server sends the rendered text to each client and removes its socket when done. */
+TEST(Metrics, SocketServer) {
+  TemporaryDirectory temp_dir;
+  const boost::filesystem::path path = temp_dir / "metrics.sock";
+  {
+    metrics::SocketServer server(path, []() { return std::string("metric 1\n"); });
+    EXPECT_EQ(metrics::readFromSocket(path), "metric 1\n");
+    EXPECT_EQ(metrics::readFromSocket(path), "metric 1\n");
+  }
+  EXPECT_FALSE(boost::filesystem::exists(path));
+  EXPECT_THROW(metrics::readFromSocket(path), std::runtime_error);
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
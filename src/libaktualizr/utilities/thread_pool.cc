@@ -0,0 +1,79 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t size) {
+  size = std::max<size_t>(size, 1);
+  workers_.reserve(size);
+  for (size_t i = 0; i < size; ++i) {
+    workers_.emplace_back(&ThreadPool::run, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    shutdown_ = true;
+  }
+  cv_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::setGroupLimit(const std::string &group, size_t limit) {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    group_limits_[group] = limit;
+  }
+  cv_.notify_all();
+}
+
+size_t ThreadPool::pending() const {
+  std::lock_guard<std::mutex> lock(m_);
+  return tasks_.size();
+}
+
+// Highest priority task whose group is below its limit, the earliest one among
+// equals. Must be called with m_ held.
+std::list<ThreadPool::Task>::iterator ThreadPool::nextTask() {
+  auto next = tasks_.end();
+  for (auto it = tasks_.begin(); it != tasks_.end(); ++it) {
+    if (next != tasks_.end() && it->priority <= next->priority) {
+      continue;
+    }
+    const auto limit = group_limits_.find(it->group);
+    if (limit != group_limits_.end() && limit->second != 0 && group_running_[it->group] >= limit->second) {
+      continue;
+    }
+    next = it;
+  }
+  return next;
+}
+
+void ThreadPool::run() {
+  for (;;) {
+    Task task{};
+    {
+      std::unique_lock<std::mutex> lock(m_);
+      auto next = tasks_.end();
+      cv_.wait(lock, [this, &next] {
+        next = nextTask();
+        return next != tasks_.end() || (shutdown_ && tasks_.empty());
+      });
+      if (next == tasks_.end()) {
+        return;
+      }
+      task = std::move(*next);
+      tasks_.erase(next);
+      ++group_running_[task.group];
+    }
+    task.fn();
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      --group_running_[task.group];
+    }
+    // A task of the same group may have been waiting for this one to finish.
+    cv_.notify_all();
+  }
+}
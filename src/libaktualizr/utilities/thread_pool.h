@@ -0,0 +1,80 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Fixed-size pool of worker threads.
+ *
+ * Tasks run in order of decreasing priority, and in submission order for equal
+ * priorities. A task can be put in a named group, e.g. the bus that it uses;
+ * setGroupLimit() caps how many tasks of a group run at the same time.
+ *
+ * The destructor waits for all the submitted tasks to complete. Exceptions
+ * thrown by a task are forwarded to the caller through its future.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t size);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool(ThreadPool &&) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ThreadPool &operator=(ThreadPool &&) = delete;
+
+  template <class F>
+  std::future<typename std::result_of<F()>::type> submit(F &&f, int priority = 0, const std::string &group = "") {
+    using R = typename std::result_of<F()>::type;
+    // std::function needs a copyable callable, which std::packaged_task is not.
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    std::future<R> result = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      tasks_.push_back(Task{priority, group, [task]() { (*task)(); }});
+    }
+    cv_.notify_one();
+    return result;
+  }
+
+  /**
+   * Limit the number of tasks of a group running at once. 0 means no limit
+   * other than the size of the pool.
+   */
+  void setGroupLimit(const std::string &group, size_t limit);
+
+  size_t size() const { return workers_.size(); }
+
+  /** Number of tasks that have been submitted but have not started yet. */
+  size_t pending() const;
+
+ private:
+  struct Task {
+    int priority;
+    std::string group;
+    std::function<void()> fn;
+  };
+
+  void run();
+  std::list<Task>::iterator nextTask();
+
+  std::vector<std::thread> workers_;
+  std::list<Task> tasks_;
+  std::map<std::string, size_t> group_limits_;
+  std::map<std::string, size_t> group_running_;
+  mutable std::mutex m_;
+  std::condition_variable cv_;
+  bool shutdown_{false};
+};
+
+#endif  // THREAD_POOL_H_
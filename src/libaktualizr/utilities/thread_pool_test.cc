@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+#include "utilities/thread_pool.h"
+
+/* All the submitted tasks run and their results are returned through the futures. */
+TEST(ThreadPool, Results) {
+  ThreadPool pool(4);
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < 100; ++i) {
+    results.push_back(pool.submit([i]() { return i * i; }));
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(results[static_cast<size_t>(i)].get(), i * i);
+  }
+}
+
+/* No more tasks than the size of the pool run at the same time. */
+TEST(ThreadPool, Bounded) {
+  ThreadPool pool(3);
+  EXPECT_EQ(pool.size(), 3);
+  std::atomic<int> running{0};
+  std::atomic<int> max_running{0};
+  std::vector<std::future<void>> results;
+  for (int i = 0; i < 12; ++i) {
+    results.push_back(pool.submit([&running, &max_running]() {
+      const int now = ++running;
+      int prev = max_running.load();
+      while (now > prev && !max_running.compare_exchange_weak(prev, now)) {
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      --running;
+    }));
+  }
+  for (auto &r : results) {
+    r.get();
+  }
+  EXPECT_EQ(max_running.load(), 3);
+}
+
+/* Pending tasks run by decreasing priority, then in submission order. */
+TEST(ThreadPool, Priority) {
+  ThreadPool pool(1);
+  std::promise<void> started;
+  std::promise<void> gate;
+  std::shared_future<void> opened = gate.get_future().share();
+  auto blocker = pool.submit([&started, opened]() {
+    started.set_value();
+    opened.wait();
+  });
+  started.get_future().wait();
+
+  std::mutex m;
+  std::vector<int> order;
+  std::vector<std::future<void>> results;
+  for (int priority : {0, 5, 1, 5, 0}) {
+    results.push_back(pool.submit(
+        [&m, &order, priority]() {
+          std::lock_guard<std::mutex> lock(m);
+          order.push_back(priority);
+        },
+        priority));
+  }
+  EXPECT_EQ(pool.pending(), 5);
+  gate.set_value();
+  blocker.get();
+  for (auto &r : results) {
+    r.get();
+  }
+  EXPECT_EQ(order, std::vector<int>({5, 5, 1, 0, 0}));
+  EXPECT_EQ(pool.pending(), 0);
+}
+
+/* A group limit caps that group only. */
+TEST(ThreadPool, GroupLimit) {
+  ThreadPool pool(4);
+  pool.setGroupLimit("slow-bus", 1);
+  std::atomic<int> running{0};
+  std::atomic<int> max_running{0};
+  std::atomic<int> others_done{0};
+  std::vector<std::future<void>> results;
+  for (int i = 0; i < 6; ++i) {
+    results.push_back(pool.submit(
+        [&running, &max_running]() {
+          const int now = ++running;
+          int prev = max_running.load();
+          while (now > prev && !max_running.compare_exchange_weak(prev, now)) {
+          }
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+          --running;
+        },
+        0, "slow-bus"));
+    results.push_back(pool.submit([&others_done]() { ++others_done; }));
+  }
+  for (auto &r : results) {
+    r.get();
+  }
+  EXPECT_EQ(max_running.load(), 1);
+  EXPECT_EQ(others_done.load(), 6);
+}
+
+/* Exceptions are forwarded to the caller and do not stop the workers. */
+TEST(ThreadPool, Exception) {
+  ThreadPool pool(1);
+  auto failed = pool.submit([]() -> int { throw std::runtime_error("failed"); });
+  auto succeeded = pool.submit([]() { return 1; });
+  EXPECT_THROW(failed.get(), std::runtime_error);
+  EXPECT_EQ(succeeded.get(), 1);
+}
+
+/* The destructor waits for the pending tasks. */
+TEST(ThreadPool, Drain) {
+  std::atomic<int> done{0};
+  {
+    ThreadPool pool(2);
+    for (int i = 0; i < 10; ++i) {
+      pool.submit([&done]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        ++done;
+      });
+    }
+  }
+  EXPECT_EQ(done.load(), 10);
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
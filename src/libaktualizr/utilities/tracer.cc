@@ -0,0 +1,76 @@
+#include "utilities/tracer.h"
+
+#include <unistd.h>
+
+#include "libaktualizr/logging/logging.h"
+
+namespace tracing {
+
+std::atomic<bool> Tracer::enabled_{false};
+
+// Small and stable thread ids make the trace easier to read than hashes of
+// std::thread::id.
+static int currentThreadId() {
+  static std::atomic<int> next_id{1};
+  thread_local int id = next_id++;
+  return id;
+}
+
+Tracer &Tracer::instance() {
+  static Tracer tracer;
+  return tracer;
+}
+
+Tracer::~Tracer() { stop(); }
+
+void Tracer::start(const boost::filesystem::path &path) {
+#ifndef PERF_TRACING_ENABLE
+  LOG_WARNING << "Not writing a trace to " << path << ": tracing is not enabled in this build";
+  return;
+#endif
+  std::lock_guard<std::mutex> lock(m_);
+  if (out_.is_open()) {
+    out_.close();
+  }
+  out_.open(path.string(), std::ios::out | std::ios::trunc);
+  if (!out_.good()) {
+    LOG_ERROR << "Unable to open trace file " << path;
+    enabled_ = false;
+    return;
+  }
+  // The JSON array format lets viewers read traces that were cut short, as
+  // the closing bracket is optional.
+  out_ << "[";
+  first_event_ = true;
+  epoch_ = std::chrono::steady_clock::now();
+  enabled_ = true;
+  LOG_INFO << "Writing a performance trace to " << path;
+}
+
+void Tracer::stop() {
+  std::lock_guard<std::mutex> lock(m_);
+  enabled_ = false;
+  if (out_.is_open()) {
+    out_ << "\n]\n";
+    out_.close();
+  }
+}
+
+void Tracer::addSpan(const char *category, const char *name, std::chrono::steady_clock::time_point begin,
+                     std::chrono::steady_clock::time_point end) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  const int tid = currentThreadId();
+
+  std::lock_guard<std::mutex> lock(m_);
+  if (!out_.is_open()) {
+    return;
+  }
+  out_ << (first_event_ ? "\n" : ",\n") << R"({"name":")" << name << R"(","cat":")" << category
+       << R"(","ph":"X","ts":)" << duration_cast<microseconds>(begin - epoch_).count()
+       << R"(,"dur":)" << duration_cast<microseconds>(end - begin).count() << R"(,"pid":)" << getpid()
+       << R"(,"tid":)" << tid << "}";
+  first_event_ = false;
+}
+
+}  // namespace tracing
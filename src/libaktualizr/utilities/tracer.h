@@ -0,0 +1,95 @@
+#ifndef TRACER_H_
+#define TRACER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+
+#include <boost/filesystem.hpp>
+
+/**
+ * Span tracer for performance analysis.
+ *
+ * Spans are written to a file in the Chrome trace-event format, which can be
+ * opened in chrome://tracing or https://ui.perfetto.dev. Instrumented code
+ * uses TRACE_SPAN() or TRACE_FUNCTION(); they compile to nothing without
+ * PERF_TRACING_ENABLE and cost an atomic load while the tracer is stopped.
+ */
+namespace tracing {
+
+class Tracer {
+ public:
+  static Tracer &instance();
+
+  Tracer(const Tracer &) = delete;
+  Tracer(Tracer &&) = delete;
+  Tracer &operator=(const Tracer &) = delete;
+  Tracer &operator=(Tracer &&) = delete;
+
+  /** Start writing spans to `path`, replacing its previous contents. */
+  void start(const boost::filesystem::path &path);
+  /** Stop tracing and close the file. */
+  void stop();
+
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+  /** Record a completed span. `category` and `name` must not need JSON escaping. */
+  void addSpan(const char *category, const char *name, std::chrono::steady_clock::time_point begin,
+               std::chrono::steady_clock::time_point end);
+
+ private:
+  Tracer() = default;
+  ~Tracer();
+
+  static std::atomic<bool> enabled_;
+
+  std::mutex m_;
+  std::ofstream out_;
+  bool first_event_{true};
+  std::chrono::steady_clock::time_point epoch_;
+};
+
+/** Records the time between its construction and destruction as a span. */
+class Span {
+ public:
+  Span(const char *category, const char *name) : category_(category), name_(name) {
+    if (Tracer::enabled()) {
+      active_ = true;
+      begin_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~Span() {
+    if (active_) {
+      Tracer::instance().addSpan(category_, name_, begin_, std::chrono::steady_clock::now());
+    }
+  }
+  Span(const Span &) = delete;
+  Span(Span &&) = delete;
+  Span &operator=(const Span &) = delete;
+  Span &operator=(Span &&) = delete;
+
+ private:
+  const char *category_;
+  const char *name_;
+  bool active_{false};
+  std::chrono::steady_clock::time_point begin_;
+};
+
+}  // namespace tracing
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef PERF_TRACING_ENABLE
+/** Trace the rest of the enclosing scope as a span called `name`. */
+#define TRACE_SPAN(category, name) tracing::Span TRACE_CONCAT(trace_span_, __LINE__)(category, name)
+#else
+#define TRACE_SPAN(category, name)
+#endif
+
+/** Trace the enclosing function. */
+#define TRACE_FUNCTION(category) TRACE_SPAN(category, __func__)
+
+#endif  // TRACER_H_
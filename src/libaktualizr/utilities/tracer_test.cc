@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+
+#include <set>
+#include <string>
+#include <thread>
+
+#include "libaktualizr/utilities/utils.h"
+#include "utilities/tracer.h"
+
+static void tracedWork() {
+  TRACE_FUNCTION("test");
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+}
+
+/* Spans from several threads end up in a valid Chrome trace. */
+TEST(Tracer, ChromeTrace) {
+  TemporaryDirectory temp_dir;
+  const boost::filesystem::path path = temp_dir / "trace.json";
+
+  tracedWork();  // not traced yet
+  tracing::Tracer::instance().start(path);
+  {
+    TRACE_SPAN("test", "outer");
+    tracedWork();
+    std::thread other(tracedWork);
+    other.join();
+  }
+  tracing::Tracer::instance().stop();
+  tracedWork();  // not traced anymore
+
+  const Json::Value trace = Utils::parseJSONFile(path);
+  ASSERT_TRUE(trace.isArray());
+  ASSERT_EQ(trace.size(), 3U);
+  std::set<int> threads;
+  for (const auto &event : trace) {
+    EXPECT_EQ(event["ph"].asString(), "X");
+    EXPECT_EQ(event["cat"].asString(), "test");
+    EXPECT_GE(event["dur"].asInt64(), 0);
+    threads.insert(event["tid"].asInt());
+  }
+  EXPECT_EQ(trace[0]["name"].asString(), "tracedWork");
+  EXPECT_EQ(trace[2]["name"].asString(), "outer");
+  EXPECT_GE(trace[0]["dur"].asInt64(), 2000);
+  // The outer span encloses the others.
+  EXPECT_LE(trace[2]["ts"].asInt64(), trace[0]["ts"].asInt64());
+  EXPECT_EQ(threads.size(), 2U);
+}
+
+#ifndef __NO_MAIN__
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+#endif
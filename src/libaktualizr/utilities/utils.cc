@@ -944,12 +944,16 @@ std::string Socket::ToString() const {
   return Utils::ipDisplayName(saddr) + ":" + std::to_string(Utils::ipPort(saddr));
 }
 
-void Socket::bind(in_port_t port, bool reuse) const {
+void Socket::bind(in_port_t port, bool reuse, const std::string &ip) const {
   sockaddr_in sa{};
   memset(&sa, 0, sizeof(sa));
   sa.sin_family = AF_INET;
-  sa.sin_port = htons(port);               // NOLINT(readability-isolate-declaration)
-  sa.sin_addr.s_addr = htonl(INADDR_ANY);  // NOLINT(readability-isolate-declaration)
+  sa.sin_port = htons(port);  // NOLINT(readability-isolate-declaration)
+  if (ip.empty()) {
+    sa.sin_addr.s_addr = htonl(INADDR_ANY);  // NOLINT(readability-isolate-declaration)
+  } else if (inet_pton(AF_INET, ip.c_str(), &sa.sin_addr) != 1) {
+    throw std::runtime_error("Invalid IPv4 address: " + ip);
+  }
 
   int reuseaddr = reuse ? 1 : 0;
   if (-1 == setsockopt(socket_fd_, SOL_SOCKET, SO_REUSEADDR, &reuseaddr, sizeof(reuseaddr))) {
@@ -961,8 +965,8 @@ void Socket::bind(in_port_t port, bool reuse) const {
   }
 }
 
-ListenSocket::ListenSocket(in_port_t port) : _port(port) {
-  bind(port);
+ListenSocket::ListenSocket(in_port_t port, const std::string &ip) : _port(port) {
+  bind(port, true, ip);
   if (_port == 0) {
     // ephemeral port was bound, find out its real port number
     auto ephemeral_port = Utils::ipPort(Utils::ipGetSockaddr(socket_fd_));
@@ -9,15 +9,28 @@ void DirectorRepo::addTarget(const std::string &target_name, const Json::Value &
   const boost::filesystem::path current = path_ / DirectorRepo::dir / "targets.json";
   const boost::filesystem::path staging = path_ / DirectorRepo::dir / "staging/targets.json";
 
-  Json::Value director_targets;
-  if (boost::filesystem::exists(staging)) {
-    director_targets = Utils::parseJSONFile(staging);
-  } else if (boost::filesystem::exists(current)) {
-    director_targets = Utils::parseJSONFile(current)["signed"];
-  } else {
-    throw std::runtime_error(std::string("targets.json not found at ") + staging.c_str() + " or " + current.c_str() +
-                             "!");
+  StagedRole *staged = batching_ ? findStaged(Uptane::Role::Targets()) : nullptr;
+  Json::Value loaded;
+  if (staged == nullptr) {
+    if (boost::filesystem::exists(staging)) {
+      loaded = Utils::parseJSONFile(staging);
+    } else if (boost::filesystem::exists(current)) {
+      loaded = Utils::parseJSONFile(current)["signed"];
+    } else {
+      throw std::runtime_error(std::string("targets.json not found at ") + staging.c_str() + " or " +
+                               current.c_str() + "!");
+    }
+    loaded["version"] = (Utils::parseJSONFile(current)["signed"]["version"].asUInt()) + 1;
   }
+  if (batching_ && staged == nullptr) {
+    StagedRole to_stage;
+    to_stage.path = staging;
+    to_stage.meta = std::move(loaded);
+    to_stage.sign = false;
+    staged = &stage(Uptane::Role::Targets(), std::move(to_stage));
+  }
+  Json::Value &director_targets = (staged != nullptr) ? staged->meta : loaded;
+
   if (!expires.empty()) {
     director_targets["expires"] = expires;
   }
@@ -30,7 +43,10 @@ void DirectorRepo::addTarget(const std::string &target_name, const Json::Value &
     director_targets["targets"][target_name]["custom"].removeMember("uri");
   }
   director_targets["targets"][target_name]["custom"].removeMember("version");
-  director_targets["version"] = (Utils::parseJSONFile(current)["signed"]["version"].asUInt()) + 1;
+  if (staged != nullptr) {
+    staged->modified = true;
+    return;
+  }
   Utils::writeFile(staging, Utils::jsonToCanonicalStr(director_targets));
   updateRepo();
 }
@@ -57,7 +73,10 @@ void DirectorRepo::signTargets() {
   const boost::filesystem::path staging = path_ / DirectorRepo::dir / "staging/targets.json";
   Json::Value targets_unsigned;
 
-  if (boost::filesystem::exists(staging)) {
+  StagedRole *staged = batching_ ? findStaged(Uptane::Role::Targets()) : nullptr;
+  if (staged != nullptr) {
+    targets_unsigned = std::move(staged->meta);
+  } else if (boost::filesystem::exists(staging)) {
     targets_unsigned = Utils::parseJSONFile(staging);
   } else if (boost::filesystem::exists(current)) {
     targets_unsigned = Utils::parseJSONFile(current)["signed"];
@@ -66,6 +85,15 @@ void DirectorRepo::signTargets() {
                              "!");
   }
 
+  if (batching_) {
+    StagedRole to_stage;
+    to_stage.path = current;
+    to_stage.meta = std::move(targets_unsigned);
+    to_stage.modified = true;
+    to_stage.replaces = staging;
+    stage(Uptane::Role::Targets(), std::move(to_stage));
+    return;
+  }
   Utils::writeFile(path_ / DirectorRepo::dir / "targets.json",
                    Utils::jsonToCanonicalStr(signTuf(Uptane::Role::Targets(), targets_unsigned)));
   boost::filesystem::remove(path_ / DirectorRepo::dir / "staging/targets.json");
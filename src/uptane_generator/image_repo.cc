@@ -1,6 +1,9 @@
 #include "libaktualizr/image_repo.h"
 
+#include <array>
+#include <boost/algorithm/string/case_conv.hpp>
 #include <boost/filesystem.hpp>
+#include <fstream>
 
 #include "libaktualizr/crypto/crypto.h"
 #include "libaktualizr/utilities/utils.h"
@@ -11,13 +14,18 @@ void ImageRepo::addImage(const std::string &name, Json::Value &target, const std
 
   boost::filesystem::path targets_path =
       delegation ? ((repo_dir / "delegations") / delegation.name).string() + ".json" : repo_dir / "targets.json";
-  Json::Value targets = Utils::parseJSONFile(targets_path)["signed"];
+  auto role = delegation ? Uptane::Role(delegation.name, true) : Uptane::Role::Targets();
   // TODO: support multiple hardware IDs.
   target["custom"]["hardwareIds"][0] = hardware_id;
+  if (batching_) {
+    modifyStaged(role, targets_path)["targets"][name] = target;
+    return;
+  }
+
+  Json::Value targets = Utils::parseJSONFile(targets_path)["signed"];
   targets["targets"][name] = target;
   targets["version"] = (targets["version"].asUInt()) + 1;
 
-  auto role = delegation ? Uptane::Role(delegation.name, true) : Uptane::Role::Targets();
   std::string signed_targets = Utils::jsonToCanonicalStr(signTuf(role, targets));
   Utils::writeFile(targets_path, signed_targets);
   updateRepo();
@@ -26,6 +34,12 @@ void ImageRepo::addImage(const std::string &name, Json::Value &target, const std
 void ImageRepo::addBinaryImage(const boost::filesystem::path &image_path, const boost::filesystem::path &targetname,
                                const std::string &hardware_id, const std::string &url, const int32_t custom_version,
                                const Delegation &delegation, const Json::Value &custom) {
+  addImportedImage(targetname, importImage(image_path, targetname), hardware_id, url, custom_version, delegation,
+                   custom);
+}
+
+Json::Value ImageRepo::importImage(const boost::filesystem::path &image_path,
+                                   const boost::filesystem::path &targetname) const {
   boost::filesystem::path repo_dir(path_ / ImageRepo::dir);
   boost::filesystem::path targets_path = repo_dir / "targets";
 
@@ -34,12 +48,31 @@ void ImageRepo::addBinaryImage(const boost::filesystem::path &image_path, const
   boost::filesystem::copy_file(image_path, targets_path / targetname_dir / targetname.filename(),
                                boost::filesystem::copy_options::overwrite_existing);
 
-  std::string image = Utils::readFile(image_path);
+  std::ifstream image(image_path.c_str(), std::ios::binary);
+  if (!image.good()) {
+    throw std::runtime_error("Unable to read image " + image_path.string());
+  }
+  auto sha256 = MultiPartHasher::create(Hash::Type::kSha256);
+  auto sha512 = MultiPartHasher::create(Hash::Type::kSha512);
+  std::array<char, 65536> buf{};
+  uint64_t length = 0;
+  while (image.read(buf.data(), buf.size()) || image.gcount() > 0) {
+    const auto read = static_cast<uint64_t>(image.gcount());
+    sha256->update(reinterpret_cast<const unsigned char *>(buf.data()), read);
+    sha512->update(reinterpret_cast<const unsigned char *>(buf.data()), read);
+    length += read;
+  }
 
   Json::Value target;
-  target["length"] = Json::UInt64(image.size());
-  target["hashes"]["sha256"] = Crypto::sha256digestHex(image);
-  target["hashes"]["sha512"] = Crypto::sha512digestHex(image);
+  target["length"] = Json::UInt64(length);
+  target["hashes"]["sha256"] = boost::algorithm::to_lower_copy(sha256->getHexDigest());
+  target["hashes"]["sha512"] = boost::algorithm::to_lower_copy(sha512->getHexDigest());
+  return target;
+}
+
+void ImageRepo::addImportedImage(const boost::filesystem::path &targetname, Json::Value target,
+                                 const std::string &hardware_id, const std::string &url, const int32_t custom_version,
+                                 const Delegation &delegation, const Json::Value &custom) {
   target["custom"] = custom;
   if (!target["custom"].isMember("targetFormat")) {
     target["custom"]["targetFormat"] = "BINARY";
@@ -93,7 +126,7 @@ void ImageRepo::addDelegation(const Uptane::Role &name, const Uptane::Role &pare
   }
   parent_path = parent_path /= (parent_role.ToString() + ".json");
 
-  if (!boost::filesystem::exists(parent_path)) {
+  if (!boost::filesystem::exists(parent_path) && !(batching_ && findStaged(parent_role) != nullptr)) {
     throw std::runtime_error("Delegation role " + parent_role.ToString() + " does not exist.");
   }
 
@@ -104,19 +137,34 @@ void ImageRepo::addDelegation(const Uptane::Role &name, const Uptane::Role &pare
   delegate["version"] = 1;
   delegate["targets"] = Json::objectValue;
 
-  std::string delegate_signed = Utils::jsonToCanonicalStr(signTuf(name, delegate));
-  Utils::writeFile((repo_dir / "delegations" / name.ToString()).string() + ".json", delegate_signed);
-
-  Json::Value parent_notsigned = Utils::parseJSONFile(parent_path)["signed"];
-
+  const boost::filesystem::path delegate_path = (repo_dir / "delegations" / name.ToString()).string() + ".json";
   auto keypair = keys_[name];
-  parent_notsigned["delegations"]["keys"][keypair.public_key.KeyId()] = keypair.public_key.ToUptane();
   Json::Value role;
   role["name"] = name.ToString();
   role["keyids"].append(keypair.public_key.KeyId());
   role["paths"].append(path);
   role["threshold"] = 1;
   role["terminating"] = terminating;
+
+  if (batching_) {
+    StagedRole staged;
+    staged.path = delegate_path;
+    staged.meta = delegate;
+    staged.modified = true;
+    stage(name, std::move(staged));
+
+    Json::Value &parent_staged = modifyStaged(parent_role, parent_path);
+    parent_staged["delegations"]["keys"][keypair.public_key.KeyId()] = keypair.public_key.ToUptane();
+    parent_staged["delegations"]["roles"].append(role);
+    return;
+  }
+
+  std::string delegate_signed = Utils::jsonToCanonicalStr(signTuf(name, delegate));
+  Utils::writeFile(delegate_path, delegate_signed);
+
+  Json::Value parent_notsigned = Utils::parseJSONFile(parent_path)["signed"];
+
+  parent_notsigned["delegations"]["keys"][keypair.public_key.KeyId()] = keypair.public_key.ToUptane();
   parent_notsigned["delegations"]["roles"].append(role);
   parent_notsigned["version"] = (parent_notsigned["version"].asUInt()) + 1;
 
@@ -42,6 +42,7 @@ int main(int argc, char **argv) {
                                           "adddelegation: \tadd a delegated role to the Image repo metadata\n"
                                           "revokedelegation: \tremove delegated role from the Image repo metadata and all signed targets of this role\n"
                                           "image: \tadd a target to the Image repo metadata\n"
+                                          "delta: \tadd a target with a binary delta from --deltafrom to --filename\n"
                                           "addtarget: \tprepare Director Targets metadata for a given device\n"
                                           "signtargets: \tsign the staged Director Targets metadata\n"
                                           "emptytargets: \tclear the staged Director Targets metadata\n"
@@ -49,12 +50,16 @@ int main(int argc, char **argv) {
                                           "sign: \tsign arbitrary metadata with repo keys\n"
                                           "addcampaigns: \tgenerate campaigns json\n"
                                           "refresh: \trefresh a metadata object (bump the version)\n"
-                                          "rotate: \trotate a Root metadata key")
+                                          "rotate: \trotate a Root metadata key\n"
+                                          "batch: \tapply a manifest of image, adddelegation, addtarget and signtargets\n"
+                                          "\tcommands in one pass")
     ("path", po::value<boost::filesystem::path>(), "path to the repository")
-    ("filename", po::value<boost::filesystem::path>(), "path to the image")
+    ("filename", po::value<boost::filesystem::path>(), "path to the image (or to the manifest for 'batch' command)")
     ("hwid", po::value<std::string>(), "target hardware identifier")
     ("targetformat", po::value<std::string>(), "format of target for 'image' command")
     ("targetcustom", po::value<boost::filesystem::path>(), "path to custom JSON for 'image' command")
+    ("deltafrom", po::value<boost::filesystem::path>(), "path to the image a 'delta' target applies to")
+    ("deltaimagename", po::value<std::string>(), "name of the target a 'delta' target produces (default: --filename)")
     ("serial", po::value<std::string>(), "target ECU serial")
     ("expires", po::value<std::string>(), "expiration time")
     ("keyname", po::value<std::string>(), "name of key's role")
@@ -170,6 +175,35 @@ int main(int argc, char **argv) {
                               delegation, custom);
           std::cout << "Added a custom image target " << targetname.string() << std::endl;
         }
+      } else if (command == "delta") {
+        if (vm.count("filename") == 0 || vm.count("deltafrom") == 0 || vm.count("targetname") == 0 ||
+            vm.count("hwid") == 0) {
+          std::cerr << "delta command requires --filename, --deltafrom, --targetname and --hwid\n";
+          exit(EXIT_FAILURE);
+        }
+        const std::string targetname = vm["targetname"].as<std::string>();
+        Delegation delegation;
+        if (vm.count("dname") != 0) {
+          delegation = Delegation(repo_dir, dname);
+          if (!delegation.isMatched(targetname)) {
+            std::cerr << "Image path doesn't match delegation!\n";
+            exit(EXIT_FAILURE);
+          }
+        }
+        std::string url;
+        if (vm.count("url") != 0) {
+          url = vm["url"].as<std::string>();
+        }
+        int32_t custom_version{0};
+        if (vm.count("customversion") != 0) {
+          custom_version = vm["customversion"].as<int32_t>();
+        }
+        const auto filename = vm["filename"].as<boost::filesystem::path>();
+        const std::string image_targetname =
+            (vm.count("deltaimagename") > 0) ? vm["deltaimagename"].as<std::string>() : filename.string();
+        repo.addDeltaImage(vm["deltafrom"].as<boost::filesystem::path>(), filename, targetname, image_targetname,
+                           vm["hwid"].as<std::string>(), url, custom_version, delegation);
+        std::cout << "Added a delta target " << targetname << " to the Image repo metadata" << std::endl;
       } else if (command == "addtarget") {
         if (vm.count("targetname") == 0 || vm.count("hwid") == 0 || vm.count("serial") == 0) {
           std::cerr << "addtarget command requires --targetname, --hwid, and --serial\n";
@@ -251,6 +285,13 @@ int main(int argc, char **argv) {
         }
         KeyType key_type = parseKeyType(vm);
         repo.rotate(Uptane::RepositoryType(vm["repotype"].as<std::string>()), Uptane::Role::Root(), key_type);
+      } else if (command == "batch") {
+        if (vm.count("filename") == 0) {
+          std::cerr << "batch command requires --filename\n";
+          exit(EXIT_FAILURE);
+        }
+        repo.applyBatch(vm["filename"].as<boost::filesystem::path>());
+        std::cout << "Applied batch manifest " << vm["filename"].as<boost::filesystem::path>() << std::endl;
       } else {
         std::cout << desc << std::endl;
         exit(EXIT_FAILURE);
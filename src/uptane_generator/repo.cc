@@ -250,7 +250,96 @@ void Repo::generateCampaigns() const {
   Utils::writeFile(path_ / "campaigns.json", Utils::jsonToCanonicalStr(json));
 }
 
+void Repo::beginBatch() {
+  batching_ = true;
+  if (repo_type_ != Uptane::RepositoryType::Image()) {
+    return;
+  }
+  // Load the whole Image repo tree upfront so that target lookups do not have
+  // to go back to the disk for every entry of the batch.
+  readStaged(Uptane::Role::Targets(), repo_dir_ / "targets.json");
+  if (boost::filesystem::is_directory(repo_dir_ / "delegations")) {
+    for (auto &p : boost::filesystem::directory_iterator(repo_dir_ / "delegations")) {
+      const auto name = p.path().stem().string();
+      if (Uptane::Role::IsReserved(name)) {
+        continue;
+      }
+      readStaged(Uptane::Role(name, true), p.path());
+    }
+  }
+}
+
+void Repo::commitBatch() {
+  batching_ = false;
+  bool changed = false;
+  for (const auto &staged : staged_) {
+    if (!staged.second.modified) {
+      continue;
+    }
+    changed = true;
+    if (staged.second.sign) {
+      Utils::writeFile(staged.second.path, Utils::jsonToCanonicalStr(signTuf(staged.first, staged.second.meta)));
+    } else {
+      Utils::writeFile(staged.second.path, Utils::jsonToCanonicalStr(staged.second.meta));
+    }
+    if (!staged.second.replaces.empty()) {
+      boost::filesystem::remove(staged.second.replaces);
+    }
+  }
+  staged_.clear();
+  if (changed) {
+    updateRepo();
+  }
+}
+
+Repo::StagedRole *Repo::findStaged(const Uptane::Role &role) {
+  auto it = staged_.find(role);
+  if (it == staged_.end()) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
+Repo::StagedRole &Repo::stage(const Uptane::Role &role, StagedRole staged) {
+  return staged_[role] = std::move(staged);
+}
+
+const Json::Value &Repo::readStaged(const Uptane::Role &role, const boost::filesystem::path &path) {
+  StagedRole *staged = findStaged(role);
+  if (staged == nullptr) {
+    StagedRole loaded;
+    loaded.path = path;
+    loaded.meta = Utils::parseJSONFile(path)["signed"];
+    staged = &stage(role, std::move(loaded));
+  }
+  return staged->meta;
+}
+
+Json::Value &Repo::modifyStaged(const Uptane::Role &role, const boost::filesystem::path &path) {
+  readStaged(role, path);
+  StagedRole &staged = staged_[role];
+  // The version is bumped once per batch, no matter how many changes are made.
+  if (!staged.modified) {
+    staged.meta["version"] = (staged.meta["version"].asUInt()) + 1;
+    staged.modified = true;
+  }
+  return staged.meta;
+}
+
 Json::Value Repo::getTarget(const std::string &target_name) {
+  if (batching_ && repo_type_ == Uptane::RepositoryType::Image()) {
+    const Json::Value &image_targets = readStaged(Uptane::Role::Targets(), repo_dir_ / "targets.json");
+    if (image_targets["targets"].isMember(target_name)) {
+      return image_targets["targets"][target_name];
+    }
+    for (const auto &staged : staged_) {
+      if (staged.first.IsDelegation() && staged.second.meta["targets"].isMember(target_name)) {
+        return staged.second.meta["targets"][target_name];
+      }
+    }
+    return {};
+  }
+
   const Json::Value image_targets = Utils::parseJSONFile(repo_dir_ / "targets.json")["signed"];
   if (image_targets["targets"].isMember(target_name)) {
     return image_targets["targets"][target_name];
@@ -435,6 +435,75 @@ TEST(uptane_generator, image_custom) {
   check_repo(temp_dir);
 }
 
+/*
+ * Build Image and Director metadata from a batch manifest in a single pass.
+ */
+TEST(uptane_generator, batch) {
+  TemporaryDirectory temp_dir;
+  std::ostringstream keytype_stream;
+  keytype_stream << key_type;
+  std::string cmd = generate_repo_exec + " generate " + temp_dir.Path().string() + " --keytype " + keytype_stream.str();
+  std::string output;
+  int retval = Utils::shell(cmd, &output);
+  if (retval) {
+    FAIL() << "'" << cmd << "' exited with error code " << retval << "\n";
+  }
+
+  const std::string manifest =
+      "{\"command\":\"adddelegation\",\"dname\":\"test_delegate\",\"dpattern\":\"tests/test_data/*.txt\","
+      "\"keytype\":\"ED25519\"}\n"
+      "# comments and empty lines are skipped\n"
+      "\n"
+      "{\"command\":\"image\",\"filename\":\"tests/test_data/firmware.txt\",\"hwid\":\"primary_hw\","
+      "\"dname\":\"test_delegate\"}\n"
+      "{\"command\":\"image\",\"filename\":\"tests/test_data/firmware_name.txt\",\"targetname\":\"target1\","
+      "\"hwid\":\"primary_hw\",\"customversion\":42}\n"
+      "{\"command\":\"image\",\"targetname\":\"target2\",\"targetsha256\":"
+      "\"8ab755c16de6ee9b6224169b36cbf0f2a545f859be385501ad82cdccc240d0a6\",\"targetlength\":123,"
+      "\"hwid\":\"secondary_hw\"}\n"
+      "{\"command\":\"addtarget\",\"targetname\":\"tests/test_data/firmware.txt\",\"hwid\":\"primary_hw\","
+      "\"serial\":\"CA:FE:A6:D2:84:9D\"}\n"
+      "{\"command\":\"addtarget\",\"targetname\":\"target2\",\"hwid\":\"secondary_hw\","
+      "\"serial\":\"secondary_ecu_serial\"}\n"
+      "{\"command\":\"signtargets\"}\n";
+  Utils::writeFile(temp_dir.Path() / "manifest.jsonl", manifest);
+  cmd = generate_repo_exec + " batch " + temp_dir.Path().string() + " " + (temp_dir.Path() / "manifest.jsonl").string();
+  retval = Utils::shell(cmd, &output);
+  if (retval) {
+    FAIL() << "'" << cmd << "' exited with error code " << retval << "\n";
+  }
+
+  // Every role is signed only once, so every version is bumped only once.
+  const Json::Value image_targets = Utils::parseJSONFile(temp_dir.Path() / ImageRepo::dir / "targets.json");
+  EXPECT_EQ(image_targets["signed"]["version"].asUInt(), 2);
+  EXPECT_EQ(image_targets["signed"]["targets"].size(), 2);
+  EXPECT_EQ(image_targets["signed"]["targets"]["target1"]["custom"]["version"].asInt(), 42);
+  EXPECT_EQ(image_targets["signed"]["targets"]["target2"]["length"].asUInt(), 123);
+  EXPECT_EQ(image_targets["signed"]["delegations"]["roles"][0]["name"].asString(), "test_delegate");
+  EXPECT_TRUE(boost::filesystem::exists(temp_dir.Path() / ImageRepo::dir / "targets/target1"));
+
+  const auto test_delegate = Utils::parseJSONFile(temp_dir.Path() / ImageRepo::dir / "delegations/test_delegate.json");
+  Uptane::Targets delegate_targets(test_delegate);
+  EXPECT_EQ(delegate_targets.version(), 1);
+  ASSERT_EQ(delegate_targets.targets.size(), 1);
+  EXPECT_EQ(delegate_targets.targets[0].filename(), "tests/test_data/firmware.txt");
+  EXPECT_EQ(delegate_targets.targets[0].length(), 17);
+  EXPECT_EQ(delegate_targets.targets[0].sha256Hash(),
+            "d8e9caba8c1697fcbade1057f9c2488044192ff76bb64d4aba2c20e53dc33033");
+
+  const Json::Value image_snapshot = Utils::parseJSONFile(temp_dir.Path() / ImageRepo::dir / "snapshot.json");
+  EXPECT_EQ(image_snapshot["signed"]["version"].asUInt(), 2);
+  EXPECT_EQ(image_snapshot["signed"]["meta"]["test_delegate.json"]["version"].asUInt(), 1);
+
+  const Json::Value director_targets = Utils::parseJSONFile(temp_dir.Path() / DirectorRepo::dir / "targets.json");
+  EXPECT_EQ(director_targets["signed"]["version"].asUInt(), 2);
+  EXPECT_EQ(director_targets["signed"]["targets"].size(), 2);
+  const Json::Value ecus = director_targets["signed"]["targets"]["target2"]["custom"]["ecuIdentifiers"];
+  EXPECT_EQ(ecus["secondary_ecu_serial"]["hardwareId"].asString(), "secondary_hw");
+  EXPECT_FALSE(boost::filesystem::exists(temp_dir.Path() / DirectorRepo::dir / "staging/targets.json"));
+  check_repo(temp_dir);
+}
+
 /*
  * Clear the staged Director Targets metadata.
  */
@@ -1,8 +1,20 @@
 #include "libaktualizr/uptane_repo.h"
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <thread>
+
+#include <boost/algorithm/string/trim.hpp>
+
+#include "libaktualizr/utilities/utils.h"
+#include "utilities/binary_delta.h"
+
 UptaneRepo::UptaneRepo(const boost::filesystem::path &path, const std::string &expires,
                        const std::string &correlation_id)
-    : director_repo_(path, expires, correlation_id), image_repo_(path, expires, correlation_id) {}
+    : path_(path), director_repo_(path, expires, correlation_id), image_repo_(path, expires, correlation_id) {}
 
 void UptaneRepo::generateRepo(KeyType key_type) {
   director_repo_.generateRepo(key_type);
@@ -38,6 +50,24 @@ void UptaneRepo::addCustomImage(const std::string &name, const Hash &hash, uint6
                                 const Delegation &delegation, const Json::Value &custom) {
   image_repo_.addCustomImage(name, hash, length, hardware_id, url, custom_version, delegation, custom);
 }
+void UptaneRepo::addDeltaImage(const boost::filesystem::path &source_path, const boost::filesystem::path &image_path,
+                               const boost::filesystem::path &targetname, const std::string &image_targetname,
+                               const std::string &hardware_id, const std::string &url, const int32_t custom_version,
+                               const Delegation &delegation) {
+  const std::string source = Utils::readFile(source_path);
+  const std::string image = Utils::readFile(image_path);
+  binary_delta::TargetInfo info;
+  info.source_sha256 = Hash::generate(Hash::Type::kSha256, source).HashString();
+  info.source_length = source.size();
+  info.target_name = image_targetname;
+  info.sha256 = Hash::generate(Hash::Type::kSha256, image).HashString();
+  info.length = image.size();
+
+  TemporaryFile delta_file("delta");
+  delta_file.PutContents(binary_delta::create(source, image));
+  image_repo_.addBinaryImage(delta_file.Path(), targetname, hardware_id, url, custom_version, delegation,
+                             info.toCustom());
+}
 
 void UptaneRepo::signTargets() { director_repo_.signTargets(); }
 void UptaneRepo::emptyTargets() { director_repo_.emptyTargets(); }
@@ -59,3 +89,148 @@ void UptaneRepo::rotate(Uptane::RepositoryType repo_type, const Uptane::Role &ro
     image_repo_.rotate(role, key_type);
   }
 }
+
+static std::string batchTargetName(const Json::Value &entry) {
+  return entry.isMember("targetname") ? entry["targetname"].asString() : entry["filename"].asString();
+}
+
+static std::string batchRequire(const Json::Value &entry, const std::string &field) {
+  if (!entry.isMember(field)) {
+    throw std::runtime_error(entry["command"].asString() + " entry requires " + field + ": " +
+                             Utils::jsonToCanonicalStr(entry));
+  }
+  return entry[field].asString();
+}
+
+void UptaneRepo::applyBatch(const boost::filesystem::path &manifest_path) {
+  std::ifstream manifest(manifest_path.c_str());
+  if (!manifest.good()) {
+    throw std::runtime_error("Unable to open batch manifest " + manifest_path.string());
+  }
+  std::vector<Json::Value> entries;
+  std::string line;
+  while (std::getline(manifest, line)) {
+    boost::algorithm::trim(line);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    Json::Value entry = Utils::parseJSON(line);
+    if (!entry.isObject() || !entry["command"].isString()) {
+      throw std::runtime_error("Invalid batch manifest entry: " + line);
+    }
+    entries.push_back(entry);
+  }
+
+  // Copying and hashing the images does not touch any metadata, so it can be
+  // spread over all cores before the metadata is built up sequentially.
+  std::vector<size_t> to_import;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i]["command"].asString() == "image" && entries[i].isMember("filename")) {
+      to_import.push_back(i);
+    }
+  }
+  std::vector<Json::Value> imported(entries.size());
+  if (!to_import.empty()) {
+    std::atomic<size_t> next{0};
+    const size_t workers = std::min<size_t>(std::max(1U, std::thread::hardware_concurrency()), to_import.size());
+    std::vector<std::future<void>> futures;
+    for (size_t w = 0; w < workers; ++w) {
+      futures.push_back(std::async(std::launch::async, [this, &entries, &to_import, &imported, &next]() {
+        for (size_t i = next++; i < to_import.size(); i = next++) {
+          const Json::Value &entry = entries[to_import[i]];
+          imported[to_import[i]] = image_repo_.importImage(entry["filename"].asString(), batchTargetName(entry));
+        }
+      }));
+    }
+    for (auto &f : futures) {
+      f.get();
+    }
+  }
+
+  image_repo_.beginBatch();
+  director_repo_.beginBatch();
+  std::map<std::string, std::string> new_delegations;
+  bool sign_targets = false;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const Json::Value &entry = entries[i];
+    const std::string command = entry["command"].asString();
+    if (command == "image") {
+      const std::string targetname = batchTargetName(entry);
+      if (targetname.empty()) {
+        throw std::runtime_error("image entry requires targetname or filename");
+      }
+      const std::string hwid = batchRequire(entry, "hwid");
+      Delegation delegation;
+      if (entry.isMember("dname")) {
+        const std::string dname = entry["dname"].asString();
+        auto created = new_delegations.find(dname);
+        if (created != new_delegations.end()) {
+          delegation.name = dname;
+          delegation.pattern = created->second;
+        } else {
+          delegation = Delegation(path_, dname);
+        }
+        if (!delegation.isMatched(targetname)) {
+          throw std::runtime_error("Image path " + targetname + " doesn't match delegation " + dname);
+        }
+      }
+      if (entry.isMember("targetcustom") && entry.isMember("targetformat")) {
+        throw std::runtime_error("targetcustom and targetformat cannot be used together");
+      }
+      Json::Value custom;
+      if (entry.isMember("targetcustom")) {
+        custom = entry["targetcustom"];
+      } else if (entry.isMember("targetformat")) {
+        custom["targetFormat"] = entry["targetformat"].asString();
+      }
+      const std::string url = entry["url"].asString();
+      const int32_t custom_version = entry["customversion"].asInt();
+      if (entry.isMember("filename")) {
+        image_repo_.addImportedImage(targetname, imported[i], hwid, url, custom_version, delegation, custom);
+      } else {
+        if ((!entry.isMember("targetsha256") && !entry.isMember("targetsha512")) || !entry.isMember("targetlength")) {
+          throw std::runtime_error("image entry requires targetsha256 or targetsha512, and targetlength when filename "
+                                   "is not supplied");
+        }
+        const Hash hash = entry.isMember("targetsha256")
+                              ? Hash(Hash::Type::kSha256, entry["targetsha256"].asString())
+                              : Hash(Hash::Type::kSha512, entry["targetsha512"].asString());
+        image_repo_.addCustomImage(targetname, hash, entry["targetlength"].asUInt64(), hwid, url, custom_version,
+                                   delegation, custom);
+      }
+    } else if (command == "adddelegation") {
+      const std::string dname = batchRequire(entry, "dname");
+      const std::string dpattern = batchRequire(entry, "dpattern");
+      const std::string dparent = entry.isMember("dparent") ? entry["dparent"].asString() : "targets";
+      KeyType key_type = KeyType::kRSA2048;
+      if (entry.isMember("keytype")) {
+        std::istringstream key_type_str{entry["keytype"].asString()};
+        key_type_str >> key_type;
+      }
+      image_repo_.addDelegation(Uptane::Role(dname, true), Uptane::Role(dparent, dparent != "targets"), dpattern,
+                                entry["dterm"].asBool(), key_type);
+      std::string pattern = dpattern;
+      if (!pattern.empty() && pattern.back() == '/') {
+        pattern.append("**");
+      }
+      new_delegations[dname] = pattern;
+    } else if (command == "addtarget") {
+      const std::string targetname = batchRequire(entry, "targetname");
+      auto target = image_repo_.getTarget(targetname);
+      if (target.empty()) {
+        throw std::runtime_error("No such " + targetname + " target in the image repository");
+      }
+      director_repo_.addTarget(targetname, target, batchRequire(entry, "hwid"), batchRequire(entry, "serial"),
+                               entry["url"].asString(), entry["expires"].asString());
+    } else if (command == "signtargets") {
+      sign_targets = true;
+    } else {
+      throw std::runtime_error("Unsupported batch command " + command);
+    }
+  }
+  image_repo_.commitBatch();
+  if (sign_targets) {
+    director_repo_.signTargets();
+  }
+  director_repo_.commitBatch();
+}
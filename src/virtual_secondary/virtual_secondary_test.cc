@@ -89,6 +89,228 @@ TEST(VirtualSecondary, RootRotation) {
   EXPECT_TRUE(install_result.dev_report.success);
 }
 
+/*
+ * Rotate the Director Root twice and update several Secondaries at once, with
+ * fewer metadata threads than Secondaries. All of them must receive the
+ * intermediate Root.
+ */
+TEST(VirtualSecondary, RootRotationMultipleSecondaries) {
+  TemporaryDirectory temp_dir;
+  TemporaryDirectory meta_dir;
+  auto http = std::make_shared<HttpFake>(temp_dir.Path(), "", meta_dir.Path() / "repo");
+  Config conf = UptaneTestCommon::makeTestConfig(temp_dir, http->tls_server);
+  conf.uptane.secondary_metadata_threads = 2;
+  const std::vector<std::string> serials{"secondary_ecu_serial", "sec_serial1", "sec_serial2", "sec_serial3"};
+  for (size_t i = 1; i < serials.size(); ++i) {
+    UptaneTestCommon::addDefaultSecondary(conf, temp_dir, serials[i], "secondary_hw");
+  }
+
+  auto storage = INvStorage::newStorage(conf.storage);
+  UptaneTestCommon::TestAktualizr aktualizr(conf, storage, http);
+  aktualizr.Initialize();
+
+  UptaneRepo uptane_repo{meta_dir.PathString(), "", ""};
+  uptane_repo.generateRepo(KeyType::kED25519);
+  for (const auto &serial : serials) {
+    uptane_repo.addImage("tests/test_data/firmware.txt", serial + "_firmware.txt", "secondary_hw");
+    uptane_repo.addTarget(serial + "_firmware.txt", "secondary_hw", serial);
+  }
+  uptane_repo.signTargets();
+
+  result::UpdateCheck update_result = aktualizr.CheckUpdates().get();
+  EXPECT_EQ(update_result.status, result::UpdateStatus::kUpdatesAvailable);
+  result::Download download_result = aktualizr.Download(update_result.updates).get();
+  ASSERT_EQ(download_result.status, result::DownloadStatus::kSuccess);
+  result::Install install_result = aktualizr.Install(download_result.updates).get();
+  EXPECT_TRUE(install_result.dev_report.success);
+
+  uptane_repo.rotate(Uptane::RepositoryType::Director(), Uptane::Role::Root(), KeyType::kED25519);
+  uptane_repo.rotate(Uptane::RepositoryType::Director(), Uptane::Role::Root(), KeyType::kED25519);
+  uptane_repo.emptyTargets();
+  for (const auto &serial : serials) {
+    uptane_repo.addImage("tests/test_data/firmware_name.txt", serial + "_firmware_name.txt", "secondary_hw");
+    uptane_repo.addTarget(serial + "_firmware_name.txt", "secondary_hw", serial);
+  }
+  uptane_repo.signTargets();
+
+  update_result = aktualizr.CheckUpdates().get();
+  EXPECT_EQ(update_result.status, result::UpdateStatus::kUpdatesAvailable);
+  download_result = aktualizr.Download(update_result.updates).get();
+  ASSERT_EQ(download_result.status, result::DownloadStatus::kSuccess);
+  install_result = aktualizr.Install(download_result.updates).get();
+  EXPECT_TRUE(install_result.dev_report.success);
+  EXPECT_EQ(install_result.ecu_reports.size(), serials.size());
+  for (const auto &report : install_result.ecu_reports) {
+    EXPECT_TRUE(report.install_res.isSuccess()) << report.serial;
+  }
+}
+
+/*
+ * With the Secondary bus limited to one transfer at a time, Secondaries are
+ * installed in the configured priority order and the events report the queue
+ * depth and transfer rate.
+ */
+TEST(VirtualSecondary, InstallPriority) {
+  TemporaryDirectory temp_dir;
+  TemporaryDirectory meta_dir;
+  auto http = std::make_shared<HttpFake>(temp_dir.Path(), "", meta_dir.Path() / "repo");
+  Config conf = UptaneTestCommon::makeTestConfig(temp_dir, http->tls_server);
+  conf.uptane.secondary_bus_limits = std::string(Primary::VirtualSecondaryConfig::Type) + ":1";
+  conf.uptane.secondary_install_priority = "sec_serial3,sec_serial1";
+  const std::vector<std::string> serials{"secondary_ecu_serial", "sec_serial1", "sec_serial2", "sec_serial3"};
+  for (size_t i = 1; i < serials.size(); ++i) {
+    UptaneTestCommon::addDefaultSecondary(conf, temp_dir, serials[i], "secondary_hw");
+  }
+
+  auto storage = INvStorage::newStorage(conf.storage);
+  UptaneTestCommon::TestAktualizr aktualizr(conf, storage, http);
+  std::mutex m;
+  std::vector<std::string> started;
+  std::vector<size_t> queue_depths;
+  std::vector<uint64_t> transfer_rates;
+  auto f_cb = [&](const std::shared_ptr<event::BaseEvent> &event) {
+    std::lock_guard<std::mutex> lock(m);
+    if (event->isTypeOf<event::InstallStarted>()) {
+      const auto install_started = dynamic_cast<event::InstallStarted *>(event.get());
+      started.push_back(install_started->serial.ToString());
+      queue_depths.push_back(install_started->queue_depth);
+    } else if (event->isTypeOf<event::InstallTargetComplete>()) {
+      transfer_rates.push_back(dynamic_cast<event::InstallTargetComplete *>(event.get())->transfer_rate);
+    }
+  };
+  boost::signals2::connection conn = aktualizr.SetSignalHandler(f_cb);
+  aktualizr.Initialize();
+
+  UptaneRepo uptane_repo{meta_dir.PathString(), "", ""};
+  uptane_repo.generateRepo(KeyType::kED25519);
+  for (const auto &serial : serials) {
+    uptane_repo.addImage("tests/test_data/firmware.txt", serial + "_firmware.txt", "secondary_hw");
+    uptane_repo.addTarget(serial + "_firmware.txt", "secondary_hw", serial);
+  }
+  uptane_repo.signTargets();
+
+  result::UpdateCheck update_result = aktualizr.CheckUpdates().get();
+  EXPECT_EQ(update_result.status, result::UpdateStatus::kUpdatesAvailable);
+  result::Download download_result = aktualizr.Download(update_result.updates).get();
+  ASSERT_EQ(download_result.status, result::DownloadStatus::kSuccess);
+  result::Install install_result = aktualizr.Install(download_result.updates).get();
+  EXPECT_TRUE(install_result.dev_report.success);
+  EXPECT_EQ(install_result.ecu_reports.size(), serials.size());
+
+  std::lock_guard<std::mutex> lock(m);
+  ASSERT_EQ(started.size(), serials.size());
+  EXPECT_EQ(started[0], "sec_serial3");
+  EXPECT_EQ(started[1], "sec_serial1");
+  // The first installation may start before the others are queued.
+  ASSERT_EQ(queue_depths.size(), serials.size());
+  EXPECT_LE(queue_depths[0], 3);
+  EXPECT_EQ(std::vector<size_t>(queue_depths.cbegin() + 1, queue_depths.cend()), std::vector<size_t>({2, 1, 0}));
+  ASSERT_EQ(transfer_rates.size(), serials.size());
+  for (const auto rate : transfer_rates) {
+    EXPECT_GT(rate, 0);
+  }
+}
+
+/* A virtual Secondary that can receive an image while the Primary reads it, or fail to. */
+class FanOutSecondary : public Primary::VirtualSecondary {
+ public:
+  FanOutSecondary(Primary::VirtualSecondaryConfig sconfig_in, bool fail_writes)
+      : Primary::VirtualSecondary(std::move(sconfig_in)), fail_writes_(fail_writes) {}
+
+  data::InstallationResult putMetadata(const Uptane::Target &target) override {
+    ++metadata_count;
+    received.clear();
+    return Primary::VirtualSecondary::putMetadata(target);
+  }
+  std::unique_ptr<FirmwareWriter> openFirmwareWriter(const Uptane::Target &target) override {
+    (void)target;
+    return std_::make_unique<Writer>(*this);
+  }
+  data::InstallationResult sendFirmware(const Uptane::Target &target) override {
+    ++firmware_count;
+    return Primary::VirtualSecondary::sendFirmware(target);
+  }
+
+  std::string received;
+  int metadata_count{0};
+  int firmware_count{0};
+
+ private:
+  class Writer : public FirmwareWriter {
+   public:
+    explicit Writer(FanOutSecondary &secondary) : secondary_(secondary) {}
+    data::InstallationResult write(const uint8_t *data, size_t size) override {
+      if (secondary_.fail_writes_) {
+        return data::InstallationResult(data::ResultCode::Numeric::kDownloadFailed, "Forced failure");
+      }
+      secondary_.received.append(reinterpret_cast<const char *>(data), size);
+      return data::InstallationResult(data::ResultCode::Numeric::kOk, "");
+    }
+
+   private:
+    FanOutSecondary &secondary_;
+  };
+
+  const bool fail_writes_;
+};
+
+/*
+ * Two Secondaries with the same hardware ID get the same image at once. The
+ * one that fails to receive it gets its metadata and the image again in the
+ * usual way, and both are installed.
+ */
+TEST(VirtualSecondary, FanOutFailure) {
+  TemporaryDirectory temp_dir;
+  TemporaryDirectory meta_dir;
+  auto http = std::make_shared<HttpFake>(temp_dir.Path(), "", meta_dir.Path() / "repo");
+  Config conf = UptaneTestCommon::makeTestConfig(temp_dir, http->tls_server);
+  conf.uptane.secondary_fan_out = true;
+  conf.uptane.secondary_install_priority = "fan_serial2";
+
+  // Not listed in the Secondary config file of the Primary, they are added below.
+  TemporaryDirectory sec_dir;
+  Config sec_conf;
+  auto good = std::make_shared<FanOutSecondary>(
+      UptaneTestCommon::addDefaultSecondary(sec_conf, sec_dir, "fan_serial1", "fan_hw"), false);
+  auto bad = std::make_shared<FanOutSecondary>(
+      UptaneTestCommon::addDefaultSecondary(sec_conf, sec_dir, "fan_serial2", "fan_hw"), true);
+
+  auto storage = INvStorage::newStorage(conf.storage);
+  UptaneTestCommon::TestAktualizr aktualizr(conf, storage, http);
+  aktualizr.AddSecondary(good);
+  aktualizr.AddSecondary(bad);
+  aktualizr.Initialize();
+
+  UptaneRepo uptane_repo{meta_dir.PathString(), "", ""};
+  uptane_repo.generateRepo(KeyType::kED25519);
+  uptane_repo.addImage("tests/test_data/firmware.txt", "firmware.txt", "fan_hw");
+  uptane_repo.addTarget("firmware.txt", "fan_hw", "fan_serial1");
+  // uptane-generator assigns a target to a single ECU, the Director can assign it to several.
+  const boost::filesystem::path staging = meta_dir.Path() / DirectorRepo::dir / "staging/targets.json";
+  Json::Value director_targets = Utils::parseJSONFile(staging);
+  director_targets["targets"]["firmware.txt"]["custom"]["ecuIdentifiers"]["fan_serial2"]["hardwareId"] = "fan_hw";
+  Utils::writeFile(staging, Utils::jsonToCanonicalStr(director_targets));
+  uptane_repo.signTargets();
+
+  result::UpdateCheck update_result = aktualizr.CheckUpdates().get();
+  EXPECT_EQ(update_result.status, result::UpdateStatus::kUpdatesAvailable);
+  result::Download download_result = aktualizr.Download(update_result.updates).get();
+  ASSERT_EQ(download_result.status, result::DownloadStatus::kSuccess);
+  result::Install install_result = aktualizr.Install(download_result.updates).get();
+  EXPECT_TRUE(install_result.dev_report.success);
+  ASSERT_EQ(install_result.ecu_reports.size(), 2);
+  for (const auto &report : install_result.ecu_reports) {
+    EXPECT_TRUE(report.install_res.isSuccess()) << report.serial;
+  }
+
+  EXPECT_EQ(good->received, Utils::readFile("tests/test_data/firmware.txt"));
+  EXPECT_EQ(good->metadata_count, 1);
+  EXPECT_EQ(good->firmware_count, 0);
+  EXPECT_TRUE(bad->received.empty());
+  EXPECT_EQ(bad->metadata_count, 2);
+  EXPECT_EQ(bad->firmware_count, 1);
+}
+
 /**
  * The secondary generates a key pair on first run, and re-uses it afterwards
  */
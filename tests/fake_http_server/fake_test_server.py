@@ -92,10 +92,17 @@ class Handler(SimpleHTTPRequestHandler):
             response_size = 100 * chunk_size
             if "Range" in self.headers:
                 r = self.headers["Range"]
-                r_from = int(r.split("=")[1].split("-")[0])
+                r_from, r_to = r.split("=")[1].split("-")
+                r_from = int(r_from)
+                r_to = min(int(r_to), response_size - 1) if r_to else response_size - 1
+                if r_from >= response_size:
+                    self.send_response(416)
+                    self.send_header('Content-Range', 'bytes */%d' % response_size)
+                    self.end_headers()
+                    return
                 self.send_response(206)
-                self.send_header('Content-Range', 'bytes %d-%d/%d' % (r_from, response_size-1, response_size))
-                response_size = response_size - r_from
+                self.send_header('Content-Range', 'bytes %d-%d/%d' % (r_from, r_to, response_size))
+                response_size = r_to - r_from + 1
             else:
                 self.send_response(200)
             self.send_header('Content-Type', 'application/json')
@@ -69,8 +69,16 @@ class HttpFake : public HttpInterface {
     return downloadAsync(url, write_cb, progress_cb, userp, from, nullptr).get();
   }
 
+  HttpResponse downloadRateLimited(const std::string &url, curl_write_callback write_cb,
+                                   curl_xferinfo_callback progress_cb, void *userp, curl_off_t from,
+                                   curl_off_t max_bytes_per_sec) override {
+    last_rate_limit = max_bytes_per_sec;
+    return download(url, write_cb, progress_cb, userp, from);
+  }
+
   const std::string tls_server = "https://tlsserver.com";
   Json::Value last_manifest;
+  curl_off_t last_rate_limit{0};
 
  protected:
   boost::filesystem::path test_dir;